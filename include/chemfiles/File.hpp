@@ -16,6 +16,7 @@
 #include <fmt/format.h>
 
 #include "chemfiles/exports.h"
+#include "chemfiles/external/optional.hpp"
 
 namespace chemfiles {
 
@@ -42,6 +43,8 @@ public:
         BZIP2,
         /// lzma compression (.xz)
         LZMA,
+        /// Zstandard compression (.zst)
+        ZSTD,
     };
 
     virtual ~File() noexcept = default;
@@ -104,6 +107,28 @@ public:
     /// @throws FileError if it could not write all of the data to the file
     virtual void write(const char* data, size_t count) = 0;
 
+    /// Write all the data still pending to the file, and close it. This is
+    /// called by `TextFile::close`, so that errors while finishing the file
+    /// (for example while compressing the last block of data) are reported
+    /// to the caller. No other function is called after this one, and
+    /// implementations must still finish the file in their destructor if
+    /// `close` was never called.
+    ///
+    /// The default implementation does nothing.
+    ///
+    /// @throws FileError if the data could not be written to the file
+    virtual void close() {}
+
+    /// Get the full content of the file, if it is directly available in
+    /// memory. In this case, `TextFile` will read lines directly from this
+    /// memory instead of copying chunks of the file with `read`. The memory
+    /// must stay valid as long as this `TextFileImpl` exists.
+    ///
+    /// The default implementation returns `nullopt`.
+    virtual optional<std::string_view> data() const {
+        return nullopt;
+    }
+
 protected:
     /// Get the string path used to open this file
     std::string_view path() const {
@@ -123,9 +148,15 @@ class MemoryBuffer;
 /// storing a chunk of the file in a memory buffer, and searching for new line
 /// indicators (either `\n` or `\r\n`) in this buffer. It then returns
 /// `string_view` inside this buffer, removing the need to allocate a new
-/// `std::string` for each line.
+/// `std::string` for each line. If the `TextFileImpl` provides direct access
+/// to the file content (see `TextFileImpl::data`), lines are searched and
+/// returned directly from this memory, without any intermediary buffer.
 ///
-/// Writing to the files is done without buffering or considering lines.
+/// When writing, data is formatted directly in an internal buffer which is
+/// reused between calls to `print`, and written to the `TextFileImpl` in large
+/// blocks, when the buffer is full, when calling `flush` or `close`, or when the
+/// file is destroyed. Files in memory are the exception: the data is written to the
+/// `MemoryBuffer` immediately, so it is always visible to the buffer owner.
 ///
 ///
 /// This class can read compressed data or in-memory data by using one of the
@@ -146,8 +177,16 @@ public:
     /// compressed file.
     TextFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
+    /// Use the given `TextFileImpl` with the requested `mode`. This is used
+    /// for streams, where `TextFile` never needs to seek to a position
+    /// outside of its internal buffer.
+    ///
+    /// @throws FileError if the file mode is append
+    TextFile(std::unique_ptr<TextFileImpl> file, File::Mode mode);
+
+    ~TextFile() override;
     TextFile(TextFile&&) = default;
-    TextFile& operator=(TextFile&&) = default;
+    TextFile& operator=(TextFile&& other);
     TextFile(const TextFile&) = delete;
     TextFile& operator=(const TextFile&) = delete;
 
@@ -158,6 +197,12 @@ public:
     /// Set the position indicator to `position`.
     void seekpos(uint64_t position);
 
+    /// Keep all the data read after the current position in memory, until
+    /// the next call to `seekpos`. Seeking back to this position is then
+    /// done inside the internal buffer, without seeking the underlying
+    /// `TextFileImpl`, which can be very slow for compressed files.
+    void mark();
+
     /// Reset the position indicator to the beginning of the file, and clear
     /// end-of-file flag.
     void rewind();
@@ -189,36 +234,73 @@ public:
         this->vprint(format, fmt::make_format_args(args...));
     }
 
+    /// Write all the data buffered by `print` to the underlying
+    /// `TextFileImpl`.
+    ///
+    /// @throws FileError if the data could not be written
+    void flush();
+
+    /// Write all the buffered data, and close the underlying `TextFileImpl`.
+    /// The file can not be used after calling this function. This is called
+    /// by the destructor if needed, but errors are then only sent as
+    /// warnings.
+    ///
+    /// @throws FileError if the data could not be written
+    void close();
+
 private:
+    /// Setup either direct reading from the `TextFileImpl` memory or the
+    /// internal buffer, depending on the capacities of `file_`.
+    void init_buffer();
+
     /// Fill the buffer, calling `refill` and setting all needed internal values
     void fill_buffer(size_t start);
 
     /// Actually format and print data to the file
     void vprint(fmt::string_view format, fmt::format_args args);
 
-    /// Check if the buffer was initialized and contains data from the
-    /// underlying  `TextFileImpl`.
-    bool buffer_initialized() const;
+    /// Implementation of `readline` when reading directly from the memory
+    /// provided by the `TextFileImpl`
+    std::string_view readline_direct();
+
+    /// When reaching the end of a memory mapped file which grew since it was
+    /// mapped, continue reading it with `PlainFile` from the current position.
+    /// Returns `true` if the file was re-opened.
+    bool unmap_if_grown();
 
     /// Pointer to the actual file implementation
     std::unique_ptr<TextFileImpl> file_;
-    /// Buffer storing characters read from the `TextFileImpl`. If
-    /// `got_impl_eof_` is true, this contains the remaining characters from the
-    /// file and is then padded with null characters ('\0').
+    /// Buffer storing characters read from the `TextFileImpl`. Only the data
+    /// between `buffer_.data()` and `end_` is valid.
     std::vector<char> buffer_;
     /// Start of the current line;
     const char* line_start_;
-    /// End of the buffer
+    /// End of the valid data in the buffer
     const char* end_;
     /// Current position in the file, this is the number of characters in the
     /// file up to the start of the buffer (`buffer_[0]` is the `position_`'th
     /// character in the file).
     uint64_t position_ = 0;
+    /// Was the buffer initialized with data from the underlying `TextFileImpl`?
+    bool buffer_initialized_ = false;
     /// Did we reach the end of the underlying `TextFileImpl`? Since we are
     /// buffering data, this does not necessarily correspond to `this->eof()`.
     bool got_impl_eof_ = false;
     /// Did we actually reached the end of file while reading a line?
     bool eof_ = false;
+    /// Position given to `mark`, the data after this position is kept in
+    /// `buffer_` until the next call to `seekpos`
+    optional<uint64_t> mark_ = nullopt;
+    /// Buffer containing formatted data waiting to be written to `file_`
+    fmt::memory_buffer write_buffer_;
+    /// Should `print` keep data in `write_buffer_` until it is large enough?
+    /// This is disabled for memory files, where `MemoryBuffer` already acts
+    /// as a write buffer.
+    bool buffered_writes_ = true;
+    /// Are we reading directly from the memory given by `TextFileImpl::data`?
+    /// In this case, `buffer_` is not used, `line_start_` and `end_` point
+    /// inside the `TextFileImpl` memory, and `position_` is always 0.
+    bool direct_ = false;
 };
 
 } // namespace chemfiles
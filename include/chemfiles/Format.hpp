@@ -9,17 +9,23 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <utility>
+#include <functional>
+#include <string_view>
 
 #include "chemfiles/exports.h"
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Error.hpp"
+#include "chemfiles/types.hpp"
+#include "chemfiles/external/span.hpp"
 #include "chemfiles/external/optional.hpp"
 
 namespace chemfiles {
 class Frame;
 class MemoryBuffer;
 class FormatMetadata;
+class FrameIndex;
 
 /// Get the metadata associated with `Format`.
 ///
@@ -75,6 +81,24 @@ public:
     /// @param frame The frame to fill
     virtual void read_at(size_t index, Frame& frame);
 
+    /// Read the frames at all the given `indices`, and call `callback` with
+    /// the index and the corresponding frame for each of them. The frames can
+    /// be given to the callback in any order.
+    ///
+    /// The default implementation calls `read_at` for each index in order.
+    /// Formats which know where all frames are in the file can instead issue
+    /// multiple reads at once, and decode frames as the reads complete.
+    ///
+    /// @throw FormatError if the file does not follow the format
+    /// @throw FileError if their is an OS error while reading the file
+    ///
+    /// @param indices The indexes to read
+    /// @param callback Function called with each frame
+    virtual void read_batch(
+        const std::vector<size_t>& indices,
+        const std::function<void(size_t, Frame&)>& callback
+    );
+
     /// Read the next frame from the trajectory file.
     ///
     /// @throw FormatError if the file does not follow the format
@@ -83,6 +107,49 @@ public:
     /// @param frame The frame to fill
     virtual void read(Frame& frame);
 
+    /// Read the positions of `n_frames` frames, starting at `start` and
+    /// taking one frame every `stride`, into `positions`. The positions of
+    /// all frames are stored one after the other, and all the frames must
+    /// contain `positions.size() / n_frames` atoms.
+    ///
+    /// The default implementation reads each frame with `read_at` and copies
+    /// the positions. Formats which can find and decode the positions without
+    /// creating a full `Frame` should override this function.
+    ///
+    /// @throw FormatError if the file does not follow the format, or if a
+    ///                    frame does not contain the expected number of atoms
+    /// @throw FileError if their is an OS error while reading the file
+    ///
+    /// @param start The index of the first frame to read
+    /// @param stride The number of frames between two frames to read
+    /// @param n_frames The number of frames to read
+    /// @param positions Array to fill with the positions
+    virtual void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions);
+
+    /// Check if this format can read a frame into a `Frame` that already
+    /// contains data from a previous step of the same file, reusing the memory
+    /// allocated for it. Formats returning `true` must make sure the frame
+    /// given to `read` and `read_at` ends up with the same content as a newly
+    /// created frame would, except for data never stored in the file (such as
+    /// the atom names in XTC files) which is kept from the previous step.
+    ///
+    /// The default implementation returns `false`, in which case the frame is
+    /// reset before being given to the format.
+    virtual bool supports_in_place_read() const;
+
+    /// Create a new format reading the same file as this one, which can be
+    /// used from another thread at the same time as this format. `create`
+    /// opens the file again with a new instance of this format.
+    ///
+    /// The default implementation calls `create`. Formats which need to look
+    /// for the frames in the file before reading them should instead give the
+    /// frame positions they already know to the new format, so it does not
+    /// need to scan the file again.
+    ///
+    /// @param create function opening the file with a new instance of this
+    ///               format
+    virtual std::unique_ptr<Format> open_cursor(const std::function<std::unique_ptr<Format>()>& create);
+
     /// Write a frame to the trajectory file.
     ///
     /// @throw FormatError if the file does not follow the format
@@ -96,6 +163,25 @@ public:
     ///
     /// @return The number of frames
     virtual size_t size() = 0;
+
+    /// Check if the associated file contains a frame at the given `index`.
+    ///
+    /// The default implementation compares `index` with `size()`. Formats for
+    /// which `size()` needs to scan the whole file should override this
+    /// function to only look for frames up to `index`.
+    ///
+    /// @param index The index of the frame
+    virtual bool has_frame(size_t index);
+
+    /// Write any data still buffered by this format to the file, and close
+    /// the file. This is called by `Trajectory::close` before destroying the
+    /// format, so that errors while writing the end of the file can be
+    /// reported to the caller instead of being lost in the destructor.
+    ///
+    /// The default implementation does nothing.
+    ///
+    /// @throw FileError if their is an OS error while writing the file
+    virtual void close();
 };
 
 /// The `TextFormat` class defines a common, simpler interface for text based
@@ -104,24 +190,89 @@ public:
 /// It is possible to implement only one of `TextFormat::read_next` or
 /// `TextFormat::write_next`. In that case, only the corresponding operations
 /// will be available from the corresponding `chemfiles::Trajectory`.
+///
+/// The positions of the frames in the file are found incrementally, calling
+/// `forward` only until the requested frame is found. The whole file is only
+/// scanned when calling `size`, or when trying to read a frame after the end
+/// of the file.
+///
+/// Large uncompressed files can be scanned with multiple threads, when the
+/// format implements `is_scan_marker` and `frames_from_markers`. Each thread
+/// looks for marker lines in a part of the file, and the format uses these
+/// markers to find the positions of the frames.
+///
+/// When `chemfiles::set_frame_index` is enabled, the positions of the frames
+/// are saved to an index file after a full scan, and loaded from there when
+/// opening the same file again. The index is identified by the format name,
+/// set by the `FormatFactory` with `set_format_name`.
+///
+/// When created from a stream, the format parses frames as they arrive, one
+/// after the other, without scanning the whole file first. Frames can only be
+/// read in order, and `size` only looks for the start of the next frame.
 class CHFL_EXPORT TextFormat: public Format {
 public:
     TextFormat(std::string path, File::Mode mode, File::Compression compression);
     TextFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
-    virtual ~TextFormat() override = default;
+    TextFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode);
+    virtual ~TextFormat() override;
 
     void read_at(size_t index, Frame& frame) override;
     void read(Frame& frame) override;
+    void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) override;
+    std::unique_ptr<Format> open_cursor(const std::function<std::unique_ptr<Format>()>& create) override;
     void write(const Frame& frame) override;
     size_t size() override;
+    bool has_frame(size_t index) override;
+    void close() override;
+
+    /// Set the name of this format in the `FormatFactory`, used to identify
+    /// the index files created by this format
+    void set_format_name(std::string name) {
+        format_name_ = std::move(name);
+    }
 
     /// Fast-forward the file for one step, returning a valid position if the
     /// file does contain one more step or `nullopt` if it does not.
     virtual optional<uint64_t> forward() = 0;
 
+    /// A line found by `is_scan_marker` when scanning a file in parallel
+    struct scan_marker {
+        /// Index of the line, counting from the start of the scan
+        uint64_t line;
+        /// Position of the start of the line in the file
+        uint64_t position;
+        /// Position of the start of the next line in the file
+        uint64_t next;
+        /// Content of the line
+        std::string content;
+    };
+
+    /// Does this format implement `is_scan_marker` and `frames_from_markers`,
+    /// allowing to scan large uncompressed files using multiple threads?
+    virtual bool supports_parallel_scan() const;
+
+    /// Check if `line` could be used to find the boundaries between frames,
+    /// and should be recorded when scanning the file in parallel. This
+    /// function is called concurrently from multiple threads.
+    virtual bool is_scan_marker(std::string_view line) const;
+
+    /// Get the positions of the frames starting at or after `start`, using
+    /// the `markers` found in the file after `start`, sorted by line. The
+    /// first position must be `start` and the positions must give the same
+    /// frames as `forward` would. The last position is always checked again
+    /// with `forward`, so it is fine to include a position if unsure whether
+    /// a frame actually starts there.
+    virtual std::vector<uint64_t> frames_from_markers(uint64_t start, const std::vector<scan_marker>& markers);
+
     virtual void read_next(Frame& frame);
     virtual void write_next(const Frame& frame);
 
+    /// Read the positions of the next frame in the file into `positions`,
+    /// and throw a `FormatError` if the frame does not contain
+    /// `positions.size()` atoms. The default implementation reads the full
+    /// frame with `read_next` and copies the positions.
+    virtual void read_next_positions(span<Vector3D> positions);
+
 protected:
     /// Text file used to read/write data
     TextFile file_;
@@ -129,6 +280,25 @@ protected:
 private:
     /// Scan the whole file to get all the steps positions
     void scan_all();
+    /// Scan the file until the position of the step at `index` is known, or
+    /// the end of the file is reached. Returns `true` if the step exists.
+    bool scan_until(size_t index);
+
+    /// Find the frame positions between `next_scan_` and the end of the file
+    /// using multiple threads, if the file is large enough and the format
+    /// supports it. This leaves the last frame to be checked by `forward`.
+    void scan_parallel();
+    /// Find the markers in the lines starting between `begin` and `end` in
+    /// the file, returning them together with the number of lines. Line
+    /// numbers in the markers are counted from `begin`.
+    std::pair<std::vector<scan_marker>, uint64_t> find_scan_markers(uint64_t begin, uint64_t end) const;
+
+    /// Load the frame positions from the index file if it is up to date, or
+    /// prepare to save them once the whole file has been scanned
+    void load_frame_index();
+
+    /// Check if the stream contains another frame, skipping empty lines
+    bool stream_has_next();
 
     /// The next index to read
     size_t index_ = 0;
@@ -139,6 +309,25 @@ private:
 
     /// Did we found the end of file while scanning or reading?
     bool eof_found_ = false;
+    /// Position in the file where the next call to `forward` should start, if
+    /// the file was already partially scanned
+    optional<uint64_t> next_scan_;
+
+    /// Are we reading/writing a non-seekable stream?
+    bool streaming_ = false;
+
+    /// Is the file an uncompressed file on disk, which can be read by
+    /// multiple threads at the same time?
+    bool parallel_scan_ = false;
+
+    /// Should we try to load the frame positions from an index file before
+    /// the first scan?
+    bool use_frame_index_ = false;
+    /// Name of the format, used as tag for the index file. The index is not
+    /// used if this is empty.
+    std::string format_name_;
+    /// Index file where the frame positions will be saved after a full scan
+    std::unique_ptr<FrameIndex> frame_index_;
 };
 
 } // namespace chemfiles
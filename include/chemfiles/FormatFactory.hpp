@@ -15,23 +15,28 @@
 #include "chemfiles/mutex.hpp"
 #include "chemfiles/File.hpp"
 #include "chemfiles/Format.hpp"
+#include "chemfiles/FormatMetadata.hpp"
 
 namespace chemfiles {
 class MemoryBuffer;
-class FormatMetadata;
 
 using format_creator_t = std::function<std::unique_ptr<Format>(std::string path, File::Mode mode, File::Compression compression)>;
 using memory_stream_t = std::function<std::unique_ptr<Format>(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression)>;
+using stream_creator_t = std::function<std::unique_ptr<Format>(std::unique_ptr<TextFileImpl> stream, File::Mode mode)>;
 
 struct RegisteredFormat {
     const FormatMetadata& metadata;
     format_creator_t creator;
     memory_stream_t memory_stream_creator;
+    stream_creator_t stream_creator;
 };
 
 template <typename T>
 using SupportsMemoryIO = std::is_constructible<T, std::shared_ptr<MemoryBuffer>, File::Mode, File::Compression>;
 
+template <typename T>
+using SupportsStreamIO = std::is_constructible<T, std::unique_ptr<TextFileImpl>, File::Mode>;
+
 /// This class allow to register Format with names and file extensions
 class CHFL_EXPORT FormatFactory final {
 private:
@@ -64,12 +69,13 @@ public:
         const auto& metadata = format_metadata<Format>();
         metadata.validate();
         register_format(metadata,
-            [](const std::string& path, File::Mode mode, File::Compression compression) {
-                return std::make_unique<Format>(path, mode, compression);
+            [&metadata](const std::string& path, File::Mode mode, File::Compression compression) {
+                return create<Format>(metadata, path, mode, compression);
             },
             [](std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) {
                 return std::make_unique<Format>(std::move(memory), mode, compression);
-            }
+            },
+            stream_creator<Format>()
         );
     }
 
@@ -84,9 +90,10 @@ public:
         const auto& metadata = format_metadata<Format>();
         metadata.validate();
         register_format(metadata,
-            [](const std::string& path, File::Mode mode, File::Compression compression) {
-                return std::make_unique<Format>(path, mode, compression);
-            }
+            [&metadata](const std::string& path, File::Mode mode, File::Compression compression) {
+                return create<Format>(metadata, path, mode, compression);
+            },
+            stream_creator<Format>()
         );
     }
 
@@ -94,8 +101,33 @@ public:
     std::vector<std::reference_wrapper<const FormatMetadata>> formats();
 
 private:
-    void register_format(const FormatMetadata& metadata, format_creator_t creator, memory_stream_t memory_stream);
-    void register_format(const FormatMetadata& metadata, format_creator_t creator);
+    /// Create a `Format` reading the file at `path`. Text formats are given
+    /// their name, to identify the index files they create.
+    template<class Format>
+    static std::unique_ptr<Format> create(const FormatMetadata& metadata, const std::string& path, File::Mode mode, File::Compression compression) {
+        auto format = std::make_unique<Format>(path, mode, compression);
+        if constexpr (std::is_base_of<TextFormat, Format>::value) {
+            format->set_format_name(metadata.name);
+        }
+        return format;
+    }
+
+    /// Get a function creating a `Format` from a stream, if the format
+    /// supports it, or an empty function otherwise.
+    template<class Format, std::enable_if_t<SupportsStreamIO<Format>::value, int> = 0>
+    static stream_creator_t stream_creator() {
+        return [](std::unique_ptr<TextFileImpl> stream, File::Mode mode) {
+            return std::make_unique<Format>(std::move(stream), mode);
+        };
+    }
+
+    template<class Format, std::enable_if_t<!SupportsStreamIO<Format>::value, int> = 0>
+    static stream_creator_t stream_creator() {
+        return nullptr;
+    }
+
+    void register_format(const FormatMetadata& metadata, format_creator_t creator, memory_stream_t memory_stream, stream_creator_t stream);
+    void register_format(const FormatMetadata& metadata, format_creator_t creator, stream_creator_t stream);
 
     /// Trajectory map associating format descriptions and creators
     mutex<std::vector<RegisteredFormat>> formats_;
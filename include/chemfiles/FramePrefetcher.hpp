@@ -0,0 +1,110 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_FRAME_PREFETCHER_HPP
+#define CHEMFILES_FRAME_PREFETCHER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/Frame.hpp"
+
+namespace chemfiles {
+class Format;
+
+/// Read the frames of a trajectory on a background thread, before they are
+/// needed. This is used by `Trajectory::set_prefetch`, so that reading and
+/// decoding the next frames happens while the current one is being used.
+///
+/// The background thread reads the frames one after the other with its own
+/// cursor in the file, keeping at most `depth` frames ready. The frames given
+/// back to the prefetcher are re-used to read the next frames. Asking for a
+/// frame which is not the next one discards all the frames read in advance,
+/// and restarts the background reads from the requested frame.
+class FramePrefetcher final {
+public:
+    /// Read frames with `cursor` on a background thread, starting with the
+    /// frame at `start` and keeping at most `depth` frames ready
+    FramePrefetcher(std::unique_ptr<Format> cursor, size_t depth, size_t start);
+    ~FramePrefetcher();
+
+    FramePrefetcher(const FramePrefetcher&) = delete;
+    FramePrefetcher& operator=(const FramePrefetcher&) = delete;
+    FramePrefetcher(FramePrefetcher&&) = delete;
+    FramePrefetcher& operator=(FramePrefetcher&&) = delete;
+
+    /// Get the frame at `index` in `frame`, waiting for the background thread
+    /// to read it if needed. The previous content of `frame` is re-used to
+    /// read another frame.
+    ///
+    /// This returns `false` if the file does not contain a frame at `index`,
+    /// and re-throws any error raised while reading this frame.
+    bool read(size_t index, Frame& frame);
+
+    /// Check if the file contains a frame at `index`, waiting for the
+    /// background thread to read it if needed. Frames which could not be
+    /// read because of an error are considered to exist, and the error is
+    /// given by the next call to `read`.
+    bool has_frame(size_t index);
+
+private:
+    /// A frame read by the background thread
+    struct item {
+        /// index of the frame in the file
+        size_t index;
+        /// the frame itself
+        Frame frame;
+        /// error raised while reading this frame
+        std::exception_ptr error;
+    };
+
+    /// Main function of the background thread
+    void run();
+
+    /// Discard all the frames read in advance, and restart reading from the
+    /// frame at `index`. `mutex_` must be locked when calling this function.
+    void restart(size_t index);
+
+    /// Format used to read the frames. This is only used by the background
+    /// thread after construction.
+    std::unique_ptr<Format> cursor_;
+    /// Maximal number of frames to keep ready
+    size_t depth_;
+
+    /// Mutex protecting all the members below
+    std::mutex mutex_;
+    /// Used to wake up the background thread
+    std::condition_variable producer_;
+    /// Used to wake up the thread calling `read`
+    std::condition_variable consumer_;
+    /// Frames read by the background thread, in order
+    std::deque<item> ready_;
+    /// Frames available to be re-used by the background thread
+    std::vector<Frame> free_;
+    /// Index of the next frame the background thread will read
+    size_t next_read_;
+    /// Index of the next frame we expect to be requested in `read`
+    size_t next_index_;
+    /// Did the background thread reach the end of the file, or an error?
+    bool end_ = false;
+    /// Incremented on each call to `restart`, to discard frames read from the
+    /// old position
+    uint64_t generation_ = 0;
+    /// Should the background thread stop?
+    bool stop_ = false;
+
+    /// The background thread itself. This must be the last member, to only
+    /// start the thread after everything else is initialized.
+    std::thread thread_;
+};
+
+} // namespace chemfiles
+
+#endif
@@ -0,0 +1,88 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_FRAME_WRITER_HPP
+#define CHEMFILES_FRAME_WRITER_HPP
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/Frame.hpp"
+
+namespace chemfiles {
+class Format;
+
+/// Write frames with a `Format` on a background thread. This is used by
+/// `Trajectory::set_async_write`, so that formatting, compressing and writing
+/// the frames does not block the thread producing them.
+///
+/// Frames are given to the background thread through a queue containing at
+/// most `depth` frames, and `write` waits for some space in the queue when it
+/// is full. Errors raised while writing a frame are re-thrown by the next call
+/// to `write` or `flush`, and the frames still in the queue when the error
+/// happens are discarded.
+class FrameWriter final {
+public:
+    /// Write frames with `format` on a background thread, keeping at most
+    /// `depth` frames in the queue. `format` must not be used by anything
+    /// else until this `FrameWriter` is destroyed.
+    FrameWriter(Format& format, size_t depth);
+    /// Write all the frames remaining in the queue and stop the background
+    /// thread. Errors are sent as warnings, use `flush` before destroying the
+    /// writer to get them as exceptions.
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+    FrameWriter(FrameWriter&&) = delete;
+    FrameWriter& operator=(FrameWriter&&) = delete;
+
+    /// Add `frame` to the queue of frames to write, waiting for some space in
+    /// the queue if it is full
+    void write(Frame frame);
+
+    /// Wait until all the frames in the queue have been given to the format,
+    /// and re-throw any error raised while writing them
+    void flush();
+
+private:
+    /// Main function of the background thread
+    void run();
+
+    /// Re-throw the error raised by the background thread, if any, and reset
+    /// it. `mutex_` must be locked when calling this function.
+    void rethrow_error();
+
+    /// The format used to write frames, only used by the background thread
+    Format& format_;
+    /// Maximal number of frames in the queue
+    size_t depth_;
+
+    /// Mutex protecting all the members below
+    std::mutex mutex_;
+    /// Used to wake up the background thread
+    std::condition_variable background_;
+    /// Used to wake up the threads waiting in `write` or `flush`
+    std::condition_variable caller_;
+    /// Frames waiting to be written
+    std::deque<Frame> queue_;
+    /// Is the background thread currently writing a frame?
+    bool writing_ = false;
+    /// Error raised on the background thread, to be re-thrown by `write` or
+    /// `flush`
+    std::exception_ptr error_;
+    /// Should the background thread stop once the queue is empty?
+    bool stop_ = false;
+
+    /// The background thread itself. This must be the last member, to only
+    /// start the thread after everything else is initialized.
+    std::thread thread_;
+};
+
+} // namespace chemfiles
+
+#endif
@@ -7,6 +7,8 @@
 #include <cstddef>
 #include <memory>
 #include <string>
+#include <vector>
+#include <functional>
 
 #include "chemfiles/exports.h"
 #include "chemfiles/Frame.hpp"
@@ -18,6 +20,8 @@ namespace chemfiles {
 class Format;
 class Topology;
 class MemoryBuffer;
+class FramePrefetcher;
+class FrameWriter;
 
 /// A `Trajectory` is a chemistry file on the hard drive. It is the entry point
 /// of the chemfiles library.
@@ -29,16 +33,16 @@ public:
     /// `"<format>/<compression>"`. `<format>` should be the format name (see
     /// the corresponding [documentation section][formats] for the names) or an
     /// empty string. `<compression>` should be `GZ` for gzip files, `BZ2` for
-    /// bzip2 files, or `XZ` for lzma/.xz files. If `<compression>` is present,
-    /// it will determine which compression method is used to read/write the
-    /// file.
+    /// bzip2 files, `XZ` for lzma/.xz files, or `ZST` for Zstandard files. If
+    /// `<compression>` is present, it will determine which compression method
+    /// is used to read/write the file.
     ///
     /// For example, `format = "XYZ"` will force usage of XYZ format regardless
     /// of the file extension; `format = "XYZ / GZ"` will additionally use gzip
     /// compression.
     ///
     /// If the `format` is an empty string, the file extension will be used to
-    /// guess the format. If the file path ends with `.gz`, `.xz`, or `.bz2`;
+    /// guess the format. If the file path ends with `.gz`, `.xz`, `.bz2` or `.zst`;
     /// the file will be treated as a compressed file and the next extension is
     /// used to guess the format. For example `Trajectory("file.xyz.gz")` will
     /// open the file for reading using the XYZ format and the gzip compression
@@ -99,6 +103,52 @@ public:
     /// @throws FormatError if the format does not support writing to a memory buffer
     static Trajectory memory_writer(const std::string& format);
 
+    /// Read a stream of data as though it were a formatted file, getting the
+    /// data from the `read` callback. This can be used to read trajectories
+    /// from pipes or sockets, without storing the whole data in memory.
+    ///
+    /// `read(data, count)` should write at most `count` bytes to `data`, and
+    /// return the number of bytes written. It can block until some data is
+    /// available, and return less data than requested. Returning 0 indicates
+    /// the end of the stream.
+    ///
+    /// Frames are parsed as soon as they arrive, and can only be read in
+    /// order. The `size` of the trajectory is the number of frames already
+    /// read, plus one if the stream contains another frame. Empty lines
+    /// between frames are ignored.
+    ///
+    /// The `format` parameter should be follow the same rules as in the main
+    /// `Trajectory` constructor, except that compression specification are not
+    /// supported.
+    ///
+    /// @example{trajectory/stream_reader.cpp}
+    ///
+    /// @param read function used to get more data from the stream
+    /// @param format Specific format to use.
+    ///
+    /// @throws FileError If any compression is given in `format`
+    /// @throws FormatError if the format does not support streaming IO
+    static Trajectory stream_reader(std::function<size_t(char* data, size_t count)> read, const std::string& format);
+
+    /// Write to a stream of data as though it were a formatted file, sending
+    /// the data to the `write` callback as soon as it is produced.
+    ///
+    /// `write(data, count)` should consume the `count` bytes starting at
+    /// `data`, and throw an exception if this is not possible.
+    ///
+    /// The `format` parameter should be follow the same rules as in the main
+    /// `Trajectory` constructor, except that compression specification are not
+    /// supported.
+    ///
+    /// @example{trajectory/stream_writer.cpp}
+    ///
+    /// @param write function used to send data to the stream
+    /// @param format Specific format to use.
+    ///
+    /// @throws FileError If any compression is given in `format`
+    /// @throws FormatError if the format does not support streaming IO
+    static Trajectory stream_writer(std::function<void(const char* data, size_t count)> write, const std::string& format);
+
     ~Trajectory();
 
     Trajectory(Trajectory&& other) noexcept;
@@ -123,6 +173,24 @@ public:
     ///                     the format does not support reading.
     Frame read();
 
+    /// Read the next frame in the trajectory into an existing `frame`.
+    ///
+    /// This works like `Trajectory::read()`, but the formats reading one step
+    /// after the other with the same number of atoms (XTC, TRR, DCD, XYZ, PDB
+    /// and LAMMPS) will reuse the memory already allocated in `frame` instead
+    /// of allocating a new frame every time. `frame` should either be empty or
+    /// come from a previous call to this function with the same trajectory.
+    /// Data which is not stored in the file (such as atom names in XTC files)
+    /// is kept from the previous step.
+    ///
+    /// @param frame frame to fill with the next step
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    void read(Frame& frame);
+
     /// Read a single frame at specified `index` from the trajectory.
     ///
     /// The trajectory must have been opened in read mode, and the
@@ -141,6 +209,120 @@ public:
     ///                     the format does not support reading.
     Frame read_at(size_t index);
 
+    /// Read a single frame at specified `index` from the trajectory into an
+    /// existing `frame`, reusing the memory already allocated for it. See
+    /// `Trajectory::read(Frame&)` for more information.
+    ///
+    /// @param index index of the frame to read in the trajectory
+    /// @param frame frame to fill with the step at `index`
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    void read_at(size_t index, Frame& frame);
+
+    /// Read all the frames at the given `indices`, calling `callback` with
+    /// each frame as soon as it is read.
+    ///
+    /// The frames can be given to the callback in any order, use
+    /// `Frame::index` to know which frame is being processed. For formats
+    /// storing the position of all frames (XTC, TRR and DCD), multiple frames
+    /// are read from the file at the same time (using io_uring on Linux if
+    /// chemfiles was built with `CHFL_USE_IO_URING=ON`), making this faster
+    /// than calling `read_at` in a loop when reading frames out of order.
+    ///
+    /// @example{trajectory/read_batch.cpp}
+    ///
+    /// @param indices indexes of the frames to read
+    /// @param callback function called with each frame
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    void read_batch(const std::vector<size_t>& indices, const std::function<void(Frame)>& callback);
+
+    /// Read the positions of the frames from `start` (included) to `stop`
+    /// (excluded), taking one frame every `stride`, into `positions`.
+    ///
+    /// The positions are stored as `n_frames x n_atoms x 3` values, where
+    /// `n_frames` is the number of frames to read and `n_atoms` the number of
+    /// atoms in each frame, which is computed from the size of `positions`.
+    /// No `Frame` is created when reading XTC, TRR, DCD, Amber NetCDF and XYZ
+    /// files, making this faster than calling `read_at` and copying the
+    /// positions of each frame.
+    ///
+    /// @example{trajectory/read_positions.cpp}
+    ///
+    /// @param start index of the first frame to read
+    /// @param stop index after the last frame to read
+    /// @param stride number of frames between two frames to read
+    /// @param positions array to fill with the positions
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    /// @throws Error if the size of `positions` does not match the number of
+    ///               frames and atoms
+    void read_positions(size_t start, size_t stop, size_t stride, span<double> positions);
+
+    /// Read the positions of the frames from `start` (included) to `stop`
+    /// (excluded), taking one frame every `stride`, into `positions`, using
+    /// single precision floating point values. See
+    /// `Trajectory::read_positions(size_t, size_t, size_t, span<double>)` for
+    /// more information.
+    ///
+    /// @param start index of the first frame to read
+    /// @param stop index after the last frame to read
+    /// @param stride number of frames between two frames to read
+    /// @param positions array to fill with the positions
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    /// @throws Error if the size of `positions` does not match the number of
+    ///               frames and atoms
+    void read_positions(size_t start, size_t stop, size_t stride, span<float> positions);
+
+    /// Read the frames from `start` (included) to `stop` (excluded) using
+    /// `n_threads` threads, calling `callback` with the index of each frame
+    /// and the corresponding frame.
+    ///
+    /// Each thread reads the file with its own cursor. The positions of the
+    /// frames already known in text, XTC and TRR files are shared with all
+    /// the cursors, so the file is only scanned once. `callback` is called
+    /// concurrently from multiple threads, and the frames are given to it in
+    /// any order. Each thread re-uses the same `Frame` to read its next
+    /// frames (see `Trajectory::read(Frame&)`), use `Frame::clone` to keep
+    /// a frame after `callback` returns.
+    ///
+    /// If reading a frame or calling `callback` throws an exception, the
+    /// other threads stop reading new frames, and the exception is re-thrown
+    /// by this function. This function does not change the next frame read
+    /// by `Trajectory::read`.
+    ///
+    /// @example{trajectory/parallel_for_each.cpp}
+    ///
+    /// @param start index of the first frame to read
+    /// @param stop index after the last frame to read
+    /// @param callback function called with each frame and its index
+    /// @param n_threads number of threads to use, `0` uses one thread for
+    ///                  each available CPU core
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the file is not valid for the used format, or if
+    ///                     the format does not support reading.
+    void parallel_for_each(
+        size_t start,
+        size_t stop,
+        const std::function<void(size_t, Frame&)>& callback,
+        size_t n_threads = 0
+    );
+
     // /// Deprecated, see `Frame::read_at`
     // Frame read_step(size_t step);
 
@@ -158,6 +340,79 @@ public:
     /// @throws FormatError if the format does not support writing.
     void write(const Frame& frame);
 
+    /// Write a single frame to the trajectory, moving it to the queue of
+    /// frames to write when writing asynchronously (see
+    /// `Trajectory::set_async_write`) instead of copying it. In this case,
+    /// `frame` is left in a valid but unspecified state.
+    ///
+    /// @param frame frame to write to this trajectory
+    ///
+    /// @throws FileError for all errors concerning the physical file: can not
+    ///                   open it, can not read/write it, *etc.*
+    /// @throws FormatError if the format does not support writing.
+    void write(Frame&& frame);
+
+    /// Write the frames on a background thread, keeping at most `depth`
+    /// frames waiting to be written, or go back to writing frames directly
+    /// in `Trajectory::write` if `depth` is `0`.
+    ///
+    /// When writing asynchronously, `Trajectory::write` adds a copy of the
+    /// frame to a queue and returns, while a background thread formats,
+    /// compresses and writes the frames in the queue. If the queue is full,
+    /// `Trajectory::write` waits until some space is available, limiting the
+    /// memory used by the queue.
+    ///
+    /// Errors raised while writing a frame are re-thrown by the next call to
+    /// `Trajectory::write`, `Trajectory::flush` or `Trajectory::close`, and
+    /// the other frames in the queue are discarded. When the trajectory is
+    /// destroyed without calling `close`, these errors are sent as warnings.
+    ///
+    /// The callback of trajectories created with `Trajectory::stream_writer`
+    /// is called from the background thread when writing asynchronously.
+    ///
+    /// @example{trajectory/set_async_write.cpp}
+    ///
+    /// @param depth maximal number of frames waiting to be written
+    ///
+    /// @throws FileError if the trajectory was not opened in write or append
+    ///                   mode, or for errors while writing the frames already
+    ///                   in the queue
+    /// @throws FormatError for errors while writing the frames already in the
+    ///                     queue
+    void set_async_write(size_t depth);
+
+    /// Wait until all the frames given to `Trajectory::write` have been
+    /// written, and re-throw any error raised while writing them. This does
+    /// nothing if the trajectory is not writing asynchronously.
+    ///
+    /// @throws FileError for errors while writing the frames
+    /// @throws FormatError for errors while writing the frames
+    void flush();
+
+    /// Read up to `depth` frames in advance on a background thread when
+    /// calling `Trajectory::read`, or stop reading frames in advance if
+    /// `depth` is `0`.
+    ///
+    /// When reading frames in order, the next frames are read and decoded
+    /// while the current frame is being used, and `Trajectory::read` only
+    /// needs to give back the next frame once it is ready. Using
+    /// `Trajectory::read(Frame&)` with the same frame for every step allows
+    /// to re-use the memory of the previous frame to read another one in
+    /// advance. Reading frames out of order (for example with `read_at`)
+    /// discards all the frames read in advance.
+    ///
+    /// This is most useful with formats which need a lot of work to decode a
+    /// frame, such as XTC files or compressed text files. Prefetching is
+    /// disabled by default.
+    ///
+    /// @example{trajectory/set_prefetch.cpp}
+    ///
+    /// @param depth maximal number of frames to read in advance
+    ///
+    /// @throws FileError if the trajectory was not opened in read mode, or
+    ///                   was created with `Trajectory::stream_reader`
+    void set_prefetch(size_t depth);
+
     /// Use the given `topology` instead of any pre-existing `Topology` when
     /// reading or writing.
     ///
@@ -214,6 +469,12 @@ public:
 
     /// Get the number of frames in this trajectory.
     ///
+    /// Opening a text file does not look for all the frames in the file, and
+    /// the first call to this function may need to scan the whole file.
+    ///
+    /// For trajectories created with `Trajectory::stream_reader`, this is the
+    /// number of frames known so far.
+    ///
     /// @example{trajectory/size.cpp}
     size_t size() const;
 
@@ -225,6 +486,12 @@ public:
 
     /// Close a trajectory, and synchronize all buffered content with the drive.
     ///
+    /// When writing asynchronously, this writes all the frames in the queue
+    /// before closing the file, and re-throws any error raised while writing
+    /// them. Errors while writing the data still buffered in memory are also
+    /// reported by this function, while they are only sent as warnings when
+    /// the trajectory is destroyed without calling `close`.
+    ///
     /// Calling any function on a closed trajectory will throw a `FileError`.
     ///
     /// @example{trajectory/close.cpp}
@@ -241,7 +508,11 @@ public:
     /// with `Trajectory::memory_writer`.
     ///
     /// If the trajectory was not created for writing to memory, this will
-    /// return `nullopt`.
+    /// return `nullopt`. Some binary formats (such as Amber NetCDF) only
+    /// finish writing their header when closing the trajectory, and the
+    /// buffer will only contain a complete file after calling `close()`.
+    /// When writing asynchronously, this waits for all the frames in the
+    /// queue to be written.
     ///
     /// @example{trajectory/memory_buffer.cpp}
     optional<span<const char>> memory_buffer() const;
@@ -251,8 +522,18 @@ private:
 
     /// Perform a few checks before reading a frame
     void pre_read(size_t index);
+    /// Throw a `FileError` for a missing frame at `index`
+    [[noreturn]] void missing_frame(size_t index) const;
+    /// Perform a few checks before writing a frame
+    void pre_write();
+    /// Set the frame topology and/or cell, and add it to the queue of frames
+    /// to write asynchronously
+    void write_async(Frame frame);
     /// Set the frame topology and/or cell after reading it
     void post_read(Frame& frame);
+    /// Check the arguments of `read_positions`, and get the number of frames
+    /// to read
+    size_t positions_frames(size_t start, size_t stop, size_t stride, size_t size);
     /// Check that the trajectory is still open, and throw a `FileError` is it
     /// has been closed.
     void check_opened() const;
@@ -263,8 +544,14 @@ private:
     char mode_ = '\0';
     /// Next index that will be read by `read`
     size_t index_ = 0;
-    /// Number of frames in the file
-    size_t size_ = 0;
+    /// Number of frames in the file. When reading, this is only computed
+    /// when needed, since it may require scanning the whole file.
+    mutable optional<size_t> size_ = 0;
+    /// Frames written asynchronously on a background thread with `format_`,
+    /// if enabled with `set_async_write`. This must be declared before
+    /// `format_`, so that moving another trajectory into this one finishes
+    /// writing the frames before destroying the format.
+    std::unique_ptr<FrameWriter> writer_;
     /// Format used to read the associated file. It will be `nullptr` is the
     /// trajectory is closed
     std::unique_ptr<Format> format_;
@@ -276,6 +563,20 @@ private:
     optional<UnitCell> custom_cell_;
     /// The internal memory buffer, shared with the MemoryFile implementation
     std::shared_ptr<MemoryBuffer> buffer_;
+    /// Is this trajectory reading from or writing to a stream? In this case,
+    /// `size_` only contains the number of frames known so far.
+    bool streaming_ = false;
+    /// Open the file again with a new instance of the format, used to create
+    /// the cursors in `parallel_for_each`. This is empty if the file can not
+    /// be opened again, *i.e.* for streams and files not opened in read mode.
+    std::function<std::unique_ptr<Format>()> open_format_;
+    /// Frames read in advance on a background thread, if enabled with
+    /// `set_prefetch`
+    std::unique_ptr<FramePrefetcher> prefetcher_;
+    /// Frames were given by `prefetcher_` or `read_batch` instead of
+    /// `format_->read`, so the next frame read by `format_` has to be
+    /// selected with `read_at`
+    bool sync_format_ = false;
 };
 
 } // namespace chemfiles
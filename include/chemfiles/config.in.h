@@ -19,6 +19,9 @@
 /// Are we building code on Windows?
 #cmakedefine CHEMFILES_WINDOWS
 
+/// Should we use io_uring to read multiple frames at once?
+#cmakedefine CHEMFILES_USE_IO_URING
+
 // Should we include GEMMI code?
 #cmakedefine CHFL_DISABLE_GEMMI
 
@@ -73,8 +73,11 @@ public:
     template< class U, size_t N >
     span(std::array< U, N > & arr): begin_(arr.data()), end_(arr.data() + N) {}
 
-    // SFINAE enable only if Cont has a data() member function
-    template< class Cont, typename = decltype(std::declval<Cont>().data()) >
+    // SFINAE enable only if Cont has a data() member function returning
+    // pointers convertible to `pointer`
+    template< class Cont, typename = typename std::enable_if<
+        std::is_convertible<decltype(std::declval<Cont&>().data()), pointer>::value
+    >::type >
     span(Cont & cont): begin_(cont.data()), end_(cont.data() + cont.size()) {}
 
     span(span &&) = default;
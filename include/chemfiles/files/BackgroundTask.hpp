@@ -0,0 +1,121 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_BACKGROUND_TASK_HPP
+#define CHEMFILES_BACKGROUND_TASK_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace chemfiles {
+
+template <typename T> class BackgroundTask;
+
+/// A fixed number of worker threads owned by a file, used to decompress data
+/// in advance.
+///
+/// The threads are started when the first task is submitted, and joined when
+/// the workers are destroyed. Tasks which did not start yet at this point are
+/// dropped, so all the `BackgroundTask` using these workers must be destroyed
+/// before them.
+class BackgroundWorkers final {
+public:
+    /// Create workers using up to `n_threads` threads
+    explicit BackgroundWorkers(size_t n_threads);
+    ~BackgroundWorkers();
+
+    BackgroundWorkers(const BackgroundWorkers&) = delete;
+    BackgroundWorkers& operator=(const BackgroundWorkers&) = delete;
+    BackgroundWorkers(BackgroundWorkers&&) = delete;
+    BackgroundWorkers& operator=(BackgroundWorkers&&) = delete;
+
+    /// Run `function(cancelled)` on one of the worker threads. `cancelled` is
+    /// a `const std::atomic<bool>&` which becomes `true` when the task result
+    /// is no longer needed, and should be checked regularly by `function`.
+    template <typename T, typename Function>
+    BackgroundTask<T> submit(Function function);
+
+private:
+    /// Add `task` to the queue, starting the threads if needed
+    void push(std::function<void()> task);
+    /// Main loop of the worker threads
+    void run();
+
+    size_t n_threads_;
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<std::function<void()>> queue_;
+    bool stop_ = false;
+};
+
+/// A task running on `BackgroundWorkers`.
+///
+/// Destroying a `BackgroundTask` does not wait for the task to finish.
+/// Instead, the task is asked to stop early, and its result is discarded.
+/// This means that the task must own all the data it uses.
+template <typename T>
+class BackgroundTask final {
+public:
+    ~BackgroundTask() {
+        this->cancel();
+    }
+
+    BackgroundTask(const BackgroundTask&) = delete;
+    BackgroundTask& operator=(const BackgroundTask&) = delete;
+
+    BackgroundTask(BackgroundTask&&) noexcept = default;
+    BackgroundTask& operator=(BackgroundTask&& other) noexcept {
+        this->cancel();
+        result_ = std::move(other.result_);
+        cancelled_ = std::move(other.cancelled_);
+        return *this;
+    }
+
+    /// Wait for the task to finish and get its result, re-throwing any
+    /// exception raised by the task. This can only be called once.
+    T get() {
+        return result_.get();
+    }
+
+private:
+    BackgroundTask(std::future<T> result, std::shared_ptr<std::atomic<bool>> cancelled):
+        result_(std::move(result)), cancelled_(std::move(cancelled)) {}
+
+    void cancel() noexcept {
+        if (cancelled_ != nullptr) {
+            *cancelled_ = true;
+        }
+    }
+
+    std::future<T> result_;
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+
+    friend class BackgroundWorkers;
+};
+
+template <typename T, typename Function>
+BackgroundTask<T> BackgroundWorkers::submit(Function function) {
+    auto cancelled = std::make_shared<std::atomic<bool>>(false);
+    auto task = std::make_shared<std::packaged_task<T()>>(
+        [function = std::move(function), cancelled]() {
+            return function(*cancelled);
+        }
+    );
+    auto result = task->get_future();
+    this->push([task]() { (*task)(); });
+    return BackgroundTask<T>(std::move(result), std::move(cancelled));
+}
+
+} // namespace chemfiles
+
+#endif
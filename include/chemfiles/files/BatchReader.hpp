@@ -0,0 +1,117 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_BATCH_READER_HPP
+#define CHEMFILES_BATCH_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "chemfiles/config.h"  // IWYU pragma: keep (CHEMFILES_USE_IO_URING)
+#include "chemfiles/external/span.hpp"
+
+namespace chemfiles {
+
+/// Read multiple ranges of a file at once. When chemfiles is built with the
+/// `CHFL_USE_IO_URING` option on Linux, this uses io_uring to keep many reads
+/// in flight at the same time, and returns the data as soon as each read
+/// completes. Otherwise, or if io_uring is not available at runtime, the
+/// ranges are read one after the other with `pread`.
+///
+/// This is only available on POSIX systems.
+class BatchReader final {
+public:
+    /// A range of bytes to read in the file
+    struct request {
+        /// Position of the first byte to read
+        uint64_t offset;
+        /// Number of bytes to read
+        size_t size;
+    };
+
+    /// Create a reader for the file descriptor `file_descriptor`, keeping at
+    /// most `queue_depth` reads in flight. The file descriptor is not owned
+    /// by the reader, and must stay open while the reader is used.
+    explicit BatchReader(int file_descriptor, unsigned queue_depth = 32);
+    ~BatchReader();
+
+    BatchReader(BatchReader&&) = delete;
+    BatchReader(const BatchReader&) = delete;
+    BatchReader& operator=(BatchReader&&) = delete;
+    BatchReader& operator=(const BatchReader&) = delete;
+
+    /// Read all the `requests`, and call `callback(i, data)` with the data of
+    /// `requests[i]` as soon as it is available. The order of the calls is
+    /// unspecified, and `data` is only valid during the call.
+    ///
+    /// @throws FileError if any of the reads fails, or if a range is outside
+    ///                   of the file
+    void read(
+        const std::vector<request>& requests,
+        const std::function<void(size_t, span<const char>)>& callback
+    );
+
+    /// Is this reader using io_uring?
+    bool uses_io_uring() const;
+
+private:
+    /// Read all the requests with `pread`
+    void read_sequential(
+        const std::vector<request>& requests,
+        const std::function<void(size_t, span<const char>)>& callback
+    );
+    /// Read the full `size` bytes at `offset` into `data`, retrying partial
+    /// reads. `done` bytes have already been read.
+    void pread_all(char* data, uint64_t offset, size_t size, size_t done);
+
+    int file_descriptor_;
+    unsigned queue_depth_;
+
+#ifdef CHEMFILES_USE_IO_URING
+    /// Data of a single read in flight
+    struct slot {
+        std::vector<char> buffer;
+        /// index of the corresponding request
+        size_t request = 0;
+        bool used = false;
+    };
+
+    /// Try to create the io_uring instance, leaving `ring_fd_` to -1 on
+    /// failure
+    void setup_ring();
+    /// Read all the requests with io_uring
+    void read_io_uring(
+        const std::vector<request>& requests,
+        const std::function<void(size_t, span<const char>)>& callback
+    );
+
+    int ring_fd_ = -1;
+    unsigned ring_entries_ = 0;
+    /// Memory mapping of the submission and completion rings, and of the
+    /// submission entries
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    void* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    /// Pointers inside the rings
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    void* cqes_ = nullptr;
+
+    std::vector<slot> slots_;
+#endif
+};
+
+} // namespace chemfiles
+
+#endif
@@ -4,12 +4,16 @@
 #include <cstddef>
 #include <cstdint>
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/external/span.hpp"
+#include "chemfiles/files/BatchReader.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 
 static_assert(sizeof(char) == sizeof(int8_t), "char must be 8-bits");
 
@@ -32,10 +36,19 @@ class BinaryFile: public File {
 public:
     /// Open the file at the given `path` using the given `mode`
     BinaryFile(std::string path, File::Mode mode);
+    /// Use the given `memory` buffer as the file content, using the given
+    /// `mode`. Reads access the buffer directly without copies, and writes
+    /// grow the buffer as needed.
+    ///
+    /// @throws FileError if `mode` is `File::APPEND`
+    BinaryFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode);
 
     /// Open the file at the given `path` using the given `mode` as a file with
     /// the current native endianess
     static std::unique_ptr<BinaryFile> open_native(std::string path, File::Mode mode);
+    /// Use the given `memory` buffer using the given `mode` as a file with the
+    /// current native endianess
+    static std::unique_ptr<BinaryFile> open_native(std::shared_ptr<MemoryBuffer> memory, File::Mode mode);
 
     virtual ~BinaryFile() noexcept override;
 
@@ -43,7 +56,7 @@ public:
     BinaryFile& operator=(const BinaryFile&) = delete;
 
     BinaryFile(BinaryFile&& other) noexcept : File(std::move(other)) {
-        *this = std::move(other);
+        this->take_from(other);
     }
     BinaryFile& operator=(BinaryFile&&) noexcept;
 
@@ -59,6 +72,45 @@ public:
     /// Get the size of the file
     uint64_t file_size();
 
+    /// Get the memory buffer used as the file content, or `nullptr` when
+    /// using an actual file
+    const std::shared_ptr<MemoryBuffer>& memory() const {
+        return memory_;
+    }
+
+    /// Expected access pattern when reading a file
+    enum class AccessPattern {
+        /// The file is read from start to end
+        SEQUENTIAL,
+        /// The file is accessed in random order
+        RANDOM,
+    };
+
+    /// Tell the operating system how the file will be accessed from now on.
+    /// This is only an hint, used to tune read-ahead of the data.
+    void set_access_pattern(AccessPattern pattern);
+    /// Get the current access pattern of this file
+    AccessPattern access_pattern() const {
+        return access_pattern_;
+    }
+
+    /// Read all the byte ranges in `requests`, and call `callback(i, data)`
+    /// with the content of `requests[i]` as soon as it is available. This
+    /// keeps multiple reads in flight when chemfiles is built with io_uring
+    /// support, and reads the ranges one after the other otherwise. The order
+    /// of the calls is unspecified, and `data` is only valid during the call.
+    /// This does not change the current position in the file.
+    void read_batch(
+        const std::vector<BatchReader::request>& requests,
+        const std::function<void(size_t, span<const char>)>& callback
+    );
+
+    /// Tell the operating system that the `count` bytes starting at
+    /// `position` will be read soon, and should be loaded in memory in
+    /// advance. This is only an hint, and does not change the current
+    /// position in the file.
+    void prefetch(uint64_t position, uint64_t count);
+
     /// Read exactly `count` char, and store them in the `data` array
     void read_char(char* data, size_t count);
     /// Read exactly as many char as fit in the pre-allocated vector
@@ -70,6 +122,17 @@ public:
         return value;
     }
 
+    /// Get a view of the next `count` bytes in the file, and advance the
+    /// current position after them. When the file is memory mapped or in
+    /// memory, the view points directly inside the mapping or the memory
+    /// buffer and no copy happens. Otherwise the
+    /// data is first read into an internal buffer. The view contains the raw
+    /// bytes in the file endianness, and is only valid until the next call to
+    /// any function of this file.
+    ///
+    /// @throws FileError if there are less than `count` bytes in the file
+    span<const char> read_view(size_t count);
+
     /// Read exactly `count` 8-bit signed integers, and store them in the `data`
     /// array
     void read_i8(int8_t* data, size_t count) {
@@ -194,6 +257,13 @@ public:
         return value;
     }
 
+    /// Read exactly `count` 32-bit floating point numbers, convert them to
+    /// 64-bit floating point numbers and store them in `data[0]`,
+    /// `data[stride]`, `data[2 * stride]`, ... When the file is memory mapped,
+    /// the conversion happens directly from the mapping, without intermediary
+    /// copy.
+    virtual void read_f32_as_f64(double* data, size_t count, size_t stride) = 0;
+
 
 
     /// Write exactly `count` char values taken from the `data` array to the
@@ -333,6 +403,8 @@ public:
     }
 protected:
     std::vector<char> swap_buffer_;
+    /// Buffer used by `read_view` when the data can not be accessed directly
+    std::vector<char> view_buffer_;
 
 private:
     /// Close the file and mmap binding, and reset all member to
@@ -340,10 +412,28 @@ private:
     /// destructor and move assignment operator
     void close_file() noexcept;
 
+    /// Close this file, and take the file or memory buffer used by `other`.
+    /// This is used to implement both the move constructor and move
+    /// assignment operator, after moving the `File` base class.
+    void take_from(BinaryFile& other) noexcept;
+
     /// When in mmap mode, sync, unmap and then remap the file starting at
     /// `mmap_offset_`
     void remap_file();
 
+    /// Get a view of the next `count` bytes in `memory_`, and advance the
+    /// current position after them
+    span<const char> memory_view(size_t count);
+
+    /// Current access pattern, see `set_access_pattern`
+    AccessPattern access_pattern_ = AccessPattern::SEQUENTIAL;
+
+    /// Memory buffer used as the file content, or `nullptr` when using an
+    /// actual file
+    std::shared_ptr<MemoryBuffer> memory_;
+    /// Current position in `memory_`
+    uint64_t memory_position_ = 0;
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     int file_descriptor_ = -1;
     char* mmap_data_ = nullptr;
@@ -354,6 +444,8 @@ private:
     size_t page_size_ = 0;
     uint64_t current_ = 0;
     uint64_t total_written_size_ = 0;
+    /// Reader used by `read_batch`, created on first use
+    std::unique_ptr<BatchReader> batch_reader_;
 #else
     FILE* file_ = nullptr;
 #endif
@@ -362,6 +454,7 @@ private:
 class BigEndianFile: public BinaryFile {
 public:
     BigEndianFile(std::string path, File::Mode mode): BinaryFile(std::move(path), mode) {}
+    BigEndianFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode): BinaryFile(std::move(memory), mode) {}
 
     virtual ~BigEndianFile() noexcept override = default;
 
@@ -379,6 +472,7 @@ public:
     void read_u64(uint64_t* data, size_t count) final;
     void read_f32(float* data, size_t count) final;
     void read_f64(double* data, size_t count) final;
+    void read_f32_as_f64(double* data, size_t count, size_t stride) final;
 
     void write_i16(const int16_t* data, size_t count) final;
     void write_u16(const uint16_t* data, size_t count) final;
@@ -396,6 +490,7 @@ private:
 class LittleEndianFile: public BinaryFile {
 public:
     LittleEndianFile(std::string path, File::Mode mode): BinaryFile(std::move(path), mode) {}
+    LittleEndianFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode): BinaryFile(std::move(memory), mode) {}
 
     virtual ~LittleEndianFile() noexcept override = default;
 
@@ -413,6 +508,7 @@ public:
     void read_u64(uint64_t* data, size_t count) final;
     void read_f32(float* data, size_t count) final;
     void read_f64(double* data, size_t count) final;
+    void read_f32_as_f64(double* data, size_t count, size_t stride) final;
 
     void write_i16(const int16_t* data, size_t count) final;
     void write_u16(const uint16_t* data, size_t count) final;
@@ -5,12 +5,17 @@
 #define CHEMFILES_BZ2_FILES_HPP
 
 #include <cstdio>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 #include <functional>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/files/BackgroundTask.hpp"
+#include "chemfiles/files/InputSource.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
 
 #include <bzlib.h>
@@ -18,10 +23,24 @@
 namespace chemfiles {
 
 /// An implementation of TextFile for bzip2 files
+///
+/// bzip2 files are made of independent blocks of up to 900 KiB of data, each
+/// starting with a 48-bit magic number (which is not aligned on byte
+/// boundaries). When reading, this class locates the blocks in the compressed
+/// file, and decompresses them independently, in advance and on a few
+/// background threads owned by the file. The uncompressed position of each
+/// block is recorded the first time it is decompressed, and used to resume
+/// decompression at the right block when seeking.
+///
+/// The magic number can also appear by chance inside the compressed data. If
+/// a block fails to decompress, the file is read with a single streaming
+/// decoder from this point on.
 class Bz2File final: public TextFileImpl {
 public:
     /// Open a text file with name `filename` and mode `mode`.
     Bz2File(const std::string& path, File::Mode mode);
+    /// Read bzip2 compressed data from `memory`, decompressing it as needed
+    Bz2File(std::shared_ptr<MemoryBuffer> memory);
     ~Bz2File() override;
 
     size_t read(char* data, size_t count) override;
@@ -29,13 +48,61 @@ public:
 
     void clear() noexcept override;
     void seek(uint64_t position) override;
+    void close() override;
 
 private:
     void compress_and_write(int action);
+    /// Prepare to read the data in `source_`
+    void init_read();
 
+    /// Position of a single block in the compressed file, in bits
+    struct block {
+        /// position of the first bit of the block (i.e. start of the block
+        /// magic number)
+        uint64_t start;
+        /// position of the first bit after the end of the block, or
+        /// `UINT64_MAX` if we did not find the end of the block yet
+        uint64_t end;
+    };
+
+    /// Read and scan the next chunk of the compressed file, looking for block
+    /// and end of stream markers.
+    void scan_chunk();
+    /// Scan the compressed file until the start and end of block `i` are known.
+    /// Returns `false` if there is no block `i` in the file.
+    bool scan_until(size_t i);
+    /// Read and decompress block `i` on the calling thread
+    std::vector<char> decompress(size_t i);
+    /// Start reading and decompressing block `i` on one of the `workers_`
+    BackgroundTask<std::vector<char>> start_decompression(size_t i);
+    /// Make block `i` the current block, using already decompressed data if
+    /// possible, and start decompressing the next blocks in the background.
+    /// Blocks already being decompressed are kept if they are still needed,
+    /// and the others are cancelled without waiting for them. The
+    /// uncompressed offset of block `i` must be known.
+    ///
+    /// This returns `false` if block `i` could not be decompressed, in which
+    /// case the caller should switch to the streaming decoder with
+    /// `use_stream_decoder`.
+    bool load_block(size_t i);
+    /// Stop reading blocks independently, and use the streaming decoder
+    /// starting at `position` in the uncompressed data instead
+    void use_stream_decoder(uint64_t position);
+    /// Implementation of `read` when reading blocks independently
+    size_t read_blocks(char* data, size_t count);
+    /// Implementation of `seek` when reading blocks independently
+    void seek_blocks(uint64_t position);
+
+    /// Underlying compressed file, used for writing
     FILE* file_ = nullptr;
     /// Store the mode used to open this file
     File::Mode mode_;
+    /// Source of compressed data, used for reading
+    std::unique_ptr<InputSource> source_;
+    /// Compressed data when reading from memory, shared with the background
+    /// tasks. This is `nullptr` when reading from a file, and the background
+    /// tasks open the file again instead.
+    std::shared_ptr<MemoryBuffer> memory_;
     /// Store the right function to close the stream
     std::function<int(bz_stream*)> stream_end_;
     /// bzip2 stream used both for reading and writing.
@@ -43,6 +110,42 @@ private:
     /// compressed data buffer, straight out from the file when reading, to be
     /// written to the file when writing.
     std::vector<char> buffer_;
+    /// Did the streaming decoder already restart for a concatenated stream?
+    bool concatenated_ = false;
+    /// Did the streaming decoder reach the end of the compressed data?
+    bool end_of_data_ = false;
+
+    /// Are we reading blocks independently? This is false for files which do
+    /// not look like valid bzip2 files, which are read with a single stream
+    /// to get the corresponding errors.
+    bool use_blocks_ = false;
+    /// Blocks found so far in the compressed file
+    std::vector<block> blocks_;
+    /// Did we scan the whole compressed file?
+    bool scan_done_ = false;
+    /// Position (in bytes) of the next chunk to scan in the compressed file
+    uint64_t scan_offset_ = 0;
+    /// Last 64 bits seen while scanning the file
+    uint64_t scan_register_ = 0;
+    /// Position in the uncompressed data of the start of the blocks. This
+    /// grows as the blocks are decompressed for the first time.
+    std::vector<uint64_t> offsets_;
+    /// Index of the block currently in `current_`
+    size_t current_block_ = 0;
+    /// Decompressed data for the current block
+    std::vector<char> current_;
+    /// Position of the next byte to read in `current_`
+    size_t block_position_ = 0;
+    /// Largest amount of memory (compressed and decompressed data) used by a
+    /// single block, estimated from the blocks decompressed so far
+    size_t block_memory_ = 0;
+    /// Threads used to decompress blocks in advance. This must be declared
+    /// before `pending_`, so the pending tasks are cancelled before the
+    /// threads are joined.
+    std::unique_ptr<BackgroundWorkers> workers_;
+    /// Blocks being decompressed in the background. The first entry contains
+    /// the block after `current_block_`, the second the one after, etc.
+    std::deque<BackgroundTask<std::vector<char>>> pending_;
 };
 
 /// Inflates BZIP2 data from the `src` buffer
@@ -0,0 +1,109 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_FRAME_INDEX_HPP
+#define CHEMFILES_FRAME_INDEX_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "chemfiles/external/optional.hpp"
+
+namespace chemfiles {
+
+/// On-disk cache of the positions of the frames in a trajectory file, stored
+/// next to the trajectory in a sidecar file (`<path>.chfl-idx`).
+///
+/// The index contains a fingerprint of the trajectory (size, modification
+/// time and hash of the first bytes of the file) and a tag identifying the
+/// format which created it. An index is only used if both the fingerprint and
+/// the tag match, and is otherwise ignored and re-created after the next full
+/// scan of the file.
+///
+/// The same mechanism can store other data computed while reading the file
+/// in a different sidecar file, such as the checkpoints used to seek inside
+/// gzip files (see `GzFile`).
+///
+/// Using the index is disabled by default, and can be enabled with
+/// `chemfiles::set_frame_index`.
+class FrameIndex {
+public:
+    /// Create an index for the trajectory at `path`, read by a format
+    /// identified by `tag`. This takes the fingerprint of the trajectory,
+    /// and should be called before scanning the file.
+    FrameIndex(std::string path, std::string tag);
+    /// Create an index for the trajectory at `path`, identified by `tag` and
+    /// stored in the file at `index` instead of `index_path(path)`.
+    FrameIndex(std::string path, std::string tag, std::string index);
+
+    /// Is the use of index files enabled?
+    static bool enabled();
+
+    /// Get the path of the index file for a trajectory at `path`
+    static std::string index_path(const std::string& path);
+
+    /// Load the frame positions from the index file. This returns `nullopt`
+    /// if the index is disabled, does not exist, was created by a different
+    /// format, or is out of date with respect to the trajectory.
+    optional<std::vector<uint64_t>> load() const;
+
+    /// Save the frame `positions` in the index file, if the use of the index
+    /// is enabled and the trajectory did not change since this `FrameIndex`
+    /// was created. Any error while writing the index is ignored, since the
+    /// index is only an optimization.
+    void save(const std::vector<uint64_t>& positions) const;
+
+    /// Load arbitrary data from the index file, with the same checks as
+    /// `load`.
+    optional<std::vector<char>> load_data() const;
+
+    /// Save arbitrary `data` in the index file, with the same checks as
+    /// `save`.
+    void save_data(const std::vector<char>& data) const;
+
+    /// Append the bytes of a single `value` of type `T` at the end of `data`,
+    /// to build the payload given to `save_data`.
+    template <typename T>
+    static void append_value(std::vector<char>& data, const T& value) {
+        auto size = data.size();
+        data.resize(size + sizeof(T));
+        std::memcpy(data.data() + size, &value, sizeof(T));
+    }
+
+    /// Read a single value of type `T` from `data` at `offset`, advancing the
+    /// offset. Returns `false` if there is not enough data.
+    template <typename T>
+    static bool read_value(const std::vector<char>& data, size_t& offset, T& value) {
+        if (data.size() - offset < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    /// Fingerprint of a trajectory file, used to check that an index is
+    /// still up to date
+    struct fingerprint {
+        uint64_t size;
+        int64_t mtime;
+        uint64_t hash;
+    };
+
+private:
+    /// Path of the trajectory
+    std::string path_;
+    /// Tag identifying the format using this index
+    std::string tag_;
+    /// Path of the index file
+    std::string index_;
+    /// Fingerprint of the trajectory when this index was created, or
+    /// `nullopt` if the index is disabled or the file can not be read
+    optional<fingerprint> fingerprint_;
+};
+
+} // namespace chemfiles
+
+#endif
@@ -6,20 +6,43 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/files/InputSource.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
 
-typedef struct gzFile_s *gzFile;
+struct z_stream_s;
 
 namespace chemfiles {
+class FrameIndex;
 
 /// An implementation of TextFile for gzip files
+///
+/// When reading, this class records checkpoints in the compressed stream (the
+/// position in the compressed and uncompressed data and the associated 32 KiB
+/// inflate window) at regular intervals while decompressing the file. Seeking
+/// then restarts decompression from the closest checkpoint before the
+/// requested position instead of from the start of the file. When frame
+/// index files are enabled (see `chemfiles::set_frame_index`), the
+/// checkpoints are saved next to the file after reading it entirely, and
+/// loaded again the next time the same file is opened.
+///
+/// When writing, the data is split in chunks of 1 MiB, which are compressed
+/// as independent gzip members on background threads, and then written to
+/// the file in order. This is the same strategy as `pigz`, and the resulting
+/// files can be read by any gzip implementation.
 class GzFile final: public TextFileImpl {
 public:
     /// Open a text file with name `filename` and mode `mode`.
     GzFile(const std::string& path, File::Mode mode);
+    /// Read gzip compressed data from `memory`, decompressing it as needed
+    GzFile(std::shared_ptr<MemoryBuffer> memory);
     ~GzFile() override;
 
     size_t read(char* data, size_t count) override;
@@ -27,13 +50,95 @@ public:
 
     void clear() noexcept override;
     void seek(uint64_t position) override;
+    void close() override;
+
+    /// Get the path of the file containing the checkpoints for a gzip file
+    /// at `path`
+    static std::string checkpoints_path(const std::string& path);
 
 private:
-    /// Check if any error happened while reading/writing the file. Returns the
-    /// corresponding error message or `nullptr` if no error occurred.
-    const char* check_error() const;
+    /// A checkpoint in the compressed stream, allowing to restart inflating
+    /// the file from the middle of the data
+    struct checkpoint {
+        /// position in the uncompressed data
+        uint64_t uncompressed;
+        /// position in the compressed file of the first byte containing data
+        /// after this checkpoint
+        uint64_t compressed;
+        /// number of bits (1-7) from the byte at `compressed - 1` used by the
+        /// data after this checkpoint, or 0
+        int bits;
+        /// the inflate window (last 32 KiB of uncompressed data) at this point
+        std::vector<unsigned char> window;
+    };
+
+    /// Start compressing the data in `chunk_` on a background thread
+    void start_compression();
+    /// Wait for the first member in `compressing_` and write it to the file
+    void write_member();
+    /// Compress and write all remaining data to the file
+    void finish();
+
+    /// Prepare to read the data in `source_`
+    void init_read();
+    /// Read more compressed data from the file into `input_`. Returns `false`
+    /// if we are at the end of the file.
+    bool read_input();
+    /// Get the position in the compressed file of the next byte that will be
+    /// used by zlib
+    uint64_t compressed_position() const;
+    /// Start inflating the file again from the start of the compressed file
+    void restart();
+    /// Start inflating the file again at the given `checkpoint`
+    void restart(const checkpoint& checkpoint);
+    /// Deal with the end of a gzip member: check for another member after
+    /// this one and prepare to read it. Returns `false` if there are no more
+    /// members in the file.
+    bool next_member();
+    /// Record a checkpoint at the current position if the stream is at a
+    /// deflate block boundary, and we are far enough from the last checkpoint
+    void maybe_add_checkpoint();
+    /// Load the checkpoints for the file at `path` from the sidecar file, if
+    /// frame index files are enabled
+    void load_checkpoints(const std::string& path);
+    /// Save the checkpoints to the sidecar file, once the whole file has
+    /// been decompressed
+    void save_checkpoints();
+
+    /// Underlying compressed file, used for writing
+    std::FILE* file_ = nullptr;
+    /// Mode used to open the file
+    File::Mode mode_;
+    /// Source of compressed data, used for reading
+    std::unique_ptr<InputSource> source_;
+    /// Is the file a plain file, not a gzip file? zlib allows to read
+    /// non-compressed files transparently, and so do we.
+    bool transparent_ = false;
+    /// zlib stream used for reading
+    std::unique_ptr<z_stream_s> stream_;
+    /// Is `stream_` inflating raw deflate data (after restarting from a
+    /// checkpoint), or a full gzip member with headers?
+    bool raw_ = false;
+    /// Did we reach the end of the last member in the file?
+    bool stream_end_ = false;
+    /// Compressed data buffer, straight out from the file
+    std::vector<unsigned char> input_;
+    /// Position in the compressed file of the end of the data in `input_`
+    uint64_t input_end_ = 0;
+    /// Position in the uncompressed data
+    uint64_t position_ = 0;
+    /// List of known checkpoints, sorted by uncompressed position
+    std::vector<checkpoint> checkpoints_;
+    /// Sidecar file in which to save the checkpoints, or `nullptr` if they
+    /// should not be saved
+    std::unique_ptr<FrameIndex> checkpoints_index_;
 
-    gzFile file_ = nullptr;
+    /// Uncompressed data waiting to be compressed when writing
+    std::vector<char> chunk_;
+    /// Gzip members being compressed in the background, in file order
+    std::deque<std::future<std::vector<unsigned char>>> compressing_;
+    /// Did we write at least one member to the file?
+    bool written_ = false;
 };
 
 /// Inflates GZipped data from the `src` buffer
@@ -0,0 +1,65 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_INPUT_SOURCE_HPP
+#define CHEMFILES_INPUT_SOURCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "chemfiles/external/optional.hpp"
+
+namespace chemfiles {
+class MemoryBuffer;
+
+/// Source of compressed data for the `TextFileImpl` reading compressed files.
+/// The data comes either from a file on disk or from a `MemoryBuffer`, and the
+/// interface mirrors the one of `std::FILE*`.
+class InputSource final {
+public:
+    /// Open the file at `path` for reading
+    ///
+    /// @throws FileError if the file can not be opened
+    explicit InputSource(const std::string& path);
+    /// Read data from the given `memory` buffer. The buffer is not copied.
+    explicit InputSource(std::shared_ptr<MemoryBuffer> memory);
+    ~InputSource();
+
+    InputSource(InputSource&&) = delete;
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(InputSource&&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+
+    /// Read up to `count` bytes into `data`, and return the number of bytes
+    /// actually read.
+    size_t read(void* data, size_t count);
+    /// Set the position of the next read to `position` bytes after the start
+    /// of the data. Returns `false` on error, with `errno` set accordingly.
+    bool seek(uint64_t position);
+    /// Get the total size of the data, if it is available
+    optional<uint64_t> size();
+
+    /// Did we reach the end of the data?
+    bool eof() const;
+    /// Did an error occurred during the last read?
+    bool error() const;
+    /// Clear end of file and error flags
+    void clear() noexcept;
+
+private:
+    /// File to read from, or `nullptr` when reading from memory
+    std::FILE* file_ = nullptr;
+    /// Memory to read from, or `nullptr` when reading from a file
+    std::shared_ptr<MemoryBuffer> memory_;
+    /// Current position in `memory_`
+    size_t position_ = 0;
+    /// Did we reach the end of `memory_`?
+    bool eof_ = false;
+};
+
+} // namespace chemfiles
+
+#endif
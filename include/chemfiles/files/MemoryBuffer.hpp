@@ -14,6 +14,7 @@ class MemoryBuffer;
 MemoryBuffer decompress_xz(const char*, size_t);
 MemoryBuffer decompress_gz(const char*, size_t);
 MemoryBuffer decompress_bz2(const char*, size_t);
+MemoryBuffer decompress_zstd(const char*, size_t);
 
 /// A class for handling memory passed directly instead of through a file
 /// handle. Unlike a `std::vector`, it does not assume ownership of the data
@@ -53,8 +54,14 @@ public:
         return ptr_;
     }
 
+    /// Write `size` bytes from `data` at the end of the buffer
     void write(const char* data, size_t size);
 
+    /// Write `size` bytes from `data` starting at `position` in the buffer,
+    /// overwriting any existing data. If `position` is after the end of the
+    /// buffer, the gap is filled with zeros.
+    void write_at(size_t position, const char* data, size_t size);
+
     /// Try to decompress the content of this buffer with the given
     /// `compression` format
     void decompress(File::Compression compression);
@@ -81,6 +88,7 @@ private:
     friend MemoryBuffer chemfiles::decompress_xz(const char*, size_t);
     friend MemoryBuffer chemfiles::decompress_gz(const char*, size_t);
     friend MemoryBuffer chemfiles::decompress_bz2(const char*, size_t);
+    friend MemoryBuffer chemfiles::decompress_zstd(const char*, size_t);
 
     /// Start of the memory buffer
     char* ptr_;
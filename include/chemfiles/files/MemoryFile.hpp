@@ -8,13 +8,18 @@
 #include <cstddef>
 #include <memory>
 #include <utility>
+#include <string_view>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/external/optional.hpp"
 
 namespace chemfiles {
 class MemoryBuffer;
 
-/// Simple TextFile implementation, that wraps memory for reading only.
+/// Simple TextFile implementation, that wraps memory for reading or writing.
+///
+/// When reading, `TextFile` uses the memory directly through
+/// `MemoryFile::data`, without copying it to an intermediary buffer.
 class MemoryFile final: public TextFileImpl {
 public:
     /// Open `memory` as though it were a file in mode `mode`. No copy of `memory` is
@@ -29,6 +34,8 @@ public:
     void clear() noexcept override {}
     void seek(uint64_t position) override;
 
+    optional<std::string_view> data() const override;
+
 private:
     /// Current reading location
     size_t current_location_ = 0;
@@ -0,0 +1,72 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_MMAP_FILES_HPP
+#define CHEMFILES_MMAP_FILES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "chemfiles/File.hpp"
+#include "chemfiles/external/optional.hpp"
+
+#if defined(__unix__) || (defined(__APPLE__) && defined(__MACH__))
+    // use mmap on posix
+    #define CHEMFILES_TEXT_FILE_USE_MMAP 1
+#else
+    #define CHEMFILES_TEXT_FILE_USE_MMAP 0
+#endif
+
+namespace chemfiles {
+
+/// TextFileImpl reading plain, uncompressed files by mapping the whole file in
+/// memory. `TextFile` uses the mapping directly through `MmapFile::data`,
+/// without copying the file content to an intermediary buffer.
+///
+/// This is only available for reading, and on platforms supporting `mmap`.
+///
+/// The mapping covers the size of the file when it was opened. Files growing
+/// after this (for example a trajectory still being written by a simulation)
+/// are detected with `grown`, and `TextFile` then continues reading them with
+/// `PlainFile`. Truncating the file while it is mapped is not supported, and
+/// accessing the removed data will crash the process with `SIGBUS`.
+class MmapFile final: public TextFileImpl {
+public:
+    /// Map the file at `path` in memory for reading.
+    ///
+    /// @throws FileError if the file can not be opened or mapped
+    MmapFile(const std::string& path);
+    ~MmapFile() override;
+
+    /// Check if the file at `path` can be memory mapped, i.e. if it exists, is
+    /// a regular file (and not a pipe or a character device), and fits in the
+    /// address space.
+    static bool can_map(const std::string& path);
+
+    /// Check if the file is now larger than when it was mapped
+    bool grown() const;
+
+    size_t read(char* data, size_t count) override;
+    void write(const char* data, size_t count) override;
+
+    void clear() noexcept override {}
+    void seek(uint64_t position) override;
+
+    optional<std::string_view> data() const override {
+        return std::string_view(data_, size_);
+    }
+
+private:
+    /// Start of the mapped memory
+    const char* data_ = nullptr;
+    /// Size of the file/mapped memory
+    size_t size_ = 0;
+    /// Current position for calls to `read`
+    size_t current_ = 0;
+};
+
+} // namespace chemfiles
+
+#endif
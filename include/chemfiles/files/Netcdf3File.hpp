@@ -241,6 +241,36 @@ public:
     template<typename T>
     void read(size_t step, T* data, size_t count);
 
+    /// read the content of this variable for the steps from `step_begin` up
+    /// to (and excluding) `step_end`, taking one step every `stride`. The
+    /// values for each step are stored one after the other in the `data`
+    /// vector. If this variable is not a record variable, `step_begin` must be
+    /// 0 and `step_end` must be 1.
+    ///
+    /// @throws if the vector type does not match this variable type
+    template<typename T>
+    void read(size_t step_begin, size_t step_end, size_t stride, std::vector<T>& data) {
+        data.resize(this->n_steps(step_begin, step_end, stride) * this->layout_.count());
+        this->read(step_begin, step_end, stride, data.data(), data.size());
+    }
+
+    /// read the content of this variable for the steps from `step_begin` up
+    /// to (and excluding) `step_end`, taking one step every `stride`, writing
+    /// values from `data` to `data + count`. The values for each step are
+    /// stored one after the other. If this variable is not a record variable,
+    /// `step_begin` must be 0 and `step_end` must be 1.
+    ///
+    /// Since the values of record variables are interleaved in the file,
+    /// this loads the full records for all the requested steps in memory in a
+    /// single pass over the file. The records are kept until the next call
+    /// with different steps, so reading other variables for the same steps
+    /// does not access the file again.
+    ///
+    /// @throws if `count` does not match the number of values in all steps
+    /// @throws if the pointer type does not match this variable type
+    template<typename T>
+    void read(size_t step_begin, size_t step_end, size_t stride, T* data, size_t count);
+
     /// write the content of `data` to this variable at the given `step`. If
     /// this variable is not a record variable `step` must be 0.
     ///
@@ -266,6 +296,10 @@ private:
     /// record variable `step` must be 0.
     void write_fill_value(size_t step);
 
+    /// Get the number of steps from `step_begin` to `step_end` with the given
+    /// `stride`, checking that all of them are inside the file
+    size_t n_steps(size_t step_begin, size_t step_end, size_t stride) const;
+
     friend class Netcdf3File;
     friend class Netcdf3Builder;
     Variable(
@@ -292,6 +326,10 @@ extern template void Variable::read(size_t step, int32_t* data, size_t count);
 extern template void Variable::read(size_t step, float* data, size_t count);
 extern template void Variable::read(size_t step, double* data, size_t count);
 
+extern template void Variable::read(size_t step_begin, size_t step_end, size_t stride, int32_t* data, size_t count);
+extern template void Variable::read(size_t step_begin, size_t step_end, size_t stride, float* data, size_t count);
+extern template void Variable::read(size_t step_begin, size_t step_end, size_t stride, double* data, size_t count);
+
 extern template void Variable::write(size_t step, const char* data, size_t count);
 extern template void Variable::write(size_t step, const int32_t* data, size_t count);
 extern template void Variable::write(size_t step, const float* data, size_t count);
@@ -312,6 +350,8 @@ extern template void Variable::write(size_t step, const double* data, size_t cou
 class Netcdf3File: public BigEndianFile {
 public:
     Netcdf3File(std::string filename, File::Mode mode);
+    /// Use the given `memory` buffer as the file content
+    Netcdf3File(std::shared_ptr<MemoryBuffer> memory, File::Mode mode);
     ~Netcdf3File() override;
 
     // disable moving/copying Netcdf3File since Variable instances take a
@@ -384,6 +424,15 @@ private:
     void write_attribute_value(const Value& value);
     /// read the header for all variables
     void read_variables();
+    /// read the file header, if the file is not empty
+    void read_header();
+    /// compute `record_size_` and `records_begin_` from the variables
+    void compute_record_layout();
+
+    /// Load the full records for the `n_steps` steps starting at `step_begin`
+    /// and taking one step every `stride` in `records_`, reading each record
+    /// only once. This does nothing if these records are already loaded.
+    void load_records(size_t step_begin, size_t stride, size_t n_steps);
 
     /// whether the file uses 32 or 64-bi variables in the headerr
     bool use_64bit_header_ = false;
@@ -391,6 +440,20 @@ private:
     uint64_t n_records_ = 0;
     /// size in bytes of a full record entry, including all record variables
     uint64_t record_size_ = 0;
+    /// offset in the file of the first record
+    uint64_t records_begin_ = 0;
+
+    /// Full records loaded by `load_records`, the `i`-th loaded record
+    /// starting at `i * record_size_`
+    struct {
+        size_t step_begin = 0;
+        size_t stride = 0;
+        size_t n_steps = 0;
+        /// raw data for the records
+        std::vector<char> buffer;
+        /// file reading from `buffer`
+        std::unique_ptr<BigEndianFile> data;
+    } records_;
 
     /// list of dimensions in this file
     std::vector<std::shared_ptr<Dimension>> dimensions_;
@@ -402,6 +465,7 @@ private:
     // was this file initialized?
     bool initialized_ = false;
 
+    friend class Variable;
     friend class Netcdf3Builder;
 };
 
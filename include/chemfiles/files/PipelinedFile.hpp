@@ -0,0 +1,94 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_PIPELINED_FILES_HPP
+#define CHEMFILES_PIPELINED_FILES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/File.hpp"
+
+namespace chemfiles {
+
+/// TextFileImpl decorator reading another `TextFileImpl` on a background
+/// thread. This is used with compressed files, so that decompression happens
+/// on the background thread while the main thread parses the data.
+///
+/// The background thread fills a bounded set of buffers, which are then
+/// consumed by calls to `read`. Seeking discards all buffers and restarts the
+/// background reads from the new position. This is only available for
+/// reading.
+class PipelinedFile final: public TextFileImpl {
+public:
+    /// Read `file` (opened from `path`) on a background thread
+    PipelinedFile(const std::string& path, std::unique_ptr<TextFileImpl> file);
+    ~PipelinedFile() override;
+
+    size_t read(char* data, size_t count) override;
+    void write(const char* data, size_t count) override;
+
+    void clear() noexcept override;
+    void seek(uint64_t position) override;
+
+private:
+    /// A buffer filled by the background thread
+    struct chunk {
+        std::vector<char> data;
+        /// number of valid bytes in `data`
+        size_t size;
+    };
+
+    /// Main function of the background thread
+    void run();
+
+    /// The file we are reading from. This is only used by the background
+    /// thread after construction.
+    std::unique_ptr<TextFileImpl> file_;
+
+    /// Chunk currently being consumed by `read`
+    chunk current_;
+    /// Position of the next byte to read in `current_`
+    size_t current_position_ = 0;
+
+    /// Mutex protecting all the members below
+    std::mutex mutex_;
+    /// Used to wake up the background thread
+    std::condition_variable producer_;
+    /// Used to wake up the thread calling `read`
+    std::condition_variable consumer_;
+    /// Chunks filled by the background thread, ready to be consumed
+    std::deque<chunk> ready_;
+    /// Empty buffers available for the background thread
+    std::vector<std::vector<char>> free_;
+    /// Did the background thread reach the end of the file?
+    bool eof_ = false;
+    /// Error raised on the background thread, to be re-thrown by `read`
+    std::exception_ptr error_;
+    /// Should the background thread call `file_->clear()`?
+    bool clear_pending_ = false;
+    /// Should the background thread seek to `seek_position_`?
+    bool seek_pending_ = false;
+    uint64_t seek_position_ = 0;
+    /// Incremented on each call to `seek`, to discard data read from the old
+    /// position
+    uint64_t generation_ = 0;
+    /// Should the background thread stop?
+    bool stop_ = false;
+
+    /// The background thread itself. This must be the last member, to only
+    /// start the thread after everything else is initialized.
+    std::thread thread_;
+};
+
+} // namespace chemfiles
+
+#endif
@@ -24,6 +24,7 @@ public:
 
     void clear() noexcept override;
     void seek(uint64_t position) override;
+    void close() override;
 
 private:
     std::FILE* file_;
@@ -0,0 +1,54 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_STREAM_FILES_HPP
+#define CHEMFILES_STREAM_FILES_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include "chemfiles/File.hpp"
+
+namespace chemfiles {
+
+/// TextFile implementation reading from or writing to user-provided
+/// callbacks, for example to use data coming from a pipe or a socket.
+///
+/// Streams can not be rewound: the only valid call to `seek` is a call with
+/// the current position.
+class StreamFile final: public TextFileImpl {
+public:
+    /// Function reading at most `count` bytes into `data`, and returning the
+    /// number of bytes actually read. Returning 0 indicates the end of the
+    /// stream, and all further calls should also return 0.
+    using read_callback_t = std::function<size_t(char* data, size_t count)>;
+    /// Function writing exactly `count` bytes from `data`
+    using write_callback_t = std::function<void(const char* data, size_t count)>;
+
+    /// Create a stream in read mode, getting data from `read`
+    explicit StreamFile(read_callback_t read)
+        : TextFileImpl("<stream>"), read_(std::move(read))
+    {}
+
+    /// Create a stream in write mode, sending data to `write`
+    explicit StreamFile(write_callback_t write)
+        : TextFileImpl("<stream>"), write_(std::move(write))
+    {}
+
+    size_t read(char* data, size_t count) override;
+    void write(const char* data, size_t count) override;
+
+    void clear() noexcept override {}
+    void seek(uint64_t position) override;
+
+private:
+    read_callback_t read_;
+    write_callback_t write_;
+    /// Number of bytes read or written so far
+    uint64_t position_ = 0;
+};
+
+} // namespace chemfiles
+
+#endif
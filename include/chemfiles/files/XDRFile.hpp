@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 #include <string>
 #include <vector>
@@ -13,6 +14,7 @@
 #include "chemfiles/File.hpp"
 
 #include "chemfiles/files/BinaryFile.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 
 namespace chemfiles {
 class UnitCell;
@@ -23,6 +25,7 @@ class UnitCell;
 class XDRFile final : public BigEndianFile {
   public:
     XDRFile(std::string path, File::Mode mode);
+    XDRFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode);
     XDRFile(XDRFile&& other) noexcept = default;
     XDRFile& operator=(XDRFile&& other) = default;
     ~XDRFile() noexcept override = default;
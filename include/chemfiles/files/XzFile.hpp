@@ -4,23 +4,42 @@
 #ifndef CHEMFILES_XZ_FILES_HPP
 #define CHEMFILES_XZ_FILES_HPP
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <lzma.h>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/files/BackgroundTask.hpp"
+#include "chemfiles/files/InputSource.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
 
 namespace chemfiles {
 
 /// An implementation of TextFile for lzma/xz files
+///
+/// When reading files containing multiple blocks (as created by `xz -T` or
+/// `xz --block-size`), this class uses the index at the end of the file to
+/// seek directly to the block containing a given position, and decompresses
+/// the following blocks in advance on a few background threads owned by the
+/// file. Other files are read with a single streaming decoder.
+///
+/// When writing more than 8 MiB of data, the data is split in blocks which
+/// are compressed independently on background threads, and the block index
+/// is written at the end of the file. Smaller files are compressed with a
+/// single streaming encoder.
 class XzFile final: public TextFileImpl {
 public:
     /// Open a text file with name `filename` and mode `mode`.
     XzFile(const std::string& path, File::Mode mode);
+    /// Read xz compressed data from `memory`, decompressing it as needed
+    XzFile(std::shared_ptr<MemoryBuffer> memory);
     ~XzFile() override;
 
     size_t read(char* data, size_t count) override;
@@ -28,19 +47,117 @@ public:
 
     void clear() noexcept override;
     void seek(uint64_t position) override;
+    void close() override;
 
 private:
     /// Compress data from stream_.next_in, and write the data to the file.
     /// If action==LZMA_FINISH, continue writing until everything has been
     /// processed.
     void compress_and_write(lzma_action action);
+    /// Prepare to read the data in `source_`
+    void init_read();
 
+    /// Information about a single block in a multi-block file
+    struct block {
+        /// offset of the block (including the block header) in the file
+        uint64_t compressed_offset;
+        /// total size of the block in the file, including header, padding
+        /// and integrity check
+        uint64_t compressed_size;
+        /// size of the block without the padding, used to validate the block
+        /// header
+        uint64_t unpadded_size;
+        /// offset of the block in the uncompressed data
+        uint64_t uncompressed_offset;
+        /// size of the decompressed block
+        uint64_t uncompressed_size;
+        /// integrity check used by the stream containing this block
+        lzma_check check;
+    };
+
+    /// Try to read the block index at the end of the file, and fill `blocks_`
+    /// with the corresponding data. This returns `false` if the file should be
+    /// read with the streaming decoder instead.
+    bool read_index();
+    /// Read and decompress block `i` on the calling thread
+    std::vector<uint8_t> decompress(size_t i);
+    /// Start reading and decompressing block `i` on one of the `workers_`
+    BackgroundTask<std::vector<uint8_t>> start_decompression(size_t i);
+    /// Make block `i` the current block, using already decompressed data if
+    /// possible, and start decompressing the next blocks in the background.
+    /// Blocks already being decompressed are kept if they are still needed,
+    /// and the others are cancelled without waiting for them.
+    void load_block(size_t i);
+    /// Implementation of `read` when reading blocks independently
+    size_t read_blocks(char* data, size_t count);
+    /// Implementation of `seek` when reading blocks independently
+    void seek_blocks(uint64_t position);
+
+    /// A block compressed in the background when writing
+    struct compressed_block {
+        /// compressed data for the block, including header and check
+        std::vector<uint8_t> data;
+        /// size of the block without padding, stored in the index
+        lzma_vli unpadded_size;
+        /// size of the uncompressed data
+        lzma_vli uncompressed_size;
+    };
+
+    /// Write `count` bytes from `data` directly to the file
+    void write_data(const uint8_t* data, size_t count);
+    /// Start compressing the data in `chunk_` on a background thread
+    void start_compression();
+    /// Wait for the first block in `compressing_` and write it to the file
+    void write_block();
+    /// Compress and write all remaining data to the file
+    void finish();
+
+    /// Blocks in the file when reading multi-block files, this is empty when
+    /// using the streaming decoder
+    std::vector<block> blocks_;
+    /// Index of the block currently in `current_`
+    size_t current_block_ = 0;
+    /// Decompressed data for the current block
+    std::vector<uint8_t> current_;
+    /// Position of the next byte to read in `current_`
+    size_t block_position_ = 0;
+    /// Number of blocks to decompress in advance, limited by the number of
+    /// threads and the memory used by the blocks
+    size_t blocks_in_advance_ = 0;
+    /// Threads used to decompress blocks in advance. This must be declared
+    /// before `pending_`, so the pending tasks are cancelled before the
+    /// threads are joined.
+    std::unique_ptr<BackgroundWorkers> workers_;
+    /// Blocks being decompressed in the background. The first entry contains
+    /// the block after `current_block_`, the second the one after, etc.
+    std::deque<BackgroundTask<std::vector<uint8_t>>> pending_;
+
+    /// Uncompressed data waiting to be compressed when writing
+    std::vector<uint8_t> chunk_;
+    /// Blocks being compressed in the background, in file order
+    std::deque<std::future<compressed_block>> compressing_;
+    /// Index of the blocks already written to the file, or `nullptr` if we
+    /// did not start writing blocks yet
+    lzma_index* index_ = nullptr;
+
+    /// Underlying compressed file, used for writing
     FILE* file_ = nullptr;
     /// Store opening file mode
     File::Mode mode_;
+    /// Source of compressed data, used for reading
+    std::unique_ptr<InputSource> source_;
+    /// Compressed data when reading from memory, shared with the background
+    /// tasks. This is `nullptr` when reading from a file, and the background
+    /// tasks open the file again instead.
+    std::shared_ptr<MemoryBuffer> memory_;
     /// lzma stream used both for reading and writing. Reading is done using
     /// lzma_stream_decoder, and writing using lzma_easy_encoder.
     lzma_stream stream_ = LZMA_STREAM_INIT;
+    /// Action to use with the streaming decoder. This becomes `LZMA_FINISH`
+    /// once all the compressed data has been given to the decoder, and is
+    /// only reset by `seek`, since calling `clear` does not restart the
+    /// decoder.
+    lzma_action action_ = LZMA_RUN;
     /// compressed data buffer, straight out from the file when reading, to be
     /// written to the file when writing.
     std::vector<uint8_t> buffer_;
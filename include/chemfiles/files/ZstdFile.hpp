@@ -0,0 +1,101 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#ifndef CHEMFILES_ZSTD_FILES_HPP
+#define CHEMFILES_ZSTD_FILES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <zstd.h>
+#include <zstd_seekable.h>
+
+#include "chemfiles/File.hpp"
+#include "chemfiles/files/InputSource.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
+
+namespace chemfiles {
+
+/// An implementation of TextFile for Zstandard files
+///
+/// Files are written using the zstd seekable format: the data is split in
+/// independent frames of 1 MiB, and a seek table describing these frames is
+/// appended to the file in a skippable frame. Such files can be read by any
+/// zstd implementation.
+///
+/// When reading a file containing a seek table, seeking only decompresses the
+/// frame containing the requested position. Other files are read with a
+/// single streaming decoder, and seeking backward restarts decompression from
+/// the start of the file.
+class ZstdFile final: public TextFileImpl {
+public:
+    /// Open a text file with name `filename` and mode `mode`.
+    ZstdFile(const std::string& path, File::Mode mode);
+    /// Read zstd compressed data from `memory`, decompressing it as needed
+    ZstdFile(std::shared_ptr<MemoryBuffer> memory);
+    ~ZstdFile() override;
+
+    size_t read(char* data, size_t count) override;
+    void write(const char* data, size_t count) override;
+
+    void clear() noexcept override;
+    void seek(uint64_t position) override;
+    void close() override;
+
+private:
+    /// Prepare to read the data in `source_`
+    void init_read();
+    /// Implementation of `read` when using the streaming decoder
+    size_t read_stream(char* data, size_t count);
+    /// Implementation of `seek` when using the streaming decoder
+    void seek_stream(uint64_t position);
+
+    /// Write the `output_.pos` bytes in `buffer_` to the file
+    void write_output();
+    /// Compress and write all remaining data to the file, followed by the
+    /// seek table
+    void finish();
+
+    /// Store opening file mode
+    File::Mode mode_;
+    /// Underlying compressed file, used for writing
+    FILE* file_ = nullptr;
+    /// Source of compressed data, used for reading
+    std::unique_ptr<InputSource> source_;
+
+    /// Decoder for files with a seek table, or `nullptr` when using the
+    /// streaming decoder
+    ZSTD_seekable* seekable_ = nullptr;
+    /// Total size of the uncompressed data, when using `seekable_`
+    uint64_t size_ = 0;
+
+    /// Streaming decoder, used for files without a seek table
+    ZSTD_DCtx* stream_ = nullptr;
+    /// Compressed data from `buffer_` waiting to be decompressed by `stream_`
+    ZSTD_inBuffer input_ = {nullptr, 0, 0};
+    /// Did `stream_` finish decompressing a full frame, without any
+    /// remaining data?
+    bool frame_done_ = true;
+
+    /// Encoder used when writing, creating frames and the seek table
+    ZSTD_seekable_CStream* cstream_ = nullptr;
+    /// Compressed data in `buffer_` waiting to be written to the file
+    ZSTD_outBuffer output_ = {nullptr, 0, 0};
+
+    /// Position of the next byte to read in the uncompressed data
+    uint64_t position_ = 0;
+    /// compressed data buffer, straight out from the file when reading, to be
+    /// written to the file when writing.
+    std::vector<char> buffer_;
+};
+
+/// Decompress Zstandard data from the `src` buffer
+MemoryBuffer decompress_zstd(const char* src, size_t size);
+
+}
+
+#endif
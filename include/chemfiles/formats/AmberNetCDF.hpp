@@ -5,7 +5,9 @@
 #define CHEMFILES_FORMAT_AMBER_NETCDF_HPP
 
 #include <cstddef>
+#include <memory>
 #include <string>
+#include <functional>
 #include <vector>
 
 #include "chemfiles/File.hpp"
@@ -20,6 +22,7 @@ class Frame;
 class UnitCell;
 class Vector3D;
 class FormatMetadata;
+class MemoryBuffer;
 
 template <class T> class span;
 
@@ -27,9 +30,15 @@ template <class T> class span;
 class AmberNetCDFBase: public Format {
 public:
     AmberNetCDFBase(std::string convention, std::string path, File::Mode mode, File::Compression compression);
+    AmberNetCDFBase(std::string convention, std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     void read(Frame& frame) final;
     void read_at(size_t index, Frame& frame) final;
+    void read_batch(
+        const std::vector<size_t>& indices,
+        const std::function<void(size_t, Frame&)>& callback
+    ) final;
+    void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) final;
     void write(const Frame& frame) override;
 
 protected:
@@ -38,10 +47,13 @@ protected:
         double scale;
     };
 
-    /// read the unit cell at the current step
-    UnitCell read_cell();
-    /// read the values from the variable at the current internal step to the array
-    void read_array(variable_scale_t& variable, span<Vector3D> array);
+    /// read `frames.size()` steps into `frames`, starting at `step` and
+    /// taking one step every `stride`
+    void read_steps(size_t step, size_t stride, span<Frame> frames);
+    /// read the `count` values from the variable for the steps between
+    /// `step_begin` and `step_end` with the given `stride` to `output`,
+    /// converting them to double and applying the scale factor
+    void read_values(variable_scale_t& variable, size_t step_begin, size_t step_end, size_t stride, double* output, size_t count);
 
     /// write the unit cell at the current step
     void write_cell(const UnitCell& cell);
@@ -68,10 +80,13 @@ protected:
 
     std::vector<float> buffer_f32_;
     std::vector<double> buffer_f64_;
+    std::vector<double> buffer_angles_f64_;
 
     virtual void initialize(const Frame& frame) = 0;
 
 private:
+    /// Check the compression and the content of `file_` after opening it
+    void open(File::Compression compression);
     /// Validate the common bits between AMBER and AMBERRESTART conventions
     void validate_common();
 
@@ -82,6 +97,7 @@ private:
 class AmberTrajectory final: public AmberNetCDFBase {
 public:
     AmberTrajectory(std::string path, File::Mode mode, File::Compression compression);
+    AmberTrajectory(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     size_t size() override;
     void initialize(const Frame& frame) override;
@@ -94,6 +110,7 @@ private:
 class AmberRestart final: public AmberNetCDFBase {
 public:
     AmberRestart(std::string path, File::Mode mode, File::Compression compression);
+    AmberRestart(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     void write(const Frame& frame) override;
     size_t size() override;
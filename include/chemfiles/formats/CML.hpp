@@ -39,9 +39,12 @@ public:
     void read(Frame& frame) override;
     void write(const Frame& frame) override;
     size_t size() override;
+    void close() override;
 private:
     /// Initialize the document and root objects
     void init_();
+    /// Write the document to the file, if needed
+    void save_document();
 
     /// Read the atoms from `atoms` into `frame`
     void read_atoms(Frame& frame, const pugi::xml_node& atoms);
@@ -63,6 +66,8 @@ private:
 
     /// Number of frames added to the file
     size_t num_added_ = 0;
+    /// Was the document already written to the file by `close`?
+    bool saved_ = false;
 
     /// Atomic reference to atomic id in the current frame
     std::unordered_map<std::string, size_t> ref_to_id_;
@@ -10,6 +10,7 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Format.hpp"
@@ -20,6 +21,7 @@
 namespace chemfiles {
 
 class Frame;
+class MemoryBuffer;
 class UnitCell;
 class Vector3D;
 class FormatMetadata;
@@ -57,13 +59,19 @@ class FormatMetadata;
 class DCDFormat final: public Format {
 public:
     DCDFormat(std::string path, File::Mode mode, File::Compression compression);
+    DCDFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     size_t size() override;
     void read(Frame& frame) override;
+    void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) override;
+    bool supports_in_place_read() const override;
     void read_at(size_t index, Frame& frame) override;
+    void read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) override;
     void write(const Frame& frame) override;
 
 private:
+    /// Read the header (or prepare for writing) once `file_` is open
+    void initialize(File::Mode mode);
 
     /****** low-level function to read fortran unformatted binary files ******/
     // read a single record size marker from the file. Each record (single
@@ -78,8 +86,14 @@ private:
     /************ high level function specialized for DCD format **************/
     /// read & parse the file header
     void read_header();
+    /// go to the frame at `index` in the file, and prefetch the next one
+    /// when reading sequentially
+    void seek_frame(size_t index);
+    /// read the frame at `index_` from the current position in the file
+    void read_frame(Frame& frame);
     UnitCell read_cell();
-    void read_positions(Frame& frame);
+    /// read the coordinates of all atoms for the current frame in `positions`
+    void read_coordinates(span<Vector3D> positions);
     void read_fixed_coordinates();
 
     void write_header();
@@ -12,6 +12,8 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+#include <string_view>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Format.hpp"
@@ -23,25 +25,43 @@ class Frame;
 class MemoryBuffer;
 class FormatMetadata;
 
+/// Per-atom field in the ATOMS section of a LAMMPS dump file
+struct AtomField;
+
 /// LAMMPS Atom file format reader and writer.
 class LAMMPSTrajectoryFormat final : public TextFormat {
   public:
-    LAMMPSTrajectoryFormat(std::string path, File::Mode mode, File::Compression compression)
-        : TextFormat(std::move(path), mode, compression) {}
-
+    LAMMPSTrajectoryFormat(std::string path, File::Mode mode, File::Compression compression);
     LAMMPSTrajectoryFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode,
-                     File::Compression compression)
-        : TextFormat(std::move(memory), mode, compression) {}
+                     File::Compression compression);
+    LAMMPSTrajectoryFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode);
+    ~LAMMPSTrajectoryFormat() override;
 
     void read_next(Frame& frame) override;
+    bool supports_in_place_read() const override;
     void write_next(const Frame& frame) override;
     optional<uint64_t> forward() override;
+    bool supports_parallel_scan() const override;
+    bool is_scan_marker(std::string_view line) const override;
+    std::vector<uint64_t> frames_from_markers(uint64_t start, const std::vector<scan_marker>& markers) override;
 
   private:
     std::array<double, 3> read_cell(Frame& frame);
+    /// Update `fields_` from the content of the `ITEM: ATOMS` header, and
+    /// check if the fields are the same as in the previous step
+    bool update_fields(std::string_view item);
+
     size_t min_numeric_type_ = 0;
     size_t max_numeric_type_ = 0;
     std::unordered_map<std::string, size_t> type_list_;
+
+    /// Per-atom fields in the last step read
+    std::vector<AtomField> fields_;
+    /// Buffers reused between lines and steps when reading, to prevent
+    /// allocations in `read_next`
+    std::vector<std::string_view> tokens_;
+    std::vector<bool> duplicate_check_;
+    std::vector<std::array<int, 3>> images_;
 };
 
 template <> const FormatMetadata& format_metadata<LAMMPSTrajectoryFormat>();
@@ -31,6 +31,9 @@ public:
     MOL2Format(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) :
         TextFormat(std::move(memory), mode, compression) {}
 
+    MOL2Format(std::unique_ptr<TextFileImpl> stream, File::Mode mode) :
+        TextFormat(std::move(stream), mode) {}
+
     void read_next(Frame& frame) override;
     void write_next(const Frame& frame) override;
     optional<uint64_t> forward() override;
@@ -53,11 +53,19 @@ public:
     PDBFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) :
         TextFormat(std::move(memory), mode, compression) {}
 
+    PDBFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode) :
+        TextFormat(std::move(stream), mode) {}
+
     ~PDBFormat() override;
 
     void read_next(Frame& frame) override;
+    bool supports_in_place_read() const override;
     void write_next(const Frame& frame) override;
     optional<uint64_t> forward() override;
+    bool supports_parallel_scan() const override;
+    bool is_scan_marker(std::string_view line) const override;
+    std::vector<uint64_t> frames_from_markers(uint64_t start, const std::vector<scan_marker>& markers) override;
+    void close() override;
 
     // Connect residues based on a predefined table
     static void link_standard_residue_bonds(Frame& frame);
@@ -27,6 +27,9 @@ public:
     SDFFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) :
         TextFormat(std::move(memory), mode, compression) {}
 
+    SDFFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode) :
+        TextFormat(std::move(stream), mode) {}
+
     void read_next(Frame& frame) override;
     void write_next(const Frame& frame) override;
     optional<uint64_t> forward() override;
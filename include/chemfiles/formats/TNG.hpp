@@ -26,6 +26,7 @@ public:
 
     void read_at(size_t index, Frame& frame) override;
     void read(Frame& frame) override;
+    using Format::read_positions;
     size_t size() override;
 private:
     void read_positions(Frame& frame);
@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 #include <string>
 #include <vector>
@@ -17,6 +18,7 @@
 
 namespace chemfiles {
 class Frame;
+class MemoryBuffer;
 class FormatMetadata;
 
 /// GROMACS TPR file format reader.
@@ -27,12 +29,16 @@ class FormatMetadata;
 class TPRFormat final : public Format {
   public:
     TPRFormat(std::string path, File::Mode mode, File::Compression compression);
+    TPRFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     void read_at(size_t index, Frame& frame) override;
     void read(Frame& frame) override;
     size_t size() override;
 
   private:
+    /// Shared implementation of the constructors, using an already opened file
+    TPRFormat(XDRFile file, File::Compression compression);
+
     // Since GROMACS 2020 (TPR version 119) the way the body is deserialized changes.
     // For `FileIOXdr` see <GMX>/src/gromacs/fileio/gmxfio_xdr.cpp
     // and <GMX>/src/gromacs/fileio/gmx_internal_xdr.cpp
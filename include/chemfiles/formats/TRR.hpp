@@ -6,30 +6,50 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/types.hpp"
 #include "chemfiles/Format.hpp"
 
+#include "chemfiles/external/optional.hpp"
+
 #include "chemfiles/files/XDRFile.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
 
 namespace chemfiles {
 class Frame;
+class MemoryBuffer;
 class FormatMetadata;
 
 /// GROMACS TRR file format reader.
 class TRRFormat final : public Format {
   public:
     TRRFormat(std::string path, File::Mode mode, File::Compression compression);
+    TRRFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     void read_at(size_t index, Frame& frame) override;
+    void read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) override;
     void read(Frame& frame) override;
+    void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) override;
+    bool supports_in_place_read() const override;
+    std::unique_ptr<Format> open_cursor(const std::function<std::unique_ptr<Format>()>& create) override;
     void write(const Frame& frame) override;
     size_t size() override;
 
   private:
+    /// Shared implementation of the constructors, using an already opened
+    /// file. When reading, the frame positions are loaded from `frame_index`
+    /// if it is up to date, and saved there after scanning the file otherwise.
+    TRRFormat(XDRFile file, File::Compression compression, optional<FrameIndex> frame_index = nullopt);
+    /// Create a new reader for `file`, using already known frame positions
+    /// and number of atoms
+    TRRFormat(XDRFile file, std::vector<uint64_t> frame_positions, size_t natoms);
+
     struct FrameHeader {
         bool use_double;  /* Double precision?                                  */
         size_t ir_size;   /* Backward compatibility                             */
@@ -50,6 +70,10 @@ class TRRFormat final : public Format {
         double lambda; /* Current value of lambda (float or double) */
     };
 
+    /// Read the frame at the current position in the file
+    void read_frame(Frame& frame);
+    /// Ask the file to load the frame after `index_` in advance
+    void prefetch_next_frame();
     /// Read header of the Frame at the current position
     FrameHeader read_frame_header();
     /// Write header of a Frame
@@ -66,6 +90,8 @@ class TRRFormat final : public Format {
     size_t index_ = 0;
     /// The number of atoms in the trajectory
     size_t natoms_ = 0;
+    /// Buffer for the forces, reused between frames
+    std::vector<Vector3D> forces_;
 };
 
 template <> const FormatMetadata& format_metadata<TRRFormat>();
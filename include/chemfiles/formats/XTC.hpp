@@ -6,30 +6,49 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 #include <string>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Format.hpp"
 
+#include "chemfiles/external/optional.hpp"
+
 #include "chemfiles/files/XDRFile.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
 
 namespace chemfiles {
 class Frame;
+class MemoryBuffer;
 class FormatMetadata;
 
 /// GROMACS XTC file format reader.
 class XTCFormat final : public Format {
   public:
     XTCFormat(std::string path, File::Mode mode, File::Compression compression);
+    XTCFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression);
 
     void read_at(size_t index, Frame& frame) override;
+    void read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) override;
     void read(Frame& frame) override;
+    void read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) override;
+    bool supports_in_place_read() const override;
+    std::unique_ptr<Format> open_cursor(const std::function<std::unique_ptr<Format>()>& create) override;
     void write(const Frame& frame) override;
     size_t size() override;
 
   private:
+    /// Shared implementation of the constructors, using an already opened
+    /// file. When reading, the frame positions are loaded from `frame_index`
+    /// if it is up to date, and saved there after scanning the file otherwise.
+    XTCFormat(XDRFile file, File::Compression compression, optional<FrameIndex> frame_index = nullopt);
+    /// Create a new reader for `file`, using already known frame positions
+    /// and number of atoms
+    XTCFormat(XDRFile file, std::vector<uint64_t> frame_positions, size_t natoms);
+
     struct FrameHeader {
         int32_t magic; // Magic number indicating the file format
         size_t natoms; // The total number of atoms
@@ -38,6 +57,13 @@ class XTCFormat final : public Format {
         bool is_long_format() const;
     };
 
+    /// Read the frame at the current position in the file
+    void read_frame(Frame& frame);
+    /// Read the coordinates of a frame with the given `header` into
+    /// `positions`, returning the precision for compressed coordinates
+    optional<float> read_coordinates(const FrameHeader& header, span<Vector3D> positions);
+    /// Ask the file to load the frame after `index_` in advance
+    void prefetch_next_frame();
     /// Read header of the Frame at the current position
     FrameHeader read_frame_header();
     /// Write header of a Frame
@@ -57,6 +83,8 @@ class XTCFormat final : public Format {
     size_t index_ = 0;
     /// The number of atoms in the trajectory
     size_t natoms_ = 0;
+    /// Buffer for the decompressed coordinates, reused between frames
+    std::vector<float> coordinates_;
 };
 
 template <> const FormatMetadata& format_metadata<XTCFormat>();
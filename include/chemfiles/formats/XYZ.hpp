@@ -9,7 +9,9 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <utility>
+#include <string_view>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Format.hpp"
@@ -33,9 +35,17 @@ public:
     XYZFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) :
         TextFormat(std::move(memory), mode, compression){}
 
+    XYZFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode) :
+        TextFormat(std::move(stream), mode) {}
+
     void read_next(Frame& frame) override;
+    bool supports_in_place_read() const override;
+    void read_next_positions(span<Vector3D> positions) override;
     void write_next(const Frame& frame) override;
     optional<uint64_t> forward() override;
+    bool supports_parallel_scan() const override;
+    bool is_scan_marker(std::string_view line) const override;
+    std::vector<uint64_t> frames_from_markers(uint64_t start, const std::vector<scan_marker>& markers) override;
 
 private:
     // used to give better error message in `forward`, this refers to the
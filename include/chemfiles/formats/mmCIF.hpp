@@ -42,6 +42,7 @@ public:
     void read(Frame& frame) override;
     void write(const Frame& frame) override;
     size_t size() override;
+    void close() override;
 private:
     /// Initialize important variables
     void init_();
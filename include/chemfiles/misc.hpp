@@ -27,6 +27,24 @@ typedef std::function<void(const std::string& message)> warning_callback_t; // N
 /// @param callback callback function that will be called on each warning
 void CHFL_EXPORT set_warning_callback(warning_callback_t callback);
 
+/// Enable or disable the use of frame index files. The default is to not use
+/// them.
+///
+/// When enabled, the positions of all the frames found when scanning a
+/// trajectory file for reading are saved next to the file, in
+/// `<path>.chfl-idx`. The next time the same file is opened, the positions are
+/// loaded from this index instead of scanning the file again. The index
+/// records the size, modification time and a hash of the start of the
+/// trajectory, and is ignored if the trajectory changed since the index was
+/// created.
+///
+/// Index files are used by text formats (for uncompressed and compressed
+/// files), and by the XTC and TRR formats. The checkpoints used to seek inside
+/// gzip-compressed files are saved in the same way, in `<path>.chfl-gzidx`.
+///
+/// @param enabled whether frame index files should be used
+void CHFL_EXPORT set_frame_index(bool enabled);
+
 /// Get the list of formats chemfiles knows about, and all associated metadata
 ///
 /// @example{formats_list.cpp}
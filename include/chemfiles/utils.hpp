@@ -13,9 +13,10 @@
 namespace chemfiles {
 
 /// Split `string` into components delimited by `delim`, ignoring empty
-/// components.
-inline std::vector<std::string_view> split(std::string_view string, char delim) {
-    std::vector<std::string_view> elems;
+/// components, and store them in `elems`. This reuses the memory already
+/// allocated by `elems`.
+inline void split(std::string_view string, char delim, std::vector<std::string_view>& elems) {
+    elems.clear();
     size_t last = 0;
     for (size_t i = 0; i<string.length(); i++) {
         if (string[i] == delim) {
@@ -30,7 +31,13 @@ inline std::vector<std::string_view> split(std::string_view string, char delim)
     if (last < string.length()) {
         elems.push_back(string.substr(last, string.length() - last));
     }
+}
 
+/// Split `string` into components delimited by `delim`, ignoring empty
+/// components.
+inline std::vector<std::string_view> split(std::string_view string, char delim) {
+    std::vector<std::string_view> elems;
+    split(string, delim, elems);
     return elems;
 }
 
@@ -2,6 +2,7 @@
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <memory>
@@ -9,30 +10,46 @@
 #include <utility>
 #include <vector>
 #include <iterator>
+#include <exception>
+#include <algorithm>
 #include <string_view>
+#include <thread>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/files/GzFile.hpp"
 #include "chemfiles/files/XzFile.hpp"
 #include "chemfiles/files/Bz2File.hpp"
+#include "chemfiles/files/ZstdFile.hpp"
 #include "chemfiles/files/PlainFile.hpp"
 #include "chemfiles/files/MemoryFile.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
+#include "chemfiles/files/MmapFile.hpp"
+#include "chemfiles/files/PipelinedFile.hpp"
 
+#include "chemfiles/warnings.hpp"
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/unreachable.hpp"
 
 using namespace chemfiles;
 
+/// Size of the data accumulated by `TextFile::print` before writing it to
+/// the `TextFileImpl`
+static constexpr size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
 TextFile::TextFile(std::string path, File::Mode mode, File::Compression compression):
     File(std::move(path), mode, compression),
     file_(nullptr),
-    buffer_(8192, 0),
-    line_start_(buffer_.data()),
-    end_(buffer_.data() + buffer_.size())
+    line_start_(nullptr),
+    end_(nullptr)
 {
     switch (compression) {
     case File::DEFAULT:
+#if CHEMFILES_TEXT_FILE_USE_MMAP
+        if (mode == File::READ && MmapFile::can_map(this->path())) {
+            file_ = std::make_unique<MmapFile>(this->path());
+            break;
+        }
+#endif
         file_ = std::make_unique<PlainFile>(this->path(), this->mode());
         break;
     case File::GZIP:
@@ -44,48 +61,165 @@ TextFile::TextFile(std::string path, File::Mode mode, File::Compression compress
     case File::LZMA:
         file_ = std::make_unique<XzFile>(this->path(), this->mode());
         break;
+    case File::ZSTD:
+        file_ = std::make_unique<ZstdFile>(this->path(), this->mode());
+        break;
     default:
         unreachable();
     }
+
+    // decompress the data on a background thread while the caller is parsing
+    // it, if we have more than one core available
+    if (compression != File::DEFAULT && mode == File::READ && std::thread::hardware_concurrency() > 1) {
+        file_ = std::make_unique<PipelinedFile>(this->path(), std::move(file_));
+    }
+
+    this->init_buffer();
 }
 
 TextFile::TextFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression):
     File("<in memory>", mode, File::Compression::DEFAULT),
     file_(nullptr),
-    buffer_(8192, 0),
-    line_start_(buffer_.data()),
-    end_(buffer_.data() + buffer_.size())
+    line_start_(nullptr),
+    end_(nullptr)
 {
     if (mode == File::APPEND) {
         throw file_error("cannot append (mode 'a') to a memory file");
     }
 
-    if (compression != File::DEFAULT) {
-        if (mode != File::READ) {
-            throw file_error("writing to a compressed memory file is not supported");
+    // data written to memory must be visible in the buffer right away
+    buffered_writes_ = false;
+
+    if (compression != File::DEFAULT && mode != File::READ) {
+        throw file_error("writing to a compressed memory file is not supported");
+    }
+
+    // compressed data is decompressed incrementally while reading, instead of
+    // decompressing everything in a new buffer upfront
+    switch (compression) {
+    case File::DEFAULT:
+        file_ = std::make_unique<MemoryFile>(std::move(memory), mode);
+        break;
+    case File::GZIP:
+        file_ = std::make_unique<GzFile>(std::move(memory));
+        break;
+    case File::BZIP2:
+        file_ = std::make_unique<Bz2File>(std::move(memory));
+        break;
+    case File::LZMA:
+        file_ = std::make_unique<XzFile>(std::move(memory));
+        break;
+    case File::ZSTD:
+        file_ = std::make_unique<ZstdFile>(std::move(memory));
+        break;
+    default:
+        unreachable();
+    }
+
+    if (compression != File::DEFAULT && std::thread::hardware_concurrency() > 1) {
+        file_ = std::make_unique<PipelinedFile>(this->path(), std::move(file_));
+    }
+
+    this->init_buffer();
+}
+
+TextFile::TextFile(std::unique_ptr<TextFileImpl> file, File::Mode mode):
+    File("<stream>", mode, File::Compression::DEFAULT),
+    file_(std::move(file)),
+    line_start_(nullptr),
+    end_(nullptr)
+{
+    if (mode == File::APPEND) {
+        throw file_error("cannot append (mode 'a') to a stream");
+    }
+
+    this->init_buffer();
+}
+
+TextFile::~TextFile() {
+    // the file should already have been closed by `close`, this is only used
+    // if it was not closed through `Trajectory::close`
+    if (file_ != nullptr) {
+        try {
+            this->close();
+        } catch (const std::exception& e) {
+            warning("TextFile", "error while writing to {}: {}", this->path(), e.what());
+        } catch (...) {  // NOLINT(bugprone-empty-catch)
+            // not much we can do here ...
         }
+    }
+}
 
-        memory->decompress(compression);
+TextFile& TextFile::operator=(TextFile&& other) {
+    if (this == &other) {
+        return *this;
     }
 
-    file_ = std::make_unique<MemoryFile>(std::move(memory), mode);
+    if (file_ != nullptr) {
+        this->close();
+    }
+
+    File::operator=(std::move(other));
+    file_ = std::move(other.file_);
+    buffer_ = std::move(other.buffer_);
+    line_start_ = other.line_start_;
+    end_ = other.end_;
+    position_ = other.position_;
+    buffer_initialized_ = other.buffer_initialized_;
+    got_impl_eof_ = other.got_impl_eof_;
+    eof_ = other.eof_;
+    mark_ = other.mark_;
+    direct_ = other.direct_;
+    write_buffer_ = std::move(other.write_buffer_);
+    buffered_writes_ = other.buffered_writes_;
+
+    other.write_buffer_.clear();
+    return *this;
+}
+
+void TextFile::init_buffer() {
+    auto data = file_->data();
+    if (this->mode() == File::READ && data) {
+        direct_ = true;
+        line_start_ = data->data();
+        end_ = data->data() + data->size();
+    } else {
+        buffer_.resize(8192, 0);
+        line_start_ = buffer_.data();
+        end_ = buffer_.data();
+    }
 }
 
 uint64_t TextFile::tellpos() const {
+    if (direct_) {
+        return static_cast<uint64_t>(line_start_ - file_->data()->data());
+    }
+
     assert(line_start_ >= buffer_.data());
-    auto delta = buffer_initialized() ? static_cast<uint64_t>(line_start_ - buffer_.data()) : 0;
+    auto delta = buffer_initialized_ ? static_cast<uint64_t>(line_start_ - buffer_.data()) : 0;
     return position_ + delta;
 }
 
 void TextFile::seekpos(uint64_t position) {
+    this->flush();
+
     got_impl_eof_ = false;
     eof_ = false;
+    mark_ = nullopt;
 
-    if (buffer_initialized()) {
+    if (direct_) {
+        const auto* start = file_->data()->data();
+        auto size = static_cast<uint64_t>(end_ - start);
+        // seeking past the end of file puts the position at the end of file
+        line_start_ = start + static_cast<ptrdiff_t>(std::min(position, size));
+        return;
+    }
+
+    if (buffer_initialized_) {
         // use signed int64_t since the requested position can be smaller than
         // position_
         auto delta = static_cast<int64_t>(position) - static_cast<int64_t>(position_);
-        if (0 <= delta && delta < static_cast<int64_t>(buffer_.size())) {
+        if (0 <= delta && delta <= static_cast<int64_t>(end_ - buffer_.data())) {
             // the new position is inside our buffer, no need to actually seek,
             // just reset the line_start_ to the corresponding position.
             line_start_ = buffer_.data() + delta;
@@ -98,7 +232,13 @@ void TextFile::seekpos(uint64_t position) {
     file_->seek(position);
     position_ = position;
     // mark buffer to be refilled
-    buffer_[0] = '\0';
+    buffer_initialized_ = false;
+}
+
+void TextFile::mark() {
+    if (!direct_) {
+        mark_ = this->tellpos();
+    }
 }
 
 void TextFile::rewind() {
@@ -114,28 +254,29 @@ void TextFile::clear() {
     file_->clear();
 }
 
-bool TextFile::buffer_initialized() const {
-    return buffer_[0] != '\0';
-}
-
 void TextFile::fill_buffer(size_t start) {
-    auto count = buffer_.size() - start;
-    if (buffer_initialized()) {
-        position_ += count;
+    // the implementation can return less data than requested without being
+    // at the end of the file (for example when reading from a pipe), so only
+    // a read returning nothing indicates the end of file
+    auto read_count = file_->read(buffer_.data() + start, buffer_.size() - start);
+    if (read_count == 0) {
+        got_impl_eof_ = true;
     }
 
-    auto read_count = file_->read(buffer_.data() + start, count);
-    if (read_count < count) {
-        got_impl_eof_ = true;
-        // Erase any remaining data in the buffer
-        std::memset(buffer_.data() + start + read_count, 0, count - read_count);
+    if (!buffer_initialized_) {
+        line_start_ = buffer_.data();
     }
-    line_start_ = buffer_.data();
+    buffer_initialized_ = true;
+    end_ = buffer_.data() + start + read_count;
 }
 
 std::string_view TextFile::readline() {
+    if (direct_) {
+        return readline_direct();
+    }
+
     // Initialize buffer if needed
-    if (!buffer_initialized()) {
+    if (!buffer_initialized_) {
         fill_buffer(0);
     }
 
@@ -162,34 +303,35 @@ std::string_view TextFile::readline() {
 
             break;
         } else if (got_impl_eof_) {
-            // no more data, we found the last line
+            // no more data, we found the last line (not terminated by a new
+            // line character), which might be empty
             eof_ = true;
+            auto line = std::string_view(line_start_, remainder);
+            line_start_ = end_;
+            return line;
+        }
 
-            // if line_start_ != end_ - 1, we still have a line in the buffer
-            // (not terminated by a newline character)
-            if (line_start_ != end_ - 1) {
-                // We don't know the line length, but the buffer is terminated
-                // with zeroes, so we can rely on std::strlen to create the
-                // string_view.
-                auto line = std::string_view(line_start_);
-                line_start_ += line.length();
-                return line;
-            }
+        // no new line found in the current buffer, get more data. Everything
+        // before the current line can be discarded, except for the data after
+        // the position given to `mark`.
+        auto keep = line_start_ - buffer_.data();
+        if (mark_) {
+            keep = static_cast<ptrdiff_t>(*mark_ - position_);
         }
+        auto kept = static_cast<size_t>(end_ - buffer_.data() - keep);
+        auto line_offset = line_start_ - buffer_.data() - keep;
 
-        // no new line found in the current buffer, get more data
-        if (remainder >= buffer_.size()) {
+        if (kept >= buffer_.size()) {
             // We did not found a new line in the whole buffer,
             // so we increase it size
-            auto delta = line_start_ - buffer_.data();
             buffer_.resize(2 * buffer_.size(), 0);
-            line_start_ = buffer_.data() + delta;
-            end_ = buffer_.data() + buffer_.size();
         }
 
         // Move remaining data to the start of buffer
-        std::memmove(buffer_.data(), line_start_, remainder);
-        fill_buffer(remainder);
+        std::memmove(buffer_.data(), buffer_.data() + keep, kept);
+        position_ += static_cast<uint64_t>(keep);
+        line_start_ = buffer_.data() + line_offset;
+        fill_buffer(kept);
     }
 
     auto line = std::string_view(line_start_, length - windows_line - 1);
@@ -198,32 +340,133 @@ std::string_view TextFile::readline() {
     return line;
 }
 
+std::string_view TextFile::readline_direct() {
+    if (eof_) {
+        return "";
+    }
+
+    auto remainder = static_cast<size_t>(end_ - line_start_);
+    if (remainder == 0) {
+        if (this->unmap_if_grown()) {
+            return this->readline();
+        }
+        eof_ = true;
+        return "";
+    }
+
+    const auto* needle = std::memchr(line_start_, '\n', remainder);
+    const auto* newline = reinterpret_cast<const char*>(needle);
+
+    if (newline == nullptr) {
+        if (this->unmap_if_grown()) {
+            // the last line might not be complete yet
+            return this->readline();
+        }
+        // no more new line character, this is the last line
+        eof_ = true;
+        auto line = std::string_view(line_start_, remainder);
+        line_start_ = end_;
+        return line;
+    }
+
+    auto length = static_cast<size_t>(newline - line_start_);
+    auto line = std::string_view(line_start_, length);
+    // Check if we have a windows style line ending (\r\n)
+    if (length != 0 && newline[-1] == '\r') {
+        line.remove_suffix(1);
+    }
+    line_start_ = newline + 1;
+
+    return line;
+}
+
 void TextFile::vprint(fmt::string_view format, fmt::format_args args) {
-    std::string buffer;
-    buffer.reserve(128);
-    fmt::vformat_to(std::back_inserter(buffer), format, args);
-    if (buffer.size() == 0) {
+    auto initial = write_buffer_.size();
+    fmt::vformat_to(std::back_inserter(write_buffer_), format, args);
+    position_ += write_buffer_.size() - initial;
+
+    if (!buffered_writes_ || write_buffer_.size() >= WRITE_BUFFER_SIZE) {
+        this->flush();
+    }
+}
+
+void TextFile::flush() {
+    if (write_buffer_.size() == 0) {
         return;
     }
-    file_->write(buffer.data(), buffer.size());
-    position_ += buffer.size();
+
+    try {
+        file_->write(write_buffer_.data(), write_buffer_.size());
+    } catch (...) {
+        // do not try to write the same data again on the next call
+        write_buffer_.clear();
+        throw;
+    }
+    write_buffer_.clear();
+}
+
+void TextFile::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto file = std::move(file_);
+    if (write_buffer_.size() != 0) {
+        try {
+            file->write(write_buffer_.data(), write_buffer_.size());
+        } catch (...) {
+            write_buffer_.clear();
+            throw;
+        }
+        write_buffer_.clear();
+    }
+    file->close();
+}
+
+bool TextFile::unmap_if_grown() {
+#if CHEMFILES_TEXT_FILE_USE_MMAP
+    const auto* mmap = dynamic_cast<const MmapFile*>(file_.get());
+    if (mmap == nullptr || !mmap->grown()) {
+        return false;
+    }
+
+    auto position = this->tellpos();
+    file_ = std::make_unique<PlainFile>(this->path(), File::READ);
+    direct_ = false;
+    this->init_buffer();
+
+    file_->seek(position);
+    position_ = position;
+    buffer_initialized_ = false;
+    return true;
+#else
+    return false;
+#endif
 }
 
 std::string TextFile::readall() {
+    if (direct_ && !this->unmap_if_grown()) {
+        auto content = std::string(line_start_, end_);
+        line_start_ = end_;
+        return content;
+    }
+
     std::string buffer;
     buffer.resize(2048, '\0');
     size_t start = 0;
     while (true) {
-        auto count = buffer.size() - start;
-        auto read_count = file_->read(buffer.data() + start, count);
-        start += read_count;
-        if (read_count < count) {
-            // Remove additional '\0' at the end
-            buffer.resize(start);
+        if (start == buffer.size()) {
+            buffer.resize(2 * buffer.size(), '\0');
+        }
+
+        auto read_count = file_->read(buffer.data() + start, buffer.size() - start);
+        if (read_count == 0) {
             break;
         }
-        buffer.resize(2 * buffer.size(), '\0');
+        start += read_count;
     }
+    // Remove additional '\0' at the end
+    buffer.resize(start);
 
     return buffer;
 }
@@ -1,25 +1,83 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <memory>
+#include <future>
+#include <thread>
 #include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
 #include <typeinfo>
+#include <string_view>
+#include <functional>
 
 #include "chemfiles/File.hpp"
+#include "chemfiles/Frame.hpp"
 #include "chemfiles/Format.hpp"
+#include "chemfiles/utils.hpp"
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/external/optional.hpp"
 
+#include "chemfiles/files/FrameIndex.hpp"
+
 namespace chemfiles {
-    class Frame;
     class MemoryBuffer;
 }
 
 using namespace chemfiles;
 
+bool Format::has_frame(size_t index) {
+    return index < this->size();
+}
+
+void Format::read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) {
+    for (auto index: indices) {
+        Frame frame;
+        this->read_at(index, frame);
+        callback(index, frame);
+    }
+}
+
+void Format::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    assert(n_frames != 0 && positions.size() % n_frames == 0);
+    auto n_atoms = positions.size() / n_frames;
+
+    Frame frame;
+    for (size_t i = 0; i < n_frames; i++) {
+        if (!this->supports_in_place_read()) {
+            frame = Frame();
+        }
+
+        auto index = start + i * stride;
+        this->read_at(index, frame);
+        if (frame.size() != n_atoms) {
+            throw format_error(
+                "can not read positions at step {}: expected {} atoms, got {}",
+                index, n_atoms, frame.size()
+            );
+        }
+
+        auto frame_positions = frame.positions();
+        std::copy(frame_positions.begin(), frame_positions.end(), positions.data() + i * n_atoms);
+    }
+}
+
+bool Format::supports_in_place_read() const {
+    return false;
+}
+
+std::unique_ptr<Format> Format::open_cursor(const std::function<std::unique_ptr<Format>()>& create) {
+    return create();
+}
+
+void Format::close() {}
+
 #if defined(__GNUC__) && !defined(__clang__)
 #define IGNORING_SUGGEST_ATTRIBUTE_NORETURN
 #pragma GCC diagnostic push
@@ -65,17 +123,73 @@ void TextFormat::write_next(const Frame& /*unused*/) {
 #pragma GCC diagnostic pop
 #endif
 
+/// Minimal size of the data to scan before using multiple threads
+static constexpr uint64_t PARALLEL_SCAN_MIN_SIZE = 16 * 1024 * 1024;
+/// Minimal size of the data scanned by each thread
+static constexpr uint64_t PARALLEL_SCAN_CHUNK_SIZE = 4 * 1024 * 1024;
+
+[[noreturn]] static void throw_missing_frame(const std::string& path, size_t index, size_t n_frames) {
+    if (n_frames == 0) {
+        throw file_error(
+            "can not read file '{}' at index {}, it does not contain any frames",
+            path, index
+        );
+    } else {
+        throw file_error(
+            "can not read file '{}' at index {}: maximal index is {}",
+            path, index, n_frames - 1
+        );
+    }
+}
+
 TextFormat::TextFormat(std::string path, File::Mode mode, File::Compression compression) :
-    file_(std::move(path), mode, compression) {}
+    file_(std::move(path), mode, compression),
+    parallel_scan_(mode == File::READ && compression == File::DEFAULT),
+    use_frame_index_(mode == File::READ && FrameIndex::enabled()) {}
 
 TextFormat::TextFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression) :
     file_(std::move(memory), mode, compression) {}
 
+TextFormat::TextFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode) :
+    file_(std::move(stream), mode), streaming_(true) {}
+
 void TextFormat::scan_all() {
-    if (eof_found_) {
+    scan_until(static_cast<size_t>(-1));
+}
+
+TextFormat::~TextFormat() = default;
+
+void TextFormat::load_frame_index() {
+    if (format_name_.empty()) {
+        // we can not tell which format created an existing index
         return;
     }
 
+    // the tag includes the compression, since the positions are offsets in
+    // the uncompressed data
+    auto tag = fmt::format("{}/{}", format_name_, static_cast<int>(file_.compression()));
+    auto frame_index = FrameIndex(file_.path(), std::move(tag));
+    auto positions = frame_index.load();
+    if (positions) {
+        frame_positions_ = std::move(*positions);
+        eof_found_ = true;
+    } else {
+        frame_index_ = std::make_unique<FrameIndex>(std::move(frame_index));
+    }
+}
+
+bool TextFormat::scan_until(size_t index) {
+    if (use_frame_index_) {
+        use_frame_index_ = false;
+        this->load_frame_index();
+    }
+
+    if (index < frame_positions_.size()) {
+        return true;
+    } else if (eof_found_) {
+        return false;
+    }
+
     optional<TextFile> tmp_read_file = nullopt;
     if (file_.mode() == File::Mode::APPEND && file_.compression() == File::Compression::GZIP) {
         tmp_read_file = TextFile(file_.path(), File::Mode::READ, file_.compression());
@@ -84,17 +198,51 @@ void TextFormat::scan_all() {
     }
 
     auto before = file_.tellpos();
-    while (!file_.eof()) {
+    if (index == static_cast<size_t>(-1) && parallel_scan_ && supports_parallel_scan()) {
+        // only try this once, the remaining part of the file is scanned by
+        // `forward` below
+        parallel_scan_ = false;
+        this->scan_parallel();
+    }
+
+    if (next_scan_) {
+        // continue scanning after the last frame found by a previous call
+        file_.seekpos(*next_scan_);
+    }
+
+    if (index == frame_positions_.size()) {
+        // when looking for a single frame (i.e. when reading frames in
+        // order), keep this frame in the file buffer to be able to seek back
+        // to it without going through compressed data again
+        file_.mark();
+    }
+
+    while (frame_positions_.size() <= index) {
+        if (file_.eof()) {
+            eof_found_ = true;
+            break;
+        }
+
         auto position = forward();
         if (!position) {
+            eof_found_ = true;
             break;
         }
         frame_positions_.push_back(position.value());
     }
 
-    eof_found_ = true;
-    // reset failbit in the file
-    file_.clear();
+    next_scan_ = file_.tellpos();
+    if (eof_found_) {
+        // reset failbit in the file. This must only be done at the end of
+        // the file, since some compressed files use the end-of-file state of
+        // the underlying data to finish decompression
+        file_.clear();
+    }
+
+    if (eof_found_ && frame_index_) {
+        frame_index_->save(frame_positions_);
+        frame_index_ = nullptr;
+    }
 
     if (tmp_read_file) {
         // use original file for all further write operations
@@ -106,48 +254,257 @@ void TextFormat::scan_all() {
     } else {
         file_.seekpos(before);
     }
+
+    return index < frame_positions_.size();
 }
 
-void TextFormat::read_at(size_t index, Frame& frame) {
-    // Start by checking if we know this index, if not, look for all frames in
-    // the file
-    if (index >= frame_positions_.size()) {
-        scan_all();
+bool TextFormat::supports_parallel_scan() const {
+    return false;
+}
+
+bool TextFormat::is_scan_marker(std::string_view /*unused*/) const {
+    return false;
+}
+
+std::vector<uint64_t> TextFormat::frames_from_markers(uint64_t start, const std::vector<scan_marker>& /*unused*/) {
+    return {start};
+}
+
+void TextFormat::scan_parallel() {
+    auto start = next_scan_.value_or(file_.tellpos());
+
+    auto error = std::error_code();
+    auto file_size = static_cast<uint64_t>(std::filesystem::file_size(file_.path(), error));
+    if (error || file_size < start || file_size - start < PARALLEL_SCAN_MIN_SIZE) {
+        return;
     }
 
-    // If the step is still too big, this is an error
-    if (index >= frame_positions_.size()) {
-        if (frame_positions_.size() == 0) {
-            throw file_error(
-                "can not read file '{}' at index {}, it does not contain any frames",
-                file_.path(), index
-            );
-        } else {
+    auto threads = static_cast<uint64_t>(std::thread::hardware_concurrency());
+    auto n_chunks = std::min(threads, (file_size - start) / PARALLEL_SCAN_CHUNK_SIZE);
+    if (n_chunks < 2) {
+        return;
+    }
+
+    auto chunk_size = (file_size - start) / n_chunks;
+    auto results = std::vector<std::future<std::pair<std::vector<scan_marker>, uint64_t>>>();
+    for (uint64_t i = 0; i < n_chunks; i++) {
+        auto begin = start + i * chunk_size;
+        auto end = (i == n_chunks - 1) ? file_size : begin + chunk_size;
+        results.emplace_back(std::async(std::launch::async, [this, begin, end]() {
+            return this->find_scan_markers(begin, end);
+        }));
+    }
+
+    // stitch the markers from all chunks together, making line numbers
+    // relative to `start`
+    auto markers = std::vector<scan_marker>();
+    uint64_t lines = 0;
+    for (auto& result: results) {
+        auto chunk = result.get();
+        for (auto& marker: chunk.first) {
+            marker.line += lines;
+            markers.emplace_back(std::move(marker));
+        }
+        lines += chunk.second;
+    }
+
+    auto frames = frames_from_markers(start, markers);
+    if (frames.size() < 2) {
+        return;
+    }
+    assert(frames[0] == start);
+
+    frame_positions_.insert(frame_positions_.end(), frames.begin(), frames.end() - 1);
+    next_scan_ = frames.back();
+}
+
+std::pair<std::vector<TextFormat::scan_marker>, uint64_t> TextFormat::find_scan_markers(uint64_t begin, uint64_t end) const {
+    auto file = TextFile(file_.path(), File::READ, File::DEFAULT);
+    if (begin != 0) {
+        // skip the end of the line containing `begin - 1`, which belongs to
+        // the previous chunk. If `begin` is already at the start of a line
+        // (including the start of the scan), this reads an empty line.
+        file.seekpos(begin - 1);
+        file.readline();
+    }
+
+    auto markers = std::vector<scan_marker>();
+    uint64_t lines = 0;
+    while (!file.eof()) {
+        auto position = file.tellpos();
+        if (position >= end) {
+            break;
+        }
+
+        auto line = file.readline();
+        if (file.eof() && line.empty()) {
+            break;
+        }
+
+        if (is_scan_marker(line)) {
+            markers.push_back(scan_marker{lines, position, file.tellpos(), std::string(line)});
+        }
+        lines++;
+    }
+
+    return {std::move(markers), lines};
+}
+
+void TextFormat::read_at(size_t index, Frame& frame) {
+    if (streaming_) {
+        if (index != index_) {
             throw file_error(
-                "can not read file '{}' at index {}: maximal index is {}",
-                file_.path(), index, frame_positions_.size() - 1
+                "can not read frame {} from a stream, only the next frame ({}) is available",
+                index, index_
             );
         }
+        this->read(frame);
+        return;
+    }
+
+    // Start by checking if we know this index, if not, look for frames in the
+    // file until we find it
+    if (!scan_until(index)) {
+        throw_missing_frame(file_.path(), index, frame_positions_.size());
     }
 
-    index_ = index;
     file_.seekpos(frame_positions_[index]);
+    index_ = index + 1;
     read_next(frame);
 }
 
 void TextFormat::read(Frame& frame) {
+    if (streaming_) {
+        if (!stream_has_next()) {
+            throw file_error("can not read the next frame, the stream ended");
+        }
+        index_++;
+        read_next(frame);
+        return;
+    }
+
+    if (!scan_until(index_)) {
+        throw_missing_frame(file_.path(), index_, frame_positions_.size());
+    }
+
     file_.seekpos(frame_positions_[index_]);
     index_++;
     read_next(frame);
 }
 
+void TextFormat::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    auto n_atoms = positions.size() / n_frames;
+    for (size_t i = 0; i < n_frames; i++) {
+        auto index = start + i * stride;
+        if (streaming_) {
+            if (index != index_) {
+                throw file_error(
+                    "can not read frame {} from a stream, only the next frame ({}) is available",
+                    index, index_
+                );
+            }
+            if (!stream_has_next()) {
+                throw file_error("can not read the next frame, the stream ended");
+            }
+            index_++;
+        } else {
+            // the frames between the ones we want are skipped with `forward`
+            // without being parsed
+            if (!scan_until(index)) {
+                throw_missing_frame(file_.path(), index, frame_positions_.size());
+            }
+            file_.seekpos(frame_positions_[index]);
+            index_ = index + 1;
+        }
+
+        read_next_positions(span<Vector3D>(positions.data() + i * n_atoms, n_atoms));
+    }
+}
+
+void TextFormat::read_next_positions(span<Vector3D> positions) {
+    Frame frame;
+    read_next(frame);
+    if (frame.size() != positions.size()) {
+        throw format_error(
+            "can not read positions in '{}': expected {} atoms, got {}",
+            file_.path(), positions.size(), frame.size()
+        );
+    }
+
+    auto frame_positions = frame.positions();
+    std::copy(frame_positions.begin(), frame_positions.end(), positions.begin());
+}
+
 void TextFormat::write(const Frame& frame) {
     write_next(frame);
-    frame_positions_.push_back(file_.tellpos());
+    if (streaming_) {
+        // give each frame to the stream as soon as it is complete
+        file_.flush();
+    } else {
+        frame_positions_.push_back(file_.tellpos());
+    }
     index_++;
 }
 
 size_t TextFormat::size() {
+    if (streaming_) {
+        // we can not look at the whole stream, only count the frames already
+        // read and the next one if it exists
+        if (file_.mode() != File::READ) {
+            return index_;
+        }
+        return stream_has_next() ? index_ + 1 : index_;
+    }
+
     scan_all();
     return frame_positions_.size();
 }
+
+std::unique_ptr<Format> TextFormat::open_cursor(const std::function<std::unique_ptr<Format>()>& create) {
+    if (streaming_) {
+        throw format_error("can not read the same stream with multiple cursors");
+    }
+
+    auto cursor = create();
+    auto* text = dynamic_cast<TextFormat*>(cursor.get());
+    assert(text != nullptr);
+
+    // share the frames we already found, the new cursor will only scan the
+    // file if it needs to read frames after these
+    text->frame_positions_ = frame_positions_;
+    text->eof_found_ = eof_found_;
+    text->next_scan_ = next_scan_;
+    text->use_frame_index_ = false;
+    text->frame_index_.reset();
+
+    return cursor;
+}
+
+bool TextFormat::has_frame(size_t index) {
+    if (streaming_) {
+        return index < this->size();
+    }
+    return scan_until(index);
+}
+
+void TextFormat::close() {
+    file_.close();
+}
+
+bool TextFormat::stream_has_next() {
+    while (true) {
+        // seeking back to the start of the last line read is always possible
+        // in streams, since this line is still in the `TextFile` buffer
+        auto position = file_.tellpos();
+        auto line = file_.readline();
+        if (!trim(line).empty()) {
+            file_.seekpos(position);
+            return true;
+        }
+
+        if (file_.eof()) {
+            file_.seekpos(position);
+            return false;
+        }
+    }
+}
@@ -98,7 +98,7 @@ FormatFactory& FormatFactory::get() {
     return instance_;
 }
 
-void FormatFactory::register_format(const FormatMetadata& metadata, format_creator_t creator, memory_stream_t memory_stream) {
+void FormatFactory::register_format(const FormatMetadata& metadata, format_creator_t creator, memory_stream_t memory_stream, stream_creator_t stream) {
     auto guard = formats_.lock();
     auto& formats = *guard;
 
@@ -119,15 +119,22 @@ void FormatFactory::register_format(const FormatMetadata& metadata, format_creat
         }
     }
 
+    if (!stream) {
+        stream = [&metadata](std::unique_ptr<TextFileImpl>, File::Mode) -> std::unique_ptr<Format> {
+            throw format_error("streaming IO is not supported for the '{}' format", metadata.name);
+        };
+    }
+
     // actually register the format
-    formats.push_back({metadata, std::move(creator), std::move(memory_stream)});
+    formats.push_back({metadata, std::move(creator), std::move(memory_stream), std::move(stream)});
 }
 
-void FormatFactory::register_format(const FormatMetadata& metadata, format_creator_t creator) {
+void FormatFactory::register_format(const FormatMetadata& metadata, format_creator_t creator, stream_creator_t stream) {
     register_format(metadata, std::move(creator),
         [&metadata](std::shared_ptr<MemoryBuffer>, File::Mode, File::Compression) -> std::unique_ptr<Format> {
             throw format_error("in-memory IO is not supported for the '{}' format", metadata.name);
-        }
+        },
+        std::move(stream)
     );
 }
 
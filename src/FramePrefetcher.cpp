@@ -0,0 +1,151 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/Frame.hpp"
+#include "chemfiles/Format.hpp"
+
+#include "chemfiles/FramePrefetcher.hpp"
+
+using namespace chemfiles;
+
+FramePrefetcher::FramePrefetcher(std::unique_ptr<Format> cursor, size_t depth, size_t start):
+    cursor_(std::move(cursor)), depth_(depth), next_read_(start), next_index_(start)
+{
+    thread_ = std::thread([this]() { this->run(); });
+}
+
+FramePrefetcher::~FramePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    producer_.notify_one();
+    thread_.join();
+}
+
+void FramePrefetcher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        producer_.wait(lock, [this]() {
+            return stop_ || (!end_ && ready_.size() < depth_);
+        });
+
+        if (stop_) {
+            return;
+        }
+
+        auto index = next_read_;
+        auto generation = generation_;
+        auto frame = Frame();
+        if (!free_.empty()) {
+            frame = std::move(free_.back());
+            free_.pop_back();
+        }
+
+        // read without holding the lock, so the consumer can use the frames
+        // already read in the meantime
+        lock.unlock();
+        auto exists = false;
+        auto error = std::exception_ptr();
+        try {
+            exists = cursor_->has_frame(index);
+            if (exists) {
+                if (!cursor_->supports_in_place_read()) {
+                    frame = Frame();
+                }
+                cursor_->read_at(index, frame);
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (generation != generation_) {
+            // `restart` was called while we were reading, discard this frame
+            free_.emplace_back(std::move(frame));
+            continue;
+        }
+
+        if (error) {
+            // stop reading after an error, it will be given to the consumer
+            // when reaching this frame
+            end_ = true;
+            ready_.push_back({index, std::move(frame), error});
+        } else if (!exists) {
+            end_ = true;
+            free_.emplace_back(std::move(frame));
+        } else {
+            next_read_ = index + 1;
+            ready_.push_back({index, std::move(frame), nullptr});
+        }
+        consumer_.notify_one();
+    }
+}
+
+void FramePrefetcher::restart(size_t index) {
+    generation_ += 1;
+    for (auto& ready: ready_) {
+        free_.emplace_back(std::move(ready.frame));
+    }
+    ready_.clear();
+
+    next_read_ = index;
+    next_index_ = index;
+    end_ = false;
+    producer_.notify_one();
+}
+
+bool FramePrefetcher::read(size_t index, Frame& frame) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (index != next_index_) {
+        restart(index);
+    }
+
+    consumer_.wait(lock, [this]() {
+        return !ready_.empty() || end_;
+    });
+
+    if (ready_.empty()) {
+        // the background thread reached the end of the file
+        return false;
+    }
+
+    auto ready = std::move(ready_.front());
+    ready_.pop_front();
+
+    if (ready.error) {
+        // try to read this frame again on the next call
+        free_.emplace_back(std::move(ready.frame));
+        restart(index);
+        std::rethrow_exception(ready.error);
+    }
+
+    std::swap(frame, ready.frame);
+    free_.emplace_back(std::move(ready.frame));
+    next_index_ = index + 1;
+    producer_.notify_one();
+
+    return true;
+}
+
+bool FramePrefetcher::has_frame(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (index != next_index_) {
+        restart(index);
+    }
+
+    consumer_.wait(lock, [this]() {
+        return !ready_.empty() || end_;
+    });
+
+    return !ready_.empty();
+}
@@ -0,0 +1,108 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/Frame.hpp"
+#include "chemfiles/Format.hpp"
+#include "chemfiles/warnings.hpp"
+
+#include "chemfiles/FrameWriter.hpp"
+
+using namespace chemfiles;
+
+FrameWriter::FrameWriter(Format& format, size_t depth): format_(format), depth_(depth) {
+    thread_ = std::thread([this]() { this->run(); });
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    background_.notify_one();
+    thread_.join();
+
+    if (error_) {
+        try {
+            std::rethrow_exception(error_);
+        } catch (const std::exception& e) {
+            warning("asynchronous writer", "error while writing a frame: {}", e.what());
+        } catch (...) {
+            warning("asynchronous writer", "unknown error while writing a frame");
+        }
+    }
+}
+
+void FrameWriter::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        background_.wait(lock, [this]() {
+            return stop_ || !queue_.empty();
+        });
+
+        if (queue_.empty()) {
+            // `stop_` is set, and all the frames have been written
+            return;
+        }
+
+        auto frame = std::move(queue_.front());
+        queue_.pop_front();
+        writing_ = true;
+        // some space is available in the queue
+        caller_.notify_all();
+
+        // write without holding the lock, so that more frames can be added
+        // to the queue in the meantime
+        lock.unlock();
+        auto error = std::exception_ptr();
+        try {
+            format_.write(frame);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        frame = Frame();
+        lock.lock();
+
+        writing_ = false;
+        if (error) {
+            if (!error_) {
+                error_ = error;
+            }
+            queue_.clear();
+        }
+        caller_.notify_all();
+    }
+}
+
+void FrameWriter::rethrow_error() {
+    if (error_) {
+        auto error = error_;
+        error_ = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void FrameWriter::write(Frame frame) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    caller_.wait(lock, [this]() {
+        return error_ || queue_.size() < depth_;
+    });
+    rethrow_error();
+
+    queue_.emplace_back(std::move(frame));
+    background_.notify_one();
+}
+
+void FrameWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    caller_.wait(lock, [this]() {
+        return queue_.empty() && !writing_;
+    });
+    rethrow_error();
+}
@@ -70,12 +70,8 @@ std::string Property::kind_as_string(Kind kind) {
 
 
 void property_map::set(std::string name, Property value) {
-    // We can not move value here, because we might need it later. C++17 solves
-    // this with insert_or_assign.
-    auto inserted = data_.emplace(std::move(name), value);
-    if (!inserted.second) {
-        inserted.first->second = std::move(value);
-    }
+    // this does not allocate a new node if the property already exists
+    data_.insert_or_assign(std::move(name), std::move(value));
 }
 
 optional<const Property&> property_map::get(const std::string& name) const {
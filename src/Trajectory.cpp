@@ -1,13 +1,18 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
-#include <cassert>
 #include <cstddef>
 
+#include <atomic>
+#include <future>
+#include <thread>
+#include <exception>
+#include <algorithm>
 #include <functional>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "chemfiles/Trajectory.hpp"
 
@@ -17,7 +22,10 @@
 #include "chemfiles/UnitCell.hpp"
 #include "chemfiles/Topology.hpp"
 #include "chemfiles/FormatFactory.hpp"
+#include "chemfiles/FrameWriter.hpp"
+#include "chemfiles/FramePrefetcher.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
+#include "chemfiles/files/StreamFile.hpp"
 
 #include "chemfiles/misc.hpp"
 #include "chemfiles/utils.hpp"
@@ -27,6 +35,12 @@
 
 using namespace chemfiles;
 
+/// Number of chunks of frames given to each thread in `parallel_for_each`
+static constexpr size_t PARALLEL_CHUNKS_PER_THREAD = 8;
+/// Maximal number of double values in the buffer used to read positions as
+/// `float` in `read_positions`
+static constexpr size_t POSITIONS_BUFFER_VALUES = 1024 * 1024;
+
 struct file_open_info {
     static file_open_info parse(const std::string& path, std::string format);
     std::string format;
@@ -50,6 +64,8 @@ file_open_info file_open_info::parse(const std::string& path, std::string format
             info.compression = File::BZIP2;
         } else if (compression == "XZ") {
             info.compression = File::LZMA;
+        } else if (compression == "ZST") {
+            info.compression = File::ZSTD;
         } else {
             throw file_error("unknown compression method '{}'", compression);
         }
@@ -84,8 +100,16 @@ Trajectory::Trajectory(std::string path, char mode, const std::string& format)
     auto format_creator = FormatFactory::get().by_name(info.format).creator;
 
     format_ = format_creator(path_, char_to_file_mode(mode), info.compression);
+    if (char_to_file_mode(mode) == File::READ) {
+        open_format_ = [path = path_, format_creator, compression = info.compression]() {
+            return format_creator(path, File::READ, compression);
+        };
+    }
 
-    if (mode == 'r' || mode == 'a') {
+    if (mode == 'r') {
+        // the number of frames will be computed when needed
+        size_ = nullopt;
+    } else if (mode == 'a') {
         size_ = format_->size();
     }
 }
@@ -102,7 +126,11 @@ Trajectory Trajectory::memory_reader(const char* data, size_t size, const std::s
     // if in-memory I/O is not supported, this call will throw
     auto format_impl = memory_creator(buffer, File::READ, info.compression);
 
-    return Trajectory('r', std::move(format_impl), std::move(buffer));
+    auto trajectory = Trajectory('r', std::move(format_impl), buffer);
+    trajectory.open_format_ = [buffer, memory_creator, compression = info.compression]() {
+        return memory_creator(buffer, File::READ, compression);
+    };
+    return trajectory;
 }
 
 Trajectory Trajectory::memory_writer(const std::string& format) {
@@ -120,30 +148,76 @@ Trajectory Trajectory::memory_writer(const std::string& format) {
     return Trajectory('w', std::move(format_impl), std::move(buffer));
 }
 
+Trajectory Trajectory::stream_reader(std::function<size_t(char* data, size_t count)> read, const std::string& format) {
+    auto info = file_open_info::parse("", format);
+
+    if (info.format == "") {
+        throw format_error("format name '{}' is invalid", format);
+    }
+
+    if (info.compression != File::DEFAULT) {
+        throw file_error("compression is not supported with streams");
+    }
+
+    auto stream_creator = FormatFactory::get().by_name(info.format).stream_creator;
+    auto stream = std::make_unique<StreamFile>(StreamFile::read_callback_t(std::move(read)));
+    // if streaming I/O is not supported, this call will throw
+    auto format_impl = stream_creator(std::move(stream), File::READ);
+
+    auto trajectory = Trajectory('r', std::move(format_impl), nullptr);
+    trajectory.path_ = "<stream>";
+    trajectory.streaming_ = true;
+    return trajectory;
+}
+
+Trajectory Trajectory::stream_writer(std::function<void(const char* data, size_t count)> write, const std::string& format) {
+    auto info = file_open_info::parse("", format);
+
+    if (info.format == "") {
+        throw format_error("format name '{}' is invalid", format);
+    }
+
+    if (info.compression != File::DEFAULT) {
+        throw file_error("compression is not supported with streams");
+    }
+
+    auto stream_creator = FormatFactory::get().by_name(info.format).stream_creator;
+    auto stream = std::make_unique<StreamFile>(StreamFile::write_callback_t(std::move(write)));
+    // if streaming I/O is not supported, this call will throw
+    auto format_impl = stream_creator(std::move(stream), File::WRITE);
+
+    auto trajectory = Trajectory('w', std::move(format_impl), nullptr);
+    trajectory.path_ = "<stream>";
+    trajectory.streaming_ = true;
+    return trajectory;
+}
+
 Trajectory::Trajectory(char mode, std::unique_ptr<Format> format, std::shared_ptr<MemoryBuffer> buffer)
     : mode_(mode), format_(std::move(format)), buffer_(std::move(buffer)) {
-    if (mode == 'r' || mode == 'a') {
+    if (mode == 'r') {
+        size_ = nullopt;
+    } else if (mode == 'a') {
         size_ = format_->size();
     }
 }
 
-Trajectory::~Trajectory() = default;
+Trajectory::~Trajectory() {
+    // write the remaining frames before destroying the format
+    writer_.reset();
+}
+
 Trajectory::Trajectory(Trajectory&&) noexcept = default;
 Trajectory& Trajectory::operator=(Trajectory&&) noexcept = default;
 
 void Trajectory::pre_read(size_t index) {
-    if (index >= size_) {
-        if (size_ == 0) {
-            throw file_error(
-                "can not read file '{}' at index {}, it does not contain any frames",
-                path_, index
-            );
-        } else {
-            throw file_error(
-                "can not read file '{}' at index {}: there are {} frames in this file",
-                path_, index, size_
-            );
-        }
+    if (streaming_ && (!size_ || index >= *size_)) {
+        // look for more frames in the stream
+        size_ = format_->size();
+    }
+
+    auto exists = size_ ? index < *size_ : format_->has_frame(index);
+    if (!exists) {
+        missing_frame(index);
     }
     if (mode_ != File::READ) {
         throw file_error(
@@ -152,6 +226,23 @@ void Trajectory::pre_read(size_t index) {
     }
 }
 
+void Trajectory::missing_frame(size_t index) const {
+    // only compute the total number of frames if the frame does not exist,
+    // to give it in the error message
+    auto size = this->size();
+    if (size == 0) {
+        throw file_error(
+            "can not read file '{}' at index {}, it does not contain any frames",
+            path_, index
+        );
+    } else {
+        throw file_error(
+            "can not read file '{}' at index {}: there are {} frames in this file",
+            path_, index, size
+        );
+    }
+}
+
 void Trajectory::post_read(Frame& frame) {
     if (custom_topology_) {
         frame.set_topology(*custom_topology_);
@@ -170,44 +261,289 @@ void Trajectory::check_opened() const {
 
 size_t Trajectory::size() const  {
     check_opened();
-    return size_;
+    if (!size_) {
+        size_ = format_->size();
+    }
+    return *size_;
 }
 
 Frame Trajectory::read() {
+    Frame frame;
+    this->read(frame);
+    return frame;
+}
+
+void Trajectory::read(Frame& frame) {
     check_opened();
-    pre_read(index_);
 
-    Frame frame;
-    format_->read(frame);
+    if (prefetcher_) {
+        // the background thread finds out if the frame exists, checking it
+        // here would mean looking for the frame in the file twice
+        if (!prefetcher_->read(index_, frame)) {
+            missing_frame(index_);
+        }
+    } else {
+        pre_read(index_);
+        if (!format_->supports_in_place_read()) {
+            frame = Frame();
+        }
+
+        if (sync_format_) {
+            format_->read_at(index_, frame);
+            sync_format_ = false;
+        } else {
+            format_->read(frame);
+        }
+    }
     post_read(frame);
 
     frame.set_index(index_);
     index_++;
+}
 
+Frame Trajectory::read_at(const size_t index) {
+    Frame frame;
+    this->read_at(index, frame);
     return frame;
 }
 
-Frame Trajectory::read_at(const size_t index) {
+void Trajectory::read_at(const size_t index, Frame& frame) {
     check_opened();
     pre_read(index);
 
-    Frame frame;
+    if (!format_->supports_in_place_read()) {
+        frame = Frame();
+    }
     format_->read_at(index, frame);
     post_read(frame);
 
     frame.set_index(index);
     index_ = index + 1;
+}
 
-    return frame;
+void Trajectory::read_batch(const std::vector<size_t>& indices, const std::function<void(Frame)>& callback) {
+    check_opened();
+    for (auto index: indices) {
+        pre_read(index);
+    }
+
+    format_->read_batch(indices, [&](size_t index, Frame& frame) {
+        post_read(frame);
+        frame.set_index(index);
+        index_ = index + 1;
+        callback(std::move(frame));
+    });
+    // the format did not read the frames in order, select the next frame
+    // with `read_at`
+    sync_format_ = true;
 }
 
-void Trajectory::write(const Frame& frame) {
+size_t Trajectory::positions_frames(size_t start, size_t stop, size_t stride, size_t size) {
+    if (stride == 0) {
+        throw error("can not read positions with a stride of 0");
+    }
+
+    if (stop < start) {
+        throw error("can not read positions from {} to {}: start is after stop", start, stop);
+    }
+
+    auto n_frames = (stop - start + stride - 1) / stride;
+    if (n_frames == 0) {
+        if (size != 0) {
+            throw error("expected an empty positions array to read 0 frames, got {} values", size);
+        }
+        return 0;
+    }
+
+    if (size % (3 * n_frames) != 0) {
+        throw error(
+            "can not read {} frames into a positions array with {} values: "
+            "the size should be 3 x {} x the number of atoms",
+            n_frames, size, n_frames
+        );
+    }
+
+    // check that all frames exist, and that the file is opened in read mode
+    pre_read(start + (n_frames - 1) * stride);
+    return n_frames;
+}
+
+void Trajectory::read_positions(size_t start, size_t stop, size_t stride, span<double> positions) {
+    check_opened();
+    auto n_frames = positions_frames(start, stop, stride, positions.size());
+    if (n_frames == 0) {
+        return;
+    }
+
+    auto* data = reinterpret_cast<Vector3D*>(positions.data());
+    format_->read_positions(start, stride, n_frames, span<Vector3D>(data, positions.size() / 3));
+    index_ = start + (n_frames - 1) * stride + 1;
+}
+
+void Trajectory::read_positions(size_t start, size_t stop, size_t stride, span<float> positions) {
+    check_opened();
+    auto n_frames = positions_frames(start, stop, stride, positions.size());
+    if (n_frames == 0) {
+        return;
+    }
+
+    // read multiple frames at once in double precision, and convert them.
+    // The frames are read in chunks to limit the size of the buffer.
+    auto n_atoms = positions.size() / (3 * n_frames);
+    auto chunk_size = std::max<size_t>(1, POSITIONS_BUFFER_VALUES / (3 * n_atoms + 1));
+    chunk_size = std::min(chunk_size, n_frames);
+    auto buffer = std::vector<Vector3D>(chunk_size * n_atoms);
+
+    size_t done = 0;
+    while (done < n_frames) {
+        auto count = std::min(chunk_size, n_frames - done);
+        auto values = span<Vector3D>(buffer.data(), count * n_atoms);
+        format_->read_positions(start + done * stride, stride, count, values);
+
+        auto* output = positions.data() + 3 * n_atoms * done;
+        for (size_t j = 0; j < values.size(); j++) {
+            output[3 * j + 0] = static_cast<float>(values[j][0]);
+            output[3 * j + 1] = static_cast<float>(values[j][1]);
+            output[3 * j + 2] = static_cast<float>(values[j][2]);
+        }
+        done += count;
+    }
+    index_ = start + (n_frames - 1) * stride + 1;
+}
+
+void Trajectory::parallel_for_each(size_t start, size_t stop, const std::function<void(size_t, Frame&)>& callback, size_t n_threads) {
+    check_opened();
+    if (stop < start) {
+        throw error("can not read frames from {} to {}: start is after stop", start, stop);
+    }
+
+    if (start == stop) {
+        return;
+    }
+
+    // check that all frames exist, and that the file is opened in read mode.
+    // For text formats, this also finds the positions of all the frames
+    // before sharing them with the cursors.
+    pre_read(stop - 1);
+    if (!open_format_) {
+        throw file_error("can not read frames from '{}' with multiple threads", path_);
+    }
+
+    if (n_threads == 0) {
+        n_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    auto n_frames = stop - start;
+    n_threads = std::min(n_threads, n_frames);
+
+    // all the cursors are created here, since `format_` can not be used from
+    // multiple threads
+    auto cursors = std::vector<std::unique_ptr<Format>>();
+    cursors.reserve(n_threads);
+    for (size_t i = 0; i < n_threads; i++) {
+        cursors.emplace_back(format_->open_cursor(open_format_));
+    }
+
+    // give contiguous chunks of frames to each thread, so that cursors read
+    // the file sequentially, while still balancing the work between threads
+    auto chunk_size = std::max<size_t>(1, n_frames / (PARALLEL_CHUNKS_PER_THREAD * n_threads));
+    auto next_chunk = std::atomic<size_t>(start);
+    auto failed = std::atomic<bool>(false);
+
+    auto work = [&](Format& cursor) {
+        try {
+            Frame frame;
+            while (!failed) {
+                auto begin = next_chunk.fetch_add(chunk_size);
+                if (begin >= stop) {
+                    break;
+                }
+
+                auto end = std::min(begin + chunk_size, stop);
+                for (auto index = begin; index < end && !failed; index++) {
+                    if (!cursor.supports_in_place_read()) {
+                        frame = Frame();
+                    }
+                    cursor.read_at(index, frame);
+                    post_read(frame);
+
+                    frame.set_index(index);
+                    callback(index, frame);
+                }
+            }
+        } catch (...) {
+            failed = true;
+            throw;
+        }
+    };
+
+    auto results = std::vector<std::future<void>>();
+    for (size_t i = 1; i < n_threads; i++) {
+        results.emplace_back(std::async(std::launch::async, work, std::ref(*cursors[i])));
+    }
+
+    auto exception = std::exception_ptr();
+    try {
+        work(*cursors[0]);
+    } catch (...) {
+        exception = std::current_exception();
+    }
+
+    for (auto& result: results) {
+        try {
+            result.get();
+        } catch (...) {
+            if (!exception) {
+                exception = std::current_exception();
+            }
+        }
+    }
+
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void Trajectory::set_prefetch(size_t depth) {
+    check_opened();
+    if (prefetcher_) {
+        prefetcher_.reset();
+        sync_format_ = true;
+    }
+
+    if (depth == 0) {
+        return;
+    }
+
+    if (mode_ != File::READ) {
+        throw file_error(
+            "the file at '{}' was not opened in read mode", path_
+        );
+    }
+
+    if (!open_format_) {
+        throw file_error("can not read frames from '{}' in advance", path_);
+    }
+
+    prefetcher_ = std::make_unique<FramePrefetcher>(format_->open_cursor(open_format_), depth, index_);
+}
+
+void Trajectory::pre_write() {
     check_opened();
     if (mode_ != File::WRITE && mode_ != File::APPEND) {
         throw file_error(
             "the file at '{}' was not opened in write or append mode", path_
         );
     }
+}
+
+void Trajectory::write(const Frame& frame) {
+    pre_write();
+
+    if (writer_) {
+        // the caller can modify the frame before it is written
+        this->write_async(frame.clone());
+        return;
+    }
 
     if (custom_topology_ || custom_cell_) {
         Frame copy = frame.clone();
@@ -223,7 +559,50 @@ void Trajectory::write(const Frame& frame) {
     }
 
     index_++;
-    size_++;
+    size_ = *size_ + 1;
+}
+
+void Trajectory::write(Frame&& frame) {
+    pre_write();
+
+    if (writer_) {
+        this->write_async(std::move(frame));
+    } else {
+        this->write(static_cast<const Frame&>(frame));
+    }
+}
+
+void Trajectory::write_async(Frame frame) {
+    if (custom_topology_) {
+        frame.set_topology(*custom_topology_);
+    }
+    if (custom_cell_) {
+        frame.set_cell(*custom_cell_);
+    }
+    writer_->write(std::move(frame));
+
+    index_++;
+    size_ = *size_ + 1;
+}
+
+void Trajectory::set_async_write(size_t depth) {
+    pre_write();
+
+    if (writer_) {
+        auto writer = std::move(writer_);
+        writer->flush();
+    }
+
+    if (depth != 0) {
+        writer_ = std::make_unique<FrameWriter>(*format_, depth);
+    }
+}
+
+void Trajectory::flush() {
+    check_opened();
+    if (writer_) {
+        writer_->flush();
+    }
 }
 
 void Trajectory::set_topology(const Topology& topology) {
@@ -234,8 +613,6 @@ void Trajectory::set_topology(const Topology& topology) {
 void Trajectory::set_topology(const std::string& filename, const std::string& format) {
     check_opened();
     Trajectory topology_file(filename, 'r', format);
-    assert(topology_file.size() > 0);
-
     auto frame = topology_file.read_at(0);
     set_topology(frame.topology());
 }
@@ -247,13 +624,49 @@ void Trajectory::set_cell(const UnitCell& cell) {
 
 bool Trajectory::done() const {
     check_opened();
-    return index_ >= size_;
+    if (streaming_ && mode_ == File::READ && (!size_ || index_ >= *size_)) {
+        // look for more frames in the stream
+        return index_ >= format_->size();
+    }
+
+    if (!size_) {
+        if (prefetcher_) {
+            return !prefetcher_->has_frame(index_);
+        }
+        return !format_->has_frame(index_);
+    }
+    return index_ >= *size_;
 }
 
 void Trajectory::close() {
     check_opened();
+    auto error = std::exception_ptr();
+    if (writer_) {
+        try {
+            writer_->flush();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        writer_.reset();
+    }
+
+    prefetcher_.reset();
+    // write the end of the file before destroying the format, to be able to
+    // report errors
+    try {
+        format_->close();
+    } catch (...) {
+        if (!error) {
+            error = std::current_exception();
+        }
+    }
+
     // delete the format and set the pointer to nullptr
     format_.reset();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
 }
 
 optional<span<const char>> Trajectory::memory_buffer() const {
@@ -261,5 +674,9 @@ optional<span<const char>> Trajectory::memory_buffer() const {
         return nullopt;
     }
 
+    if (writer_) {
+        writer_->flush();
+    }
+
     return span<const char>(buffer_->data(), buffer_->data() + buffer_->size());
 }
@@ -0,0 +1,57 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "chemfiles/files/BackgroundTask.hpp"
+
+using namespace chemfiles;
+
+BackgroundWorkers::BackgroundWorkers(size_t n_threads): n_threads_(std::max<size_t>(n_threads, 1)) {}
+
+BackgroundWorkers::~BackgroundWorkers() {
+    {
+        auto lock = std::unique_lock<std::mutex>(mutex_);
+        stop_ = true;
+        // tasks which did not start are dropped, their result is no longer
+        // needed since all the corresponding `BackgroundTask` are gone
+        queue_.clear();
+    }
+    condition_.notify_all();
+
+    for (auto& thread: threads_) {
+        thread.join();
+    }
+}
+
+void BackgroundWorkers::push(std::function<void()> task) {
+    {
+        auto lock = std::unique_lock<std::mutex>(mutex_);
+        queue_.emplace_back(std::move(task));
+        if (threads_.size() < n_threads_) {
+            threads_.emplace_back([this]() { this->run(); });
+        }
+    }
+    condition_.notify_one();
+}
+
+void BackgroundWorkers::run() {
+    while (true) {
+        auto task = std::function<void()>();
+        {
+            auto lock = std::unique_lock<std::mutex>(mutex_);
+            condition_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (stop_) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        // exceptions are stored in the task future by std::packaged_task
+        task();
+    }
+}
@@ -0,0 +1,294 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <functional>
+
+#include "chemfiles/error_fmt.hpp"
+#include "chemfiles/external/span.hpp"
+
+#include "chemfiles/files/BatchReader.hpp"
+#include "chemfiles/files/BinaryFile.hpp"
+
+#if CHEMFILES_BINARY_FILE_USE_MMAP
+
+#include <unistd.h>
+#include <sys/types.h>
+
+#ifdef CHEMFILES_USE_IO_URING
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+#endif
+
+using namespace chemfiles;
+
+BatchReader::BatchReader(int file_descriptor, unsigned queue_depth):
+    file_descriptor_(file_descriptor), queue_depth_(std::max(queue_depth, 1u))
+{
+#ifdef CHEMFILES_USE_IO_URING
+    this->setup_ring();
+#endif
+}
+
+bool BatchReader::uses_io_uring() const {
+#ifdef CHEMFILES_USE_IO_URING
+    return ring_fd_ != -1;
+#else
+    return false;
+#endif
+}
+
+void BatchReader::read(
+    const std::vector<request>& requests,
+    const std::function<void(size_t, span<const char>)>& callback
+) {
+#ifdef CHEMFILES_USE_IO_URING
+    if (ring_fd_ != -1) {
+        this->read_io_uring(requests, callback);
+        return;
+    }
+#endif
+    this->read_sequential(requests, callback);
+}
+
+void BatchReader::read_sequential(
+    const std::vector<request>& requests,
+    const std::function<void(size_t, span<const char>)>& callback
+) {
+    auto buffer = std::vector<char>();
+    for (size_t i = 0; i < requests.size(); i++) {
+        buffer.resize(requests[i].size);
+        this->pread_all(buffer.data(), requests[i].offset, requests[i].size, 0);
+        callback(i, span<const char>(static_cast<const char*>(buffer.data()), buffer.size()));
+    }
+}
+
+void BatchReader::pread_all(char* data, uint64_t offset, size_t size, size_t done) {
+    while (done < size) {
+        auto count = pread(
+            file_descriptor_,
+            data + done,
+            size - done,
+            static_cast<off_t>(offset + done)
+        );
+
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw file_error(
+                "failed to read {} bytes at offset {}: {}",
+                size, offset, std::strerror(errno)
+            );
+        } else if (count == 0) {
+            throw file_error(
+                "failed to read {} bytes at offset {}: reached end of file",
+                size, offset
+            );
+        }
+
+        done += static_cast<size_t>(count);
+    }
+}
+
+#ifdef CHEMFILES_USE_IO_URING
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static unsigned* ring_pointer(void* ring, uint32_t offset) {
+    return static_cast<unsigned*>(static_cast<void*>(static_cast<char*>(ring) + offset));
+}
+
+void BatchReader::setup_ring() {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    // io_uring might not be available (old kernel, or disabled by seccomp),
+    // in which case we fall back to pread
+    auto ring_fd = io_uring_setup(queue_depth_, &params);
+    if (ring_fd < 0) {
+        return;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        sq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        cq_ring_size_ = sq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        close(ring_fd);
+        return;
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+            sq_ring_ = nullptr;
+            cq_ring_ = nullptr;
+            close(ring_fd);
+            return;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        if (!single_mmap) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+        cq_ring_ = nullptr;
+        sqes_ = nullptr;
+        close(ring_fd);
+        return;
+    }
+
+    sq_head_ = ring_pointer(sq_ring_, params.sq_off.head);
+    sq_tail_ = ring_pointer(sq_ring_, params.sq_off.tail);
+    sq_mask_ = ring_pointer(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = ring_pointer(sq_ring_, params.sq_off.array);
+    cq_head_ = ring_pointer(cq_ring_, params.cq_off.head);
+    cq_tail_ = ring_pointer(cq_ring_, params.cq_off.tail);
+    cq_mask_ = ring_pointer(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = static_cast<char*>(cq_ring_) + params.cq_off.cqes;
+
+    ring_fd_ = ring_fd;
+    ring_entries_ = params.sq_entries;
+    slots_.resize(std::min(ring_entries_, queue_depth_));
+}
+
+BatchReader::~BatchReader() {
+    if (ring_fd_ == -1) {
+        return;
+    }
+
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+}
+
+void BatchReader::read_io_uring(
+    const std::vector<request>& requests,
+    const std::function<void(size_t, span<const char>)>& callback
+) {
+    auto* sqes = static_cast<io_uring_sqe*>(sqes_);
+    auto* cqes = static_cast<io_uring_cqe*>(cqes_);
+
+    size_t next = 0;
+    size_t in_flight = 0;
+    // if the callback or a read fails, we stop submitting new reads but still
+    // need to wait for the reads in flight, since they write to `slots_`
+    std::exception_ptr error;
+
+    while ((next < requests.size() && !error) || in_flight != 0) {
+        // fill the submission queue
+        unsigned to_submit = 0;
+        auto tail = *sq_tail_;
+        for (size_t i = 0; i < slots_.size() && next < requests.size() && !error; i++) {
+            auto& slot = slots_[i];
+            if (slot.used) {
+                continue;
+            }
+
+            slot.used = true;
+            slot.request = next;
+            slot.buffer.resize(requests[next].size);
+
+            auto index = tail & *sq_mask_;
+            auto* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(io_uring_sqe));
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = file_descriptor_;
+            sqe->off = requests[next].offset;
+            sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data());
+            // very large reads are finished with pread below
+            sqe->len = static_cast<uint32_t>(std::min(requests[next].size, size_t(1) << 30));
+            sqe->user_data = i;
+            sq_array_[index] = index;
+
+            tail++;
+            to_submit++;
+            next++;
+        }
+        // make the new entries visible to the kernel
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        in_flight += to_submit;
+
+        // submit everything the kernel did not consume yet, including entries
+        // from a previous interrupted call
+        auto pending = tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        auto status = io_uring_enter(ring_fd_, pending, 1, IORING_ENTER_GETEVENTS);
+        if (status < 0 && errno != EINTR) {
+            // this should not happen, but if it does the state of the reads
+            // in flight is unknown, and we can not safely continue
+            throw file_error("io_uring_enter failed: {}", std::strerror(errno));
+        }
+
+        // process all available completions
+        auto head = *cq_head_;
+        auto cq_tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        while (head != cq_tail) {
+            const auto& cqe = cqes[head & *cq_mask_];
+            auto& slot = slots_[static_cast<size_t>(cqe.user_data)];
+            auto result = cqe.res;
+            head++;
+            __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+            in_flight--;
+
+            if (!error) {
+                try {
+                    const auto& request = requests[slot.request];
+                    if (result < 0) {
+                        // fall back to pread on failure, for example if the
+                        // kernel does not support IORING_OP_READ
+                        this->pread_all(slot.buffer.data(), request.offset, request.size, 0);
+                    } else if (static_cast<size_t>(result) < request.size) {
+                        // finish partial reads
+                        this->pread_all(slot.buffer.data(), request.offset, request.size, static_cast<size_t>(result));
+                    }
+                    callback(slot.request, span<const char>(static_cast<const char*>(slot.buffer.data()), slot.buffer.size()));
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+
+            slot.used = false;
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#else
+
+BatchReader::~BatchReader() = default;
+
+#endif
+
+#endif
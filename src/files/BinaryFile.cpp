@@ -5,6 +5,7 @@
 #include <cstring>
 
 #include <memory>
+#include <algorithm>
 #include <string>
 #include <type_traits>
 
@@ -15,6 +16,7 @@
 #include "chemfiles/warnings.hpp"
 
 #include "chemfiles/files/BinaryFile.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 
 #include <fcntl.h>
 #include <sys/types.h>
@@ -146,13 +148,26 @@ BinaryFile::BinaryFile(std::string path, File::Mode mode):
 #endif
 }
 
+BinaryFile::BinaryFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode):
+    File("<in memory>", mode, File::Compression::DEFAULT),
+    memory_(std::move(memory))
+{
+    if (mode == File::APPEND) {
+        throw file_error("cannot append (mode 'a') to a memory file");
+    }
+}
+
 BinaryFile::~BinaryFile() noexcept {
     this->close_file();
 }
 
 BinaryFile& BinaryFile::operator=(BinaryFile&& other) noexcept {
     File::operator=(std::move(other));
+    this->take_from(other);
+    return *this;
+}
 
+void BinaryFile::take_from(BinaryFile& other) noexcept {
     this->close_file();
 
 #if CHEMFILES_BINARY_FILE_USE_MMAP
@@ -164,11 +179,13 @@ BinaryFile& BinaryFile::operator=(BinaryFile&& other) noexcept {
     std::swap(this->mmap_offset_, other.mmap_offset_);
     std::swap(this->mmap_prot_, other.mmap_prot_);
     std::swap(this->current_, other.current_);
+    std::swap(this->batch_reader_, other.batch_reader_);
 #else
     std::swap(this->file_, other.file_);
 #endif
-
-    return *this;
+    std::swap(this->access_pattern_, other.access_pattern_);
+    std::swap(this->memory_, other.memory_);
+    std::swap(this->memory_position_, other.memory_position_);
 }
 
 void BinaryFile::remap_file() {
@@ -196,7 +213,8 @@ void BinaryFile::remap_file() {
         throw file_error("mmap failed for '{}': {}", this->path(), std::strerror(errno));
     }
 
-    auto status = madvise(mmap_data_, CHEMFILES_MMAP_SIZE, MADV_SEQUENTIAL);
+    auto advice = access_pattern_ == AccessPattern::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM;
+    auto status = madvise(mmap_data_, CHEMFILES_MMAP_SIZE, advice);
     if (status != 0) {
         throw file_error("madvise failed for '{}': {}", this->path(), std::strerror(errno));
     }
@@ -206,7 +224,12 @@ void BinaryFile::remap_file() {
 
 
 void BinaryFile::close_file() noexcept {
+    memory_.reset();
+    memory_position_ = 0;
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
+    batch_reader_.reset();
+
     if (mmap_data_ != nullptr) {
         auto status = msync(mmap_data_, CHEMFILES_MMAP_SIZE, MS_SYNC);
         if (status != 0) {
@@ -274,6 +297,12 @@ void BinaryFile::close_file() noexcept {
 }
 
 void BinaryFile::read_char(char* data, size_t count) {
+    if (memory_ != nullptr) {
+        auto view = this->memory_view(count);
+        std::memcpy(data, view.data(), count);
+        return;
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     if (mmap_offset_ + current_ + count > file_size_) {
         throw file_error(
@@ -313,8 +342,62 @@ void BinaryFile::read_char(char* data, size_t count) {
 #endif
 }
 
+span<const char> BinaryFile::memory_view(size_t count) {
+    auto size = static_cast<uint64_t>(memory_->size());
+    if (memory_position_ > size || count > size - memory_position_) {
+        throw file_error(
+            "failed to read {} bytes from the file at '{}': reached end of file",
+            count, this->path()
+        );
+    }
+
+    auto view = span<const char>(memory_->data() + memory_position_, count);
+    memory_position_ += count;
+    return view;
+}
+
+span<const char> BinaryFile::read_view(size_t count) {
+    if (memory_ != nullptr) {
+        return this->memory_view(count);
+    }
+
+#if CHEMFILES_BINARY_FILE_USE_MMAP
+    if (mmap_offset_ + current_ + count > file_size_) {
+        throw file_error(
+            "failed to read {} bytes from the file at '{}': mmap out of bounds",
+            count, this->path()
+        );
+    }
+
+    if (current_ + count > CHEMFILES_MMAP_SIZE && count <= CHEMFILES_MMAP_SIZE - page_size_) {
+        // the data crosses the end of the current mapping, move the mapping
+        // to start on the page containing the current position
+        auto position = mmap_offset_ + current_;
+        mmap_offset_ = (position / page_size_) * page_size_;
+        current_ = position - mmap_offset_;
+        this->remap_file();
+    }
+
+    if (current_ + count <= CHEMFILES_MMAP_SIZE) {
+        auto view = span<const char>(static_cast<const char*>(mmap_data_ + current_), count);
+        current_ += count;
+        return view;
+    }
+#endif
+
+    view_buffer_.resize(count);
+    this->read_char(view_buffer_.data(), count);
+    return span<const char>(static_cast<const char*>(view_buffer_.data()), count);
+}
+
 
 void BinaryFile::write_char(const char* data, size_t count) {
+    if (memory_ != nullptr) {
+        memory_->write_at(static_cast<size_t>(memory_position_), data, count);
+        memory_position_ += count;
+        return;
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     auto file_size_changed = false;
     while (mmap_offset_ + current_ + count > file_size_) {
@@ -360,6 +443,10 @@ void BinaryFile::write_char(const char* data, size_t count) {
 
 
 uint64_t BinaryFile::tell() const {
+    if (memory_ != nullptr) {
+        return memory_position_;
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     return mmap_offset_ + current_;
 #else
@@ -373,6 +460,11 @@ uint64_t BinaryFile::tell() const {
 
 
 void BinaryFile::seek(uint64_t position) {
+    if (memory_ != nullptr) {
+        memory_position_ = position;
+        return;
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     if (position < mmap_offset_ || position > mmap_offset_ + CHEMFILES_MMAP_SIZE) {
         // find a new offset so positions is in the mapped region
@@ -392,6 +484,11 @@ void BinaryFile::seek(uint64_t position) {
 
 
 void BinaryFile::skip(uint64_t count) {
+    if (memory_ != nullptr) {
+        memory_position_ += count;
+        return;
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     this->seek(mmap_offset_ + current_ + count);
 #else
@@ -404,6 +501,10 @@ void BinaryFile::skip(uint64_t count) {
 
 
 uint64_t BinaryFile::file_size() {
+    if (memory_ != nullptr) {
+        return memory_->size();
+    }
+
 #if CHEMFILES_BINARY_FILE_USE_MMAP
     return total_written_size_;
 #else
@@ -420,6 +521,87 @@ uint64_t BinaryFile::file_size() {
 #endif
 }
 
+void BinaryFile::set_access_pattern(AccessPattern pattern) {
+    if (pattern == access_pattern_) {
+        return;
+    }
+    access_pattern_ = pattern;
+
+    if (memory_ != nullptr) {
+        // nothing to tell the operating system about
+        return;
+    }
+
+#if CHEMFILES_BINARY_FILE_USE_MMAP
+    // all of these are only hints, so we ignore errors
+#ifdef POSIX_FADV_SEQUENTIAL
+    auto file_advice = pattern == AccessPattern::SEQUENTIAL ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM;
+    posix_fadvise(file_descriptor_, 0, 0, file_advice);
+#endif
+
+    if (mmap_data_ != nullptr) {
+        auto advice = pattern == AccessPattern::SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM;
+        madvise(mmap_data_, CHEMFILES_MMAP_SIZE, advice);
+    }
+#endif
+}
+
+
+void BinaryFile::prefetch(uint64_t position, uint64_t count) {
+    if (memory_ != nullptr) {
+        // the data is already in memory
+        return;
+    }
+
+#if CHEMFILES_BINARY_FILE_USE_MMAP
+    if (position >= total_written_size_ || count == 0) {
+        return;
+    }
+    count = std::min(count, total_written_size_ - position);
+
+    // all of these are only hints, so we ignore errors
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(file_descriptor_, static_cast<off_t>(position), static_cast<off_t>(count), POSIX_FADV_WILLNEED);
+#else
+    // only prefetch the part of the data inside the current mapping
+    if (position >= mmap_offset_ && position < mmap_offset_ + CHEMFILES_MMAP_SIZE) {
+        auto start = ((position - mmap_offset_) / page_size_) * page_size_;
+        auto end = std::min(position + count - mmap_offset_, static_cast<uint64_t>(CHEMFILES_MMAP_SIZE));
+        madvise(mmap_data_ + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+    }
+#endif
+#else
+    // no prefetching without mmap
+    (void)position;
+    (void)count;
+#endif
+}
+
+
+void BinaryFile::read_batch(
+    const std::vector<BatchReader::request>& requests,
+    const std::function<void(size_t, span<const char>)>& callback
+) {
+#if CHEMFILES_BINARY_FILE_USE_MMAP
+    if (memory_ == nullptr) {
+        if (batch_reader_ == nullptr) {
+            batch_reader_ = std::make_unique<BatchReader>(file_descriptor_);
+        }
+        batch_reader_->read(requests, callback);
+        return;
+    }
+#endif
+
+    // read the requests one by one, in-memory files directly give views
+    // inside the buffer
+    auto initial = this->tell();
+    for (size_t i = 0; i < requests.size(); i++) {
+        this->seek(requests[i].offset);
+        auto view = this->read_view(requests[i].size);
+        callback(i, view);
+    }
+    this->seek(initial);
+}
 
 /******************************************************************************/
 
@@ -528,6 +710,156 @@ inline uint64_t swap_endianness(uint64_t value) {
     );
 }
 
+// Vectorized byte swapping of arrays, selected at compile time depending on
+// the instruction sets enabled for the target. SSE2 is always available on
+// x86_64, and NEON on aarch64.
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define CHEMFILES_SWAP_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define CHEMFILES_SWAP_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define CHEMFILES_SWAP_NEON 1
+#endif
+
+#if defined(CHEMFILES_SWAP_AVX2)
+using simd_t = __m256i;
+
+static inline simd_t simd_load(const char* data) {
+    return _mm256_loadu_si256(static_cast<const __m256i*>(static_cast<const void*>(data)));
+}
+
+static inline void simd_store(char* data, simd_t value) {
+    _mm256_storeu_si256(static_cast<__m256i*>(static_cast<void*>(data)), value);
+}
+
+template<size_t Size> inline simd_t simd_swap(simd_t value);
+
+// shuffle bytes inside each 128-bit lane, the same way for both lanes
+template<> inline simd_t simd_swap<2>(simd_t value) {
+    const auto mask = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+    );
+    return _mm256_shuffle_epi8(value, mask);
+}
+
+template<> inline simd_t simd_swap<4>(simd_t value) {
+    const auto mask = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+    );
+    return _mm256_shuffle_epi8(value, mask);
+}
+
+template<> inline simd_t simd_swap<8>(simd_t value) {
+    const auto mask = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+    );
+    return _mm256_shuffle_epi8(value, mask);
+}
+
+#elif defined(CHEMFILES_SWAP_SSE2)
+using simd_t = __m128i;
+
+static inline simd_t simd_load(const char* data) {
+    return _mm_loadu_si128(static_cast<const __m128i*>(static_cast<const void*>(data)));
+}
+
+static inline void simd_store(char* data, simd_t value) {
+    _mm_storeu_si128(static_cast<__m128i*>(static_cast<void*>(data)), value);
+}
+
+// SSE2 does not have a byte shuffle instruction, so we swap 16-bit words
+// with shuffles, and then the bytes inside each word with shifts
+template<size_t Size> inline simd_t simd_swap(simd_t value);
+
+template<> inline simd_t simd_swap<2>(simd_t value) {
+    return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+}
+
+template<> inline simd_t simd_swap<4>(simd_t value) {
+    value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+    value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+    return simd_swap<2>(value);
+}
+
+template<> inline simd_t simd_swap<8>(simd_t value) {
+    value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+    value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+    return simd_swap<2>(value);
+}
+
+#elif defined(CHEMFILES_SWAP_NEON)
+using simd_t = uint8x16_t;
+
+static inline simd_t simd_load(const char* data) {
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(data));
+}
+
+static inline void simd_store(char* data, simd_t value) {
+    vst1q_u8(reinterpret_cast<uint8_t*>(data), value);
+}
+
+template<size_t Size> inline simd_t simd_swap(simd_t value);
+
+template<> inline simd_t simd_swap<2>(simd_t value) {
+    return vrev16q_u8(value);
+}
+
+template<> inline simd_t simd_swap<4>(simd_t value) {
+    return vrev32q_u8(value);
+}
+
+template<> inline simd_t simd_swap<8>(simd_t value) {
+    return vrev64q_u8(value);
+}
+#endif
+
+/// Swap the endianness of `count` values of `Size` bytes each from `input`,
+/// and store the result in `output`. `input` and `output` can be the same
+/// pointer, to swap the values in place.
+template<size_t Size>
+static void swap_array_endianness(const char* input, char* output, size_t count) {
+    size_t i = 0;
+#if defined(CHEMFILES_SWAP_AVX2) || defined(CHEMFILES_SWAP_SSE2) || defined(CHEMFILES_SWAP_NEON)
+    constexpr size_t values_per_simd = sizeof(simd_t) / Size;
+    for (; i + values_per_simd <= count; i += values_per_simd) {
+        auto value = simd_load(input + i * Size);
+        simd_store(output + i * Size, simd_swap<Size>(value));
+    }
+#endif
+
+    // remaining values
+    using uint_t = typename unsigned_type<Size>::type;
+    for (; i < count; i++) {
+        uint_t value;
+        std::memcpy(&value, input + i * Size, Size);
+        value = swap_endianness(value);
+        std::memcpy(output + i * Size, &value, Size);
+    }
+}
+
+/// Convert `count` 32-bit floating point numbers in `input` to double, and
+/// store them in `output[i * stride]`. If `Swap` is true, the endianness of
+/// the input is swapped before the conversion.
+template<bool Swap>
+static void convert_f32_to_f64(const char* input, double* output, size_t count, size_t stride) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t bits;
+        std::memcpy(&bits, input + i * sizeof(float), sizeof(float));
+        if (Swap) {
+            bits = swap_endianness(bits);
+        }
+        float value;
+        std::memcpy(&value, &bits, sizeof(float));
+        output[i * stride] = static_cast<double>(value);
+    }
+}
+
 /******************************************************************************/
 
 template<typename T>
@@ -536,13 +868,7 @@ inline void BigEndianFile::read_as_big_endian(T* data, size_t count) {
     const size_t byte_count = sizeof(T) * count;
     this->read_char(char_data, byte_count);
 #if CHEMFILES_BYTE_ORDER == CHEMFILES_LITTLE_ENDIAN
-    for (size_t i = 0; i < count; ++i) {
-        char* value_ptr = char_data + i * sizeof(T);
-        T value;
-        std::memcpy(&value, value_ptr, sizeof(T));
-        value = swap_endianness(value);
-        std::memcpy(value_ptr, &value, sizeof(T));
-    }
+    swap_array_endianness<sizeof(T)>(char_data, char_data, count);
 #endif
 }
 
@@ -551,10 +877,7 @@ inline void BigEndianFile::write_as_big_endian(const T* data, size_t count) {
     const size_t byte_count = sizeof(T) * count;
 #if CHEMFILES_BYTE_ORDER == CHEMFILES_LITTLE_ENDIAN
     swap_buffer_.resize(byte_count);
-    for (size_t i = 0; i < count; ++i) {
-        T value = swap_endianness(data[i]);
-        std::memcpy(swap_buffer_.data() + i * sizeof(T), &value, sizeof(T));
-    }
+    swap_array_endianness<sizeof(T)>(reinterpret_cast<const char*>(data), swap_buffer_.data(), count);
     this->write_char(swap_buffer_.data(), byte_count);
 #else
     this->write_char(reinterpret_cast<const char*>(data), byte_count);
@@ -600,6 +923,11 @@ void BigEndianFile::read_f64(double* data, size_t count) {
     read_as_big_endian(data, count);
 }
 
+void BigEndianFile::read_f32_as_f64(double* data, size_t count, size_t stride) {
+    auto view = this->read_view(sizeof(float) * count);
+    convert_f32_to_f64<CHEMFILES_BYTE_ORDER == CHEMFILES_LITTLE_ENDIAN>(view.data(), data, count, stride);
+}
+
 void BigEndianFile::write_i16(const int16_t* data, size_t count) {
     write_as_big_endian(data, count);
 }
@@ -641,13 +969,7 @@ inline void LittleEndianFile::read_as_little_endian(T* data, size_t count) {
     const size_t byte_count = sizeof(T) * count;
     this->read_char(char_data, byte_count);
 #if CHEMFILES_BYTE_ORDER == CHEMFILES_BIG_ENDIAN
-    for (size_t i = 0; i < count; ++i) {
-        char* value_ptr = char_data + i * sizeof(T);
-        T value;
-        std::memcpy(&value, value_ptr, sizeof(T));
-        value = swap_endianness(value);
-        std::memcpy(value_ptr, &value, sizeof(T));
-    }
+    swap_array_endianness<sizeof(T)>(char_data, char_data, count);
 #endif
 }
 
@@ -656,10 +978,7 @@ inline void LittleEndianFile::write_as_little_endian(const T* data, size_t count
     const size_t byte_count = sizeof(T) * count;
 #if CHEMFILES_BYTE_ORDER == CHEMFILES_BIG_ENDIAN
     swap_buffer_.resize(byte_count);
-    for (size_t i = 0; i < count; ++i) {
-        T value = swap_endianness(data[i]);
-        std::memcpy(swap_buffer_.data() + i * sizeof(T), &value, sizeof(T));
-    }
+    swap_array_endianness<sizeof(T)>(reinterpret_cast<const char*>(data), swap_buffer_.data(), count);
     this->write_char(swap_buffer_.data(), byte_count);
 #else
     this->write_char(reinterpret_cast<const char*>(data), byte_count);
@@ -706,6 +1025,11 @@ void LittleEndianFile::read_f64(double* data, size_t count) {
     read_as_little_endian(data, count);
 }
 
+void LittleEndianFile::read_f32_as_f64(double* data, size_t count, size_t stride) {
+    auto view = this->read_view(sizeof(float) * count);
+    convert_f32_to_f64<CHEMFILES_BYTE_ORDER == CHEMFILES_BIG_ENDIAN>(view.data(), data, count, stride);
+}
+
 void LittleEndianFile::write_i16(const int16_t* data, size_t count) {
     write_as_little_endian(data, count);
 }
@@ -747,3 +1071,11 @@ std::unique_ptr<BinaryFile> BinaryFile::open_native(std::string path, File::Mode
     return std::make_unique<BigEndianFile>(std::move(path), mode);
 #endif
 }
+
+std::unique_ptr<BinaryFile> BinaryFile::open_native(std::shared_ptr<MemoryBuffer> memory, File::Mode mode) {
+#if CHEMFILES_BYTE_ORDER == CHEMFILES_LITTLE_ENDIAN
+    return std::make_unique<LittleEndianFile>(std::move(memory), mode);
+#else
+    return std::make_unique<BigEndianFile>(std::move(memory), mode);
+#endif
+}
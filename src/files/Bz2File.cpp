@@ -1,6 +1,8 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
 #include <cstdint>
@@ -8,6 +10,10 @@
 #include <limits>
 #include <string>
 #include <vector>
+#include <thread>
+#include <utility>
+#include <exception>
+#include <algorithm>
 #include <functional>
 
 #include <bzlib.h>
@@ -15,8 +21,9 @@
 #include "chemfiles/File.hpp"
 #include "chemfiles/error_fmt.hpp"
 
-#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/files/Bz2File.hpp"
+#include "chemfiles/files/InputSource.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 
 using namespace chemfiles;
 
@@ -57,87 +64,226 @@ static void check(int status) {
     }
 }
 
+/// Magic number at the start of each block in bzip2 files (BCD of pi)
+static constexpr uint64_t BLOCK_MAGIC = 0x314159265359;
+/// Magic number at the end of each bzip2 stream (BCD of sqrt(pi))
+static constexpr uint64_t END_OF_STREAM_MAGIC = 0x177245385090;
+/// Mask for the lower 48 bits of a 64-bit integer
+static constexpr uint64_t MASK_48_BITS = 0xFFFFFFFFFFFF;
+/// Size of the chunks used when looking for blocks in the compressed file
+static constexpr size_t SCAN_CHUNK_SIZE = 65536;
+/// Amount of data decompressed between checks for cancellation, when
+/// decompressing blocks in the background. This is smaller than a single
+/// bzip2 block, so cancelled blocks stop early.
+static constexpr size_t DECOMPRESSION_STEP = 64 * 1024;
+/// Maximal number of threads used to decompress blocks in advance
+static constexpr size_t MAX_BACKGROUND_THREADS = 8;
+/// Maximal amount of memory (compressed and decompressed data) used by the
+/// blocks decompressed in advance
+static constexpr size_t READ_AHEAD_MEMORY = 256 * 1024 * 1024;
+
+/// Number of threads to use to decompress blocks in advance
+static size_t background_threads() {
+    auto threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(threads, MAX_BACKGROUND_THREADS));
+}
+
 Bz2File::Bz2File(const std::string& path, File::Mode mode): TextFileImpl(path), mode_(mode), buffer_(8192) {
     std::memset(&stream_, 0, sizeof(bz_stream));
 
-    const char* openmode = nullptr;
     if (mode == File::READ) {
-        openmode = "rb";
-        stream_end_ = BZ2_bzDecompressEnd;
-        check(BZ2_bzDecompressInit(&stream_, 0, 0));
-    } else if (mode == File::WRITE) {
-        openmode = "wb";
-        stream_end_ = BZ2_bzCompressEnd;
-        check(BZ2_bzCompressInit(&stream_, 6, 0, 0));
-
-        stream_.next_out = buffer_.data();
-        stream_.avail_out = checked_cast(buffer_.size());
+        source_ = std::make_unique<InputSource>(path);
+        this->init_read();
+        return;
     } else if (mode == File::APPEND) {
         throw file_error("appending (open mode 'a') is not supported with bzip2 files");
     }
 
-    file_ = std::fopen(path.c_str(), openmode);
+    assert(mode == File::WRITE);
+    file_ = std::fopen(path.c_str(), "wb");
     if (file_ == nullptr) {
-        stream_end_(&stream_);
         throw file_error("could not open the file at '{}'", path);
     }
+
+    stream_end_ = BZ2_bzCompressEnd;
+    auto status = BZ2_bzCompressInit(&stream_, 6, 0, 0);
+    if (status != BZ_OK) {
+        std::fclose(file_);
+        check(status);
+    }
+
+    stream_.next_out = buffer_.data();
+    stream_.avail_out = checked_cast(buffer_.size());
+}
+
+Bz2File::Bz2File(std::shared_ptr<MemoryBuffer> memory):
+    TextFileImpl("<in memory>"), mode_(File::READ),
+    source_(std::make_unique<InputSource>(memory)), memory_(std::move(memory)), buffer_(8192)
+{
+    std::memset(&stream_, 0, sizeof(bz_stream));
+    this->init_read();
+}
+
+void Bz2File::init_read() {
+    stream_end_ = BZ2_bzDecompressEnd;
+    check(BZ2_bzDecompressInit(&stream_, 0, 0));
+
+    char header[4] = {0, 0, 0, 0};
+    auto count = source_->read(header, 4);
+    if (count == 4 && header[0] == 'B' && header[1] == 'Z' && header[2] == 'h' && header[3] >= '1' && header[3] <= '9') {
+        buffer_.resize(SCAN_CHUNK_SIZE);
+        // the first block should start right after the stream header
+        if (this->scan_until(0) && blocks_[0].start == 32) {
+            use_blocks_ = true;
+            offsets_.push_back(0);
+            // start with the block size from the stream header (100 to 900 kB)
+            block_memory_ = 2 * 100000 * static_cast<size_t>(header[3] - '0');
+            workers_ = std::make_unique<BackgroundWorkers>(background_threads());
+            try {
+                if (!this->load_block(0)) {
+                    this->use_stream_decoder(0);
+                }
+            } catch (...) {
+                pending_.clear();
+                stream_end_(&stream_);
+                throw;
+            }
+            return;
+        }
+    }
+
+    if (!use_blocks_) {
+        blocks_.clear();
+        source_->clear();
+        source_->seek(0);
+    }
 }
 
 Bz2File::~Bz2File() {
-    if (mode_ == File::WRITE) {
+    if (file_ != nullptr) {
         try {
-            compress_and_write(BZ_FINISH);
-        } catch (...) {
+            this->close();
+        } catch (...) {  // NOLINT(bugprone-empty-catch)
             // not much we can do here
         }
     }
 
     stream_end_(&stream_);
-    if (file_ != nullptr) {
-        std::fclose(file_);
+}
+
+void Bz2File::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto error = std::exception_ptr();
+    try {
+        compress_and_write(BZ_FINISH);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    auto status = std::fclose(file_);
+    file_ = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (status != 0) {
+        throw file_error("could not close the file at '{}': {}", this->path(), std::strerror(errno));
     }
 }
 
 size_t Bz2File::read(char* data, size_t count) {
+    if (use_blocks_) {
+        return this->read_blocks(data, count);
+    }
+
+    if (end_of_data_) {
+        return 0;
+    }
+
     stream_.next_out = data;
     stream_.avail_out = checked_cast(count);
 
+    auto read_input = [this]() {
+        stream_.next_in = buffer_.data();
+        stream_.avail_in = checked_cast(source_->read(buffer_.data(), buffer_.size()));
+
+        if (source_->error()) {
+            throw file_error("IO error while reading bzip2 file");
+        }
+    };
+
     while (stream_.avail_out != 0) {
         // read more compressed data from the file
-        if (stream_.avail_in == 0 && (std::feof(file_) == 0)) {
-            stream_.next_in = buffer_.data();
-            stream_.avail_in = checked_cast(std::fread(buffer_.data(), 1, buffer_.size(), file_));
-
-            if (std::ferror(file_) != 0) {
-                throw file_error("IO error while reading bzip2 file");
-            }
+        if (stream_.avail_in == 0 && !source_->eof()) {
+            read_input();
         }
 
         auto status = BZ2_bzDecompress(&stream_);
 
         if (status == BZ_STREAM_END) {
-            return count - stream_.avail_out;
+            if (stream_.avail_in == 0 && !source_->eof()) {
+                read_input();
+            }
+
+            if (stream_.avail_in == 0) {
+                end_of_data_ = true;
+                break;
+            }
+
+            // the file contains multiple concatenated streams, restart the
+            // decoder for the next one
+            auto* next_in = stream_.next_in;
+            auto avail_in = stream_.avail_in;
+            auto* next_out = stream_.next_out;
+            auto avail_out = stream_.avail_out;
+            stream_end_(&stream_);
+            std::memset(&stream_, 0, sizeof(bz_stream));
+            check(BZ2_bzDecompressInit(&stream_, 0, 0));
+            stream_.next_in = next_in;
+            stream_.avail_in = avail_in;
+            stream_.next_out = next_out;
+            stream_.avail_out = avail_out;
+            concatenated_ = true;
+        } else if (status == BZ_DATA_ERROR_MAGIC && concatenated_) {
+            // ignore trailing garbage after the last stream
+            end_of_data_ = true;
+            break;
         } else {
             // Check for error
             check(status);
         }
     }
-    return count;
+    return count - stream_.avail_out;
 }
 
 void Bz2File::clear() noexcept {
-    std::clearerr(file_);
+    if (source_ != nullptr) {
+        source_->clear();
+    } else {
+        std::clearerr(file_);
+    }
 }
 
 void Bz2File::seek(uint64_t position) {
     assert(mode_ == File::READ);
+    if (use_blocks_) {
+        this->seek_blocks(position);
+        return;
+    }
+
     // Reset stream state
     stream_end_(&stream_);
     std::memset(&stream_, 0, sizeof(bz_stream));
     check(BZ2_bzDecompressInit(&stream_, 0, 0));
+    concatenated_ = false;
+    end_of_data_ = false;
 
     // Dumb implementation, re-decompressing the file from the begining
-    std::fseek(file_, 0, SEEK_SET);
+    source_->clear();
+    source_->seek(0);
     constexpr size_t BUFFSIZE = 4096;
     char buffer[BUFFSIZE];
 
@@ -153,6 +299,307 @@ void Bz2File::seek(uint64_t position) {
     (void)count;
 }
 
+void Bz2File::scan_chunk() {
+    if (!source_->seek(scan_offset_)) {
+        throw file_error("IO error while reading bzip2 file");
+    }
+
+    auto count = source_->read(buffer_.data(), buffer_.size());
+    if (source_->error()) {
+        throw file_error("IO error while reading bzip2 file");
+    }
+
+    if (count == 0) {
+        scan_done_ = true;
+        if (!blocks_.empty() && blocks_.back().end == UINT64_MAX) {
+            // the file is truncated, decompressing this block will fail
+            blocks_.back().end = 8 * scan_offset_;
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        scan_register_ = (scan_register_ << 8) | static_cast<unsigned char>(buffer_[i]);
+        auto bits = 8 * (scan_offset_ + i + 1);
+
+        // check all 48-bit windows ending in the byte we just added, in the
+        // order in which they appear in the file
+        for (unsigned shift = 8; shift-- > 0;) {
+            if (bits < 48 + shift) {
+                continue;
+            }
+
+            auto value = (scan_register_ >> shift) & MASK_48_BITS;
+            if (value == BLOCK_MAGIC || value == END_OF_STREAM_MAGIC) {
+                auto position = bits - shift - 48;
+                if (!blocks_.empty() && blocks_.back().end == UINT64_MAX) {
+                    blocks_.back().end = position;
+                }
+
+                if (value == BLOCK_MAGIC) {
+                    blocks_.push_back({position, UINT64_MAX});
+                }
+            }
+        }
+    }
+
+    scan_offset_ += count;
+}
+
+bool Bz2File::scan_until(size_t i) {
+    while (!(i < blocks_.size() && blocks_[i].end != UINT64_MAX) && !scan_done_) {
+        this->scan_chunk();
+    }
+    return i < blocks_.size();
+}
+
+/// Decompress a single block from a bzip2 file. The block is made of `bits`
+/// bits, starting at bit `shift` in `input`.
+static std::vector<char> decompress_block(const std::vector<char>& input, unsigned shift, uint64_t bits, const std::atomic<bool>& cancelled) {
+    // the block magic number and CRC take 80 bits
+    if (bits < 80) {
+        throw file_error("bzip2: corrupted file (invalid block size)");
+    }
+
+    // Create a full bzip2 stream containing only this block: stream header,
+    // the block data aligned on a byte boundary, end of stream marker and
+    // stream CRC.
+    auto block_bytes = static_cast<size_t>((bits + 7) / 8);
+    auto stream = std::vector<char>(4 + block_bytes + 11, 0);
+    stream[0] = 'B';
+    stream[1] = 'Z';
+    stream[2] = 'h';
+    // use the largest block size, which is always large enough to decompress
+    // the data, whatever the compression level used for the file
+    stream[3] = '9';
+
+    const auto* in = reinterpret_cast<const unsigned char*>(input.data());
+    auto* out = reinterpret_cast<unsigned char*>(stream.data() + 4);
+    for (size_t i = 0; i < block_bytes; i++) {
+        if (shift == 0) {
+            out[i] = in[i];
+        } else {
+            out[i] = static_cast<unsigned char>((in[i] << shift) | (in[i + 1] >> (8 - shift)));
+        }
+    }
+
+    // remove any bit after the end of the block
+    auto extra = static_cast<unsigned>(bits % 8);
+    if (extra != 0) {
+        out[block_bytes - 1] &= static_cast<unsigned char>(0xFF << (8 - extra));
+    }
+
+    // with a single block, the stream CRC is the same as the block CRC
+    auto crc = (static_cast<uint32_t>(out[6]) << 24) | (static_cast<uint32_t>(out[7]) << 16) |
+               (static_cast<uint32_t>(out[8]) << 8) | static_cast<uint32_t>(out[9]);
+
+    auto position = 32 + bits;
+    auto write_bits = [&](uint64_t value, unsigned count) {
+        for (unsigned i = count; i > 0; i--) {
+            if (((value >> (i - 1)) & 1) != 0) {
+                stream[position / 8] = static_cast<char>(stream[position / 8] | (0x80 >> (position % 8)));
+            }
+            position++;
+        }
+    };
+    write_bits(END_OF_STREAM_MAGIC, 48);
+    write_bits(crc, 32);
+    stream.resize(static_cast<size_t>((position + 7) / 8));
+
+    bz_stream bz;
+    std::memset(&bz, 0, sizeof(bz_stream));
+    check(BZ2_bzDecompressInit(&bz, 0, 0));
+
+    bz.next_in = stream.data();
+    bz.avail_in = checked_cast(stream.size());
+
+    // assume a 20% compression ratio to start with
+    auto output = std::vector<char>(5 * stream.size());
+    size_t total = 0;
+    while (true) {
+        if (cancelled) {
+            // the block is no longer needed
+            BZ2_bzDecompressEnd(&bz);
+            return {};
+        }
+
+        if (total == output.size()) {
+            output.resize(2 * output.size());
+        }
+        // decompress the block in small steps, to be able to stop early if
+        // the block is no longer needed
+        bz.next_out = output.data() + total;
+        bz.avail_out = checked_cast(std::min(output.size() - total, DECOMPRESSION_STEP));
+
+        auto status = BZ2_bzDecompress(&bz);
+        total = static_cast<size_t>(bz.next_out - output.data());
+
+        if (status == BZ_STREAM_END) {
+            break;
+        } else if (status != BZ_OK) {
+            BZ2_bzDecompressEnd(&bz);
+            check(status);
+        } else if (bz.avail_in == 0 && bz.avail_out != 0) {
+            BZ2_bzDecompressEnd(&bz);
+            throw file_error("bzip2: corrupted file (truncated block)");
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+
+    output.resize(total);
+    return output;
+}
+
+/// Read the compressed data for a block going from bit `start` to bit `end`
+/// in the file. An additional zero byte is added at the end of the data to
+/// make bit shifting easier.
+static std::vector<char> read_block(InputSource& source, uint64_t start, uint64_t end) {
+    auto first_byte = start / 8;
+    auto last_byte = (end + 7) / 8;
+    auto input = std::vector<char>(static_cast<size_t>(last_byte - first_byte + 1), 0);
+    if (!source.seek(first_byte)) {
+        throw file_error("IO error while reading bzip2 file");
+    }
+    auto count = source.read(input.data(), input.size() - 1);
+    if (count != input.size() - 1) {
+        throw file_error("IO error while reading bzip2 file");
+    }
+    return input;
+}
+
+std::vector<char> Bz2File::decompress(size_t i) {
+    const auto& info = blocks_[i];
+    auto input = read_block(*source_, info.start, info.end);
+    auto cancelled = std::atomic<bool>(false);
+    return decompress_block(input, static_cast<unsigned>(info.start % 8), info.end - info.start, cancelled);
+}
+
+BackgroundTask<std::vector<char>> Bz2File::start_decompression(size_t i) {
+    // the task reads the compressed data through its own InputSource, so the
+    // calling thread only waits for the block it needs right now
+    return workers_->submit<std::vector<char>>([path = std::string(this->path()), memory = memory_, info = blocks_[i]](const std::atomic<bool>& cancelled) {
+        if (cancelled) {
+            return std::vector<char>();
+        }
+        auto source = memory ? std::make_unique<InputSource>(memory) : std::make_unique<InputSource>(path);
+        auto input = read_block(*source, info.start, info.end);
+        return decompress_block(input, static_cast<unsigned>(info.start % 8), info.end - info.start, cancelled);
+    });
+}
+
+bool Bz2File::load_block(size_t i) {
+    assert(i < offsets_.size());
+    block_position_ = 0;
+
+    // blocks already being decompressed, pending[k] is block `first + k`
+    auto pending = std::move(pending_);
+    pending_.clear();
+    auto first = current_block_ + 1;
+
+    try {
+        if (i >= first && i - first < pending.size()) {
+            current_ = pending[i - first].get();
+        } else {
+            current_ = this->decompress(i);
+        }
+    } catch (const FileError&) {
+        // this can be a real error, or a block magic number appearing by
+        // chance in the compressed data and splitting a block in two. The
+        // streaming decoder will report real errors.
+        return false;
+    }
+    current_block_ = i;
+
+    if (offsets_.size() == i + 1) {
+        // first time we see this block, record the start of the next one
+        offsets_.push_back(offsets_[i] + current_.size());
+    }
+
+    const auto& info = blocks_[i];
+    auto compressed_size = static_cast<size_t>((info.end - info.start) / 8);
+    block_memory_ = std::max(block_memory_, current_.size() + compressed_size);
+
+    // re-use the blocks we already started to decompress if they are still
+    // needed, the others are cancelled when `pending` is destroyed
+    auto in_advance = std::min(background_threads(), std::max<size_t>(1, READ_AHEAD_MEMORY / block_memory_));
+    for (auto next = i + 1; next <= i + in_advance; next++) {
+        if (next >= first && next - first < pending.size()) {
+            pending_.emplace_back(std::move(pending[next - first]));
+        } else if (this->scan_until(next)) {
+            pending_.emplace_back(this->start_decompression(next));
+        } else {
+            break;
+        }
+    }
+    return true;
+}
+
+void Bz2File::use_stream_decoder(uint64_t position) {
+    use_blocks_ = false;
+    pending_.clear();
+    blocks_.clear();
+    offsets_.clear();
+    current_.clear();
+    block_position_ = 0;
+
+    this->seek(position);
+}
+
+size_t Bz2File::read_blocks(char* data, size_t count) {
+    size_t total = 0;
+    while (total < count) {
+        auto available = current_.size() - block_position_;
+        if (available == 0) {
+            if (!this->scan_until(current_block_ + 1)) {
+                break;
+            }
+            if (!this->load_block(current_block_ + 1)) {
+                this->use_stream_decoder(offsets_[current_block_ + 1]);
+                return total + this->read(data + total, count - total);
+            }
+            continue;
+        }
+
+        auto amount = std::min(available, count - total);
+        std::memcpy(data + total, current_.data() + block_position_, amount);
+        block_position_ += amount;
+        total += amount;
+    }
+    return total;
+}
+
+void Bz2File::seek_blocks(uint64_t position) {
+    // find the last block starting before `position` for which we know the
+    // uncompressed offset
+    auto after = std::upper_bound(offsets_.begin(), offsets_.end(), position);
+    auto i = static_cast<size_t>(after - offsets_.begin()) - 1;
+    if (!this->scan_until(i)) {
+        // `offsets_` also contains the end of the last block
+        assert(i > 0);
+        i -= 1;
+    }
+
+    if (i != current_block_ && !this->load_block(i)) {
+        this->use_stream_decoder(position);
+        return;
+    }
+
+    // decompress blocks until we find the one containing `position`
+    while (position - offsets_[current_block_] > current_.size()) {
+        if (!this->scan_until(current_block_ + 1)) {
+            // seeking past the end of the file
+            block_position_ = current_.size();
+            return;
+        }
+        if (!this->load_block(current_block_ + 1)) {
+            this->use_stream_decoder(position);
+            return;
+        }
+    }
+
+    block_position_ = static_cast<size_t>(position - offsets_[current_block_]);
+}
+
 void Bz2File::write(const char* data, size_t count) {
     stream_.next_in = const_cast<char*>(data);
     stream_.avail_in = checked_cast(count);
@@ -0,0 +1,241 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <filesystem>
+#include <system_error>
+
+#include "chemfiles/misc.hpp"
+#include "chemfiles/external/optional.hpp"
+
+#include "chemfiles/files/FrameIndex.hpp"
+
+using namespace chemfiles;
+
+static std::atomic<bool> FRAME_INDEX_ENABLED = {false}; // NOLINT
+
+/// Magic string at the start of index files, including a version number
+static constexpr char INDEX_MAGIC[8] = {'C', 'H', 'F', 'L', 'I', 'D', 'X', '1'};
+/// Value written after the magic string, used to detect files created on
+/// machines with a different endianness
+static constexpr uint64_t ENDIANNESS_CHECK = 1;
+/// Number of bytes at the start of the trajectory used in the fingerprint
+static constexpr size_t HASHED_BYTES = 4096;
+
+void chemfiles::set_frame_index(bool enabled) {
+    FRAME_INDEX_ENABLED = enabled;
+}
+
+bool FrameIndex::enabled() {
+    return FRAME_INDEX_ENABLED;
+}
+
+std::string FrameIndex::index_path(const std::string& path) {
+    return path + ".chfl-idx";
+}
+
+using fingerprint = FrameIndex::fingerprint;
+
+namespace {
+    using file_ptr = std::unique_ptr<std::FILE, int(*)(std::FILE*)>;
+
+    file_ptr open_file(const std::string& path, const char* mode) {
+        return file_ptr(std::fopen(path.c_str(), mode), std::fclose);
+    }
+}
+
+/// 64-bit FNV-1a hash of the `size` bytes in `data`
+static uint64_t fnv1a(const unsigned char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+static bool same_fingerprint(const fingerprint& lhs, const fingerprint& rhs) {
+    return lhs.size == rhs.size && lhs.mtime == rhs.mtime && lhs.hash == rhs.hash;
+}
+
+static optional<fingerprint> get_fingerprint(const std::string& path) {
+    auto error = std::error_code();
+    auto size = std::filesystem::file_size(path, error);
+    if (error) {
+        return nullopt;
+    }
+
+    auto mtime = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return nullopt;
+    }
+
+    auto file = open_file(path, "rb");
+    if (!file) {
+        return nullopt;
+    }
+
+    unsigned char buffer[HASHED_BYTES];
+    auto read = std::fread(buffer, 1, HASHED_BYTES, file.get());
+    if (std::ferror(file.get())) {
+        return nullopt;
+    }
+
+    return fingerprint{
+        static_cast<uint64_t>(size),
+        static_cast<int64_t>(mtime.time_since_epoch().count()),
+        fnv1a(buffer, read),
+    };
+}
+
+FrameIndex::FrameIndex(std::string path, std::string tag): FrameIndex(path, std::move(tag), FrameIndex::index_path(path)) {}
+
+FrameIndex::FrameIndex(std::string path, std::string tag, std::string index):
+    path_(std::move(path)), tag_(std::move(tag)), index_(std::move(index))
+{
+    if (FrameIndex::enabled()) {
+        fingerprint_ = get_fingerprint(path_);
+    }
+}
+
+optional<std::vector<uint64_t>> FrameIndex::load() const {
+    auto data = this->load_data();
+    if (!data) {
+        return nullopt;
+    }
+
+    size_t offset = 0;
+    uint64_t count = 0;
+    if (!read_value(*data, offset, count) || (data->size() - offset) / sizeof(uint64_t) != count ||
+        (data->size() - offset) % sizeof(uint64_t) != 0) {
+        return nullopt;
+    }
+
+    auto positions = std::vector<uint64_t>(static_cast<size_t>(count));
+    std::memcpy(positions.data(), data->data() + offset, positions.size() * sizeof(uint64_t));
+    for (size_t i = 1; i < positions.size(); i++) {
+        if (positions[i] <= positions[i - 1]) {
+            return nullopt;
+        }
+    }
+
+    return positions;
+}
+
+void FrameIndex::save(const std::vector<uint64_t>& positions) const {
+    if (!fingerprint_) {
+        return;
+    }
+
+    auto data = std::vector<char>();
+    append_value(data, static_cast<uint64_t>(positions.size()));
+    for (auto position: positions) {
+        append_value(data, position);
+    }
+    this->save_data(data);
+}
+
+optional<std::vector<char>> FrameIndex::load_data() const {
+    if (!fingerprint_) {
+        return nullopt;
+    }
+
+    auto file = open_file(index_, "rb");
+    if (!file) {
+        return nullopt;
+    }
+
+    auto data = std::vector<char>();
+    char buffer[4096];
+    while (true) {
+        auto read = std::fread(buffer, 1, sizeof(buffer), file.get());
+        data.insert(data.end(), buffer, buffer + read);
+        if (read < sizeof(buffer)) {
+            break;
+        }
+    }
+    if (std::ferror(file.get())) {
+        return nullopt;
+    }
+
+    if (data.size() < sizeof(INDEX_MAGIC) || std::memcmp(data.data(), INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) {
+        return nullopt;
+    }
+    size_t offset = sizeof(INDEX_MAGIC);
+
+    uint64_t endianness = 0;
+    auto expected = fingerprint{0, 0, 0};
+    uint64_t tag_size = 0;
+    if (!read_value(data, offset, endianness) || endianness != ENDIANNESS_CHECK ||
+        !read_value(data, offset, expected.size) ||
+        !read_value(data, offset, expected.mtime) ||
+        !read_value(data, offset, expected.hash) ||
+        !read_value(data, offset, tag_size)) {
+        return nullopt;
+    }
+
+    if (data.size() - offset < tag_size || std::string(data.data() + offset, tag_size) != tag_) {
+        return nullopt;
+    }
+    offset += tag_size;
+
+    if (!same_fingerprint(*fingerprint_, expected)) {
+        return nullopt;
+    }
+
+    data.erase(data.begin(), data.begin() + static_cast<std::ptrdiff_t>(offset));
+    return data;
+}
+
+void FrameIndex::save_data(const std::vector<char>& payload) const {
+    if (!fingerprint_) {
+        return;
+    }
+
+    // the file could have been modified while we were scanning it, in which
+    // case the data might not match the current content of the file
+    auto current = get_fingerprint(path_);
+    if (!current || !same_fingerprint(*current, *fingerprint_)) {
+        return;
+    }
+
+    auto data = std::vector<char>(INDEX_MAGIC, INDEX_MAGIC + sizeof(INDEX_MAGIC));
+    append_value(data, ENDIANNESS_CHECK);
+    append_value(data, current->size);
+    append_value(data, current->mtime);
+    append_value(data, current->hash);
+    append_value(data, static_cast<uint64_t>(tag_.size()));
+    data.insert(data.end(), tag_.begin(), tag_.end());
+    data.insert(data.end(), payload.begin(), payload.end());
+
+    // write to a temporary file and then rename it, to make sure other
+    // processes never see a partially written index
+    auto temporary = index_ + ".tmp";
+    {
+        auto file = open_file(temporary, "wb");
+        if (!file) {
+            return;
+        }
+
+        auto written = std::fwrite(data.data(), 1, data.size(), file.get());
+        if (written != data.size() || std::fflush(file.get()) != 0) {
+            file.reset();
+            std::remove(temporary.c_str());
+            return;
+        }
+    }
+
+    auto error = std::error_code();
+    std::filesystem::rename(temporary, index_, error);
+    if (error) {
+        std::remove(temporary.c_str());
+    }
+}
@@ -1,9 +1,19 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cerrno>
 #include <cstdio>
 #include <cstdint>
+#include <cstring>
 #include <limits>
+#include <memory>
 #include <string>
+#include <vector>
+#include <future>
+#include <thread>
+#include <utility>
+#include <exception>
+#include <algorithm>
 
 #define ZLIB_CONST
 #include <zconf.h>
@@ -13,8 +23,10 @@
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/unreachable.hpp"
 
-#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/files/GzFile.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
+#include "chemfiles/files/InputSource.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 
 using namespace chemfiles;
 
@@ -26,73 +38,522 @@ static unsigned checked_cast(size_t value) {
     }
 }
 
-GzFile::GzFile(const std::string& path, File::Mode mode): TextFileImpl(path) {
+/// Minimal distance between two checkpoints in the uncompressed data
+static constexpr uint64_t CHECKPOINT_SPAN = 4 * 1024 * 1024;
+/// Size of the deflate window, i.e. maximal distance for back-references in
+/// the compressed data
+static constexpr unsigned WINDOW_SIZE = 32768;
+/// Size of the buffer used to read compressed data from the file
+static constexpr size_t INPUT_BUFFER_SIZE = 65536;
+/// windowBits value for zlib, to read and write gzip member with headers
+static constexpr int GZIP_WINDOW_BITS = 15 + 16;
+/// windowBits value for zlib, to read raw deflate data (no headers)
+static constexpr int RAW_WINDOW_BITS = -15;
+/// Compression level used when writing files
+static constexpr int COMPRESSION_LEVEL = 7;
+/// Size of the uncompressed data in each gzip member when writing files
+static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+GzFile::GzFile(const std::string& path, File::Mode mode): TextFileImpl(path), mode_(mode) {
+    if (mode == File::READ) {
+        source_ = std::make_unique<InputSource>(path);
+        this->init_read();
+        this->load_checkpoints(path);
+        return;
+    }
+
     const char* openmode;
     switch (mode) {
-    case File::READ:
-        openmode = "rb";
-        break;
     case File::WRITE:
-        openmode = "wb7";
+        openmode = "wb";
         break;
     case File::APPEND:
-        openmode = "ab7";
+        openmode = "ab";
         break;
     default:
         unreachable();
     }
 
-    file_ = gzopen64(path.c_str(), openmode);
+    file_ = std::fopen(path.c_str(), openmode);
     if (file_ == nullptr) {
         throw file_error("could not open the file at '{}'", path);
     }
+    chunk_.reserve(CHUNK_SIZE);
+}
+
+GzFile::GzFile(std::shared_ptr<MemoryBuffer> memory):
+    TextFileImpl("<in memory>"), mode_(File::READ),
+    source_(std::make_unique<InputSource>(std::move(memory)))
+{
+    this->init_read();
+}
+
+void GzFile::init_read() {
+    unsigned char magic[2] = {0, 0};
+    auto count = source_->read(magic, 2);
+    if (count != 2 || magic[0] != 0x1f || magic[1] != 0x8b) {
+        // this is not a gzip file, read it as a plain file
+        transparent_ = true;
+        source_->clear();
+        source_->seek(0);
+        return;
+    }
+
+    stream_ = std::make_unique<z_stream>();
+    stream_->zalloc = nullptr;
+    stream_->zfree = nullptr;
+    stream_->opaque = nullptr;
+    stream_->next_in = nullptr;
+    stream_->avail_in = 0;
+
+    auto status = inflateInit2(stream_.get(), GZIP_WINDOW_BITS);
+    if (status != Z_OK) {
+        auto message = std::string(stream_->msg != nullptr ? stream_->msg : "unknown error");
+        stream_.reset();
+        throw file_error("error creating gz stream: {}", message);
+    }
+
+    input_.resize(INPUT_BUFFER_SIZE);
+    this->restart();
 }
 
 GzFile::~GzFile() {
     if (file_ != nullptr) {
-        gzclose(file_);
+        try {
+            this->close();
+        } catch (...) {  // NOLINT(bugprone-empty-catch)
+            // not much we can do here ...
+        }
+    }
+
+    if (stream_ != nullptr) {
+        inflateEnd(stream_.get());
+    }
+}
+
+void GzFile::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto error = std::exception_ptr();
+    try {
+        this->finish();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    auto status = std::fclose(file_);
+    file_ = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (status != 0) {
+        throw file_error("could not close the file at '{}': {}", this->path(), std::strerror(errno));
+    }
+}
+
+bool GzFile::read_input() {
+    auto count = source_->read(input_.data(), input_.size());
+    if (source_->error()) {
+        throw file_error("IO error while reading gziped file");
+    }
+
+    stream_->next_in = input_.data();
+    stream_->avail_in = static_cast<unsigned>(count);
+    input_end_ += count;
+
+    return count != 0;
+}
+
+uint64_t GzFile::compressed_position() const {
+    return input_end_ - stream_->avail_in;
+}
+
+void GzFile::restart() {
+    if (!source_->seek(0)) {
+        throw file_error("error while seeking gziped file: {}", std::strerror(errno));
+    }
+
+    input_end_ = 0;
+    stream_->next_in = input_.data();
+    stream_->avail_in = 0;
+
+    auto status = inflateReset2(stream_.get(), GZIP_WINDOW_BITS);
+    if (status != Z_OK) {
+        throw file_error("error while seeking gziped file: {}", stream_->msg);
+    }
+
+    raw_ = false;
+    stream_end_ = false;
+    position_ = 0;
+}
+
+void GzFile::restart(const checkpoint& checkpoint) {
+    auto offset = checkpoint.compressed - (checkpoint.bits != 0 ? 1 : 0);
+    if (!source_->seek(offset)) {
+        throw file_error("error while seeking gziped file: {}", std::strerror(errno));
+    }
+
+    input_end_ = offset;
+    stream_->next_in = input_.data();
+    stream_->avail_in = 0;
+
+    auto status = inflateReset2(stream_.get(), RAW_WINDOW_BITS);
+    if (status != Z_OK) {
+        throw file_error("error while seeking gziped file: {}", stream_->msg);
+    }
+
+    if (checkpoint.bits != 0) {
+        if (!this->read_input()) {
+            throw file_error("error while seeking gziped file: unexpected end of file");
+        }
+        // the checkpoint starts in the middle of this byte, give the
+        // remaining bits to zlib
+        int byte = stream_->next_in[0];
+        stream_->next_in += 1;
+        stream_->avail_in -= 1;
+        status = inflatePrime(stream_.get(), checkpoint.bits, byte >> (8 - checkpoint.bits));
+        if (status != Z_OK) {
+            throw file_error("error while seeking gziped file: {}", stream_->msg);
+        }
+    }
+
+    status = inflateSetDictionary(
+        stream_.get(), checkpoint.window.data(), static_cast<unsigned>(checkpoint.window.size())
+    );
+    if (status != Z_OK) {
+        throw file_error("error while seeking gziped file: {}", stream_->msg);
+    }
+
+    raw_ = true;
+    stream_end_ = false;
+    position_ = checkpoint.uncompressed;
+}
+
+bool GzFile::next_member() {
+    if (raw_) {
+        // when reading raw deflate data, zlib does not consume the gzip
+        // trailer (CRC32 and uncompressed size), so we skip it here.
+        for (size_t i = 0; i < 8; i++) {
+            if (stream_->avail_in == 0 && !this->read_input()) {
+                throw file_error("error while reading gziped file: unexpected end of file");
+            }
+            stream_->next_in += 1;
+            stream_->avail_in -= 1;
+        }
+    }
+
+    if (stream_->avail_in < 2) {
+        // move the remaining data at the start of the buffer, and fill the
+        // rest of the buffer to be able to look at the next two bytes
+        auto remaining = static_cast<size_t>(stream_->avail_in);
+        std::memmove(input_.data(), stream_->next_in, remaining);
+        auto count = source_->read(input_.data() + remaining, input_.size() - remaining);
+        if (source_->error()) {
+            throw file_error("IO error while reading gziped file");
+        }
+        input_end_ += count;
+        stream_->next_in = input_.data();
+        stream_->avail_in = static_cast<unsigned>(remaining + count);
+    }
+
+    if (stream_->avail_in < 2 || stream_->next_in[0] != 0x1f || stream_->next_in[1] != 0x8b) {
+        // no more gzip members. Like zlib, we ignore any trailing garbage
+        return false;
+    }
+
+    auto status = inflateReset2(stream_.get(), GZIP_WINDOW_BITS);
+    if (status != Z_OK) {
+        throw file_error("error while reading gziped file: {}", stream_->msg);
+    }
+    raw_ = false;
+
+    return true;
+}
+
+void GzFile::maybe_add_checkpoint() {
+    // bit 7 of data_type is set when zlib stopped at a deflate block boundary,
+    // and bit 6 if this was the last block in the deflate stream
+    auto type = stream_->data_type;
+    if ((type & 128) == 0 || (type & 64) != 0) {
+        return;
+    }
+
+    auto last = checkpoints_.empty() ? 0 : checkpoints_.back().uncompressed;
+    if (position_ < last + CHECKPOINT_SPAN) {
+        return;
+    }
+
+    auto point = checkpoint();
+    point.uncompressed = position_;
+    point.compressed = this->compressed_position();
+    point.bits = type & 7;
+    point.window.resize(WINDOW_SIZE);
+
+    auto size = WINDOW_SIZE;
+    auto status = inflateGetDictionary(stream_.get(), point.window.data(), &size);
+    if (status != Z_OK) {
+        throw file_error("error while reading gziped file: {}", stream_->msg);
     }
+    point.window.resize(size);
+
+    checkpoints_.emplace_back(std::move(point));
+}
+
+std::string GzFile::checkpoints_path(const std::string& path) {
+    return path + ".chfl-gzidx";
+}
+
+void GzFile::load_checkpoints(const std::string& path) {
+    if (transparent_ || !FrameIndex::enabled()) {
+        return;
+    }
+
+    checkpoints_index_ = std::make_unique<FrameIndex>(path, "gzip checkpoints", GzFile::checkpoints_path(path));
+    auto data = checkpoints_index_->load_data();
+    if (!data) {
+        return;
+    }
+
+    size_t offset = 0;
+    uint64_t count = 0;
+    if (!FrameIndex::read_value(*data, offset, count)) {
+        return;
+    }
+
+    auto checkpoints = std::vector<checkpoint>();
+    for (uint64_t i = 0; i < count; i++) {
+        auto point = checkpoint();
+        uint64_t bits = 0;
+        uint64_t window_size = 0;
+        if (!FrameIndex::read_value(*data, offset, point.uncompressed) ||
+            !FrameIndex::read_value(*data, offset, point.compressed) ||
+            !FrameIndex::read_value(*data, offset, bits) || bits > 7 ||
+            !FrameIndex::read_value(*data, offset, window_size) || window_size > WINDOW_SIZE ||
+            data->size() - offset < window_size) {
+            return;
+        }
+
+        if (!checkpoints.empty() && point.uncompressed <= checkpoints.back().uncompressed) {
+            return;
+        }
+
+        point.bits = static_cast<int>(bits);
+        auto window = data->data() + offset;
+        point.window.assign(window, window + window_size);
+        offset += static_cast<size_t>(window_size);
+
+        checkpoints.emplace_back(std::move(point));
+    }
+
+    if (offset != data->size()) {
+        return;
+    }
+
+    // the checkpoints cover the whole file, there is no need to save them
+    // again
+    checkpoints_ = std::move(checkpoints);
+    checkpoints_index_.reset();
+}
+
+void GzFile::save_checkpoints() {
+    auto data = std::vector<char>();
+    FrameIndex::append_value(data, static_cast<uint64_t>(checkpoints_.size()));
+    for (const auto& point: checkpoints_) {
+        FrameIndex::append_value(data, point.uncompressed);
+        FrameIndex::append_value(data, point.compressed);
+        FrameIndex::append_value(data, static_cast<uint64_t>(point.bits));
+        FrameIndex::append_value(data, static_cast<uint64_t>(point.window.size()));
+        data.insert(data.end(), point.window.begin(), point.window.end());
+    }
+
+    checkpoints_index_->save_data(data);
+    checkpoints_index_.reset();
 }
 
 size_t GzFile::read(char* data, size_t count) {
-    auto read = gzread(file_, data, checked_cast(count));
-    const auto* error = check_error();
-    if (read == -1 || error != nullptr) {
-        throw file_error("error while reading gziped file: {}", error);
+    if (transparent_) {
+        auto result = source_->read(data, count);
+        if (source_->error()) {
+            throw file_error("IO error while reading gziped file");
+        }
+        position_ += result;
+        return result;
+    }
+
+    size_t total = 0;
+    while (total < count && !stream_end_) {
+        // zlib uses `unsigned` for sizes, so we might need to read in
+        // multiple chunks
+        auto chunk = std::min(count - total, static_cast<size_t>(std::numeric_limits<unsigned>::max()));
+        stream_->next_out = reinterpret_cast<Bytef*>(data + total);
+        stream_->avail_out = static_cast<unsigned>(chunk);
+
+        while (stream_->avail_out != 0) {
+            if (stream_->avail_in == 0 && !this->read_input()) {
+                throw file_error("error while reading gziped file: unexpected end of file");
+            }
+
+            auto available = stream_->avail_out;
+            // Z_BLOCK makes inflate stop at deflate blocks boundaries, where
+            // we can add checkpoints
+            auto status = inflate(stream_.get(), Z_BLOCK);
+            position_ += available - stream_->avail_out;
+
+            if (status == Z_STREAM_END) {
+                if (!this->next_member()) {
+                    stream_end_ = true;
+                    if (checkpoints_index_ != nullptr) {
+                        // we decompressed the whole file, and know about all
+                        // the checkpoints in it
+                        this->save_checkpoints();
+                    }
+                    break;
+                }
+            } else if (status == Z_OK) {
+                this->maybe_add_checkpoint();
+            } else {
+                const auto* message = stream_->msg != nullptr ? stream_->msg : "unknown error";
+                throw file_error("error while reading gziped file: {}", message);
+            }
+        }
+
+        total += chunk - stream_->avail_out;
+    }
+
+    return total;
+}
+
+/// Compress `data` to a full gzip member
+static std::vector<unsigned char> compress_member(const std::vector<char>& data) {
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(z_stream));
+
+    auto status = deflateInit2(&stream, COMPRESSION_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY);
+    if (status != Z_OK) {
+        throw file_error("error while writting to gziped file: {}", stream.msg);
     }
-    return static_cast<size_t>(read);
+
+    auto output = std::vector<unsigned char>(deflateBound(&stream, checked_cast(data.size())));
+    stream.next_in = reinterpret_cast<const Bytef*>(data.data());
+    stream.avail_in = checked_cast(data.size());
+    stream.next_out = output.data();
+    stream.avail_out = checked_cast(output.size());
+
+    status = deflate(&stream, Z_FINISH);
+    if (status != Z_STREAM_END) {
+        const auto* message = stream.msg != nullptr ? stream.msg : "unknown error";
+        deflateEnd(&stream);
+        throw file_error("error while writting to gziped file: {}", message);
+    }
+
+    output.resize(output.size() - stream.avail_out);
+    deflateEnd(&stream);
+
+    return output;
+}
+
+/// Number of gzip members to compress in parallel
+static size_t compression_threads() {
+    auto threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(threads, 8));
 }
 
 void GzFile::write(const char* data, size_t count) {
-    auto actual = gzwrite(file_, data, checked_cast(count));
-    const auto* error = check_error();
-    if (actual == 0 || error != nullptr) {
-        throw file_error("error while writting to gziped file: {}", error);
+    while (count != 0) {
+        auto amount = std::min(count, CHUNK_SIZE - chunk_.size());
+        chunk_.insert(chunk_.end(), data, data + amount);
+        data += amount;
+        count -= amount;
+
+        if (chunk_.size() == CHUNK_SIZE) {
+            this->start_compression();
+        }
+    }
+}
+
+void GzFile::start_compression() {
+    auto chunk = std::move(chunk_);
+    chunk_ = std::vector<char>();
+    chunk_.reserve(CHUNK_SIZE);
+
+    compressing_.emplace_back(std::async(std::launch::async, [](std::vector<char> uncompressed) {
+        return compress_member(uncompressed);
+    }, std::move(chunk)));
+
+    while (compressing_.size() > compression_threads()) {
+        this->write_member();
     }
-    if (static_cast<size_t>(actual) != count) {
+}
+
+void GzFile::write_member() {
+    auto member = compressing_.front().get();
+    compressing_.pop_front();
+
+    auto written = std::fwrite(member.data(), 1, member.size(), file_);
+    if (written != member.size()) {
         throw file_error("could not write data to the file at '{}'", this->path());
     }
+    written_ = true;
 }
 
-const char* GzFile::check_error() const {
-    int status = Z_OK;
-    const auto* message = gzerror(file_, &status);
-    return status == Z_OK ? nullptr : message;
+void GzFile::finish() {
+    // always write at least one member, to create a valid gzip file
+    if (!chunk_.empty() || (compressing_.empty() && !written_)) {
+        this->start_compression();
+    }
+
+    while (!compressing_.empty()) {
+        this->write_member();
+    }
 }
 
 void GzFile::clear() noexcept {
-    gzclearerr(file_);
+    if (source_ != nullptr) {
+        source_->clear();
+    } else {
+        std::clearerr(file_);
+    }
 }
 
 void GzFile::seek(uint64_t position) {
-    static_assert(
-        sizeof(uint64_t) == sizeof(z_off64_t),
-        "uint64_t and z_off64_t do not have the same size"
+    if (transparent_) {
+        if (!source_->seek(position)) {
+            throw file_error("error while seeking gziped file: {}", std::strerror(errno));
+        }
+        position_ = position;
+        return;
+    }
+
+    // find the last checkpoint before the requested position
+    auto after = std::upper_bound(checkpoints_.begin(), checkpoints_.end(), position,
+        [](uint64_t value, const checkpoint& point) {
+            return value < point.uncompressed;
+        }
     );
-    auto status = gzseek64(file_, static_cast<z_off64_t>(position), SEEK_SET);
-    if (status == -1) {
-        const auto* message = check_error();
-        throw file_error("error while seeking gziped file: {}", message);
+
+    if (after == checkpoints_.begin()) {
+        if (position < position_) {
+            this->restart();
+        }
+    } else {
+        const auto& before = *(after - 1);
+        if (position < position_ || before.uncompressed > position_) {
+            this->restart(before);
+        }
+    }
+
+    // decompress and discard data until we reach the requested position
+    constexpr size_t BUFFSIZE = 16384;
+    char buffer[BUFFSIZE];
+    while (position_ < position) {
+        auto count = static_cast<size_t>(std::min<uint64_t>(BUFFSIZE, position - position_));
+        if (this->read(buffer, count) == 0) {
+            // seeking past the end of the file
+            break;
+        }
     }
 }
 
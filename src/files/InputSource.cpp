@@ -0,0 +1,117 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include "chemfiles/error_fmt.hpp"
+#include "chemfiles/external/optional.hpp"
+
+#include "chemfiles/files/InputSource.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
+
+using namespace chemfiles;
+
+#ifdef __CYGWIN__
+    #include <sys/types.h>
+    #define fseek64 fseek
+    #define ftell64 ftell
+    #define off64_t off_t
+#elif defined(_MSC_VER)
+    #define fseek64 _fseeki64
+    #define ftell64 _ftelli64
+    #define off64_t __int64
+#else
+    // assume unix by default
+    #include <sys/types.h>
+    #define fseek64 fseeko
+    #define ftell64 ftello
+    #define off64_t off_t
+#endif
+
+InputSource::InputSource(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "rb");
+    if (file_ == nullptr) {
+        throw file_error("could not open the file at '{}'", path);
+    }
+}
+
+InputSource::InputSource(std::shared_ptr<MemoryBuffer> memory): memory_(std::move(memory)) {}
+
+InputSource::~InputSource() {
+    if (file_ != nullptr) {
+        std::fclose(file_);
+    }
+}
+
+size_t InputSource::read(void* data, size_t count) {
+    if (file_ != nullptr) {
+        return std::fread(data, 1, count, file_);
+    }
+
+    auto amount = std::min(count, memory_->size() - position_);
+    if (amount != 0) {
+        std::memcpy(data, memory_->data() + position_, amount);
+    }
+    position_ += amount;
+    if (amount < count) {
+        eof_ = true;
+    }
+    return amount;
+}
+
+bool InputSource::seek(uint64_t position) {
+    if (file_ != nullptr) {
+        return fseek64(file_, static_cast<off64_t>(position), SEEK_SET) == 0;
+    }
+
+    // like fseek, seeking past the end is allowed, and further reads will
+    // return 0
+    position_ = static_cast<size_t>(std::min(position, static_cast<uint64_t>(memory_->size())));
+    eof_ = false;
+    return true;
+}
+
+optional<uint64_t> InputSource::size() {
+    if (file_ != nullptr) {
+        auto initial = ftell64(file_);
+        if (initial < 0 || fseek64(file_, 0, SEEK_END) != 0) {
+            return nullopt;
+        }
+
+        auto size = ftell64(file_);
+        if (fseek64(file_, initial, SEEK_SET) != 0 || size < 0) {
+            return nullopt;
+        }
+        return static_cast<uint64_t>(size);
+    }
+
+    return static_cast<uint64_t>(memory_->size());
+}
+
+bool InputSource::eof() const {
+    if (file_ != nullptr) {
+        return std::feof(file_) != 0;
+    }
+    return eof_;
+}
+
+bool InputSource::error() const {
+    if (file_ != nullptr) {
+        return std::ferror(file_) != 0;
+    }
+    return false;
+}
+
+void InputSource::clear() noexcept {
+    if (file_ != nullptr) {
+        std::clearerr(file_);
+    } else {
+        eof_ = false;
+    }
+}
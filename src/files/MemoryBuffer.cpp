@@ -12,6 +12,7 @@
 #include "chemfiles/File.hpp"
 #include "chemfiles/files/GzFile.hpp"
 #include "chemfiles/files/XzFile.hpp"
+#include "chemfiles/files/ZstdFile.hpp"
 #include "chemfiles/files/Bz2File.hpp"
 
 #include "chemfiles/files/MemoryBuffer.hpp"
@@ -62,22 +63,29 @@ MemoryBuffer::~MemoryBuffer() {
 }
 
 void MemoryBuffer::write(const char* data, size_t size) {
+    this->write_at(len_, data, size);
+}
+
+void MemoryBuffer::write_at(size_t position, const char* data, size_t size) {
     if (!this->is_owned()) {
         throw file_error("can not write to read-only MemoryBuffer");
     }
 
     // +1 to always ensure there is a NULL byte at the end of the buffer
-    if (size > (capacity_ - (len_ + 1))) {
+    auto end = position + size;
+    if (end + 1 > capacity_) {
         auto extra = capacity_;
-        while (size > (capacity_ + extra - (len_ + 1))) {
+        while (end + 1 > capacity_ + extra) {
             extra *= 2;
         }
         this->reserve_extra(extra);
     }
 
-    auto* start = ptr_ + len_;
-    std::copy(data, data + size, start);
-    len_ += size;
+    // the memory after the end of the data is always filled with zeros
+    // (from calloc or reserve_extra), so any gap between the current end of
+    // the data and `position` already contains zeros
+    std::copy(data, data + size, ptr_ + position);
+    len_ = std::max(len_, end);
 }
 
 void MemoryBuffer::reserve_extra(size_t extra) {
@@ -118,6 +126,9 @@ void MemoryBuffer::decompress(File::Compression compression) {
     case File::BZIP2:
         *this = decompress_bz2(this->data(), this->size());
         break;
+    case File::ZSTD:
+        *this = decompress_zstd(this->data(), this->size());
+        break;
     case File::DEFAULT:
         // nothing to do
         break;
@@ -6,12 +6,14 @@
 
 #include <memory>
 #include <algorithm>
+#include <string_view>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/files/MemoryFile.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"  // IWYU pragma: keep
 
 #include "chemfiles/error_fmt.hpp"
+#include "chemfiles/external/optional.hpp"
 
 using namespace chemfiles;
 
@@ -46,6 +48,16 @@ size_t MemoryFile::read(char* data, size_t count) {
     return amount_to_read;
 }
 
+optional<std::string_view> MemoryFile::data() const {
+    if (mode_ != File::READ) {
+        // the buffer can be reallocated by writes, so we can not give access
+        // to it directly
+        return nullopt;
+    }
+
+    return std::string_view(buffer_->data(), buffer_->size());
+}
+
 void MemoryFile::write(const char* data, size_t count) {
     if (mode_ != File::WRITE) {
         throw file_error("cannot write to a memory file unless it is opened in write mode");
@@ -0,0 +1,130 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <limits>
+#include <algorithm>
+
+#include "chemfiles/File.hpp"
+#include "chemfiles/error_fmt.hpp"
+#include "chemfiles/warnings.hpp"
+
+#include "chemfiles/files/MmapFile.hpp"
+
+#if CHEMFILES_TEXT_FILE_USE_MMAP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace chemfiles;
+
+// On 32-bit systems, the address space is too small to map very large
+// files. Limit the mapping to 512 MiB, and use `PlainFile` for larger files.
+static constexpr uint64_t MMAP_MAX_SIZE_32_BITS = 0x20000000;
+
+bool MmapFile::can_map(const std::string& path) {
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return false;
+    }
+
+    if (!S_ISREG(file_stat.st_mode)) {
+        return false;
+    }
+
+    auto size = static_cast<uint64_t>(file_stat.st_size);
+    if (sizeof(void*) < 8 && size > MMAP_MAX_SIZE_32_BITS) {
+        return false;
+    }
+
+    return size < std::numeric_limits<size_t>::max();
+}
+
+MmapFile::MmapFile(const std::string& path): TextFileImpl(path) {
+    auto file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor == -1) {
+        throw file_error("could not open the file at '{}'", path);
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) != 0) {
+        auto* message = std::strerror(errno);
+        ::close(file_descriptor);
+        throw file_error("could not get the size of the file at '{}': {}", path, message);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    if (size_ == 0) {
+        // mmap does not accept empty mappings, use an empty string instead
+        ::close(file_descriptor);
+        data_ = "";
+        return;
+    }
+
+    auto* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    // the mapping keeps a reference to the file, we don't need the file
+    // descriptor anymore
+    ::close(file_descriptor);
+
+    if (mapping == MAP_FAILED) {
+        throw file_error("mmap failed for '{}': {}", path, std::strerror(errno));
+    }
+    data_ = static_cast<const char*>(mapping);
+
+    // text files are mostly read from start to end, this is only an hint so
+    // we ignore any error
+    madvise(mapping, size_, MADV_SEQUENTIAL);
+}
+
+MmapFile::~MmapFile() {
+    if (size_ != 0) {
+        if (munmap(const_cast<char*>(data_), size_) != 0) {
+            warning(
+                "memory mapped file",
+                "failed to unmap file ({}), something might be wrong",
+                std::strerror(errno)
+            );
+        }
+    }
+}
+
+bool MmapFile::grown() const {
+    struct stat file_stat;
+    auto path = std::string(this->path());
+    if (stat(path.c_str(), &file_stat) != 0) {
+        return false;
+    }
+    return static_cast<uint64_t>(file_stat.st_size) > static_cast<uint64_t>(size_);
+}
+
+void MmapFile::seek(uint64_t position) {
+    current_ = static_cast<size_t>(std::min(position, static_cast<uint64_t>(size_)));
+}
+
+size_t MmapFile::read(char* data, size_t count) {
+    auto amount = std::min(count, size_ - current_);
+    std::memcpy(data, data_ + current_, amount);
+    current_ += amount;
+    return amount;
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsuggest-attribute=noreturn"
+#endif
+
+void MmapFile::write(const char* /*unused*/, size_t /*unused*/) {
+    throw file_error("cannot write to the file at '{}', it is opened in read mode", this->path());
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <map>
 #include <memory>
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -17,6 +18,7 @@
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/external/optional.hpp"
 #include "chemfiles/files/BinaryFile.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/unreachable.hpp"
 
 using namespace chemfiles;
@@ -34,52 +36,52 @@ template<> struct nc_type_info<char> {
     static constexpr int32_t nc_type = constants::NC_CHAR;
     static constexpr const char* name = "char";
 
-    static constexpr void(Netcdf3File::*reader)(char*, size_t)
-        = static_cast<void (Netcdf3File::*)(char*, size_t)>(&Netcdf3File::read_char);
-    static constexpr void(Netcdf3File::*writer)(const char*, size_t)
-        = static_cast<void (Netcdf3File::*)(const char*, size_t)>(&Netcdf3File::write_char);
+    static constexpr void(BigEndianFile::*reader)(char*, size_t)
+        = static_cast<void (BigEndianFile::*)(char*, size_t)>(&BigEndianFile::read_char);
+    static constexpr void(BigEndianFile::*writer)(const char*, size_t)
+        = static_cast<void (BigEndianFile::*)(const char*, size_t)>(&BigEndianFile::write_char);
 };
 
 template<> struct nc_type_info<int8_t> {
     static constexpr int32_t nc_type = constants::NC_BYTE;
     static constexpr const char* name = "byte/i8";
 
-    static constexpr void(Netcdf3File::*reader)(int8_t*, size_t)
-        = static_cast<void (Netcdf3File::*)(int8_t*, size_t)>(&Netcdf3File::read_i8);
-    static constexpr void(Netcdf3File::*writer)(const int8_t*, size_t)
-        = static_cast<void (Netcdf3File::*)(const int8_t*, size_t)>(&Netcdf3File::write_i8);
+    static constexpr void(BigEndianFile::*reader)(int8_t*, size_t)
+        = static_cast<void (BigEndianFile::*)(int8_t*, size_t)>(&BigEndianFile::read_i8);
+    static constexpr void(BigEndianFile::*writer)(const int8_t*, size_t)
+        = static_cast<void (BigEndianFile::*)(const int8_t*, size_t)>(&BigEndianFile::write_i8);
 };
 
 template<> struct nc_type_info<int16_t> {
     static constexpr int32_t nc_type = constants::NC_SHORT;
     static constexpr const char* name = "short/i16";
 
-    static constexpr void(Netcdf3File::*reader)(int16_t*, size_t) = &Netcdf3File::read_i16;
-    static constexpr void(Netcdf3File::*writer)(const int16_t*, size_t) = &Netcdf3File::write_i16;
+    static constexpr void(BigEndianFile::*reader)(int16_t*, size_t) = &BigEndianFile::read_i16;
+    static constexpr void(BigEndianFile::*writer)(const int16_t*, size_t) = &BigEndianFile::write_i16;
 };
 
 template<> struct nc_type_info<int32_t> {
     static constexpr int32_t nc_type = constants::NC_INT;
     static constexpr const char* name = "int/i32";
 
-    static constexpr void(Netcdf3File::*reader)(int32_t*, size_t) = &Netcdf3File::read_i32;
-    static constexpr void(Netcdf3File::*writer)(const int32_t*, size_t) = &Netcdf3File::write_i32;
+    static constexpr void(BigEndianFile::*reader)(int32_t*, size_t) = &BigEndianFile::read_i32;
+    static constexpr void(BigEndianFile::*writer)(const int32_t*, size_t) = &BigEndianFile::write_i32;
 };
 
 template<> struct nc_type_info<float> {
     static constexpr int32_t nc_type = constants::NC_FLOAT;
     static constexpr const char* name = "float/f32";
 
-    static constexpr void(Netcdf3File::*reader)(float*, size_t) = &Netcdf3File::read_f32;
-    static constexpr void(Netcdf3File::*writer)(const float*, size_t) = &Netcdf3File::write_f32;
+    static constexpr void(BigEndianFile::*reader)(float*, size_t) = &BigEndianFile::read_f32;
+    static constexpr void(BigEndianFile::*writer)(const float*, size_t) = &BigEndianFile::write_f32;
 };
 
 template<> struct nc_type_info<double> {
     static constexpr int32_t nc_type = constants::NC_DOUBLE;
     static constexpr const char* name = "double/f64";
 
-    static constexpr void(Netcdf3File::*reader)(double*, size_t) = &Netcdf3File::read_f64;
-    static constexpr void(Netcdf3File::*writer)(const double*, size_t) = &Netcdf3File::write_f64;
+    static constexpr void(BigEndianFile::*reader)(double*, size_t) = &BigEndianFile::read_f64;
+    static constexpr void(BigEndianFile::*writer)(const double*, size_t) = &BigEndianFile::write_f64;
 };
 
 /******************************************************************************/
@@ -326,6 +328,80 @@ template void Variable::read(size_t step, int32_t* data, size_t count);
 template void Variable::read(size_t step, float* data, size_t count);
 template void Variable::read(size_t step, double* data, size_t count);
 
+size_t Variable::n_steps(size_t step_begin, size_t step_end, size_t stride) const {
+    if (stride == 0) {
+        throw file_error("the stride must be at least 1 when reading a variable");
+    }
+
+    if (step_end <= step_begin) {
+        return 0;
+    }
+
+    if (this->is_record()) {
+        auto n_records = file_.get().n_records();
+        if (step_end > n_records) {
+            throw file_error(
+                "out of bounds: trying to read variable up to step {}, "
+                "but there are only {} steps in this file",
+                step_end - 1, n_records
+            );
+        }
+    } else if (step_begin != 0 || step_end != 1) {
+        throw file_error("can not read non-record variable at an other step than 0");
+    }
+
+    return (step_end - step_begin + stride - 1) / stride;
+}
+
+template<typename T>
+void Variable::read(size_t step_begin, size_t step_end, size_t stride, T* data, size_t count) {
+    auto& file = file_.get();
+    auto n_steps = this->n_steps(step_begin, step_end, stride);
+
+    if (layout_.type != nc_type_info<T>::nc_type) {
+        throw file_error(
+            "internal error: the code tried to read {} data, but this "
+            "variable contains {} values",
+            nc_type_info<T>::name, layout_.type_name()
+        );
+    }
+
+    auto step_count = layout_.count();
+    if (count != n_steps * step_count) {
+        throw file_error(
+            "wrong array size in Variable::read: expected {}, got {}",
+            n_steps * step_count, count
+        );
+    }
+
+    if (n_steps == 0) {
+        return;
+    }
+
+    auto begin = static_cast<uint64_t>(layout_.offset);
+    begin += static_cast<uint64_t>(step_begin) * file.record_size();
+
+    if (!this->is_record() || (stride == 1 && file.record_size() == static_cast<uint64_t>(layout_.size))) {
+        // this is a non-record variable, or the only record variable without
+        // padding between steps: all the values are contiguous in the file
+        file.seek(begin);
+        (file.*nc_type_info<T>::reader)(data, count);
+        return;
+    }
+
+    file.load_records(step_begin, stride, n_steps);
+    auto& records = *file.records_.data;
+    auto offset = static_cast<uint64_t>(layout_.offset) - file.records_begin_;
+    for (size_t i = 0; i < n_steps; i++) {
+        records.seek(offset + i * file.record_size());
+        (records.*nc_type_info<T>::reader)(data + i * step_count, step_count);
+    }
+}
+
+template void Variable::read(size_t step_begin, size_t step_end, size_t stride, int32_t* data, size_t count);
+template void Variable::read(size_t step_begin, size_t step_end, size_t stride, float* data, size_t count);
+template void Variable::read(size_t step_begin, size_t step_end, size_t stride, double* data, size_t count);
+
 template<typename T>
 void Variable::write(size_t step, const T* data, size_t count) {
     auto& file = file_.get();
@@ -360,6 +436,8 @@ void Variable::write(size_t step, const T* data, size_t count) {
     begin += static_cast<uint64_t>(step) * file.record_size();
     file.seek(begin);
     (file.*nc_type_info<T>::writer)(data, count);
+    // the records loaded in memory might be out of date now
+    file.records_.data = nullptr;
 
     if (this->is_record()) {
         // fmt::print("written to {} at step {}", , step)
@@ -400,6 +478,17 @@ void Variable::write_fill_value(size_t step) {
 Netcdf3File::Netcdf3File(std::string filename, File::Mode mode):
     BigEndianFile(std::move(filename), mode)
 {
+    this->read_header();
+}
+
+Netcdf3File::Netcdf3File(std::shared_ptr<MemoryBuffer> memory, File::Mode mode):
+    BigEndianFile(std::move(memory), mode)
+{
+    this->read_header();
+}
+
+void Netcdf3File::read_header() {
+    auto mode = this->mode();
     if (mode == File::WRITE) {
         // nothing to do for now, the file will be intialized by a Netcdf3Builder
         return;
@@ -728,19 +817,67 @@ void Netcdf3File::read_variables() {
         ));
     }
 
-    // now that we know all the variables, compute the size of a single record
-    // entry, which includes all record variables
+    this->compute_record_layout();
+}
+
+void Netcdf3File::compute_record_layout() {
+    // compute the size of a single record entry, which includes all record
+    // variables, and the position of the first record
     this->record_size_ = 0;
+    this->records_begin_ = 0;
+    auto first = true;
     for (const auto& it: variables_) {
         const auto& variable = it.second;
 
         if (variable.is_record()) {
             this->record_size_ += static_cast<uint64_t>(variable.layout_.size);
             this->record_size_ += static_cast<uint64_t>(padding(variable.layout_.size));
+
+            auto offset = static_cast<uint64_t>(variable.layout_.offset);
+            if (first || offset < this->records_begin_) {
+                this->records_begin_ = offset;
+                first = false;
+            }
         }
     }
 }
 
+void Netcdf3File::load_records(size_t step_begin, size_t stride, size_t n_steps) {
+    if (records_.data != nullptr && records_.step_begin == step_begin &&
+        records_.stride == stride && records_.n_steps == n_steps) {
+        return;
+    }
+    records_.data = nullptr;
+
+    auto record_size = static_cast<size_t>(record_size_);
+    records_.buffer.assign(n_steps * record_size, 0);
+    auto* output = records_.buffer.data();
+    // the padding after the last record is not always present in the file
+    auto file_size = this->file_size();
+
+    auto begin = records_begin_ + static_cast<uint64_t>(step_begin) * record_size_;
+    if (stride == 1) {
+        // all the records are next to each other, read them with a single call
+        auto size = std::min<uint64_t>(n_steps * record_size, file_size - begin);
+        this->seek(begin);
+        this->read_char(output, static_cast<size_t>(size));
+    } else {
+        auto step_size = static_cast<uint64_t>(stride) * record_size_;
+        for (size_t i = 0; i < n_steps; i++) {
+            auto position = begin + i * step_size;
+            auto size = std::min<uint64_t>(record_size_, file_size - position);
+            this->seek(position);
+            this->read_char(output + i * record_size, static_cast<size_t>(size));
+        }
+    }
+
+    auto memory = std::make_shared<MemoryBuffer>(records_.buffer.data(), records_.buffer.size());
+    records_.data = std::make_unique<BigEndianFile>(std::move(memory), File::READ);
+    records_.step_begin = step_begin;
+    records_.stride = stride;
+    records_.n_steps = n_steps;
+}
+
 optional<const Value&> Netcdf3File::attribute(const std::string& name) const {
     auto it = attributes_.find(name);
     if (it != attributes_.end()) {
@@ -947,7 +1084,6 @@ void Netcdf3Builder::initialize(Netcdf3File* file) && {
         offset += delta;
     }
 
-    uint64_t record_size = 0;
     for (auto& it: variables) {
         if (!it.second.is_record()) {
             continue;
@@ -962,7 +1098,6 @@ void Netcdf3Builder::initialize(Netcdf3File* file) && {
 
         auto delta = static_cast<uint64_t>(layout.size) + static_cast<uint64_t>(padding(layout.size));
         offset += delta;
-        record_size += delta;
     }
 
     // fill up the non-record variable with fill values
@@ -973,9 +1108,9 @@ void Netcdf3Builder::initialize(Netcdf3File* file) && {
     }
 
     // move all the data to the file
-    file->record_size_ = record_size;
     file->n_records_ = 0;
     file->attributes_ = std::move(this->attributes_);
     file->dimensions_ = std::move(this->dimensions_);
     file->variables_ = std::move(variables);
+    file->compute_record_layout();
 }
@@ -0,0 +1,210 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <exception>
+#include <condition_variable>
+
+#include "chemfiles/File.hpp"
+#include "chemfiles/error_fmt.hpp"
+
+#include "chemfiles/files/PipelinedFile.hpp"
+
+using namespace chemfiles;
+
+/// Size of the buffers filled by the background thread
+static constexpr size_t CHUNK_SIZE = 256 * 1024;
+/// Number of buffers filled by the background thread. One of them is used by
+/// the consumer at any time, the other can be filled in advance.
+static constexpr size_t CHUNK_COUNT = 4;
+
+PipelinedFile::PipelinedFile(const std::string& path, std::unique_ptr<TextFileImpl> file):
+    TextFileImpl(path), file_(std::move(file)), current_{{}, 0}
+{
+    for (size_t i = 0; i < CHUNK_COUNT; i++) {
+        free_.emplace_back(CHUNK_SIZE);
+    }
+
+    thread_ = std::thread([this]() { this->run(); });
+}
+
+PipelinedFile::~PipelinedFile() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    producer_.notify_one();
+    thread_.join();
+}
+
+void PipelinedFile::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        producer_.wait(lock, [this]() {
+            return stop_ || clear_pending_ || seek_pending_ || (!eof_ && !error_ && !free_.empty());
+        });
+
+        if (stop_) {
+            return;
+        }
+
+        if (clear_pending_) {
+            clear_pending_ = false;
+            file_->clear();
+            continue;
+        }
+
+        if (seek_pending_) {
+            seek_pending_ = false;
+            auto position = seek_position_;
+            auto generation = generation_;
+
+            lock.unlock();
+            auto error = std::exception_ptr();
+            try {
+                file_->seek(position);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            lock.lock();
+
+            if (error && generation == generation_) {
+                error_ = error;
+                consumer_.notify_one();
+            }
+            continue;
+        }
+
+        auto buffer = std::move(free_.back());
+        free_.pop_back();
+        auto generation = generation_;
+
+        // read without holding the lock, so the consumer can use the
+        // already filled chunks in the meantime
+        lock.unlock();
+        size_t count = 0;
+        auto error = std::exception_ptr();
+        try {
+            count = file_->read(buffer.data(), buffer.size());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+
+        if (generation != generation_) {
+            // `seek` was called while we were reading, discard this data
+            free_.emplace_back(std::move(buffer));
+            continue;
+        }
+
+        if (error) {
+            error_ = error;
+            free_.emplace_back(std::move(buffer));
+        } else if (count == 0) {
+            // only an empty read marks the end of file, `file_` can return
+            // less data than requested before reaching it
+            eof_ = true;
+            free_.emplace_back(std::move(buffer));
+        } else {
+            ready_.push_back({std::move(buffer), count});
+        }
+        consumer_.notify_one();
+    }
+}
+
+size_t PipelinedFile::read(char* data, size_t count) {
+    size_t total = 0;
+    while (total < count) {
+        auto available = current_.size - current_position_;
+        if (available == 0) {
+            // give the current buffer back to the background thread, and wait
+            // for the next one
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!current_.data.empty()) {
+                free_.emplace_back(std::move(current_.data));
+                current_ = chunk{{}, 0};
+                current_position_ = 0;
+                producer_.notify_one();
+            }
+
+            consumer_.wait(lock, [this]() {
+                return !ready_.empty() || error_ || eof_;
+            });
+
+            if (!ready_.empty()) {
+                current_ = std::move(ready_.front());
+                ready_.pop_front();
+            } else if (error_) {
+                auto error = error_;
+                error_ = nullptr;
+                // try to read again after this error
+                producer_.notify_one();
+                std::rethrow_exception(error);
+            } else {
+                // end of file
+                break;
+            }
+            continue;
+        }
+
+        auto amount = std::min(available, count - total);
+        std::memcpy(data + total, current_.data.data() + current_position_, amount);
+        current_position_ += amount;
+        total += amount;
+    }
+
+    return total;
+}
+
+void PipelinedFile::clear() noexcept {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clear_pending_ = true;
+    }
+    producer_.notify_one();
+}
+
+void PipelinedFile::seek(uint64_t position) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_ += 1;
+        seek_pending_ = true;
+        seek_position_ = position;
+
+        // discard all the data read from the previous position
+        for (auto& ready: ready_) {
+            free_.emplace_back(std::move(ready.data));
+        }
+        ready_.clear();
+
+        if (!current_.data.empty()) {
+            free_.emplace_back(std::move(current_.data));
+        }
+        current_ = chunk{{}, 0};
+        current_position_ = 0;
+
+        eof_ = false;
+        error_ = nullptr;
+    }
+    producer_.notify_one();
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wsuggest-attribute=noreturn"
+#endif
+
+void PipelinedFile::write(const char* /*unused*/, size_t /*unused*/) {
+    throw file_error("cannot write to the file at '{}', it is opened in read mode", this->path());
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
@@ -95,6 +95,18 @@ PlainFile::~PlainFile() {
     }
 }
 
+void PlainFile::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto status = std::fclose(file_);
+    file_ = nullptr;
+    if (status != 0) {
+        throw file_error("could not close the file at '{}': {}", this->path(), std::strerror(errno));
+    }
+}
+
 void PlainFile::clear() noexcept {
     std::clearerr(file_);
 }
@@ -0,0 +1,46 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstddef>
+#include <cstdint>
+
+#include "chemfiles/files/StreamFile.hpp"
+
+#include "chemfiles/error_fmt.hpp"
+
+using namespace chemfiles;
+
+void StreamFile::seek(uint64_t position) {
+    if (position != position_) {
+        throw file_error(
+            "can not seek to position {} in a stream (current position is {})",
+            position, position_
+        );
+    }
+}
+
+size_t StreamFile::read(char* data, size_t count) {
+    if (!read_) {
+        throw file_error("cannot read a stream unless it is opened in read mode");
+    }
+
+    auto read_count = read_(data, count);
+    if (read_count > count) {
+        throw file_error(
+            "invalid stream: the read callback returned {} bytes, but only {} were requested",
+            read_count, count
+        );
+    }
+    position_ += read_count;
+
+    return read_count;
+}
+
+void StreamFile::write(const char* data, size_t count) {
+    if (!write_) {
+        throw file_error("cannot write to a stream unless it is opened in write mode");
+    }
+
+    write_(data, count);
+    position_ += count;
+}
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <cstdlib>
 
+#include <array>
 #include <algorithm>
 #include <limits>
 #include <string>
@@ -27,6 +28,8 @@ using namespace chemfiles;
 
 XDRFile::XDRFile(std::string path, File::Mode mode) : BigEndianFile(std::move(path), mode) {}
 
+XDRFile::XDRFile(std::shared_ptr<MemoryBuffer> memory, File::Mode mode) : BigEndianFile(std::move(memory), mode) {}
+
 void XDRFile::read_opaque(std::vector<char>& data) {
     const uint32_t count = read_single_u32();
     const uint32_t num_filler = (4 - (count % 4)) % 4;
@@ -66,11 +69,15 @@ void XDRFile::write_gmx_long_opaque(const char* data, uint64_t count) {
 std::string XDRFile::read_gmx_string() {
     // lenght with null terminator
     const uint32_t len = read_single_u32();
-    // next comes XDR string without terminator
-    std::vector<char> buf;
-    read_opaque(buf);
-    assert(len == buf.size() + 1);
-    return std::string(buf.begin(), buf.end());
+    // next comes XDR string without terminator, stored as opaque data. Read
+    // it directly in the string to avoid allocating for short strings.
+    const uint32_t count = read_single_u32();
+    const uint32_t num_filler = (4 - (count % 4)) % 4;
+    auto value = std::string(static_cast<size_t>(count + num_filler), '\0');
+    read_char(&value[0], count + num_filler);
+    value.resize(count);
+    assert(len == value.size() + 1);
+    return value;
 }
 
 void XDRFile::write_gmx_string(const std::string& value) {
@@ -84,16 +91,16 @@ void XDRFile::write_gmx_string(const std::string& value) {
 UnitCell XDRFile::read_gmx_box(bool use_double) {
     if (use_double) {
         // Double
-        std::vector<double> box(3 * 3);
-        read_f64(box);
+        std::array<double, 9> box = {};
+        read_f64(box.data(), box.size());
         auto matrix =
             Matrix3D(box[0], box[1], box[2], box[3], box[4], box[5], box[6], box[7], box[8]);
         // Factor 10 because the lengths are in nm in the TPR/TRR/XTC format
         return UnitCell(10.0 * matrix);
     } else {
         // Float
-        std::vector<float> box(3 * 3);
-        read_f32(box);
+        std::array<float, 9> box = {};
+        read_f32(box.data(), box.size());
         auto matrix = Matrix3D(
             static_cast<double>(box[0]), static_cast<double>(box[1]), static_cast<double>(box[2]),
             static_cast<double>(box[3]), static_cast<double>(box[4]), static_cast<double>(box[5]),
@@ -1,19 +1,29 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <limits>
+#include <future>
+#include <thread>
+#include <utility>
+#include <exception>
+#include <algorithm>
 
 #include <lzma.h>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/error_fmt.hpp"
+#include "chemfiles/unreachable.hpp"
 
 #include "chemfiles/files/XzFile.hpp"
+#include "chemfiles/files/InputSource.hpp"
 #include "chemfiles/files/MemoryBuffer.hpp"
 
 using namespace chemfiles;
@@ -54,71 +64,145 @@ static void check(lzma_ret code) {
     }
 }
 
+// lzma_file_info_decoder was added in liblzma 5.4. Older versions (when using
+// the system lzma) will always use the streaming decoder.
+#if LZMA_VERSION >= UINT32_C(50040002)
+    #define CHEMFILES_LZMA_FILE_INFO 1
+#else
+    #define CHEMFILES_LZMA_FILE_INFO 0
+#endif
+
+/// Maximal size of a single decompressed block to use block-based reading. We
+/// decompress full blocks in memory, so files with larger blocks are read with
+/// the streaming decoder instead.
+static constexpr uint64_t MAX_BLOCK_SIZE = 64 * 1024 * 1024;
+/// Amount of data decompressed between checks for cancellation, when
+/// decompressing blocks in the background
+static constexpr size_t DECOMPRESSION_STEP = 1024 * 1024;
+/// Size of the uncompressed data in each block when writing files
+static constexpr size_t WRITE_BLOCK_SIZE = 8 * 1024 * 1024;
+/// Compression preset used when writing files
+static constexpr uint32_t COMPRESSION_PRESET = 6;
+
 static void open_stream_read(lzma_stream* stream) {
     auto flags = LZMA_TELL_UNSUPPORTED_CHECK | LZMA_CONCATENATED;
     auto memory_limit = std::numeric_limits<uint64_t>::max();
     check(lzma_stream_decoder(stream, memory_limit, flags));
 }
 
+/// Maximal number of threads used to decompress blocks in advance
+static constexpr size_t MAX_BACKGROUND_THREADS = 8;
+/// Maximal amount of memory (compressed and decompressed data) used by the
+/// blocks decompressed in advance
+static constexpr uint64_t READ_AHEAD_MEMORY = 256 * 1024 * 1024;
+
 XzFile::XzFile(const std::string& path, File::Mode mode): TextFileImpl(path), mode_(mode), buffer_(8192) {
-    const char* openmode = nullptr;
     if (mode == File::READ) {
-        openmode = "rb";
-        open_stream_read(&stream_);
-    } else if (mode == File::WRITE) {
-        openmode = "wb";
-        check(lzma_easy_encoder(&stream_, 6, LZMA_CHECK_CRC64));
-
-        stream_.next_out = buffer_.data();
-        stream_.avail_out = buffer_.size();
+        source_ = std::make_unique<InputSource>(path);
+        this->init_read();
+        return;
     } else if (mode == File::APPEND) {
         throw file_error("appending (open mode 'a') is not supported with xz files");
     }
 
-    file_ = std::fopen(path.c_str(), openmode);
+    assert(mode == File::WRITE);
+    file_ = std::fopen(path.c_str(), "wb");
     if (file_ == nullptr) {
-        lzma_end(&stream_);
         throw file_error("could not open the file at '{}'", path);
     }
+    chunk_.reserve(WRITE_BLOCK_SIZE);
+}
+
+XzFile::XzFile(std::shared_ptr<MemoryBuffer> memory):
+    TextFileImpl("<in memory>"), mode_(File::READ),
+    source_(std::make_unique<InputSource>(memory)), memory_(std::move(memory)), buffer_(8192)
+{
+    this->init_read();
+}
+
+void XzFile::init_read() {
+    if (this->read_index()) {
+        uint64_t block_memory = 0;
+        for (const auto& info: blocks_) {
+            block_memory = std::max(block_memory, info.compressed_size + info.uncompressed_size);
+        }
+        auto threads = static_cast<size_t>(std::thread::hardware_concurrency());
+        blocks_in_advance_ = std::min<size_t>({
+            std::max<size_t>(threads, 1),
+            MAX_BACKGROUND_THREADS,
+            checked_cast(std::max<uint64_t>(READ_AHEAD_MEMORY / block_memory, 1)),
+        });
+        workers_ = std::make_unique<BackgroundWorkers>(blocks_in_advance_);
+
+        this->load_block(0);
+    } else {
+        open_stream_read(&stream_);
+    }
 }
 
 XzFile::~XzFile() {
-    if (mode_ == File::WRITE) {
+    if (file_ != nullptr) {
         try {
-            compress_and_write(LZMA_FINISH);
-        } catch (...) {
+            this->close();
+        } catch (...) {  // NOLINT(bugprone-empty-catch)
             // not much we can do here ...
         }
     }
 
+    if (index_ != nullptr) {
+        lzma_index_end(index_, nullptr);
+    }
+
     lzma_end(&stream_);
-    if (file_ != nullptr) {
-        std::fclose(file_);
+}
+
+void XzFile::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto error = std::exception_ptr();
+    try {
+        this->finish();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    auto status = std::fclose(file_);
+    file_ = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (status != 0) {
+        throw file_error("could not close the file at '{}': {}", this->path(), std::strerror(errno));
     }
 }
 
 size_t XzFile::read(char* data, size_t count) {
-    auto action = LZMA_RUN;
+    if (!blocks_.empty()) {
+        return this->read_blocks(data, count);
+    }
 
     stream_.next_out = reinterpret_cast<uint8_t*>(data);
     stream_.avail_out = count;
 
     while (stream_.avail_out != 0) {
         // read more compressed data from the file
-        if (stream_.avail_in == 0 && (std::feof(file_) == 0)) {
+        if (stream_.avail_in == 0 && !source_->eof()) {
             stream_.next_in = buffer_.data();
-            stream_.avail_in = std::fread(buffer_.data(), 1, buffer_.size(), file_);
+            stream_.avail_in = source_->read(buffer_.data(), buffer_.size());
 
-            if (std::ferror(file_) != 0) {
+            if (source_->error()) {
                 throw file_error("IO error while reading xz file");
             }
         }
 
-        if (std::feof(file_) != 0) {
-            action = LZMA_FINISH;
+        if (source_->eof()) {
+            action_ = LZMA_FINISH;
         }
 
-        auto status = lzma_code(&stream_, action);
+        auto status = lzma_code(&stream_, action_);
 
         if (status == LZMA_STREAM_END) {
             return count - stream_.avail_out;
@@ -131,18 +215,29 @@ size_t XzFile::read(char* data, size_t count) {
 }
 
 void XzFile::clear() noexcept {
-    std::clearerr(file_);
+    if (source_ != nullptr) {
+        source_->clear();
+    } else {
+        std::clearerr(file_);
+    }
 }
 
 void XzFile::seek(uint64_t position) {
     assert(mode_ == File::READ);
+    if (!blocks_.empty()) {
+        this->seek_blocks(position);
+        return;
+    }
+
     // Reset stream state
     lzma_end(&stream_);
     stream_ = LZMA_STREAM_INIT;
     open_stream_read(&stream_);
+    action_ = LZMA_RUN;
 
     // Dumb implementation, re-decompressing the file from the begining
-    std::fseek(file_, 0, SEEK_SET);
+    source_->clear();
+    source_->seek(0);
     constexpr size_t BUFFSIZE = 4096;
     char buffer[BUFFSIZE];
 
@@ -158,17 +253,405 @@ void XzFile::seek(uint64_t position) {
     (void)count;
 }
 
+bool XzFile::read_index() {
+#if CHEMFILES_LZMA_FILE_INFO
+    auto file_size = source_->size();
+    if (!file_size || *file_size == 0 || !source_->seek(0)) {
+        return false;
+    }
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+    lzma_index* index = nullptr;
+    auto memory_limit = std::numeric_limits<uint64_t>::max();
+    auto status = lzma_file_info_decoder(&stream, &index, memory_limit, *file_size);
+    if (status != LZMA_OK) {
+        lzma_end(&stream);
+        return false;
+    }
+
+    // the decoder only reads the stream headers, footers and indexes, asking
+    // us to seek around in the file
+    while (status == LZMA_OK) {
+        auto action = LZMA_RUN;
+        if (stream.avail_in == 0) {
+            stream.next_in = buffer_.data();
+            stream.avail_in = source_->read(buffer_.data(), buffer_.size());
+            if (source_->error()) {
+                break;
+            }
+            if (stream.avail_in == 0) {
+                action = LZMA_FINISH;
+            }
+        }
+
+        status = lzma_code(&stream, action);
+        if (status == LZMA_SEEK_NEEDED) {
+            if (!source_->seek(stream.seek_pos)) {
+                break;
+            }
+            stream.avail_in = 0;
+            status = LZMA_OK;
+        }
+    }
+    lzma_end(&stream);
+
+    source_->clear();
+    if (!source_->seek(0) || status != LZMA_STREAM_END) {
+        // let the streaming decoder report any error in the file
+        if (index != nullptr) {
+            lzma_index_end(index, nullptr);
+        }
+        return false;
+    }
+
+    lzma_index_iter iter;
+    lzma_index_iter_init(&iter, index);
+    while (!lzma_index_iter_next(&iter, LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+        auto info = block();
+        info.compressed_offset = iter.block.compressed_file_offset;
+        info.compressed_size = iter.block.total_size;
+        info.unpadded_size = iter.block.unpadded_size;
+        info.uncompressed_offset = iter.block.uncompressed_file_offset;
+        info.uncompressed_size = iter.block.uncompressed_size;
+        info.check = iter.stream.flags->check;
+        blocks_.push_back(info);
+    }
+    lzma_index_end(index, nullptr);
+
+    // there is nothing to gain from reading files with a single block this
+    // way, and blocks larger than MAX_BLOCK_SIZE would use too much memory
+    auto use_blocks = blocks_.size() > 1 && std::all_of(blocks_.begin(), blocks_.end(), [](const block& info) {
+        return info.uncompressed_size <= MAX_BLOCK_SIZE && info.compressed_size <= 2 * MAX_BLOCK_SIZE;
+    });
+
+    if (!use_blocks) {
+        blocks_.clear();
+    }
+    return use_blocks;
+#else
+    return false;
+#endif
+}
+
+#if CHEMFILES_LZMA_FILE_INFO
+static std::vector<uint8_t> read_block(InputSource& source, uint64_t offset, uint64_t size) {
+    auto input = std::vector<uint8_t>(checked_cast(size));
+    if (!source.seek(offset)) {
+        throw file_error("IO error while reading xz file");
+    }
+    auto count = source.read(input.data(), input.size());
+    if (count != input.size()) {
+        throw file_error("IO error while reading xz file");
+    }
+    return input;
+}
+
+static std::vector<uint8_t> decompress_block(const std::vector<uint8_t>& input, lzma_check integrity_check, uint64_t unpadded_size, uint64_t uncompressed_size, const std::atomic<bool>& cancelled) {
+    lzma_filter filters[LZMA_FILTERS_MAX + 1];
+    lzma_block block;
+    std::memset(&block, 0, sizeof(block));
+    block.version = 1;
+    block.check = integrity_check;
+    block.filters = filters;
+
+    block.header_size = lzma_block_header_size_decode(input[0]);
+    if (input[0] == 0 || block.header_size > input.size()) {
+        throw file_error("lzma: compressed file is corrupted (invalid block header)");
+    }
+    check(lzma_block_header_decode(&block, nullptr, input.data()));
+
+    auto status = lzma_block_compressed_size(&block, unpadded_size);
+    if (status != LZMA_OK) {
+        lzma_filters_free(filters, nullptr);
+        check(status);
+    }
+
+    auto stream = lzma_stream(LZMA_STREAM_INIT);
+    status = lzma_block_decoder(&stream, &block);
+    lzma_filters_free(filters, nullptr);
+    check(status);
+
+    auto output = std::vector<uint8_t>(checked_cast(uncompressed_size));
+    stream.next_in = input.data() + block.header_size;
+    stream.avail_in = input.size() - block.header_size;
+    stream.next_out = output.data();
+
+    // decompress the block in small steps, to be able to stop early if the
+    // block is no longer needed
+    while (!cancelled) {
+        auto remaining = output.size() - static_cast<size_t>(stream.next_out - output.data());
+        stream.avail_out = std::min(remaining, DECOMPRESSION_STEP);
+
+        status = lzma_code(&stream, LZMA_RUN);
+        if (status == LZMA_STREAM_END) {
+            break;
+        } else if (status != LZMA_OK) {
+            lzma_end(&stream);
+            check(status);
+        }
+    }
+
+    auto written = static_cast<size_t>(stream.next_out - output.data());
+    lzma_end(&stream);
+
+    if (!cancelled && written != output.size()) {
+        throw file_error("lzma: compressed file is corrupted (invalid block size)");
+    }
+
+    return output;
+}
+#endif
+
+std::vector<uint8_t> XzFile::decompress(size_t i) {
+#if CHEMFILES_LZMA_FILE_INFO
+    const auto& info = blocks_[i];
+    auto input = read_block(*source_, info.compressed_offset, info.compressed_size);
+    auto cancelled = std::atomic<bool>(false);
+    return decompress_block(input, info.check, info.unpadded_size, info.uncompressed_size, cancelled);
+#else
+    (void)i;
+    unreachable();
+#endif
+}
+
+BackgroundTask<std::vector<uint8_t>> XzFile::start_decompression(size_t i) {
+#if CHEMFILES_LZMA_FILE_INFO
+    // the task reads the compressed data through its own InputSource, so the
+    // calling thread only waits for the block it needs right now
+    return workers_->submit<std::vector<uint8_t>>([path = std::string(this->path()), memory = memory_, info = blocks_[i]](const std::atomic<bool>& cancelled) {
+        if (cancelled) {
+            return std::vector<uint8_t>();
+        }
+        auto source = memory ? std::make_unique<InputSource>(memory) : std::make_unique<InputSource>(path);
+        auto input = read_block(*source, info.compressed_offset, info.compressed_size);
+        return decompress_block(input, info.check, info.unpadded_size, info.uncompressed_size, cancelled);
+    });
+#else
+    (void)i;
+    unreachable();
+#endif
+}
+
+void XzFile::load_block(size_t i) {
+    block_position_ = 0;
+
+    // blocks already being decompressed, pending[k] is block `first + k`
+    auto pending = std::move(pending_);
+    pending_.clear();
+    auto first = current_block_ + 1;
+
+    if (i >= blocks_.size()) {
+        // past the end of the file
+        current_.clear();
+        current_block_ = blocks_.size();
+        return;
+    }
+
+    if (i >= first && i - first < pending.size()) {
+        current_ = pending[i - first].get();
+    } else {
+        current_ = this->decompress(i);
+    }
+    current_block_ = i;
+
+    // re-use the blocks we already started to decompress if they are still
+    // needed, the others are cancelled when `pending` is destroyed
+    for (auto next = i + 1; next < blocks_.size() && next <= i + blocks_in_advance_; next++) {
+        if (next >= first && next - first < pending.size()) {
+            pending_.emplace_back(std::move(pending[next - first]));
+        } else {
+            pending_.emplace_back(this->start_decompression(next));
+        }
+    }
+}
+
+size_t XzFile::read_blocks(char* data, size_t count) {
+    size_t total = 0;
+    while (total < count && current_block_ < blocks_.size()) {
+        auto available = current_.size() - block_position_;
+        if (available == 0) {
+            this->load_block(current_block_ + 1);
+            continue;
+        }
+
+        auto amount = std::min(available, count - total);
+        std::memcpy(data + total, current_.data() + block_position_, amount);
+        block_position_ += amount;
+        total += amount;
+    }
+    return total;
+}
+
+void XzFile::seek_blocks(uint64_t position) {
+    // find the block containing `position`
+    auto after = std::upper_bound(blocks_.begin(), blocks_.end(), position,
+        [](uint64_t value, const block& info) {
+            return value < info.uncompressed_offset;
+        }
+    );
+    assert(after != blocks_.begin());
+    auto i = static_cast<size_t>(after - blocks_.begin()) - 1;
+
+    const auto& info = blocks_[i];
+    if (position >= info.uncompressed_offset + info.uncompressed_size) {
+        // seeking past the end of the file
+        this->load_block(blocks_.size());
+        return;
+    }
+
+    if (i != current_block_) {
+        this->load_block(i);
+    }
+    block_position_ = checked_cast(position - info.uncompressed_offset);
+}
+
+/// Compress `input` to a single xz block, and set `unpadded_size` to the size
+/// of the block without padding, as required by the index.
+static std::vector<uint8_t> encode_block(const std::vector<uint8_t>& input, lzma_vli& unpadded_size) {
+    lzma_options_lzma options;
+    if (lzma_lzma_preset(&options, COMPRESSION_PRESET)) {
+        throw file_error("lzma: unsupported compression options");
+    }
+
+    lzma_filter filters[2];
+    filters[0].id = LZMA_FILTER_LZMA2;
+    filters[0].options = &options;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = nullptr;
+
+    lzma_block block;
+    std::memset(&block, 0, sizeof(block));
+    block.version = 0;
+    block.check = LZMA_CHECK_CRC64;
+    block.filters = filters;
+
+    auto output = std::vector<uint8_t>(lzma_block_buffer_bound(input.size()));
+    size_t position = 0;
+    check(lzma_block_buffer_encode(
+        &block, nullptr,
+        input.data(), input.size(),
+        output.data(), &position, output.size()
+    ));
+    output.resize(position);
+
+    unpadded_size = lzma_block_unpadded_size(&block);
+    return output;
+}
+
+/// Number of blocks to compress in parallel. Each lzma encoder uses close to
+/// 100 MiB of memory, so we limit this to 4 blocks.
+static size_t compression_threads() {
+    auto threads = static_cast<size_t>(std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min<size_t>(threads, 4));
+}
+
 void XzFile::write(const char* data, size_t count) {
-    stream_.next_in = reinterpret_cast<const uint8_t*>(data);
-    stream_.avail_in = count;
-    compress_and_write(LZMA_RUN);
+    while (count != 0) {
+        auto amount = std::min(count, WRITE_BLOCK_SIZE - chunk_.size());
+        chunk_.insert(chunk_.end(), data, data + amount);
+        data += amount;
+        count -= amount;
+
+        if (chunk_.size() == WRITE_BLOCK_SIZE) {
+            this->start_compression();
+        }
+    }
+}
 
-    auto actual = count - stream_.avail_in;
-    if (actual != count) {
-        throw file_error("could not write data to the file at '{}'", this->path());
+void XzFile::write_data(const uint8_t* data, size_t count) {
+    auto written = std::fwrite(data, sizeof(uint8_t), count, file_);
+    if (written != count) {
+        throw file_error("error while writting data to xz file");
     }
 }
 
+void XzFile::start_compression() {
+    if (index_ == nullptr) {
+        // first block, start a new stream
+        index_ = lzma_index_init(nullptr);
+        if (index_ == nullptr) {
+            throw file_error("lzma: memory allocation failed");
+        }
+
+        lzma_stream_flags flags;
+        std::memset(&flags, 0, sizeof(flags));
+        flags.version = 0;
+        flags.check = LZMA_CHECK_CRC64;
+
+        uint8_t header[LZMA_STREAM_HEADER_SIZE];
+        check(lzma_stream_header_encode(&flags, header));
+        this->write_data(header, LZMA_STREAM_HEADER_SIZE);
+    }
+
+    auto chunk = std::move(chunk_);
+    chunk_ = std::vector<uint8_t>();
+    chunk_.reserve(WRITE_BLOCK_SIZE);
+
+    compressing_.emplace_back(std::async(std::launch::async, [](std::vector<uint8_t> uncompressed) {
+        auto result = compressed_block();
+        result.data = encode_block(uncompressed, result.unpadded_size);
+        result.uncompressed_size = uncompressed.size();
+        return result;
+    }, std::move(chunk)));
+
+    while (compressing_.size() > compression_threads()) {
+        this->write_block();
+    }
+}
+
+void XzFile::write_block() {
+    auto block = compressing_.front().get();
+    compressing_.pop_front();
+
+    this->write_data(block.data.data(), block.data.size());
+    check(lzma_index_append(index_, nullptr, block.unpadded_size, block.uncompressed_size));
+}
+
+void XzFile::finish() {
+    if (index_ == nullptr) {
+        // We never filled a full block, use a single stream encoder. This
+        // creates slightly smaller files than the block encoder for small
+        // amounts of data.
+        check(lzma_easy_encoder(&stream_, COMPRESSION_PRESET, LZMA_CHECK_CRC64));
+        stream_.next_out = buffer_.data();
+        stream_.avail_out = buffer_.size();
+
+        stream_.next_in = chunk_.data();
+        stream_.avail_in = chunk_.size();
+        compress_and_write(LZMA_FINISH);
+        chunk_.clear();
+        return;
+    }
+
+    if (!chunk_.empty()) {
+        this->start_compression();
+    }
+
+    while (!compressing_.empty()) {
+        this->write_block();
+    }
+
+    // write the index and stream footer
+    auto index_size = lzma_index_size(index_);
+    auto index = std::vector<uint8_t>(checked_cast(index_size));
+    size_t position = 0;
+    check(lzma_index_buffer_encode(index_, index.data(), &position, index.size()));
+    this->write_data(index.data(), position);
+
+    lzma_stream_flags flags;
+    std::memset(&flags, 0, sizeof(flags));
+    flags.version = 0;
+    flags.check = LZMA_CHECK_CRC64;
+    flags.backward_size = index_size;
+
+    uint8_t footer[LZMA_STREAM_HEADER_SIZE];
+    check(lzma_stream_footer_encode(&flags, footer));
+    this->write_data(footer, LZMA_STREAM_HEADER_SIZE);
+
+    lzma_index_end(index_, nullptr);
+    index_ = nullptr;
+}
+
 void XzFile::compress_and_write(lzma_action action) {
     lzma_ret status = LZMA_OK;
     do {
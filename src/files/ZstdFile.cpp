@@ -0,0 +1,326 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <exception>
+#include <algorithm>
+
+#include <zstd.h>
+#include <zstd_seekable.h>
+
+#include "chemfiles/File.hpp"
+#include "chemfiles/error_fmt.hpp"
+
+#include "chemfiles/files/ZstdFile.hpp"
+#include "chemfiles/files/InputSource.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
+
+using namespace chemfiles;
+
+/// Size of the uncompressed data in each frame when writing files
+static constexpr unsigned WRITE_FRAME_SIZE = 1024 * 1024;
+
+static size_t check(size_t code) {
+    if (ZSTD_isError(code)) {
+        throw file_error("zstd: {}", ZSTD_getErrorName(code));
+    }
+    return code;
+}
+
+static size_t checked_cast(uint64_t value) {
+    if (value < std::numeric_limits<size_t>::max()) {
+        return static_cast<size_t>(value);
+    } else {
+        throw file_error("{} is too big for size_t in call to zstd function", value);
+    }
+}
+
+// callbacks used by ZSTD_seekable to read the compressed data from an
+// InputSource, returning 0 on success and a negative value on error
+static int seekable_read(void* opaque, void* buffer, size_t count) {
+    auto* source = static_cast<InputSource*>(opaque);
+    return source->read(buffer, count) == count ? 0 : -1;
+}
+
+static int seekable_seek(void* opaque, long long offset, int origin) {
+    auto* source = static_cast<InputSource*>(opaque);
+    auto position = static_cast<int64_t>(offset);
+    if (origin == SEEK_END) {
+        auto size = source->size();
+        if (!size) {
+            return -1;
+        }
+        position += static_cast<int64_t>(*size);
+    } else if (origin != SEEK_SET) {
+        return -1;
+    }
+
+    if (position < 0) {
+        return -1;
+    }
+
+    source->clear();
+    return source->seek(static_cast<uint64_t>(position)) ? 0 : -1;
+}
+
+ZstdFile::ZstdFile(const std::string& path, File::Mode mode): TextFileImpl(path), mode_(mode) {
+    if (mode == File::READ) {
+        source_ = std::make_unique<InputSource>(path);
+        this->init_read();
+        return;
+    } else if (mode == File::APPEND) {
+        throw file_error("appending (open mode 'a') is not supported with zstd files");
+    }
+
+    assert(mode == File::WRITE);
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        throw file_error("could not open the file at '{}'", path);
+    }
+
+    cstream_ = ZSTD_seekable_createCStream();
+    if (cstream_ == nullptr) {
+        throw file_error("zstd: memory allocation failed");
+    }
+    check(ZSTD_seekable_initCStream(cstream_, ZSTD_CLEVEL_DEFAULT, /* checksum */ 1, WRITE_FRAME_SIZE));
+
+    buffer_.resize(ZSTD_CStreamOutSize());
+    output_ = {buffer_.data(), buffer_.size(), 0};
+}
+
+ZstdFile::ZstdFile(std::shared_ptr<MemoryBuffer> memory):
+    TextFileImpl("<in memory>"), mode_(File::READ),
+    source_(std::make_unique<InputSource>(std::move(memory)))
+{
+    this->init_read();
+}
+
+void ZstdFile::init_read() {
+    seekable_ = ZSTD_seekable_create();
+    if (seekable_ == nullptr) {
+        throw file_error("zstd: memory allocation failed");
+    }
+
+    auto custom = ZSTD_seekable_customFile{source_.get(), seekable_read, seekable_seek};
+    auto status = ZSTD_seekable_initAdvanced(seekable_, custom);
+    auto frames = ZSTD_seekable_getNumFrames(seekable_);
+    if (!ZSTD_isError(status) && frames != 0) {
+        auto last = frames - 1;
+        size_ = ZSTD_seekable_getFrameDecompressedOffset(seekable_, last);
+        size_ += ZSTD_seekable_getFrameDecompressedSize(seekable_, last);
+        return;
+    }
+
+    // this file does not contain a seek table (or is empty), use the
+    // streaming decoder instead. This will also report errors in the file.
+    ZSTD_seekable_free(seekable_);
+    seekable_ = nullptr;
+
+    source_->clear();
+    if (!source_->seek(0)) {
+        throw file_error("IO error while reading zstd file");
+    }
+
+    stream_ = ZSTD_createDCtx();
+    if (stream_ == nullptr) {
+        throw file_error("zstd: memory allocation failed");
+    }
+    buffer_.resize(ZSTD_DStreamInSize());
+}
+
+ZstdFile::~ZstdFile() {
+    if (file_ != nullptr) {
+        try {
+            this->close();
+        } catch (...) {  // NOLINT(bugprone-empty-catch)
+            // not much we can do here ...
+        }
+    }
+
+    ZSTD_seekable_free(seekable_);
+    ZSTD_freeDCtx(stream_);
+    ZSTD_seekable_freeCStream(cstream_);
+}
+
+void ZstdFile::close() {
+    if (file_ == nullptr) {
+        return;
+    }
+
+    auto error = std::exception_ptr();
+    try {
+        this->finish();
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    auto status = std::fclose(file_);
+    file_ = nullptr;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    if (status != 0) {
+        throw file_error("could not close the file at '{}': {}", this->path(), std::strerror(errno));
+    }
+}
+
+size_t ZstdFile::read(char* data, size_t count) {
+    if (seekable_ == nullptr) {
+        return this->read_stream(data, count);
+    }
+
+    if (position_ >= size_) {
+        return 0;
+    }
+
+    auto size = std::min<uint64_t>(count, size_ - position_);
+    auto read = check(ZSTD_seekable_decompress(seekable_, data, checked_cast(size), position_));
+    position_ += read;
+    return read;
+}
+
+size_t ZstdFile::read_stream(char* data, size_t count) {
+    auto output = ZSTD_outBuffer{data, count, 0};
+    while (output.pos < output.size) {
+        // read more compressed data from the file
+        if (input_.pos == input_.size && !source_->eof()) {
+            auto read = source_->read(buffer_.data(), buffer_.size());
+            if (source_->error()) {
+                throw file_error("IO error while reading zstd file");
+            }
+            input_ = {buffer_.data(), read, 0};
+        }
+
+        auto previous_in = input_.pos;
+        auto previous_out = output.pos;
+        auto status = check(ZSTD_decompressStream(stream_, &output, &input_));
+        if (output.pos == previous_out && input_.pos == previous_in && source_->eof()) {
+            // no more data available
+            break;
+        }
+        frame_done_ = (status == 0);
+    }
+
+    if (output.pos < count && !frame_done_) {
+        throw file_error("zstd: compressed file is truncated");
+    }
+
+    position_ += output.pos;
+    return output.pos;
+}
+
+void ZstdFile::clear() noexcept {
+    if (source_ != nullptr) {
+        source_->clear();
+    } else {
+        std::clearerr(file_);
+    }
+}
+
+void ZstdFile::seek(uint64_t position) {
+    assert(mode_ == File::READ);
+    if (seekable_ != nullptr) {
+        // ZSTD_seekable_decompress will find the right frame when reading
+        position_ = position;
+        return;
+    }
+
+    this->seek_stream(position);
+}
+
+void ZstdFile::seek_stream(uint64_t position) {
+    if (position < position_) {
+        // restart decompression from the beginning of the file
+        ZSTD_DCtx_reset(stream_, ZSTD_reset_session_only);
+        source_->clear();
+        if (!source_->seek(0)) {
+            throw file_error("IO error while reading zstd file");
+        }
+        input_ = {buffer_.data(), 0, 0};
+        frame_done_ = true;
+        position_ = 0;
+    }
+
+    // skip the data before `position`
+    constexpr size_t BUFFSIZE = 4096;
+    char buffer[BUFFSIZE];
+    while (position_ < position) {
+        auto size = static_cast<size_t>(std::min<uint64_t>(BUFFSIZE, position - position_));
+        if (this->read_stream(buffer, size) != size) {
+            // seeking past the end of the file
+            break;
+        }
+    }
+}
+
+void ZstdFile::write(const char* data, size_t count) {
+    auto input = ZSTD_inBuffer{data, count, 0};
+    while (input.pos < input.size) {
+        check(ZSTD_seekable_compressStream(cstream_, &output_, &input));
+        if (output_.pos == output_.size) {
+            this->write_output();
+        }
+    }
+}
+
+void ZstdFile::write_output() {
+    auto written = std::fwrite(buffer_.data(), sizeof(char), output_.pos, file_);
+    if (written != output_.pos) {
+        throw file_error("error while writting data to zstd file");
+    }
+    output_.pos = 0;
+}
+
+void ZstdFile::finish() {
+    size_t remaining = 0;
+    do {
+        remaining = check(ZSTD_seekable_endStream(cstream_, &output_));
+        this->write_output();
+    } while (remaining != 0);
+}
+
+MemoryBuffer chemfiles::decompress_zstd(const char* src, size_t size) {
+    // assume a 10% compression ratio, which should be plenty enough
+    // (typical ratio is around 15-20%)
+    auto output = MemoryBuffer(10 * size + 1);
+
+    auto stream = std::unique_ptr<ZSTD_DCtx, size_t(*)(ZSTD_DCtx*)>(ZSTD_createDCtx(), ZSTD_freeDCtx);
+    if (stream == nullptr) {
+        throw file_error("zstd: memory allocation failed");
+    }
+
+    auto input = ZSTD_inBuffer{src, size, 0};
+    size_t total = 0;
+    size_t status = 0;
+    do {
+        // if we need more space, resize the buffer
+        if (total >= output.capacity()) {
+            output.reserve_extra(output.capacity());
+        }
+
+        auto out = ZSTD_outBuffer{output.data_mut() + total, output.capacity() - total, 0};
+        status = check(ZSTD_decompressStream(stream.get(), &out, &input));
+        total += out.pos;
+    } while (input.pos < input.size || (status != 0 && total >= output.capacity()));
+
+    if (status != 0) {
+        throw file_error("zstd: compressed data is truncated");
+    }
+
+    if (total >= output.capacity()) {
+        // make sure the buffer always contains a terminal NULL
+        output.reserve_extra(1);
+    }
+    output.set_size(total);
+    return output;
+}
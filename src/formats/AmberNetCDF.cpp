@@ -5,7 +5,10 @@
 #include <cstddef>
 
 #include <array>
+#include <memory>
 #include <string>
+#include <algorithm>
+#include <functional>
 #include <utility>
 #include <vector>
 
@@ -26,6 +29,7 @@
 #include "chemfiles/FormatMetadata.hpp"
 
 #include "chemfiles/files/Netcdf3File.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/formats/AmberNetCDF.hpp"
 
 using namespace chemfiles;
@@ -42,6 +46,10 @@ static double scale_for_distance(std::string unit);
 static double scale_for_velocity(std::string unit);
 static double scale_for_time(std::string unit);
 
+/// Maximal number of values (for a single variable) read at once by
+/// `AmberNetCDFBase::read_batch` and `AmberNetCDFBase::read_positions`
+static constexpr size_t AMBER_NETCDF_BLOCK_VALUES = 4 * 1024 * 1024;
+
 /******************************************************************************/
 
 AmberNetCDFBase::AmberNetCDFBase(std::string convention, std::string path, File::Mode mode, File::Compression compression):
@@ -49,6 +57,18 @@ AmberNetCDFBase::AmberNetCDFBase(std::string convention, std::string path, File:
     convention_(std::move(convention)),
     index_(0)
 {
+    this->open(compression);
+}
+
+AmberNetCDFBase::AmberNetCDFBase(std::string convention, std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression):
+    file_(std::move(memory), mode),
+    convention_(std::move(convention)),
+    index_(0)
+{
+    this->open(compression);
+}
+
+void AmberNetCDFBase::open(File::Compression compression) {
     if (compression != File::DEFAULT) {
         throw format_error("compression is not supported with NetCDF format");
     }
@@ -140,7 +160,7 @@ AmberNetCDFBase::AmberNetCDFBase(std::string convention, std::string path, File:
     }
 
 
-    if (mode == File::APPEND) {
+    if (file_.mode() == File::APPEND) {
         // start writing at the end of pre-existing files in append mode
         index_ = static_cast<size_t>(file_.n_records());
     }
@@ -209,44 +229,71 @@ AmberNetCDFBase::variable_scale_t AmberNetCDFBase::get_variable(const std::strin
 
 void AmberNetCDFBase::read(Frame& frame) {
     this->read_at(index_, frame);
-    index_++;
 }
 
 void AmberNetCDFBase::read_at(const size_t index, Frame& frame) {
-    // Set the internal index_ before further reading
-    index_ = index;
+    this->read_steps(index, 1, span<Frame>(&frame, 1));
+}
 
-    frame.set_cell(read_cell());
+void AmberNetCDFBase::read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) {
+    // read the frames in order, so the file is traversed in a single pass
+    auto sorted = indices;
+    std::sort(sorted.begin(), sorted.end());
+
+    // limit the number of frames read together to keep the memory use
+    // reasonable for large systems
+    auto max_block_size = std::max<size_t>(1, AMBER_NETCDF_BLOCK_VALUES / (3 * n_atoms_ + 1));
+
+    auto frames = std::vector<Frame>();
+    size_t start = 0;
+    while (start < sorted.size()) {
+        // find the longest run of steps separated by a constant stride
+        size_t stride = 1;
+        size_t end = start + 1;
+        if (end < sorted.size() && sorted[end] != sorted[start]) {
+            stride = sorted[end] - sorted[start];
+            while (end < sorted.size() && end - start < max_block_size && sorted[end] == sorted[end - 1] + stride) {
+                end++;
+            }
+        }
 
-    if (file_title_) {
-        frame.set("name", file_title_.value());
-    }
+        frames.clear();
+        frames.resize(end - start);
+        this->read_steps(sorted[start], stride, frames);
+        for (size_t i = 0; i < frames.size(); i++) {
+            callback(sorted[start + i], frames[i]);
+        }
 
-    frame.resize(n_atoms_);
+        start = end;
+    }
+}
 
-    if (variables_.coordinates.var != nullptr) {
-        this->read_array(variables_.coordinates, frame.positions());
+void AmberNetCDFBase::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    if (positions.size() != n_frames * n_atoms_) {
+        throw format_error(
+            "can not read positions in Amber NetCDF file at '{}': expected {} atoms, got {}",
+            file_.path(), positions.size() / n_frames, n_atoms_
+        );
     }
 
-    if (variables_.velocities.var != nullptr) {
-        frame.add_velocities();
-        this->read_array(variables_.velocities, *frame.velocities());
+    // the next call to `read` continues after the last frame read here
+    index_ = start + (n_frames - 1) * stride + 1;
+
+    if (variables_.coordinates.var == nullptr) {
+        std::fill(positions.begin(), positions.end(), Vector3D());
+        return;
     }
 
-    if (variables_.time.var != nullptr) {
-        double time_value = 0.0;
-        if (variables_.time.var->type() == netcdf3::constants::NC_FLOAT) {
-            float value;
-            variables_.time.var->read(index, &value, 1);
-            time_value = variables_.time.scale * static_cast<double>(value);
-        } else if (variables_.time.var->type() == netcdf3::constants::NC_DOUBLE) {
-            double value;
-            variables_.time.var->read(index, &value, 1);
-            time_value = variables_.time.scale * value;
-        } else {
-            throw format_error("invalid type for time variable");
-        }
-        frame.set("time", time_value);
+    // read the values for multiple steps at once with a strided read, while
+    // keeping the memory use reasonable for large systems
+    auto max_block_size = std::max<size_t>(1, AMBER_NETCDF_BLOCK_VALUES / (3 * n_atoms_ + 1));
+    size_t done = 0;
+    while (done < n_frames) {
+        auto count = std::min(max_block_size, n_frames - done);
+        auto step = start + done * stride;
+        auto* output = reinterpret_cast<double*>(positions.data() + done * n_atoms_);
+        this->read_values(variables_.coordinates, step, step + (count - 1) * stride + 1, stride, output, 3 * n_atoms_ * count);
+        done += count;
     }
 }
 
@@ -315,75 +362,85 @@ void AmberNetCDFBase::write(const Frame& frame) {
 
 /******************************************************************************/
 
-UnitCell AmberNetCDFBase::read_cell() {
-    if ((variables_.cell_lengths.var == nullptr) || (variables_.cell_angles.var == nullptr)) {
-        // No cell information
-        return {};
-    }
+void AmberNetCDFBase::read_steps(size_t step, size_t stride, span<Frame> frames) {
+    assert(!frames.empty());
+    auto step_end = step + (frames.size() - 1) * stride + 1;
 
-    auto data_f32 = std::array<float, 3>();
-    auto data_f64 = std::array<double, 3>();
+    // the next call to `read` continues after the last frame read here
+    index_ = step_end;
 
-    Vector3D lengths;
-    auto& cell_lengths = variables_.cell_lengths.var;
-    if (cell_lengths->type() == netcdf3::constants::NC_FLOAT) {
-        cell_lengths->read(index_, data_f32.data(), data_f32.size());
-        lengths = Vector3D(
-            static_cast<double>(data_f32[0]),
-            static_cast<double>(data_f32[1]),
-            static_cast<double>(data_f32[2])
-        );
-    } else if (cell_lengths->type() == netcdf3::constants::NC_DOUBLE) {
-        cell_lengths->read(index_, data_f64.data(), data_f64.size());
-        lengths = Vector3D(
-            data_f64[0],
-            data_f64[1],
-            data_f64[2]
-        );
-    } else {
-        unreachable();
+    for (auto& frame: frames) {
+        if (file_title_) {
+            frame.set("name", file_title_.value());
+        }
+        frame.resize(n_atoms_);
     }
 
-    Vector3D angles;
-    auto& cell_angles = variables_.cell_angles.var;
-    if (cell_angles->type() == netcdf3::constants::NC_FLOAT) {
-        cell_angles->read(index_, data_f32.data(), data_f32.size());
-        angles = Vector3D(
-            static_cast<double>(data_f32[0]),
-            static_cast<double>(data_f32[1]),
-            static_cast<double>(data_f32[2])
-        );
-    } else if (cell_angles->type() == netcdf3::constants::NC_DOUBLE) {
-        cell_angles->read(index_, data_f64.data(), data_f64.size());
-        angles = Vector3D(
-            data_f64[0],
-            data_f64[1],
-            data_f64[2]
-        );
+    // All the variables are read for the same steps, so the corresponding
+    // records are only read once from the file, by the first variable.
+    if ((variables_.cell_lengths.var != nullptr) && (variables_.cell_angles.var != nullptr)) {
+        buffer_f64_.resize(3 * frames.size());
+        buffer_angles_f64_.resize(3 * frames.size());
+        this->read_values(variables_.cell_lengths, step, step_end, stride, buffer_f64_.data(), buffer_f64_.size());
+        this->read_values(variables_.cell_angles, step, step_end, stride, buffer_angles_f64_.data(), buffer_angles_f64_.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            const auto* lengths = buffer_f64_.data() + 3 * i;
+            const auto* angles = buffer_angles_f64_.data() + 3 * i;
+            frames[i].set_cell(UnitCell(
+                Vector3D(lengths[0], lengths[1], lengths[2]),
+                Vector3D(angles[0], angles[1], angles[2])
+            ));
+        }
     } else {
-        unreachable();
+        // No cell information
+        for (auto& frame: frames) {
+            frame.set_cell(UnitCell());
+        }
     }
 
-    return UnitCell(
-        variables_.cell_lengths.scale * lengths,
-        variables_.cell_angles.scale * angles
-    );
+    if (variables_.coordinates.var != nullptr) {
+        buffer_f64_.resize(3 * n_atoms_ * frames.size());
+        this->read_values(variables_.coordinates, step, step_end, stride, buffer_f64_.data(), buffer_f64_.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            auto positions = frames[i].positions();
+            const auto* values = buffer_f64_.data() + 3 * n_atoms_ * i;
+            std::copy(values, values + 3 * n_atoms_, reinterpret_cast<double*>(positions.data()));
+        }
+    }
+
+    if (variables_.velocities.var != nullptr) {
+        buffer_f64_.resize(3 * n_atoms_ * frames.size());
+        this->read_values(variables_.velocities, step, step_end, stride, buffer_f64_.data(), buffer_f64_.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            frames[i].add_velocities();
+            auto velocities = *frames[i].velocities();
+            const auto* values = buffer_f64_.data() + 3 * n_atoms_ * i;
+            std::copy(values, values + 3 * n_atoms_, reinterpret_cast<double*>(velocities.data()));
+        }
+    }
+
+    if (variables_.time.var != nullptr) {
+        buffer_f64_.resize(frames.size());
+        this->read_values(variables_.time, step, step_end, stride, buffer_f64_.data(), buffer_f64_.size());
+        for (size_t i = 0; i < frames.size(); i++) {
+            frames[i].set("time", buffer_f64_[i]);
+        }
+    }
 }
 
-void AmberNetCDFBase::read_array(variable_scale_t& variable, span<Vector3D> array) {
+void AmberNetCDFBase::read_values(variable_scale_t& variable, size_t step_begin, size_t step_end, size_t stride, double* output, size_t count) {
     if (variable.var->type() == netcdf3::constants::NC_FLOAT) {
-        variable.var->read(index_, buffer_f32_);
-        for (size_t i=0; i<n_atoms_; i++) {
-            array[i][0] = variable.scale * static_cast<double>(buffer_f32_[3 * i + 0]);
-            array[i][1] = variable.scale * static_cast<double>(buffer_f32_[3 * i + 1]);
-            array[i][2] = variable.scale * static_cast<double>(buffer_f32_[3 * i + 2]);
+        buffer_f32_.resize(count);
+        variable.var->read(step_begin, step_end, stride, buffer_f32_.data(), count);
+        for (size_t i=0; i<count; i++) {
+            output[i] = variable.scale * static_cast<double>(buffer_f32_[i]);
         }
     } else if (variable.var->type() == netcdf3::constants::NC_DOUBLE) {
-        variable.var->read(index_, buffer_f64_);
-        for (size_t i=0; i<n_atoms_; i++) {
-            array[i][0] = variable.scale * buffer_f64_[3 * i + 0];
-            array[i][1] = variable.scale * buffer_f64_[3 * i + 1];
-            array[i][2] = variable.scale * buffer_f64_[3 * i + 2];
+        variable.var->read(step_begin, step_end, stride, output, count);
+        if (variable.scale != 1.0) {
+            for (size_t i=0; i<count; i++) {
+                output[i] *= variable.scale;
+            }
         }
     } else {
         throw format_error("invalid type for variable, expected floating point");
@@ -465,6 +522,21 @@ AmberTrajectory::AmberTrajectory(std::string path, File::Mode mode, File::Compre
     }
 }
 
+AmberTrajectory::AmberTrajectory(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression):
+    AmberNetCDFBase("AMBER", std::move(memory), mode, compression)
+{
+    if (!file_.initialized()) {
+        // skip validation, the file will be initialized later
+        return;
+    }
+
+    try {
+        this->validate();
+    } catch (const Error& e) {
+        throw format_error("invalid Amber NetCDF trajectory at '{}': {}", file_.path(), e.what());
+    }
+}
+
 size_t AmberTrajectory::size() {
     return static_cast<size_t>(file_.n_records());
 }
@@ -601,6 +673,16 @@ AmberRestart::AmberRestart(std::string path, File::Mode mode, File::Compression
     }
 }
 
+AmberRestart::AmberRestart(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression):
+    AmberNetCDFBase("AMBERRESTART", std::move(memory), mode, compression)
+{
+    try {
+        this->validate();
+    } catch (const Error& e) {
+        throw format_error("invalid Amber NetCDF restart at '{}': {}", file_.path(), e.what());
+    }
+}
+
 void AmberRestart::write(const Frame& frame) {
     if (index_ != 0) {
         throw format_error("AMBER Restart format only supports writing one frame");
@@ -729,7 +811,7 @@ template<> const FormatMetadata& chemfiles::format_metadata<AmberTrajectory>() {
 
     metadata.read = true;
     metadata.write = true;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = true;
@@ -749,7 +831,7 @@ template<> const FormatMetadata& chemfiles::format_metadata<AmberRestart>() {
 
     metadata.read = true;
     metadata.write = true;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = true;
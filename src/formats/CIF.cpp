@@ -94,6 +94,10 @@ size_t CIFFormat::size() {
     return structures_.size();
 }
 
+void CIFFormat::close() {
+    file_.close();
+}
+
 void CIFFormat::read_at(const size_t index, Frame& frame) {
     assert(index < structures_.size());
 
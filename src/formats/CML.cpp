@@ -118,6 +118,18 @@ void CMLFormat::init_() {
 }
 
 CMLFormat::~CMLFormat() {
+    if (!saved_) {
+        save_document();
+    }
+}
+
+void CMLFormat::close() {
+    save_document();
+    file_.close();
+}
+
+void CMLFormat::save_document() {
+    saved_ = true;
     if (num_added_ != 0 && file_.mode() == File::WRITE) {
         auto writter = xml_writer(file_);
         document_.save(writter, "  ");
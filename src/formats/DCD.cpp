@@ -12,6 +12,7 @@
 #include <memory>
 #include <set>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/File.hpp"
 #include "chemfiles/Property.hpp"
@@ -24,6 +25,7 @@
 #include "chemfiles/FormatMetadata.hpp"
 
 #include "chemfiles/files/BinaryFile.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/formats/DCD.hpp"
 
 static double cos_to_angle_degrees(double cos) {
@@ -62,15 +64,18 @@ static constexpr double AKMA_TO_PS = 4.888821e-2;
 
 using namespace chemfiles;
 
-static std::unique_ptr<BinaryFile> open_dcd_file(std::string path, File::Mode mode, bool& use_64_bit_markers) {
+// `Source` is either the path to the file (`std::string`), or the file data
+// (`std::shared_ptr<MemoryBuffer>`)
+template <typename Source>
+static std::unique_ptr<BinaryFile> open_dcd_file(Source source, File::Mode mode, bool& use_64_bit_markers) {
     if (mode == File::WRITE) {
-        return BinaryFile::open_native(std::move(path), mode);
+        return BinaryFile::open_native(std::move(source), mode);
     }
 
-    auto file = LittleEndianFile(path, mode);
+    auto file = LittleEndianFile(source, mode);
 
     if (mode == File::APPEND && file.file_size() == 0) {
-        return BinaryFile::open_native(std::move(path), mode);
+        return BinaryFile::open_native(std::move(source), mode);
     }
 
     // we need to check multiple variants of the DCD format: 32 and 64-bits
@@ -98,14 +103,14 @@ static std::unique_ptr<BinaryFile> open_dcd_file(std::string path, File::Mode mo
     } else if (data[0] == 0 && data[1] == 0 && data[2] == 0) {
         if (data[3] == 84 && data[4] == 'C' && data[5] == 'O' && data[6] == 'R' && data[7] == 'D') {
             use_64_bit_markers = false;
-            return std::make_unique<BigEndianFile>(path, mode);
+            return std::make_unique<BigEndianFile>(std::move(source), mode);
         } else if (data[3] == 0 && data[4] == 0 && data[5] == 0 && data[6] == 0 && data[7] == 84) {
             // We might be using 64-bit record markers, check for CORD
             char extra[4] = {0};
             file.read_char(extra, 4);
             if (extra[0] == 'C' && extra[1] == 'O' && extra[2] == 'R' && extra[3] == 'D') {
                 use_64_bit_markers = true;
-                return std::make_unique<BigEndianFile>(path, mode);
+                return std::make_unique<BigEndianFile>(std::move(source), mode);
             }
         }
     }
@@ -131,6 +136,26 @@ DCDFormat::DCDFormat(std::string path, File::Mode mode, File::Compression compre
         throw format_error("unable to open '{}': {}", path, e.what());
     }
 
+    this->initialize(mode);
+}
+
+DCDFormat::DCDFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression):
+    file_(nullptr)
+{
+    if (compression != File::DEFAULT) {
+        throw format_error("compression is not supported for DCD files");
+    }
+
+    try {
+        file_ = open_dcd_file(std::move(memory), mode, options_.use_64_bit_markers);
+    } catch (const Error& e) {
+        throw format_error("unable to open in-memory DCD data: {}", e.what());
+    }
+
+    this->initialize(mode);
+}
+
+void DCDFormat::initialize(File::Mode mode) {
     if (mode == File::WRITE || (mode == File::APPEND && file_->file_size() == 0)) {
         return;
     }
@@ -161,20 +186,27 @@ size_t DCDFormat::size() {
 
 void DCDFormat::read(Frame& frame) {
     this->read_at(index_, frame);
-    index_++;
 }
 
 void DCDFormat::read_at(size_t index, Frame& frame) {
-    index_ = index;
-
-    if (index_ == 0) {
-        file_->seek(header_size_);
+    if (index == index_) {
+        file_->set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
     } else {
-        file_->seek(header_size_ + first_frame_size_ + (index_ - 1) * frame_size_);
+        file_->set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    }
+    this->seek_frame(index);
+    this->read_frame(frame);
+}
+
+void DCDFormat::read_frame(Frame& frame) {
+    if (frame.size() != n_atoms_ || frame.velocities()) {
+        // the frame can not be reused for this step
+        frame = Frame();
     }
 
     frame.set_cell(this->read_cell());
-    read_positions(frame);
+    frame.resize(n_atoms_);
+    read_coordinates(frame.positions());
 
     // set frame properties
     if (timesteps_.dt != 0.0 && timesteps_.step != 0) {
@@ -184,10 +216,101 @@ void DCDFormat::read_at(size_t index, Frame& frame) {
     }
 
     if (!title_.empty()) {
-        frame.set("title", title_);
+        // the title is the same for all frames, only copy it if needed
+        auto title = frame.get<Property::STRING>("title");
+        if (!title || *title != title_) {
+            frame.set("title", title_);
+        }
+    }
+
+    index_++;
+}
+
+bool DCDFormat::supports_in_place_read() const {
+    return true;
+}
+
+void DCDFormat::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    if (positions.size() != n_frames * n_atoms_) {
+        throw format_error(
+            "can not read positions in DCD file at '{}': expected {} atoms, got {}",
+            file_->path(), positions.size() / n_frames, n_atoms_
+        );
+    }
+
+    if (stride == 1) {
+        file_->set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    } else {
+        file_->set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    }
+
+    for (size_t i = 0; i < n_frames; i++) {
+        this->seek_frame(start + i * stride);
+        // the cell needs to be read to get to the positions
+        this->read_cell();
+        read_coordinates(span<Vector3D>(positions.data() + i * n_atoms_, n_atoms_));
+    }
+    index_++;
+}
+
+void DCDFormat::seek_frame(size_t index) {
+    index_ = index;
+    if (index_ == 0) {
+        file_->seek(header_size_);
+    } else {
+        file_->seek(header_size_ + first_frame_size_ + (index_ - 1) * frame_size_);
+    }
+
+    if (file_->access_pattern() == BinaryFile::AccessPattern::SEQUENTIAL && index_ + 1 < n_frames_) {
+        // load the next frame while this one is being decoded
+        file_->prefetch(header_size_ + first_frame_size_ + index_ * frame_size_, frame_size_);
     }
 }
 
+void DCDFormat::read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) {
+    auto requests = std::vector<BatchReader::request>();
+    requests.reserve(indices.size());
+    for (auto index: indices) {
+        if (index == 0) {
+            requests.push_back({header_size_, static_cast<size_t>(first_frame_size_)});
+        } else {
+            auto start = header_size_ + first_frame_size_ + (index - 1) * frame_size_;
+            requests.push_back({start, static_cast<size_t>(frame_size_)});
+        }
+    }
+
+    auto initial_index = index_;
+    auto big_endian = dynamic_cast<BigEndianFile*>(file_.get()) != nullptr;
+    file_->set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    file_->read_batch(requests, [&](size_t i, span<const char> data) {
+        // decode the frame from the data we just read, using a file in
+        // memory with the same endianness in place of the actual file
+        auto memory = std::make_shared<MemoryBuffer>(data.data(), data.size());
+        auto frame_file = std::unique_ptr<BinaryFile>();
+        if (big_endian) {
+            frame_file = std::make_unique<BigEndianFile>(std::move(memory), File::READ);
+        } else {
+            frame_file = std::make_unique<LittleEndianFile>(std::move(memory), File::READ);
+        }
+        frame_file->set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+        std::swap(file_, frame_file);
+
+        Frame frame;
+        index_ = indices[i];
+        try {
+            this->read_frame(frame);
+        } catch (...) {
+            std::swap(file_, frame_file);
+            index_ = initial_index;
+            throw;
+        }
+        std::swap(file_, frame_file);
+        index_ = initial_index;
+
+        callback(indices[i], frame);
+    });
+}
+
 size_t DCDFormat::read_marker() {
     if (options_.use_64_bit_markers) {
         return checked_cast(file_->read_single_i64());
@@ -409,15 +532,14 @@ UnitCell DCDFormat::read_cell() {
     return UnitCell(lengths, angles);
 }
 
-void DCDFormat::read_positions(Frame& frame) {
-    frame.resize(n_atoms_);
-    auto positions = frame.positions();
+void DCDFormat::read_coordinates(span<Vector3D> positions) {
+    assert(positions.size() == n_atoms_);
 
     auto n_atoms_to_read = n_atoms_;
     if (!fixed_atoms_.empty()) {
         if (index_ != 0) {
             n_atoms_to_read = n_free_atoms_;
-            for (size_t i=0; i<frame.size(); i++) {
+            for (size_t i=0; i<positions.size(); i++) {
                 if (fixed_atoms_[i].fixed) {
                     positions[i] = fixed_atoms_[i].fixed_coord;
                 }
@@ -426,18 +548,21 @@ void DCDFormat::read_positions(Frame& frame) {
     }
 
     buffer_.resize(n_atoms_to_read);
+    // when reading all atoms, the coordinates are converted directly into the
+    // frame positions
+    auto* positions_data = reinterpret_cast<double*>(positions.data());
 
     // read the X coordinate
     this->expect_marker(sizeof(float) * n_atoms_to_read);
-    file_->read_f32(buffer_);
-    this->expect_marker(sizeof(float) * n_atoms_to_read);
-
     if (n_atoms_to_read == n_atoms_) {
-        for (size_t i=0; i<n_atoms_; i++) {
-            positions[i][0] = static_cast<double>(buffer_[i]);
-        }
+        file_->read_f32_as_f64(positions_data + 0, n_atoms_, 3);
     } else {
-        for (size_t i=0; i<frame.size(); i++) {
+        file_->read_f32(buffer_);
+    }
+    this->expect_marker(sizeof(float) * n_atoms_to_read);
+
+    if (n_atoms_to_read != n_atoms_) {
+        for (size_t i=0; i<positions.size(); i++) {
             if (!fixed_atoms_[i].fixed) {
                 positions[i][0] = static_cast<double>(buffer_[fixed_atoms_[i].free_index]);
             }
@@ -446,15 +571,15 @@ void DCDFormat::read_positions(Frame& frame) {
 
     // read the Y coordinate
     this->expect_marker(sizeof(float) * n_atoms_to_read);
-    file_->read_f32(buffer_);
-    this->expect_marker(sizeof(float) * n_atoms_to_read);
-
     if (n_atoms_to_read == n_atoms_) {
-        for (size_t i=0; i<n_atoms_; i++) {
-            positions[i][1] = static_cast<double>(buffer_[i]);
-        }
+        file_->read_f32_as_f64(positions_data + 1, n_atoms_, 3);
     } else {
-        for (size_t i=0; i<frame.size(); i++) {
+        file_->read_f32(buffer_);
+    }
+    this->expect_marker(sizeof(float) * n_atoms_to_read);
+
+    if (n_atoms_to_read != n_atoms_) {
+        for (size_t i=0; i<positions.size(); i++) {
             if (!fixed_atoms_[i].fixed) {
                 positions[i][1] = static_cast<double>(buffer_[fixed_atoms_[i].free_index]);
             }
@@ -463,15 +588,15 @@ void DCDFormat::read_positions(Frame& frame) {
 
     // read the Z coordinate
     this->expect_marker(sizeof(float) * n_atoms_to_read);
-    file_->read_f32(buffer_);
-    this->expect_marker(sizeof(float) * n_atoms_to_read);
-
     if (n_atoms_to_read == n_atoms_) {
-        for (size_t i=0; i<n_atoms_; i++) {
-            positions[i][2] = static_cast<double>(buffer_[i]);
-        }
+        file_->read_f32_as_f64(positions_data + 2, n_atoms_, 3);
     } else {
-        for (size_t i=0; i<frame.size(); i++) {
+        file_->read_f32(buffer_);
+    }
+    this->expect_marker(sizeof(float) * n_atoms_to_read);
+
+    if (n_atoms_to_read != n_atoms_) {
+        for (size_t i=0; i<positions.size(); i++) {
             if (!fixed_atoms_[i].fixed) {
                 positions[i][2] = static_cast<double>(buffer_[fixed_atoms_[i].free_index]);
             }
@@ -741,7 +866,7 @@ template <> const FormatMetadata& chemfiles::format_metadata<DCDFormat>() {
 
     metadata.read = true;
     metadata.write = true;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = false;
@@ -9,6 +9,7 @@
 #include <array>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <string_view>
 
 #include "chemfiles/Property.hpp"
@@ -52,11 +53,28 @@ template <> const FormatMetadata& chemfiles::format_metadata<LAMMPSTrajectoryFor
 using chemfiles::details::is_lower_triangular;
 
 static optional<std::string_view> get_item(std::string_view line) {
-    auto splitted = split(line, ':');
-    if (splitted.size() != 2 || trim(splitted[0]) != "ITEM") {
+    // look for exactly two non-empty components separated by ':', without
+    // allocating memory for them like `split` would
+    std::string_view components[2];
+    size_t count = 0;
+    size_t last = 0;
+    for (size_t i = 0; i <= line.size(); i++) {
+        if (i == line.size() || line[i] == ':') {
+            if (i != last) {
+                if (count == 2) {
+                    return nullopt;
+                }
+                components[count] = line.substr(last, i - last);
+                count++;
+            }
+            last = i + 1;
+        }
+    }
+
+    if (count != 2 || trim(components[0]) != "ITEM") {
         return nullopt;
     }
-    return trim(splitted[1]);
+    return trim(components[1]);
 }
 
 std::array<double, 3> LAMMPSTrajectoryFormat::read_cell(Frame& frame) {
@@ -66,7 +84,8 @@ std::array<double, 3> LAMMPSTrajectoryFormat::read_cell(Frame& frame) {
         if (!item) {
             throw format_error("expected an ITEM entry in LAMMPS format, got '{}'", line);
         }
-        auto splitted = split(*item, ' ');
+        auto& splitted = tokens_;
+        split(*item, ' ', splitted);
         if (splitted[0] == "BOX" && splitted[1] == "BOUNDS") {
             auto matrix = Matrix3D::unit();
             std::array<double, 3> origin;
@@ -75,7 +94,7 @@ std::array<double, 3> LAMMPSTrajectoryFormat::read_cell(Frame& frame) {
                 shape = UnitCell::TRICLINIC;
             }
             line = file_.readline();
-            splitted = split(line, ' ');
+            split(line, ' ', splitted);
             if ((shape == UnitCell::ORTHORHOMBIC && splitted.size() != 2) ||
                 (shape == UnitCell::TRICLINIC && splitted.size() != 3)) {
                 size_t expected_dims = (shape == UnitCell::ORTHORHOMBIC) ? 2 : 3;
@@ -92,7 +111,7 @@ std::array<double, 3> LAMMPSTrajectoryFormat::read_cell(Frame& frame) {
             }
 
             line = file_.readline();
-            splitted = split(line, ' ');
+            split(line, ' ', splitted);
             if ((shape == UnitCell::ORTHORHOMBIC && splitted.size() != 2) ||
                 (shape == UnitCell::TRICLINIC && splitted.size() != 3)) {
                 size_t expected_dims = (shape == UnitCell::ORTHORHOMBIC) ? 2 : 3;
@@ -109,7 +128,7 @@ std::array<double, 3> LAMMPSTrajectoryFormat::read_cell(Frame& frame) {
             }
 
             line = file_.readline();
-            splitted = split(line, ' ');
+            split(line, ' ', splitted);
             if ((shape == UnitCell::ORTHORHOMBIC && splitted.size() != 2) ||
                 (shape == UnitCell::TRICLINIC && splitted.size() != 3)) {
                 size_t expected_dims = (shape == UnitCell::ORTHORHOMBIC) ? 2 : 3;
@@ -245,11 +264,22 @@ static lammps_atom_attr_t attribute_from_str(std::string_view attr_str) {
     }
 }
 
-struct AtomField {
+struct chemfiles::AtomField {
     std::string name;
     lammps_atom_attr_t kind;
 };
 
+LAMMPSTrajectoryFormat::LAMMPSTrajectoryFormat(std::string path, File::Mode mode, File::Compression compression)
+    : TextFormat(std::move(path), mode, compression) {}
+
+LAMMPSTrajectoryFormat::LAMMPSTrajectoryFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression)
+    : TextFormat(std::move(memory), mode, compression) {}
+
+LAMMPSTrajectoryFormat::LAMMPSTrajectoryFormat(std::unique_ptr<TextFileImpl> stream, File::Mode mode)
+    : TextFormat(std::move(stream), mode) {}
+
+LAMMPSTrajectoryFormat::~LAMMPSTrajectoryFormat() = default;
+
 static lammps_position_representation_t
 detect_best_pos_representation(const std::vector<AtomField>& fields) {
     int wrapped_count = 0;
@@ -308,30 +338,54 @@ static void unwrap(Vector3D& position, std::array<int, 3>& image, Matrix3D& matr
     position[2] += image[2] * matrix[2][2];
 }
 
+bool LAMMPSTrajectoryFormat::update_fields(std::string_view item) {
+    split(item, ' ', tokens_);
+    if (tokens_.empty() || tokens_[0] != "ATOMS") {
+        throw format_error("can not read next step as LAMMPS format: expected 'ATOMS' got '{}'",
+                           item);
+    }
+
+    auto same_fields = fields_.size() == tokens_.size() - 1;
+    for (size_t i = 1; same_fields && i < tokens_.size(); ++i) {
+        same_fields = fields_[i - 1].name == tokens_[i];
+    }
+
+    if (!same_fields) {
+        fields_.clear();
+        fields_.reserve(tokens_.size() - 1);
+        for (size_t i = 1; i < tokens_.size(); ++i) {
+            fields_.push_back({std::string(tokens_[i]), attribute_from_str(tokens_[i])});
+        }
+    }
+
+    return same_fields;
+}
+
 void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
     auto item = get_item(file_.readline());
     if (!item) {
         throw format_error("can not read next step as LAMMPS format: expected an ITEM entry");
     }
+    optional<std::string_view> units = nullopt;
     if (*item == "UNITS") { // optional
-        frame.set("lammps_units", std::string(trim(file_.readline())));
+        units = trim(file_.readline());
         item = get_item(file_.readline());
         if (!item) {
             throw format_error("can not read next step as LAMMPS format: expected an ITEM entry");
         }
     }
+    optional<double> time = nullopt;
     if (*item == "TIME") { // optional
-        double time = parse<double>(trim(file_.readline()));
-        frame.set("time", time);
+        time = parse<double>(trim(file_.readline()));
         item = get_item(file_.readline());
         if (!item) {
             throw format_error("can not read next step as LAMMPS format: expected an ITEM entry");
         }
     }
 
+    int64_t timestep = 0;
     if (*item == "TIMESTEP") {
-        int64_t timestep = parse<int64_t>(trim(file_.readline()));
-        frame.set("simulation_step", timestep);
+        timestep = parse<int64_t>(trim(file_.readline()));
     } else {
         throw format_error("can not read next step as LAMMPS format: expected 'TIMESTEP' got '{}'",
                            *item);
@@ -355,30 +409,47 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
     if (!item) {
         throw format_error("can not read next step as LAMMPS format: expected an ITEM entry");
     }
-    auto atoms_item = split(*item, ' ');
-    if (atoms_item.empty() || atoms_item[0] != "ATOMS") {
-        throw format_error("can not read next step as LAMMPS format: expected 'ATOMS' got '{}'",
-                           *item);
-    }
-    std::vector<AtomField> fields;
-    fields.reserve(atoms_item.size() - 1);
+    auto same_fields = update_fields(*item);
+    const auto& fields = fields_;
+
     optional<size_t> atomid_column = nullopt;
-    std::vector<bool> duplicate_check;
-    optional<std::vector<std::array<int, 3>>> images = nullopt;
-    for (size_t i = 1; i < atoms_item.size(); ++i) {
-        auto attr = attribute_from_str(atoms_item[i]);
+    bool has_velocities = false;
+    bool has_images = false;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        auto attr = fields[i].kind;
         if (attr == ATOMID) {
-            atomid_column = i - 1;
-            duplicate_check = std::vector<bool>(natoms, false);
+            atomid_column = i;
+            duplicate_check_.assign(natoms, false);
         }
         if (attr == VELX || attr == VELY || attr == VELZ) {
-            frame.add_velocities();
+            has_velocities = true;
         }
         if (attr == IMGX || attr == IMGY || attr == IMGZ) {
-            images = std::vector<std::array<int, 3>>(natoms, {0, 0, 0});
+            has_images = true;
+            images_.assign(natoms, {0, 0, 0});
         }
-        fields.push_back({std::string(atoms_item[i]), attr});
     }
+
+    // the atoms from the previous step are only overwritten if the same
+    // fields are present in this step
+    if (!same_fields || frame.size() != natoms || static_cast<bool>(frame.velocities()) != has_velocities ||
+        static_cast<bool>(frame.get("lammps_units")) != static_cast<bool>(units) ||
+        static_cast<bool>(frame.get("time")) != static_cast<bool>(time)) {
+        auto cell = frame.cell();
+        frame = Frame(std::move(cell));
+    }
+
+    if (units) {
+        frame.set("lammps_units", std::string(*units));
+    }
+    if (time) {
+        frame.set("time", *time);
+    }
+    frame.set("simulation_step", timestep);
+    if (has_velocities) {
+        frame.add_velocities();
+    }
+
     lammps_position_representation_t use_pos_repr = detect_best_pos_representation(fields);
 
     frame.resize(natoms);
@@ -387,7 +458,8 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
 
     for (size_t i = 0; i < natoms; ++i) {
         auto line = file_.readline();
-        auto splitted = split(line, ' ');
+        auto& splitted = tokens_;
+        split(line, ' ', splitted);
         if (splitted.size() != fields.size()) {
             throw format_error(
                 "LAMMPS atom line has wrong number of fields: expected {} got {}",
@@ -401,13 +473,13 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
             atomid = parse<size_t>(splitted[*atomid_column]);
             assert(atomid > 0);
             --atomid; // the frame uses zero-based indices
-            assert(duplicate_check.size() == natoms);
-            if (duplicate_check[atomid]) {
+            assert(duplicate_check_.size() == natoms);
+            if (duplicate_check_[atomid]) {
                 throw format_error(
                     "found atoms with the same ID in LAMMPS format: {} is already present",
                     atomid + 1);
             }
-            duplicate_check[atomid] = true;
+            duplicate_check_[atomid] = true;
         }
 
         auto& atom = frame[atomid];
@@ -487,16 +559,16 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
                 }
                 break;
             case IMGX:
-                assert(images);
-                (*images)[atomid][0] = parse<int>(splitted[j]);
+                assert(has_images);
+                images_[atomid][0] = parse<int>(splitted[j]);
                 break;
             case IMGY:
-                assert(images);
-                (*images)[atomid][1] = parse<int>(splitted[j]);
+                assert(has_images);
+                images_[atomid][1] = parse<int>(splitted[j]);
                 break;
             case IMGZ:
-                assert(images);
-                (*images)[atomid][2] = parse<int>(splitted[j]);
+                assert(has_images);
+                images_[atomid][2] = parse<int>(splitted[j]);
                 break;
             case VELX:
                 assert(velocities);
@@ -544,20 +616,20 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
                 origin[1] + positions[i][1] * matrix[1][1] + positions[i][2] * matrix[2][1];
             // z = zlo + zs * (zhi - zlo)
             positions[i][2] = origin[2] + positions[i][2] * matrix[2][2];
-            if (images && use_pos_repr != SCALED_UNWRAPPED) {
+            if (has_images && use_pos_repr != SCALED_UNWRAPPED) {
                 // unwrap coordinates by using image data
-                unwrap(positions[i], (*images)[i], matrix);
+                unwrap(positions[i], images_[i], matrix);
             }
         }
-    } else if (images && use_pos_repr != UNWRAPPED) {
+    } else if (has_images && use_pos_repr != UNWRAPPED) {
         // unwrap coordinates by using image data
         auto matrix = frame.cell().matrix();
         for (size_t i = 0; i < natoms; ++i) {
-            unwrap(positions[i], (*images)[i], matrix);
+            unwrap(positions[i], images_[i], matrix);
         }
     }
 
-    if (use_pos_repr == UNWRAPPED || use_pos_repr == SCALED_UNWRAPPED || images) {
+    if (use_pos_repr == UNWRAPPED || use_pos_repr == SCALED_UNWRAPPED || has_images) {
         frame.set("is_unwrapped", true);
     }
     else {
@@ -565,6 +637,10 @@ void LAMMPSTrajectoryFormat::read_next(Frame& frame) {
     }
 }
 
+bool LAMMPSTrajectoryFormat::supports_in_place_read() const {
+    return true;
+}
+
 static optional<size_t> parse_lammps_type(const std::string& type_str) {
     if (type_str.empty()) {
         return nullopt;
@@ -673,6 +749,86 @@ void LAMMPSTrajectoryFormat::write_next(const Frame& frame) {
     }
 }
 
+/// Check if the line only contains digits, ignoring surrounding whitespace
+static bool is_integer_line(std::string_view line) {
+    line = trim(line);
+    if (line.empty()) {
+        return false;
+    }
+    return std::all_of(line.begin(), line.end(), [](char c) { return '0' <= c && c <= '9'; });
+}
+
+bool LAMMPSTrajectoryFormat::supports_parallel_scan() const {
+    return true;
+}
+
+bool LAMMPSTrajectoryFormat::is_scan_marker(std::string_view line) const {
+    // record all ITEM lines, and the lines which could contain the number of
+    // atoms after 'ITEM: NUMBER OF ATOMS'
+    return trim(line).substr(0, 4) == "ITEM" || is_integer_line(line);
+}
+
+std::vector<uint64_t> LAMMPSTrajectoryFormat::frames_from_markers(uint64_t /*unused*/, const std::vector<scan_marker>& markers) {
+    auto find = [&](std::vector<scan_marker>::const_iterator from, uint64_t line) {
+        auto marker = std::lower_bound(from, markers.end(), line, [](const scan_marker& m, uint64_t l) {
+            return m.line < l;
+        });
+        if (marker != markers.end() && marker->line != line) {
+            return markers.end();
+        }
+        return marker;
+    };
+
+    auto frames = std::vector<uint64_t>();
+    uint64_t line = 0;
+    auto marker = markers.begin();
+    while (true) {
+        marker = find(marker, line);
+        if (marker == markers.end()) {
+            break;
+        }
+        frames.push_back(marker->position);
+
+        // same as in `forward`, look for the number of atoms, followed by the
+        // box and the atoms header
+        while (marker != markers.end()) {
+            auto item = get_item(marker->content);
+            if (item && *item == "NUMBER OF ATOMS") {
+                break;
+            }
+            ++marker;
+        }
+        if (marker == markers.end()) {
+            break;
+        }
+
+        auto natoms_line = marker->line;
+        auto natoms_marker = find(marker, natoms_line + 1);
+        auto box_marker = find(marker, natoms_line + 2);
+        auto atoms_marker = find(marker, natoms_line + 6);
+        if (natoms_marker == markers.end() || box_marker == markers.end() || atoms_marker == markers.end()) {
+            break;
+        }
+
+        auto box = get_item(box_marker->content);
+        auto atoms = get_item(atoms_marker->content);
+        if (!box || box->substr(0, 10) != "BOX BOUNDS" || !atoms || atoms->substr(0, 5) != "ATOMS") {
+            break;
+        }
+
+        size_t natoms = 0;
+        try {
+            natoms = parse<size_t>(trim(natoms_marker->content));
+        } catch (const Error&) {
+            break;
+        }
+
+        line = natoms_line + 7 + natoms;
+        marker = atoms_marker;
+    }
+    return frames;
+}
+
 optional<uint64_t> LAMMPSTrajectoryFormat::forward() {
     auto position = file_.tellpos();
     size_t natoms = 0;
@@ -124,6 +124,20 @@ void PDBFormat::read_next(Frame& frame) {
     residues_.clear();
     atom_offsets_.clear();
 
+    const auto& topology = frame.topology();
+    if (frame.velocities() || frame.properties().size() != 0 || topology.residues().size() != 0) {
+        // residues and properties can not be removed from an existing frame,
+        // start from a new one with enough space for the atoms
+        auto natoms = frame.size();
+        frame = Frame();
+        frame.reserve(natoms);
+    } else {
+        // remove the atoms, keeping the memory allocated for them
+        frame.clear_bonds();
+        frame.resize(0);
+        frame.set_cell(UnitCell());
+    }
+
     uint64_t position;
     bool got_end = false;
     while (!got_end && !file_.eof()) {
@@ -224,6 +238,10 @@ void PDBFormat::read_next(Frame& frame) {
     link_standard_residue_bonds(frame);
 }
 
+bool PDBFormat::supports_in_place_read() const {
+    return true;
+}
+
 void PDBFormat::read_CRYST1(Frame& frame, std::string_view line) {
     assert(line.substr(0, 6) == "CRYST1");
     if (line.length() < 54) {
@@ -914,6 +932,36 @@ PDBFormat::~PDBFormat() {
     }
 }
 
+void PDBFormat::close() {
+    if (written_) {
+        file_.print("END\n");
+        written_ = false;
+    }
+    TextFormat::close();
+}
+
+bool PDBFormat::supports_parallel_scan() const {
+    return true;
+}
+
+bool PDBFormat::is_scan_marker(std::string_view line) const {
+    // frames end with END or ENDMDL records
+    return line.substr(0, 3) == "END";
+}
+
+std::vector<uint64_t> PDBFormat::frames_from_markers(uint64_t start, const std::vector<scan_marker>& markers) {
+    auto frames = std::vector<uint64_t>{start};
+    for (size_t i = 0; i < markers.size(); i++) {
+        const auto& marker = markers[i];
+        if (marker.content.substr(0, 6) == "ENDMDL" && i + 1 < markers.size() && markers[i + 1].line == marker.line + 1) {
+            // same as in `forward`, skip ENDMDL directly followed by END
+            continue;
+        }
+        frames.push_back(marker.next);
+    }
+    return frames;
+}
+
 optional<uint64_t> PDBFormat::forward() {
     auto position = file_.tellpos();
 
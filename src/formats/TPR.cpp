@@ -7,6 +7,7 @@
 
 #include <algorithm>
 #include <array>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -26,6 +27,7 @@
 #include "chemfiles/Residue.hpp"
 
 #include "chemfiles/files/XDRFile.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/formats/TPR.hpp"
 
 // see <GMX>/src/gromacs/fileio/tpxio.cpp
@@ -540,7 +542,7 @@ template <> const FormatMetadata& chemfiles::format_metadata<TPRFormat>() {
 
     metadata.read = true;
     metadata.write = false;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = true;
@@ -552,7 +554,14 @@ template <> const FormatMetadata& chemfiles::format_metadata<TPRFormat>() {
 }
 
 TPRFormat::TPRFormat(std::string path, File::Mode mode, File::Compression compression)
-    : file_(std::move(path), mode) {
+    : TPRFormat(XDRFile(std::move(path), mode), compression) {}
+
+TPRFormat::TPRFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression)
+    : TPRFormat(XDRFile(std::move(memory), mode), compression) {}
+
+TPRFormat::TPRFormat(XDRFile file, File::Compression compression)
+    : file_(std::move(file)) {
+    auto mode = file_.mode();
     if (compression != File::DEFAULT) {
         throw format_error("TPR format does not support compression");
     }
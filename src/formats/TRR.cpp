@@ -6,10 +6,13 @@
 #include <cstdint>
 
 #include <array>
+#include <algorithm>
+#include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/external/optional.hpp"
@@ -24,6 +27,8 @@
 #include "chemfiles/UnitCell.hpp"
 
 #include "chemfiles/files/XDRFile.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/formats/TRR.hpp"
 
 // definitions from the xdrfile library
@@ -57,7 +62,7 @@ template <> const FormatMetadata& chemfiles::format_metadata<TRRFormat>() {
 
     metadata.read = true;
     metadata.write = true;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = true;
@@ -75,13 +80,34 @@ static void get_forces(std::vector<float>& f, const Frame& frame);
 static bool has_forces(const Frame& frame);
 
 TRRFormat::TRRFormat(std::string path, File::Mode mode, File::Compression compression)
-    : file_(std::move(path), mode) {
+    : TRRFormat(
+        XDRFile(path, mode),
+        compression,
+        mode == File::READ ? optional<FrameIndex>(FrameIndex(path, "TRR")) : nullopt
+    ) {}
+
+TRRFormat::TRRFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression)
+    : TRRFormat(XDRFile(std::move(memory), mode), compression) {}
+
+TRRFormat::TRRFormat(XDRFile file, File::Compression compression, optional<FrameIndex> frame_index)
+    : file_(std::move(file)) {
+    auto mode = file_.mode();
     if (compression != File::DEFAULT) {
         throw format_error("TRR format does not support compression");
     }
 
     if (mode == File::READ) {
-        determine_frame_offsets();
+        auto positions = frame_index ? frame_index->load() : nullopt;
+        if (positions) {
+            frame_positions_ = std::move(*positions);
+            natoms_ = read_frame_header().natoms;
+            file_.seek(0);
+        } else {
+            determine_frame_offsets();
+            if (frame_index) {
+                frame_index->save(frame_positions_);
+            }
+        }
     } else if (mode == File::APPEND) {
         try {
             determine_frame_offsets();
@@ -92,74 +118,146 @@ TRRFormat::TRRFormat(std::string path, File::Mode mode, File::Compression compre
     }
 }
 
+TRRFormat::TRRFormat(XDRFile file, std::vector<uint64_t> frame_positions, size_t natoms)
+    : file_(std::move(file)), frame_positions_(std::move(frame_positions)), natoms_(natoms) {}
+
 size_t TRRFormat::size() { return frame_positions_.size(); }
 
 void TRRFormat::read_at(size_t index, Frame& frame) {
+    if (index == index_) {
+        file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    } else {
+        file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    }
+
     index_ = index;
     file_.seek(frame_positions_[index_]);
-    read(frame);
+    read_frame(frame);
+}
+
+void TRRFormat::read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) {
+    auto requests = std::vector<BatchReader::request>();
+    requests.reserve(indices.size());
+    for (auto index: indices) {
+        auto start = frame_positions_[index];
+        auto end = index + 1 < frame_positions_.size() ? frame_positions_[index + 1] : file_.file_size();
+        requests.push_back({start, static_cast<size_t>(end - start)});
+    }
+
+    auto initial_index = index_;
+    file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    file_.read_batch(requests, [&](size_t i, span<const char> data) {
+        // decode the frame from the data we just read, using a file in
+        // memory in place of the actual file
+        auto frame_file = XDRFile(std::make_shared<MemoryBuffer>(data.data(), data.size()), File::READ);
+        frame_file.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+        std::swap(file_, frame_file);
+
+        Frame frame;
+        index_ = indices[i];
+        try {
+            read_frame(frame);
+        } catch (...) {
+            std::swap(file_, frame_file);
+            index_ = initial_index;
+            throw;
+        }
+        std::swap(file_, frame_file);
+        index_ = initial_index;
+
+        callback(indices[i], frame);
+    });
+}
+
+bool TRRFormat::supports_in_place_read() const {
+    return true;
+}
+
+std::unique_ptr<Format> TRRFormat::open_cursor(const std::function<std::unique_ptr<Format>()>& /*unused*/) {
+    // open the file again, re-using the frame positions instead of scanning
+    // the file to find them
+    auto& memory = file_.memory();
+    auto file = memory ? XDRFile(memory, File::READ) : XDRFile(file_.path(), File::READ);
+    return std::unique_ptr<Format>(new TRRFormat(std::move(file), frame_positions_, natoms_));
+}
+
+void TRRFormat::read(Frame& frame) {
+    file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    read_frame(frame);
 }
 
-template <typename T> void read_real_vec(XDRFile& file, std::vector<T>& dx) {
+void TRRFormat::prefetch_next_frame() {
+    auto next = index_ + 1;
+    if (next >= frame_positions_.size()) {
+        return;
+    }
+
+    auto start = frame_positions_[next];
+    auto end = next + 1 < frame_positions_.size() ? frame_positions_[next + 1] : file_.file_size();
+    file_.prefetch(start, end - start);
+}
+
+template <typename T> void read_vectors(XDRFile& file, span<Vector3D> vectors) {
     // Compile-time error whenever T is a concrete type here
     // (i.e. specialization for float/double is not used)
-    static_assert(sizeof(T) == -1, "read_real_vec can only be used with float or double");
+    static_assert(sizeof(T) == -1, "read_vectors can only be used with float or double");
 }
 
-template <> void read_real_vec<double>(XDRFile& file, std::vector<double>& dx) {
-    file.read_f64(dx);
+template <> void read_vectors<double>(XDRFile& file, span<Vector3D> vectors) {
+    file.read_f64(reinterpret_cast<double*>(vectors.data()), 3 * vectors.size());
 }
 
-template <> void read_real_vec<float>(XDRFile& file, std::vector<float>& dx) { file.read_f32(dx); }
+template <> void read_vectors<float>(XDRFile& file, span<Vector3D> vectors) {
+    // convert directly into the vectors, without intermediary copy
+    file.read_f32_as_f64(reinterpret_cast<double*>(vectors.data()), 3 * vectors.size(), 1);
+}
 
 template <typename T>
 void read_xvf(Frame& frame, XDRFile& file, size_t natoms, bool has_positions, bool has_velocities,
-              bool has_forces) {
+              bool has_forces, std::vector<Vector3D>& forces) {
     static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value,
                   "read_xvf can only be used with float or double");
 
-    std::vector<T> dx(natoms * 3);
+    auto positions = frame.positions();
+    assert(natoms == positions.size());
     if (has_positions) {
-        read_real_vec(file, dx);
-        auto positions = frame.positions();
-        assert(dx.size() == 3 * positions.size());
-        for (size_t i = 0; i < frame.size(); i++) {
+        read_vectors<T>(file, positions);
+        for (auto& position: positions) {
             // Factor 10 because the cell lengths are in nm in the TRR format
-            positions[i][0] = static_cast<double>(dx[i * 3]) * 10.0;
-            positions[i][1] = static_cast<double>(dx[i * 3 + 1]) * 10.0;
-            positions[i][2] = static_cast<double>(dx[i * 3 + 2]) * 10.0;
+            position *= 10.0;
         }
+    } else {
+        // the frame might contain positions from a previous step
+        std::fill(positions.begin(), positions.end(), Vector3D());
     }
     if (has_velocities) {
-        read_real_vec(file, dx);
         frame.add_velocities();
         auto velocities = *frame.velocities();
-        assert(dx.size() == 3 * velocities.size());
-        for (size_t i = 0; i < frame.size(); i++) {
+        assert(natoms == velocities.size());
+        read_vectors<T>(file, velocities);
+        for (auto& velocity: velocities) {
             // Factor 10 because the lengths are in nm in the TRR format
             // GROMACS velocity unit: nm / ps
-            velocities[i][0] = static_cast<double>(dx[i * 3]) * 10.0;
-            velocities[i][1] = static_cast<double>(dx[i * 3 + 1]) * 10.0;
-            velocities[i][2] = static_cast<double>(dx[i * 3 + 2]) * 10.0;
+            velocity *= 10.0;
         }
     }
     if (has_forces) {
-        read_real_vec(file, dx);
-        assert(dx.size() == 3 * frame.size());
+        forces.resize(natoms);
+        read_vectors<T>(file, forces);
         for (size_t i = 0; i < frame.size(); i++) {
             // Factor 10 because the lengths are in nm in the TRR format
             // GROMACS force unit: kJ / (mol * nm)
-            const Vector3D force = {
-                static_cast<double>(dx[i * 3] / 10.0),
-                static_cast<double>(dx[i * 3 + 1] / 10.0),
-                static_cast<double>(dx[i * 3 + 2] / 10.0),
-            };
-            frame[i].set("force", force);
+            frame[i].set("force", forces[i] / 10.0);
         }
     }
 }
 
-void TRRFormat::read(Frame& frame) {
+void TRRFormat::read_frame(Frame& frame) {
+    if (file_.access_pattern() == BinaryFile::AccessPattern::SEQUENTIAL) {
+        // load the next frame while this one is being decoded
+        this->prefetch_next_frame();
+    }
+
     FrameHeader header = read_frame_header();
 
     bool has_box = (header.box_size > 0);
@@ -167,6 +265,13 @@ void TRRFormat::read(Frame& frame) {
     bool has_velocities = (header.v_size > 0);
     bool has_forces = (header.f_size > 0);
 
+    // the frame can only be reused if it contains the same data as this step
+    auto has_previous_forces = frame.size() != 0 && frame[0].get("force");
+    if (frame.size() != header.natoms || static_cast<bool>(frame.velocities()) != has_velocities ||
+        has_previous_forces != has_forces) {
+        frame = Frame();
+    }
+
     frame.set("simulation_step", header.step); // actual step of MD Simulation
     frame.set("time", header.time);            // time in pico seconds
     frame.set("trr_lambda", header.lambda);    // coupling parameter for free energy methods
@@ -176,6 +281,8 @@ void TRRFormat::read(Frame& frame) {
     if (has_box) {
         const auto box = file_.read_gmx_box(header.use_double);
         frame.set_cell(box);
+    } else {
+        frame.set_cell(UnitCell());
     }
 
     size_t legacy_size = header.vir_size + header.pres_size;
@@ -184,11 +291,57 @@ void TRRFormat::read(Frame& frame) {
     }
 
     if (header.use_double) {
-        read_xvf<double>(frame, file_, header.natoms, has_positions, has_velocities, has_forces);
+        read_xvf<double>(frame, file_, header.natoms, has_positions, has_velocities, has_forces, forces_);
+    } else {
+        read_xvf<float>(frame, file_, header.natoms, has_positions, has_velocities, has_forces, forces_);
+    }
+
+    index_++;
+}
+
+void TRRFormat::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    if (stride == 1) {
+        file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
     } else {
-        read_xvf<float>(frame, file_, header.natoms, has_positions, has_velocities, has_forces);
+        file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
     }
 
+    auto natoms = positions.size() / n_frames;
+    for (size_t i = 0; i < n_frames; i++) {
+        index_ = start + i * stride;
+        file_.seek(frame_positions_[index_]);
+        if (stride == 1) {
+            // load the next frame while this one is being decoded
+            this->prefetch_next_frame();
+        }
+
+        auto header = read_frame_header();
+        if (header.natoms != natoms) {
+            throw format_error(
+                "can not read positions at step {} in TRR file at '{}': expected {} atoms, got {}",
+                index_, file_.path(), natoms, header.natoms
+            );
+        }
+
+        auto frame_positions = span<Vector3D>(positions.data() + i * natoms, natoms);
+        if (header.x_size == 0) {
+            std::fill(frame_positions.begin(), frame_positions.end(), Vector3D());
+            continue;
+        }
+
+        // skip the box and legacy data
+        file_.skip(static_cast<uint64_t>(header.box_size + header.vir_size + header.pres_size));
+        if (header.use_double) {
+            read_vectors<double>(file_, frame_positions);
+        } else {
+            read_vectors<float>(file_, frame_positions);
+        }
+
+        for (auto& position: frame_positions) {
+            // Factor 10 because the cell lengths are in nm in the TRR format
+            position *= 10.0;
+        }
+    }
     index_++;
 }
 
@@ -6,9 +6,11 @@
 #include <cstdint>
 
 #include <array>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
+#include <functional>
 
 #include "chemfiles/error_fmt.hpp"
 #include "chemfiles/external/optional.hpp"
@@ -22,6 +24,8 @@
 #include "chemfiles/UnitCell.hpp"
 
 #include "chemfiles/files/XDRFile.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
+#include "chemfiles/files/MemoryBuffer.hpp"
 #include "chemfiles/formats/XTC.hpp"
 
 // definitions from the xdrfile library
@@ -70,7 +74,7 @@ template <> const FormatMetadata& chemfiles::format_metadata<XTCFormat>() {
 
     metadata.read = true;
     metadata.write = true;
-    metadata.memory = false;
+    metadata.memory = true;
 
     metadata.positions = true;
     metadata.velocities = false;
@@ -85,13 +89,34 @@ static void get_cell(std::vector<float>& box, const Frame& frame);
 static void get_positions(std::vector<float>& x, const Frame& frame);
 
 XTCFormat::XTCFormat(std::string path, File::Mode mode, File::Compression compression)
-    : file_(std::move(path), mode) {
+    : XTCFormat(
+        XDRFile(path, mode),
+        compression,
+        mode == File::READ ? optional<FrameIndex>(FrameIndex(path, "XTC")) : nullopt
+    ) {}
+
+XTCFormat::XTCFormat(std::shared_ptr<MemoryBuffer> memory, File::Mode mode, File::Compression compression)
+    : XTCFormat(XDRFile(std::move(memory), mode), compression) {}
+
+XTCFormat::XTCFormat(XDRFile file, File::Compression compression, optional<FrameIndex> frame_index)
+    : file_(std::move(file)) {
+    auto mode = file_.mode();
     if (compression != File::DEFAULT) {
         throw format_error("XTC format does not support compression");
     }
 
     if (mode == File::READ) {
-        determine_frame_offsets();
+        auto positions = frame_index ? frame_index->load() : nullopt;
+        if (positions) {
+            frame_positions_ = std::move(*positions);
+            natoms_ = read_frame_header().natoms;
+            file_.seek(0);
+        } else {
+            determine_frame_offsets();
+            if (frame_index) {
+                frame_index->save(frame_positions_);
+            }
+        }
     } else if (mode == File::APPEND) {
         try {
             determine_frame_offsets();
@@ -102,45 +127,171 @@ XTCFormat::XTCFormat(std::string path, File::Mode mode, File::Compression compre
     }
 }
 
+XTCFormat::XTCFormat(XDRFile file, std::vector<uint64_t> frame_positions, size_t natoms)
+    : file_(std::move(file)), frame_positions_(std::move(frame_positions)), natoms_(natoms) {}
+
 size_t XTCFormat::size() { return frame_positions_.size(); }
 
 void XTCFormat::read_at(size_t index, Frame& frame) {
+    if (index == index_) {
+        file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    } else {
+        file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    }
+
     index_ = index;
     file_.seek(frame_positions_[index_]);
-    read(frame);
+    read_frame(frame);
+}
+
+void XTCFormat::read_batch(const std::vector<size_t>& indices, const std::function<void(size_t, Frame&)>& callback) {
+    auto requests = std::vector<BatchReader::request>();
+    requests.reserve(indices.size());
+    for (auto index: indices) {
+        auto start = frame_positions_[index];
+        auto end = index + 1 < frame_positions_.size() ? frame_positions_[index + 1] : file_.file_size();
+        requests.push_back({start, static_cast<size_t>(end - start)});
+    }
+
+    auto initial_index = index_;
+    file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    file_.read_batch(requests, [&](size_t i, span<const char> data) {
+        // decode the frame from the data we just read, using a file in
+        // memory in place of the actual file
+        auto frame_file = XDRFile(std::make_shared<MemoryBuffer>(data.data(), data.size()), File::READ);
+        frame_file.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+        std::swap(file_, frame_file);
+
+        Frame frame;
+        index_ = indices[i];
+        try {
+            read_frame(frame);
+        } catch (...) {
+            std::swap(file_, frame_file);
+            index_ = initial_index;
+            throw;
+        }
+        std::swap(file_, frame_file);
+        index_ = initial_index;
+
+        callback(indices[i], frame);
+    });
 }
 
 void XTCFormat::read(Frame& frame) {
+    file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    read_frame(frame);
+}
+
+bool XTCFormat::supports_in_place_read() const {
+    return true;
+}
+
+std::unique_ptr<Format> XTCFormat::open_cursor(const std::function<std::unique_ptr<Format>()>& /*unused*/) {
+    // open the file again, re-using the frame positions instead of scanning
+    // the file to find them
+    auto& memory = file_.memory();
+    auto file = memory ? XDRFile(memory, File::READ) : XDRFile(file_.path(), File::READ);
+    return std::unique_ptr<Format>(new XTCFormat(std::move(file), frame_positions_, natoms_));
+}
+
+void XTCFormat::prefetch_next_frame() {
+    auto next = index_ + 1;
+    if (next >= frame_positions_.size()) {
+        return;
+    }
+
+    auto start = frame_positions_[next];
+    auto end = next + 1 < frame_positions_.size() ? frame_positions_[next + 1] : file_.file_size();
+    file_.prefetch(start, end - start);
+}
+
+void XTCFormat::read_frame(Frame& frame) {
+    if (file_.access_pattern() == BinaryFile::AccessPattern::SEQUENTIAL) {
+        // load the next frame while this one is being decoded
+        this->prefetch_next_frame();
+    }
+
     FrameHeader header = read_frame_header();
 
+    // the frame can only be reused if it contains the same data as this step
+    auto compressed = header.natoms > XTC_MAX_NATOMS_UNCOMPRESSED;
+    auto has_precision = static_cast<bool>(frame.get("xtc_precision"));
+    if (frame.size() != header.natoms || frame.velocities() || has_precision != compressed) {
+        frame = Frame();
+    }
+
     frame.set("simulation_step", header.step);           // actual step of MD Simulation
     frame.set("time", static_cast<double>(header.time)); // time in pico seconds
     frame.resize(header.natoms);
 
     frame.set_cell(file_.read_gmx_box());
 
+    auto precision = read_coordinates(header, frame.positions());
+    if (precision) {
+        frame.set("xtc_precision", static_cast<double>(*precision));
+    }
+
+    index_++;
+}
+
+optional<float> XTCFormat::read_coordinates(const FrameHeader& header, span<Vector3D> positions) {
     size_t natoms_again = file_.read_single_size_as_i32();
     if (natoms_again != header.natoms) {
         throw format_error("contradictory number of atoms in XTC file at '{}': expected {}, got {}",
                            file_.path(), header.natoms, natoms_again);
     }
 
-    std::vector<float> x(header.natoms * 3);
+    assert(positions.size() == header.natoms);
     if (header.natoms <= XTC_MAX_NATOMS_UNCOMPRESSED) {
-        file_.read_f32(x);
-    } else {
-        float precision = file_.read_gmx_compressed_floats(x, header.is_long_format());
-        frame.set("xtc_precision", static_cast<double>(precision));
+        // convert directly into the positions
+        file_.read_f32_as_f64(reinterpret_cast<double*>(positions.data()), 3 * header.natoms, 1);
+        for (auto& position: positions) {
+            // Factor 10 because the cell lengths are in nm in the XTC format
+            position *= 10.0;
+        }
+        return nullopt;
     }
-    auto positions = frame.positions();
-    assert(x.size() == 3 * positions.size());
-    for (size_t i = 0; i < frame.size(); i++) {
+
+    coordinates_.resize(header.natoms * 3);
+    float precision = file_.read_gmx_compressed_floats(coordinates_, header.is_long_format());
+    for (size_t i = 0; i < positions.size(); i++) {
         // Factor 10 because the cell lengths are in nm in the XTC format
-        positions[i][0] = static_cast<double>(x[i * 3]) * 10.0;
-        positions[i][1] = static_cast<double>(x[i * 3 + 1]) * 10.0;
-        positions[i][2] = static_cast<double>(x[i * 3 + 2]) * 10.0;
+        positions[i][0] = static_cast<double>(coordinates_[i * 3]) * 10.0;
+        positions[i][1] = static_cast<double>(coordinates_[i * 3 + 1]) * 10.0;
+        positions[i][2] = static_cast<double>(coordinates_[i * 3 + 2]) * 10.0;
+    }
+    return precision;
+}
+
+void XTCFormat::read_positions(size_t start, size_t stride, size_t n_frames, span<Vector3D> positions) {
+    if (stride == 1) {
+        file_.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    } else {
+        file_.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
     }
 
+    auto natoms = positions.size() / n_frames;
+    for (size_t i = 0; i < n_frames; i++) {
+        index_ = start + i * stride;
+        file_.seek(frame_positions_[index_]);
+        if (stride == 1) {
+            // load the next frame while this one is being decoded
+            this->prefetch_next_frame();
+        }
+
+        auto header = read_frame_header();
+        if (header.natoms != natoms) {
+            throw format_error(
+                "can not read positions at step {} in XTC file at '{}': expected {} atoms, got {}",
+                index_, file_.path(), natoms, header.natoms
+            );
+        }
+
+        // skip the box
+        file_.skip(9 * sizeof(float));
+        read_coordinates(header, span<Vector3D>(positions.data() + i * natoms, natoms));
+    }
     index_++;
 }
 
@@ -12,6 +12,7 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <algorithm>
 #include <string_view>
 #include <unordered_map>
 
@@ -28,6 +29,7 @@
 #include "chemfiles/Frame.hpp"
 #include "chemfiles/Property.hpp"
 #include "chemfiles/UnitCell.hpp"
+#include "chemfiles/Topology.hpp"
 #include "chemfiles/Format.hpp"
 #include "chemfiles/FormatMetadata.hpp"
 
@@ -83,6 +85,17 @@ template<> const FormatMetadata& chemfiles::format_metadata<XYZFormat>() {
 void XYZFormat::read_next(Frame& frame) {
     auto n_atoms = parse<size_t>(file_.readline());
 
+    const auto& topology = frame.topology();
+    if (frame.velocities() || frame.properties().size() != 0 || topology.bonds().size() != 0 ||
+        topology.residues().size() != 0) {
+        // this frame contains data which might not be overwritten by this step
+        frame = Frame();
+    } else {
+        // remove the atoms, keeping the memory allocated for them
+        frame.resize(0);
+        frame.set_cell(UnitCell());
+    }
+
     auto properties = read_extended_comment_line(file_.readline(), frame);
 
     frame.reserve(n_atoms);
@@ -100,6 +113,32 @@ void XYZFormat::read_next(Frame& frame) {
     }
 }
 
+void XYZFormat::read_next_positions(span<Vector3D> positions) {
+    auto n_atoms = parse<size_t>(file_.readline());
+    if (n_atoms != positions.size()) {
+        throw format_error(
+            "can not read positions in XYZ format: expected {} atoms, got {}",
+            positions.size(), n_atoms
+        );
+    }
+
+    // skip the comment line, it can not change the positions
+    file_.readline();
+
+    for (size_t i=0; i<n_atoms; i++) {
+        double x = 0;
+        double y = 0;
+        double z = 0;
+        std::string name;
+        scan(file_.readline(), name, x, y, z);
+        positions[i] = Vector3D(x, y, z);
+    }
+}
+
+bool XYZFormat::supports_in_place_read() const {
+    return true;
+}
+
 void XYZFormat::write_next(const Frame& frame) {
     const auto& positions = frame.positions();
     auto velocities = frame.velocities();
@@ -152,6 +191,55 @@ void XYZFormat::write_next(const Frame& frame) {
     }
 }
 
+/// Check if the line only contains digits, ignoring surrounding whitespace
+static bool is_integer_line(std::string_view line) {
+    line = trim(line);
+    if (line.empty()) {
+        return false;
+    }
+    return std::all_of(line.begin(), line.end(), [](char c) { return '0' <= c && c <= '9'; });
+}
+
+bool XYZFormat::supports_parallel_scan() const {
+    return true;
+}
+
+bool XYZFormat::is_scan_marker(std::string_view line) const {
+    // the first line of each frame contains the number of atoms
+    return is_integer_line(line);
+}
+
+std::vector<uint64_t> XYZFormat::frames_from_markers(uint64_t /*unused*/, const std::vector<scan_marker>& markers) {
+    auto frames = std::vector<uint64_t>();
+    uint64_t line = 0;
+    auto marker = markers.begin();
+    while (true) {
+        // look for the number of atoms at the first line of the frame
+        marker = std::lower_bound(marker, markers.end(), line, [](const scan_marker& m, uint64_t l) {
+            return m.line < l;
+        });
+        if (marker == markers.end() || marker->line != line) {
+            break;
+        }
+
+        size_t n_atoms = 0;
+        try {
+            n_atoms = parse<size_t>(marker->content);
+        } catch (const Error&) {
+            break;
+        }
+
+        frames.push_back(marker->position);
+        line += n_atoms + 2;
+    }
+
+    // all frames except the last one will not go through `forward`
+    if (!frames.empty()) {
+        current_forward_step_ += frames.size() - 1;
+    }
+    return frames;
+}
+
 optional<uint64_t> XYZFormat::forward() {
     auto position = file_.tellpos();
 
@@ -665,6 +753,12 @@ static properties_list_t parse_property_list(std::string_view input) {
 }
 
 properties_list_t read_extended_comment_line(std::string_view line, Frame& frame) {
+    // this is the comment line written for frames without properties, velocities
+    // or unit cell. It does not define anything, so we can skip parsing it.
+    if (trim(line) == "Properties=species:S:1:pos:R:3") {
+        return {};
+    }
+
     // only try to parse as extended XYZ if `Properties` or `Lattice` are
     // defined as expected
     auto contains_properties = line.find("species:S:1:pos:R:3") != std::string::npos;
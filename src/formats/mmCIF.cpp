@@ -202,6 +202,10 @@ size_t mmCIFFormat::size() {
     return frame_positions_.size();
 }
 
+void mmCIFFormat::close() {
+    file_.close();
+}
+
 void mmCIFFormat::read_at(const size_t index, Frame& frame) {
     assert(index < frame_positions_.size());
     file_.seekpos(frame_positions_[index]);
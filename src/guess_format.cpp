@@ -40,6 +40,9 @@ std::string chemfiles::guess_format(std::string path, char mode) {
         } else if (extension == ".xz") {
             new_extension = true;
             compression = "XZ";
+        } else if (extension == ".zst") {
+            new_extension = true;
+            compression = "ZST";
         }
 
         if (new_extension) {
@@ -84,6 +87,8 @@ static optional<std::string> distinguish_cif_variants(
         c = File::BZIP2;
     } else if (compression == "XZ") {
         c = File::LZMA;
+    } else if (compression == "ZST") {
+        c = File::ZSTD;
     }
 
     try {
@@ -15,8 +15,8 @@ TEST_CASE() {
 
     // Other formats do not and will throw an error
     CHECK_THROWS_WITH(
-        Trajectory::memory_reader(aromatics.data(), aromatics.size(), "DCD"),
-        "in-memory IO is not supported for the 'DCD' format"
+        Trajectory::memory_reader(aromatics.data(), aromatics.size(), "TNG"),
+        "in-memory IO is not supported for the 'TNG' format"
     );
 
     // [example]
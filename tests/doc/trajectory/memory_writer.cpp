@@ -12,8 +12,8 @@ TEST_CASE() {
 
     // Binary formats typically do not support this feature
     CHECK_THROWS_WITH(
-        Trajectory::memory_writer("XTC"),
-        "in-memory IO is not supported for the 'XTC' format"
+        Trajectory::memory_writer("TNG"),
+        "in-memory IO is not supported for the 'TNG' format"
     );
 
     // [example]
@@ -0,0 +1,21 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    auto trajectory = Trajectory("water.xtc");
+
+    auto n_frames = trajectory.size();
+    auto volumes = std::vector<double>(n_frames);
+    trajectory.parallel_for_each(0, n_frames, [&](size_t index, Frame& frame) {
+        // this function is called from multiple threads at the same time,
+        // each one writing to a different element of `volumes`
+        volumes[index] = frame.cell().volume();
+    }, 4);
+    // [example]
+}
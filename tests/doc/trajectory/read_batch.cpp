@@ -0,0 +1,23 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    auto trajectory = Trajectory("water.xtc");
+
+    auto frames = std::vector<Frame>(trajectory.size());
+    auto indices = std::vector<size_t>{12, 5, 42, 7};
+    trajectory.read_batch(indices, [&](Frame frame) {
+        // frames are given in any order, use the frame index to know which
+        // one is being processed
+        auto index = frame.index();
+        frames[index] = std::move(frame);
+    });
+    // Use the frames for awesome science here!
+    // [example]
+}
@@ -0,0 +1,22 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    auto trajectory = Trajectory("water.xtc");
+    auto n_atoms = trajectory.read_at(0).size();
+
+    // read one frame every 10 frames, from the 100th to the 1000th
+    size_t n_frames = 90;
+    auto positions = std::vector<float>(n_frames * n_atoms * 3);
+    trajectory.read_positions(100, 1000, 10, positions);
+
+    // the position of atom `i` in the `k`-th frame read is at
+    // positions[3 * (k * n_atoms + i) + 0 ... 2]
+    // [example]
+}
@@ -0,0 +1,30 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    auto trajectory = Trajectory("water.xtc", 'w');
+    // write frames on a background thread, with at most 8 frames waiting
+    trajectory.set_async_write(8);
+
+    auto frame = Frame();
+    frame.add_atom(Atom("O"), {0, 0, 0});
+    frame.add_atom(Atom("H"), {1, 0, 0});
+    frame.add_atom(Atom("H"), {0, 1, 0});
+
+    for (size_t step = 0; step < 1000; step++) {
+        // run the simulation, updating the positions in the frame
+
+        // a copy of the frame is written in the background
+        trajectory.write(frame);
+    }
+
+    // wait for all frames to be written, and check for errors
+    trajectory.close();
+    // [example]
+}
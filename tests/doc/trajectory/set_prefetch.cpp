@@ -0,0 +1,22 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    auto trajectory = Trajectory("water.xtc");
+    // read and decode up to 4 frames on a background thread
+    trajectory.set_prefetch(4);
+
+    auto frame = Frame();
+    while (!trajectory.done()) {
+        // the next frame is already available most of the time
+        trajectory.read(frame);
+        // Use the frame for awesome science here!
+    }
+    // [example]
+}
@@ -0,0 +1,31 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstdio>
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [no-run]
+    // [example]
+    // read XYZ frames from the standard input, for example from
+    // `md-engine | ./analysis`
+    auto trajectory = Trajectory::stream_reader([](char* data, size_t count) {
+        return std::fread(data, 1, count, stdin);
+    }, "XYZ");
+
+    while (!trajectory.done()) {
+        // frames are parsed as soon as they are available
+        auto frame = trajectory.read();
+        // Use the frame for awesome science here!
+    }
+
+    // Binary formats do not support this feature
+    CHECK_THROWS_WITH(
+        Trajectory::stream_reader([](char*, size_t) { return size_t(0); }, "XTC"),
+        "streaming IO is not supported for the 'XTC' format"
+    );
+    // [example]
+}
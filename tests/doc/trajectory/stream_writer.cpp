@@ -0,0 +1,23 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstdio>
+
+#include <catch.hpp>
+#include <chemfiles.hpp>
+using namespace chemfiles;
+
+TEST_CASE() {
+    // [example]
+    // send XYZ frames to the standard output, for example to use them in
+    // `./generate | other-program`
+    auto trajectory = Trajectory::stream_writer([](const char* data, size_t count) {
+        std::fwrite(data, 1, count, stdout);
+    }, "XYZ");
+
+    auto frame = Frame();
+    frame.add_atom(Atom("Zn"), {1.0, 2.0, 3.0});
+    trajectory.write(frame);
+
+    // [example]
+}
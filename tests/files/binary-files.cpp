@@ -363,3 +363,235 @@ TEST_CASE("Write binary files") {
         }
     }
 }
+
+static void write_array(BinaryFile& file, const std::vector<uint16_t>& data) { file.write_u16(data); }
+static void write_array(BinaryFile& file, const std::vector<uint32_t>& data) { file.write_u32(data); }
+static void write_array(BinaryFile& file, const std::vector<uint64_t>& data) { file.write_u64(data); }
+static void read_array(BinaryFile& file, std::vector<uint16_t>& data) { file.read_u16(data); }
+static void read_array(BinaryFile& file, std::vector<uint32_t>& data) { file.read_u32(data); }
+static void read_array(BinaryFile& file, std::vector<uint64_t>& data) { file.read_u64(data); }
+
+static std::unique_ptr<BinaryFile> open_binary_file(const std::string& path, File::Mode mode, bool big_endian) {
+    if (big_endian) {
+        return std::make_unique<BigEndianFile>(path, mode);
+    } else {
+        return std::make_unique<LittleEndianFile>(path, mode);
+    }
+}
+
+template <typename T>
+static void check_large_array(const std::string& path, bool big_endian) {
+    // use an odd number of values, to check both the vectorized and the
+    // scalar code paths
+    auto data = std::vector<T>(1003);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<T>(i * 131 + 7);
+    }
+
+    {
+        auto file = open_binary_file(path, File::WRITE, big_endian);
+        // misalign the array in the file
+        file->write_single_char('x');
+        write_array(*file, data);
+    }
+
+    auto content = read_binary_file(path);
+    REQUIRE(content.size() == 1 + sizeof(T) * data.size());
+    for (size_t i = 0; i < data.size(); i++) {
+        uint64_t value = 0;
+        for (size_t byte = 0; byte < sizeof(T); byte++) {
+            auto shift = big_endian ? 8 * (sizeof(T) - 1 - byte) : 8 * byte;
+            value |= static_cast<uint64_t>(content[1 + i * sizeof(T) + byte]) << shift;
+        }
+        CHECK(value == static_cast<uint64_t>(data[i]));
+    }
+
+    auto file = open_binary_file(path, File::READ, big_endian);
+    file->skip(1);
+    auto read = std::vector<T>(data.size());
+    read_array(*file, read);
+    CHECK(read == data);
+}
+
+TEST_CASE("Large arrays in binary files") {
+    auto filename = NamedTempPath(".data");
+    for (auto big_endian: {true, false}) {
+        check_large_array<uint16_t>(filename.path(), big_endian);
+        check_large_array<uint32_t>(filename.path(), big_endian);
+        check_large_array<uint64_t>(filename.path(), big_endian);
+    }
+}
+
+TEST_CASE("Views and conversions in binary files") {
+    auto filename = NamedTempPath(".data");
+    auto values = std::vector<float>{1.5f, -2.25f, 3.0f, 4.125f, -5.5f, 6.0f, 7.75f};
+    for (auto big_endian: {true, false}) {
+        {
+            auto file = open_binary_file(filename, File::WRITE, big_endian);
+            file->write_char("abc", 3);
+            file->write_f32(values);
+        }
+
+        auto content = read_binary_file(filename);
+        auto file = open_binary_file(filename, File::READ, big_endian);
+
+        auto view = file->read_view(3);
+        CHECK(std::string(view.data(), view.size()) == "abc");
+        CHECK(file->tell() == 3);
+
+        view = file->read_view(4 * values.size());
+        CHECK(std::equal(view.begin(), view.end(), reinterpret_cast<const char*>(content.data()) + 3));
+        CHECK(file->tell() == content.size());
+
+        CHECK_THROWS_AS(file->read_view(1), FileError);
+
+        file->seek(3);
+        auto converted = std::vector<double>(2 * values.size(), 0.0);
+        file->read_f32_as_f64(converted.data() + 1, values.size(), 2);
+        for (size_t i = 0; i < values.size(); i++) {
+            CHECK(converted[2 * i] == 0.0);
+            CHECK(converted[2 * i + 1] == static_cast<double>(values[i]));
+        }
+    }
+}
+
+TEST_CASE("Access pattern hints in binary files") {
+    auto filename = NamedTempPath(".data");
+    {
+        auto file = BigEndianFile(filename, File::WRITE);
+        auto data = std::vector<uint32_t>(4096);
+        for (size_t i = 0; i < data.size(); i++) {
+            data[i] = static_cast<uint32_t>(i);
+        }
+        file.write_u32(data.data(), data.size());
+    }
+
+    auto file = BigEndianFile(filename, File::READ);
+    CHECK(file.access_pattern() == BinaryFile::AccessPattern::SEQUENTIAL);
+
+    file.set_access_pattern(BinaryFile::AccessPattern::RANDOM);
+    CHECK(file.access_pattern() == BinaryFile::AccessPattern::RANDOM);
+
+    // prefetching does not change the position, and is allowed outside of
+    // the file
+    file.prefetch(4000, 1000);
+    file.prefetch(1000000, 1000);
+    CHECK(file.tell() == 0);
+
+    file.seek(4 * 2000);
+    CHECK(file.read_single_u32() == 2000);
+
+    file.set_access_pattern(BinaryFile::AccessPattern::SEQUENTIAL);
+    CHECK(file.read_single_u32() == 2001);
+}
+
+TEST_CASE("Batch reads in binary files") {
+    auto filename = NamedTempPath(".data");
+    auto data = std::vector<uint8_t>(100000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>((i * 7) % 251);
+    }
+    {
+        auto file = LittleEndianFile(filename, File::WRITE);
+        file.write_u8(data);
+    }
+
+    auto file = LittleEndianFile(filename, File::READ);
+    file.seek(42);
+
+    // use more requests than the queue depth, in random order
+    auto requests = std::vector<BatchReader::request>();
+    for (size_t i = 0; i < 100; i++) {
+        auto offset = (i * 7919) % 90000;
+        requests.push_back({offset, 1000 + i});
+    }
+
+    auto seen = std::vector<bool>(requests.size(), false);
+    file.read_batch(requests, [&](size_t i, span<const char> view) {
+        CHECK_FALSE(seen[i]);
+        seen[i] = true;
+
+        REQUIRE(view.size() == requests[i].size);
+        auto offset = static_cast<size_t>(requests[i].offset);
+        for (size_t j = 0; j < view.size(); j++) {
+            if (static_cast<uint8_t>(view[j]) != data[offset + j]) {
+                FAIL("wrong data for request " << i << " at byte " << j);
+            }
+        }
+    });
+    CHECK(std::all_of(seen.begin(), seen.end(), [](bool value) { return value; }));
+    CHECK(file.tell() == 42);
+
+    // errors in the callback are propagated
+    CHECK_THROWS_WITH(
+        file.read_batch(requests, [](size_t, span<const char>) { throw FileError("test error"); }),
+        "test error"
+    );
+
+    // reading outside of the file
+    requests = {{99990, 100}};
+    CHECK_THROWS_AS(file.read_batch(requests, [](size_t, span<const char>) {}), FileError);
+}
+
+TEST_CASE("Binary files in memory") {
+    auto filename = NamedTempPath(".data");
+    {
+        auto file = BigEndianFile(filename, File::Mode::WRITE);
+        write_binary_file(file);
+    }
+    auto expected = read_binary_file(filename);
+
+    auto memory = std::make_shared<MemoryBuffer>(8192);
+    {
+        auto file = BigEndianFile(memory, File::Mode::WRITE);
+        write_binary_file(file);
+        CHECK(file.file_size() == expected.size());
+
+        // overwrite some data in the middle of the file
+        file.seek(2);
+        file.write_char("XY", 2);
+        CHECK(file.tell() == 4);
+        CHECK(file.file_size() == expected.size());
+    }
+    expected[2] = 'X';
+    expected[3] = 'Y';
+    REQUIRE(memory->size() == expected.size());
+    CHECK(std::equal(expected.begin(), expected.end(), reinterpret_cast<const uint8_t*>(memory->data())));
+
+    // reading does not copy the data
+    auto data = reinterpret_cast<const char*>(expected.data());
+    auto file = BigEndianFile(std::make_shared<MemoryBuffer>(data, expected.size()), File::Mode::READ);
+    CHECK(file.file_size() == expected.size());
+    CHECK(file.read_view(4).data() == data);
+    CHECK(file.read_single_i16() == -42);
+    file.skip(2);
+    CHECK(file.read_single_i32() == -573);
+    CHECK(file.tell() == 12);
+
+    file.seek(44);
+    char buffer[3] = {0};
+    file.read_char(buffer, 3);
+    CHECK(std::string(buffer, 3) == "EFG");
+
+    auto requests = std::vector<BatchReader::request>{{44, 3}, {0, 4}};
+    file.read_batch(requests, [&](size_t i, span<const char> view) {
+        CHECK(view.data() == data + requests[i].offset);
+    });
+    CHECK(file.tell() == 47);
+
+    file.seek(expected.size() - 2);
+    CHECK_THROWS_WITH(
+        file.read_single_i32(),
+        "failed to read 4 bytes from the file at '<in memory>': reached end of file"
+    );
+
+    CHECK_THROWS_WITH(
+        file.write_single_i32(3),
+        "can not write to read-only MemoryBuffer"
+    );
+
+    CHECK_THROWS_WITH(
+        BigEndianFile(std::make_shared<MemoryBuffer>(8192), File::Mode::APPEND),
+        "cannot append (mode 'a') to a memory file"
+    );
+}
@@ -1,6 +1,8 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <fstream>
+
 #include "catch.hpp"
 #include "helpers.hpp"
 #include "chemfiles/File.hpp"
@@ -98,6 +100,91 @@ TEST_CASE("Write a bzip2 file") {
     CHECK(file.readline() == "5467");
 }
 
+TEST_CASE("Seek in a large bzip2 file") {
+    auto first = NamedTempPath(".bz2");
+    auto second = NamedTempPath(".bz2");
+
+    // write enough data to get multiple blocks in the file
+    auto positions = std::vector<uint64_t>();
+    uint64_t position = 0;
+    size_t line_number = 0;
+    for (const auto& path: {first.path(), second.path()}) {
+        TextFile file(path, File::WRITE, File::BZIP2);
+        for (size_t i=0; i<150000; i++) {
+            auto line = fmt::format("line {} of the file\n", line_number);
+            if (line_number % 10000 == 0) {
+                positions.push_back(position);
+            }
+            line_number++;
+            file.print("{}", line);
+            position += line.size();
+        }
+    }
+
+    // concatenate the two files to get a file with multiple bzip2 streams
+    auto filename = NamedTempPath(".bz2");
+    {
+        auto content = read_binary_file(first);
+        auto second_content = read_binary_file(second);
+        content.insert(content.end(), second_content.begin(), second_content.end());
+        std::ofstream output(filename, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    }
+
+    TextFile file(filename, File::READ, File::BZIP2);
+    size_t lines = 0;
+    while (!file.eof()) {
+        file.readline();
+        lines++;
+    }
+    CHECK(lines == 300001);
+    CHECK(file.tellpos() == position);
+
+    // seek backward
+    for (size_t i=positions.size(); i>0; i--) {
+        file.seekpos(positions[i - 1]);
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 10000));
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 10000 + 1));
+    }
+
+    // seek forward with a new file
+    auto other = TextFile(filename, File::READ, File::BZIP2);
+    for (size_t i=0; i<positions.size(); i += 7) {
+        other.seekpos(positions[i]);
+        CHECK(other.readline() == fmt::format("line {} of the file", i * 10000));
+    }
+}
+
+TEST_CASE("Block magic number outside of a block") {
+    auto stream = std::vector<uint8_t> {
+        'B', 'Z', 'h', 0x36, 0x31, 0x41, 0x59, 0x26, 0x53, 0x59, 0xde, 0x45, 0xac,
+        0xea, 0x00, 0x00, 0x03, 0x4b, 0x80, 0x00, 0x10, 0x07, 0x80, 0x04, 0x00,
+        0x02, 0x00, 0x0c, 0x00, 0x20, 0x00, 0x31, 0x06, 0x4c, 0x41, 0x01, 0x93,
+        0x0c, 0x8e, 0x07, 0x7d, 0x38, 0x2e, 0xe4, 0x8a, 0x70, 0xa1, 0x21, 0xbc,
+        0x8b, 0x59, 0xd4
+    };
+
+    // two concatenated streams, followed by garbage starting with the block
+    // magic number. Decompressing this "block" fails, and the file is read
+    // with the streaming decoder instead.
+    auto content = stream;
+    content.insert(content.end(), stream.begin(), stream.end());
+    content.insert(content.end(), {0x31, 0x41, 0x59, 0x26, 0x53, 0x59, 0xff, 0x00, 0xff, 0x00, 0xff, 0x00, 0xff});
+
+    auto memory = std::make_shared<MemoryBuffer>(reinterpret_cast<const char*>(content.data()), content.size());
+    auto file = TextFile(std::move(memory), File::READ, File::BZIP2);
+    CHECK(file.readline() == "Test");
+    CHECK(file.readline() == "5467");
+    CHECK(file.readline() == "Test");
+    CHECK(file.readline() == "5467");
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+
+    file.seekpos(12);
+    CHECK(file.readline() == "st");
+    CHECK(file.readline() == "5467");
+}
+
 TEST_CASE("In-memory decompression") {
     auto content = std::vector<uint8_t> {
         'B', 'Z', 'h', 0x36, 0x31, 0x41, 0x59, 0x26, 0x53, 0x59, 0xde, 0x45, 0xac,
@@ -110,6 +197,18 @@ TEST_CASE("In-memory decompression") {
     auto decompressed = decompress_bz2(reinterpret_cast<const char*>(content.data()), content.size());
     CHECK(std::string(decompressed.data(), decompressed.size()) == "Test\n5467\n");
 
+    {
+        auto memory = std::make_shared<MemoryBuffer>(reinterpret_cast<const char*>(content.data()), content.size());
+        auto file = TextFile(std::move(memory), File::READ, File::BZIP2);
+        CHECK(file.readline() == "Test");
+        CHECK(file.readline() == "5467");
+        CHECK(file.readline() == "");
+        CHECK(file.eof());
+
+        file.seekpos(5);
+        CHECK(file.readline() == "5467");
+    }
+
     content[23] = 0x00;
     CHECK_THROWS_WITH(
         decompress_bz2(reinterpret_cast<const char*>(content.data()), content.size()),
@@ -0,0 +1,120 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstdio>
+#include <fstream>
+
+#include "catch.hpp"
+#include "helpers.hpp"
+#include "chemfiles.hpp"
+#include "chemfiles/files/FrameIndex.hpp"
+using namespace chemfiles;
+
+static void write_xyz(const std::string& path, size_t n_frames) {
+    auto file = std::ofstream(path);
+    for (size_t i = 0; i < n_frames; i++) {
+        file << "1\nframe " << i << "\nC 0 0 " << i << "\n";
+    }
+}
+
+TEST_CASE("Frame index files") {
+    auto filename = NamedTempPath(".xyz");
+    auto index_path = FrameIndex::index_path(filename);
+    write_xyz(filename, 3);
+
+    SECTION("Disabled by default") {
+        auto index = FrameIndex(filename, "test");
+        index.save({0, 10, 20});
+        CHECK(index.load() == nullopt);
+        CHECK_FALSE(std::ifstream(index_path).good());
+    }
+
+    set_frame_index(true);
+
+    SECTION("Save and load positions") {
+        FrameIndex(filename, "test").save({0, 10, 20});
+        CHECK(std::ifstream(index_path).good());
+
+        auto positions = FrameIndex(filename, "test").load();
+        REQUIRE(positions);
+        CHECK(*positions == std::vector<uint64_t>{0, 10, 20});
+
+        // index created by another format
+        CHECK(FrameIndex(filename, "other").load() == nullopt);
+
+        // the trajectory changed after creating the index
+        write_xyz(filename, 4);
+        CHECK(FrameIndex(filename, "test").load() == nullopt);
+
+        // the trajectory changed while scanning, nothing is saved
+        auto index = FrameIndex(filename, "test");
+        write_xyz(filename, 5);
+        index.save({0, 10, 20, 30, 40});
+        CHECK(FrameIndex(filename, "test").load() == nullopt);
+
+        // invalid index files are ignored
+        std::ofstream(index_path) << "not an index";
+        CHECK(FrameIndex(filename, "test").load() == nullopt);
+    }
+
+    SECTION("Text formats") {
+        CHECK(Trajectory(filename).size() == 3);
+        REQUIRE(std::ifstream(index_path).good());
+
+        // the index is identified by the format name and compression
+        auto positions = FrameIndex(filename, "XYZ/0").load();
+        REQUIRE(positions);
+        CHECK(positions->size() == 3);
+
+        // the positions are used when opening the file again
+        auto trajectory = Trajectory(filename);
+        CHECK(trajectory.size() == 3);
+        auto frame = trajectory.read_at(2);
+        CHECK(frame.positions()[0][2] == 2.0);
+
+        // partially reading the file does not create the index
+        std::remove(index_path.c_str());
+        Trajectory(filename).read();
+        CHECK_FALSE(std::ifstream(index_path).good());
+
+        // a stale index is ignored and replaced
+        Trajectory(filename).size();
+        write_xyz(filename, 5);
+        CHECK(Trajectory(filename).size() == 5);
+        CHECK(Trajectory(filename).read_at(4).positions()[0][2] == 4.0);
+    }
+
+    SECTION("XTC format") {
+        auto xtc = NamedTempPath(".xtc");
+        auto xtc_index = FrameIndex::index_path(xtc);
+        {
+            auto trajectory = Trajectory(xtc, 'w');
+            auto frame = Frame();
+            for (size_t i = 0; i < 20; i++) {
+                frame.add_atom(Atom("C"), {0.0, 0.0, 0.0});
+            }
+            for (size_t i = 0; i < 4; i++) {
+                frame.positions()[0][2] = static_cast<double>(i);
+                trajectory.write(frame);
+            }
+        }
+
+        CHECK(Trajectory(xtc).size() == 4);
+        auto positions = FrameIndex(xtc, "XTC").load();
+        REQUIRE(positions);
+        CHECK(positions->size() == 4);
+
+        // check that the index is actually used, by removing a frame from it
+        positions->pop_back();
+        FrameIndex(xtc, "XTC").save(*positions);
+
+        auto trajectory = Trajectory(xtc);
+        CHECK(trajectory.size() == 3);
+        CHECK(trajectory.read_at(2).positions()[0][2] == Approx(2.0));
+
+        std::remove(xtc_index.c_str());
+    }
+
+    set_frame_index(false);
+    std::remove(index_path.c_str());
+}
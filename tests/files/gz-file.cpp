@@ -1,11 +1,15 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <cstdio>
+#include <fstream>
+
 #include "catch.hpp"
 #include "helpers.hpp"
 #include "chemfiles/File.hpp"
 #include "chemfiles/files/GzFile.hpp"
 #include "chemfiles/Error.hpp"
+#include "chemfiles/misc.hpp"
 using namespace chemfiles;
 
 static void check_file(TextFile& file) {
@@ -139,6 +143,144 @@ TEST_CASE("Append to a gz file") {
     CHECK(file.eof());
 }
 
+TEST_CASE("Write a large gz file") {
+    auto filename = NamedTempPath(".gz");
+
+    // write enough data to get multiple members in the file
+    {
+        auto file = TextFile(filename, File::WRITE, File::GZIP);
+        for (size_t i=0; i<400000; i++) {
+            file.print("line {} of the file\n", i);
+        }
+        file.close();
+    }
+
+    auto file = TextFile(filename, File::READ, File::GZIP);
+    size_t lines = 0;
+    while (!file.eof()) {
+        auto line = file.readline();
+        if (lines < 400000) {
+            CHECK(line == fmt::format("line {} of the file", lines));
+        }
+        lines++;
+    }
+    CHECK(lines == 400001);
+
+#ifdef __linux__
+    // errors while writing the last members are reported by close
+    auto full = TextFile("/dev/full", File::WRITE, File::GZIP);
+    for (size_t i=0; i<1000; i++) {
+        full.print("line {} of the file\n", i);
+    }
+    CHECK_THROWS_AS(full.close(), FileError);
+#endif
+}
+
+TEST_CASE("Seek in a large gz file") {
+    auto filename = NamedTempPath(".gz");
+
+    // write enough data to create multiple checkpoints in the file
+    auto positions = std::vector<uint64_t>();
+    {
+        TextFile file(filename, File::WRITE, File::GZIP);
+        for (size_t i=0; i<1000000; i++) {
+            if (i % 50000 == 0) {
+                positions.push_back(file.tellpos());
+            }
+            file.print("line {} of the file\n", i);
+        }
+    }
+
+    TextFile file(filename, File::READ, File::GZIP);
+    // read the whole file once
+    size_t lines = 0;
+    while (!file.eof()) {
+        file.readline();
+        lines++;
+    }
+    // the last readline returns an empty string
+    CHECK(lines == 1000001);
+
+    // seek backward
+    for (size_t i=positions.size(); i>0; i--) {
+        file.seekpos(positions[i - 1]);
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 50000));
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 50000 + 1));
+    }
+
+    // seek forward
+    for (size_t i=0; i<positions.size(); i++) {
+        file.seekpos(positions[i]);
+        CHECK(file.readline() == fmt::format("line {} of the file", i * 50000));
+    }
+}
+
+TEST_CASE("Save checkpoints of a gz file") {
+    auto filename = NamedTempPath(".gz");
+    auto checkpoints_path = GzFile::checkpoints_path(filename);
+
+    auto positions = std::vector<uint64_t>();
+    {
+        TextFile file(filename, File::WRITE, File::GZIP);
+        for (size_t i=0; i<1000000; i++) {
+            if (i % 50000 == 0) {
+                positions.push_back(file.tellpos());
+            }
+            file.print("line {} of the file\n", i);
+        }
+    }
+
+    auto check_seek = [&](TextFile& file) {
+        for (size_t i=positions.size(); i>0; i--) {
+            file.seekpos(positions[i - 1]);
+            CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 50000));
+        }
+    };
+
+    {
+        // nothing is saved by default
+        TextFile file(filename, File::READ, File::GZIP);
+        check_seek(file);
+        CHECK_FALSE(std::ifstream(checkpoints_path).good());
+    }
+
+    set_frame_index(true);
+
+    {
+        // reading only part of the file does not save the checkpoints
+        TextFile file(filename, File::READ, File::GZIP);
+        file.seekpos(positions[3]);
+        CHECK(file.readline() == "line 150000 of the file");
+        CHECK_FALSE(std::ifstream(checkpoints_path).good());
+    }
+
+    {
+        // the checkpoints are saved after reading the whole file
+        TextFile file(filename, File::READ, File::GZIP);
+        while (!file.eof()) {
+            file.readline();
+        }
+        CHECK(std::ifstream(checkpoints_path).good());
+        check_seek(file);
+    }
+
+    {
+        // and used when opening the file again
+        TextFile file(filename, File::READ, File::GZIP);
+        check_seek(file);
+    }
+
+    {
+        // invalid checkpoints files are ignored
+        std::ofstream(checkpoints_path) << "not an index";
+        TextFile file(filename, File::READ, File::GZIP);
+        check_seek(file);
+    }
+
+    set_frame_index(false);
+    std::remove(checkpoints_path.c_str());
+}
+
 TEST_CASE("In-memory decompression") {
     auto content = std::vector<uint8_t>{
         0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x0b, 0x49,
@@ -149,6 +291,18 @@ TEST_CASE("In-memory decompression") {
     auto decompressed = decompress_gz(reinterpret_cast<const char*>(content.data()), content.size());
     CHECK(std::string(decompressed.data(), decompressed.size()) == "Test\n5467\n");
 
+    {
+        auto memory = std::make_shared<MemoryBuffer>(reinterpret_cast<const char*>(content.data()), content.size());
+        auto file = TextFile(std::move(memory), File::READ, File::GZIP);
+        CHECK(file.readline() == "Test");
+        CHECK(file.readline() == "5467");
+        CHECK(file.readline() == "");
+        CHECK(file.eof());
+
+        file.seekpos(5);
+        CHECK(file.readline() == "5467");
+    }
+
     content[23] = 0x00;
     CHECK_THROWS_WITH(
         decompress_gz(reinterpret_cast<const char*>(content.data()), content.size()),
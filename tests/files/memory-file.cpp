@@ -74,6 +74,13 @@ TEST_CASE("Reading from files in memory") {
             "cannot write to a memory file unless it is opened in write mode"
         );
 
+        // Lines point directly inside the memory buffer
+        file.rewind();
+        auto line = file.readline();
+        CHECK(line.data() == TEST_DATA.data());
+        line = file.readline();
+        CHECK(line.data() == TEST_DATA.data() + 8);
+
         // Note that a large file is tested with the text-based formats!
         // This way, we can be sure the file works with buffers greater than
         // 8192 in size
@@ -0,0 +1,151 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <fstream>
+#include "catch.hpp"
+#include "helpers.hpp"
+#include "chemfiles/files/MmapFile.hpp"
+#include "chemfiles/Error.hpp"
+using namespace chemfiles;
+
+#if CHEMFILES_TEXT_FILE_USE_MMAP
+
+TEST_CASE("Read a memory mapped file") {
+    SECTION("Basic reading functionalities") {
+        auto file = TextFile("data/xyz/helium.xyz", File::READ, File::DEFAULT);
+        CHECK_FALSE(file.eof());
+
+        CHECK(file.readline() == "125");
+        // skip a line
+        file.readline();
+        CHECK(file.readline() == "He 0.49053 8.41351 0.0777257");
+
+        file.seekpos(0);
+        auto content = file.readall();
+        CHECK(content.size() == 1521940);
+        CHECK(content == read_text_file("data/xyz/helium.xyz"));
+    }
+
+    SECTION("Constructor errors") {
+        CHECK_THROWS_WITH(
+            MmapFile("not existing"),
+            "could not open the file at 'not existing'"
+        );
+
+        CHECK_FALSE(MmapFile::can_map("not existing"));
+        CHECK_FALSE(MmapFile::can_map("data"));
+        CHECK(MmapFile::can_map("data/xyz/helium.xyz"));
+    }
+
+    SECTION("Raw reading") {
+        auto file = MmapFile("data/xyz/helium.xyz");
+        REQUIRE(file.data());
+        CHECK(file.data()->size() == 1521940);
+
+        char buffer[4] = {0};
+        CHECK(file.read(buffer, 3) == 3);
+        CHECK(std::string(buffer) == "125");
+
+        file.seek(1521938);
+        CHECK(file.read(buffer, 3) == 2);
+        file.seek(1521940 + 10);
+        CHECK(file.read(buffer, 3) == 0);
+
+        CHECK_THROWS_WITH(
+            file.write("JUNK", 4),
+            "cannot write to the file at 'data/xyz/helium.xyz', it is opened in read mode"
+        );
+    }
+}
+
+TEST_CASE("Lines and positions in memory mapped files") {
+    auto tmpfile = NamedTempPath(".dat");
+
+    std::ofstream stream(tmpfile, std::ios_base::binary);
+    stream << "line one\nline two\r\n\n\r\nlast line\n";
+    stream.close();
+
+    auto file = TextFile(tmpfile, File::READ, File::DEFAULT);
+    CHECK(file.tellpos() == 0);
+    CHECK(file.readline() == "line one");
+    CHECK(file.tellpos() == 9);
+    CHECK(file.readline() == "line two");
+    CHECK(file.readline() == "");
+    CHECK(file.readline() == "");
+    CHECK(file.readline() == "last line");
+    CHECK_FALSE(file.eof());
+    CHECK(file.tellpos() == 32);
+
+    // Need to go past the end to get eof
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+
+    file.seekpos(14);
+    CHECK_FALSE(file.eof());
+    CHECK(file.readline() == "two");
+
+    // Seeking past the end of the file
+    file.seekpos(100);
+    CHECK(file.tellpos() == 32);
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+
+    file.rewind();
+    CHECK_FALSE(file.eof());
+    CHECK(file.readline() == "line one");
+
+    // last line without end of line
+    stream.open(tmpfile, std::ios_base::binary);
+    stream << "first\nno eol";
+    stream.close();
+
+    file = TextFile(tmpfile, File::READ, File::DEFAULT);
+    CHECK(file.readline() == "first");
+    CHECK(file.readline() == "no eol");
+    CHECK(file.eof());
+    CHECK(file.tellpos() == 12);
+
+    // empty files
+    stream.open(tmpfile, std::ios_base::binary);
+    stream.close();
+
+    file = TextFile(tmpfile, File::READ, File::DEFAULT);
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+    CHECK(file.tellpos() == 0);
+}
+
+TEST_CASE("Growing memory mapped files") {
+    auto tmpfile = NamedTempPath(".dat");
+
+    std::ofstream stream(tmpfile, std::ios_base::binary);
+    stream << "line one\nline";
+    stream.flush();
+
+    auto file = TextFile(tmpfile, File::READ, File::DEFAULT);
+    CHECK(file.readline() == "line one");
+
+    // the file grows after being mapped, the new data is read from the
+    // file, including the end of the last line
+    stream << " two\nline three\n";
+    stream.flush();
+
+    CHECK(file.readline() == "line two");
+    CHECK(file.readline() == "line three");
+    CHECK(file.readline() == "");
+    CHECK(file.eof());
+
+    stream << "line four\n";
+    stream.close();
+
+    file.clear();
+    CHECK(file.readline() == "line four");
+
+    file.rewind();
+    CHECK(file.readline() == "line one");
+    CHECK(file.readline() == "line two");
+}
+
+#endif
@@ -225,6 +225,91 @@ TEST_CASE("Write NetCDF files") {
         CHECK(double_data == std::vector<double>(42 * 42, netcdf3::constants::NC_FILL_DOUBLE));
     }
 
+    SECTION("read multiple records") {
+        auto tmpfile = NamedTempPath(".nc");
+        {
+            netcdf3::Netcdf3File file(tmpfile, File::WRITE);
+            file_builder().initialize(&file);
+            file.variable("B").value().write(0, std::vector<double>(42 * 42, 37.4));
+
+            for (size_t step = 0; step < 5; step++) {
+                file.add_record();
+                file.variable("A").value().write(step, std::vector<float>(42, static_cast<float>(step)));
+            }
+        }
+
+        netcdf3::Netcdf3File file(tmpfile, File::READ);
+        auto A = file.variable("A").value();
+
+        auto float_data = std::vector<float>();
+        A.read(1, 4, 1, float_data);
+        REQUIRE(float_data.size() == 3 * 42);
+        CHECK(float_data[0] == 1.0f);
+        CHECK(float_data[41] == 1.0f);
+        CHECK(float_data[42] == 2.0f);
+        CHECK(float_data[3 * 42 - 1] == 3.0f);
+
+        A.read(0, 5, 2, float_data);
+        REQUIRE(float_data.size() == 3 * 42);
+        CHECK(float_data[0] == 0.0f);
+        CHECK(float_data[42] == 2.0f);
+        CHECK(float_data[2 * 42] == 4.0f);
+        CHECK(float_data[3 * 42 - 1] == 4.0f);
+
+        CHECK_THROWS_WITH(A.read(0, 6, 1, float_data),
+            "out of bounds: trying to read variable up to step 5, but there are only 5 steps in this file"
+        );
+
+        auto B = file.variable("B").value();
+        auto double_data = std::vector<double>();
+        B.read(0, 1, 1, double_data);
+        CHECK(double_data == std::vector<double>(42 * 42, 37.4));
+        CHECK_THROWS_WITH(B.read(0, 2, 1, double_data),
+            "can not read non-record variable at an other step than 0"
+        );
+    }
+
+    SECTION("read multiple record variables") {
+        auto tmpfile = NamedTempPath(".nc");
+        {
+            netcdf3::Netcdf3Builder builder;
+            auto infinite = builder.add_dimension("infinite", 0);
+            auto spatial = builder.add_dimension("spatial", 3);
+            builder.add_variable("time", netcdf3::VariableDefinition {
+                netcdf3::constants::NC_DOUBLE, {infinite}, {}
+            });
+            builder.add_variable("positions", netcdf3::VariableDefinition {
+                netcdf3::constants::NC_FLOAT, {infinite, spatial}, {}
+            });
+
+            netcdf3::Netcdf3File file(tmpfile, File::WRITE);
+            std::move(builder).initialize(&file);
+            for (size_t step = 0; step < 6; step++) {
+                file.add_record();
+                auto value = static_cast<float>(step);
+                file.variable("time").value().write(step, std::vector<double>{2.0 * value});
+                file.variable("positions").value().write(step, std::vector<float>{value, value, -value});
+            }
+        }
+
+        netcdf3::Netcdf3File file(tmpfile, File::READ);
+        auto time = file.variable("time").value();
+        auto positions = file.variable("positions").value();
+
+        auto double_data = std::vector<double>();
+        auto float_data = std::vector<float>();
+        // both variables are read from the same records
+        time.read(1, 6, 2, double_data);
+        positions.read(1, 6, 2, float_data);
+        CHECK(double_data == std::vector<double>{2.0, 6.0, 10.0});
+        CHECK(float_data == std::vector<float>{1, 1, -1, 3, 3, -3, 5, 5, -5});
+
+        positions.read(0, 2, 1, float_data);
+        CHECK(float_data == std::vector<float>{0, 0, 0, 1, 1, -1});
+        time.read(4, 6, 1, double_data);
+        CHECK(double_data == std::vector<double>{8.0, 10.0});
+    }
+
     SECTION("append to existing file") {
         auto tmpfile = NamedTempPath(".nc");
         {
@@ -0,0 +1,153 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <fstream>
+#include <algorithm>
+
+#include "catch.hpp"
+#include "helpers.hpp"
+#include "chemfiles/files/GzFile.hpp"
+#include "chemfiles/files/PlainFile.hpp"
+#include "chemfiles/files/PipelinedFile.hpp"
+#include "chemfiles/Error.hpp"
+using namespace chemfiles;
+
+TEST_CASE("Pipelined file") {
+    auto filename = NamedTempPath(".txt");
+
+    auto content = std::string();
+    for (size_t i=0; i<100000; i++) {
+        content += fmt::format("line {} of the file\n", i);
+    }
+
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << content;
+    }
+
+    auto file = PipelinedFile(filename, std::make_unique<PlainFile>(filename, File::READ));
+
+    SECTION("Read") {
+        auto buffer = std::string(content.size() + 100, '\0');
+        size_t position = 0;
+        while (true) {
+            auto count = file.read(&buffer[position], 10000);
+            position += count;
+            if (count < 10000) {
+                break;
+            }
+        }
+
+        CHECK(position == content.size());
+        buffer.resize(position);
+        CHECK(buffer == content);
+
+        // reading past the end of file
+        CHECK(file.read(&buffer[0], 100) == 0);
+    }
+
+    SECTION("Seek") {
+        auto buffer = std::string(50, '\0');
+        for (auto position: {1234567, 42, 0, 2000000, 600000}) {
+            file.seek(static_cast<uint64_t>(position));
+            CHECK(file.read(&buffer[0], 50) == 50);
+            CHECK(buffer == content.substr(static_cast<size_t>(position), 50));
+        }
+
+        file.seek(content.size() - 10);
+        CHECK(file.read(&buffer[0], 50) == 10);
+        CHECK(buffer.substr(0, 10) == content.substr(content.size() - 10));
+    }
+
+    SECTION("Errors") {
+        CHECK_THROWS_WITH(
+            file.write("test", 4),
+            "cannot write to the file at '" + filename.path() + "', it is opened in read mode"
+        );
+    }
+}
+
+/// TextFileImpl returning at most 1000 bytes for each call to `read`
+class PartialReadFile final: public TextFileImpl {
+public:
+    PartialReadFile(const std::string& path): TextFileImpl(path), file_(path, File::READ) {}
+
+    size_t read(char* data, size_t count) override {
+        return file_.read(data, std::min<size_t>(count, 1000));
+    }
+
+    void write(const char* data, size_t count) override {
+        file_.write(data, count);
+    }
+
+    void clear() noexcept override {
+        file_.clear();
+    }
+
+    void seek(uint64_t position) override {
+        file_.seek(position);
+    }
+
+private:
+    PlainFile file_;
+};
+
+TEST_CASE("Pipelined file with partial reads") {
+    auto filename = NamedTempPath(".txt");
+
+    auto content = std::string();
+    for (size_t i=0; i<10000; i++) {
+        content += fmt::format("line {} of the file\n", i);
+    }
+
+    {
+        std::ofstream file(filename, std::ios::binary);
+        file << content;
+    }
+
+    auto file = PipelinedFile(filename, std::make_unique<PartialReadFile>(filename));
+    auto buffer = std::string(content.size() + 100, '\0');
+    size_t position = 0;
+    while (true) {
+        auto count = file.read(&buffer[position], 10000);
+        position += count;
+        if (count == 0) {
+            break;
+        }
+    }
+
+    CHECK(position == content.size());
+    buffer.resize(position);
+    CHECK(buffer == content);
+}
+
+TEST_CASE("Pipelined compressed file") {
+    auto filename = NamedTempPath(".gz");
+    {
+        auto file = TextFile(filename, File::WRITE, File::GZIP);
+        for (size_t i=0; i<100000; i++) {
+            file.print("line {:06} of the file\n", i);
+        }
+    }
+
+    auto file = PipelinedFile(filename, std::make_unique<GzFile>(filename, File::READ));
+    auto buffer = std::string(23, '\0');
+    file.seek(24 * 12345);
+    CHECK(file.read(&buffer[0], 23) == 23);
+    CHECK(buffer == "line 012345 of the file");
+
+    // corrupted files report errors when reading
+    auto corrupted = NamedTempPath(".gz");
+    {
+        auto data = read_binary_file(filename);
+        data[data.size() / 2] ^= 0xff;
+        data[data.size() / 2 + 1] ^= 0xff;
+        data[data.size() / 2 + 2] ^= 0xff;
+        std::ofstream output(corrupted, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    auto corrupted_file = PipelinedFile(corrupted, std::make_unique<GzFile>(corrupted, File::READ));
+    auto large = std::string(3000000, '\0');
+    CHECK_THROWS_AS(corrupted_file.read(&large[0], large.size()), FileError);
+}
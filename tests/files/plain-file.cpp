@@ -175,3 +175,49 @@ TEST_CASE("Write a text file") {
     std::getline(verification, line);
     CHECK(line == "5467");
 }
+
+/// TextFileImpl recording all calls to `write`
+class RecordingFile final: public TextFileImpl {
+public:
+    RecordingFile(std::vector<std::string>& writes): TextFileImpl("<recording>"), writes_(writes) {}
+
+    size_t read(char*, size_t) override { return 0; }
+    void write(const char* data, size_t count) override {
+        writes_.emplace_back(data, count);
+    }
+    void clear() noexcept override {}
+    void seek(uint64_t) override {}
+
+private:
+    std::vector<std::string>& writes_;
+};
+
+TEST_CASE("Buffered writes in text files") {
+    auto writes = std::vector<std::string>();
+    {
+        auto file = TextFile(std::make_unique<RecordingFile>(writes), File::WRITE);
+
+        file.print("{} {}\n", "first", 1);
+        CHECK(file.tellpos() == 8);
+        // the data is still in the buffer
+        CHECK(writes.empty());
+
+        file.flush();
+        REQUIRE(writes.size() == 1);
+        CHECK(writes[0] == "first 1\n");
+
+        // large amounts of data are written in large blocks without calling
+        // flush
+        for (size_t i = 0; i < 20000; i++) {
+            file.print("line {}\n", i);
+        }
+        CHECK(writes.size() > 1);
+        CHECK(writes.size() < 10);
+        CHECK(writes[1].size() >= 64 * 1024);
+
+        file.print("last line\n");
+    }
+
+    // remaining data is written when the file is destroyed
+    CHECK(writes.back().substr(writes.back().size() - 21) == "line 19999\nlast line\n");
+}
@@ -0,0 +1,105 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <cstring>
+#include <algorithm>
+
+#include "catch.hpp"
+#include "helpers.hpp"
+#include "chemfiles.hpp"
+#include "chemfiles/files/StreamFile.hpp"
+using namespace chemfiles;
+
+const auto TEST_DATA = std::string(
+R"(This is
+a test
+for the stream file
+
+class!)");
+
+// simulate a pipe, returning at most `chunk` bytes at a time
+static StreamFile::read_callback_t pipe_reader(const std::string& data, size_t chunk) {
+    auto position = std::make_shared<size_t>(0);
+    return [data, chunk, position](char* buffer, size_t count) {
+        auto size = std::min({count, chunk, data.size() - *position});
+        std::memcpy(buffer, data.data() + *position, size);
+        *position += size;
+        return size;
+    };
+}
+
+TEST_CASE("Reading from streams") {
+    SECTION("Lines") {
+        for (auto chunk: {1, 3, 10000}) {
+            auto file = TextFile(std::make_unique<StreamFile>(pipe_reader(TEST_DATA, static_cast<size_t>(chunk))), File::READ);
+
+            CHECK(file.readline() == "This is");
+            CHECK(file.tellpos() == 8);
+            CHECK(file.readline() == "a test");
+            CHECK(file.readline() == "for the stream file");
+
+            // seeking back to the start of the last line is possible
+            auto position = file.tellpos();
+            CHECK(file.readline() == "");
+            file.seekpos(position);
+            CHECK(file.readline() == "");
+
+            CHECK(file.readline() == "class!");
+            CHECK(file.eof());
+        }
+    }
+
+    SECTION("Seeking") {
+        auto file = TextFile(std::make_unique<StreamFile>(pipe_reader(TEST_DATA, 3)), File::READ);
+        file.readline();
+        file.readline();
+        CHECK_THROWS_WITH(file.seekpos(0), "can not seek to position 0 in a stream (current position is 15)");
+    }
+
+    SECTION("Frames") {
+        auto data = std::string("1\nfirst\nHe 0 0 0\n\n2\nsecond\nZn 0 0 0\nZn 1 1 1\n\n\n");
+        auto trajectory = Trajectory::stream_reader(pipe_reader(data, 5), "XYZ");
+
+        CHECK_FALSE(trajectory.done());
+        auto frame = trajectory.read();
+        CHECK(frame.size() == 1);
+        CHECK(frame[0].name() == "He");
+
+        CHECK_FALSE(trajectory.done());
+        frame = trajectory.read();
+        CHECK(frame.size() == 2);
+        CHECK(frame[0].name() == "Zn");
+        CHECK(frame.positions()[1] == Vector3D(1, 1, 1));
+
+        CHECK(trajectory.done());
+        CHECK(trajectory.size() == 2);
+        CHECK_THROWS_WITH(trajectory.read(),
+            "can not read file '<stream>' at index 2: there are 2 frames in this file"
+        );
+        CHECK_THROWS_WITH(trajectory.read_at(0),
+            "can not read frame 0 from a stream, only the next frame (2) is available"
+        );
+
+        CHECK_THROWS_WITH(
+            Trajectory::stream_reader(pipe_reader(data, 5), "XYZ / GZ"),
+            "compression is not supported with streams"
+        );
+    }
+}
+
+TEST_CASE("Writing to streams") {
+    auto output = std::string();
+    auto trajectory = Trajectory::stream_writer([&](const char* data, size_t count) {
+        output.append(data, count);
+    }, "XYZ");
+
+    auto frame = Frame();
+    frame.add_atom(Atom("Zn"), {1, 2, 3});
+    trajectory.write(frame);
+    // the data is sent to the stream directly
+    auto expected = std::string("1\nProperties=species:S:1:pos:R:3\nZn 1 2 3\n");
+    CHECK(output == expected);
+
+    trajectory.write(frame);
+    CHECK(output == expected + expected);
+}
@@ -1,6 +1,10 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <fstream>
+
+#include <lzma.h>
+
 #include "catch.hpp"
 #include "helpers.hpp"
 #include "chemfiles/files/XzFile.hpp"
@@ -65,6 +69,80 @@ TEST_CASE("Read a text file") {
     }
 }
 
+// Write a xz file containing one block for every 10000 lines
+static std::vector<uint64_t> write_multi_block_file(const std::string& path) {
+    auto positions = std::vector<uint64_t>();
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+    REQUIRE(lzma_easy_encoder(&stream, 1, LZMA_CHECK_CRC64) == LZMA_OK);
+
+    auto output = std::vector<uint8_t>(1024 * 1024);
+    auto file = std::ofstream(path, std::ios::binary);
+
+    auto compress = [&](const std::string& data, lzma_action action) {
+        stream.next_in = reinterpret_cast<const uint8_t*>(data.data());
+        stream.avail_in = data.size();
+        lzma_ret status = LZMA_OK;
+        do {
+            stream.next_out = output.data();
+            stream.avail_out = output.size();
+            status = lzma_code(&stream, action);
+            REQUIRE((status == LZMA_OK || status == LZMA_STREAM_END));
+            file.write(reinterpret_cast<const char*>(output.data()), static_cast<std::streamsize>(output.size() - stream.avail_out));
+        } while (stream.avail_in != 0 || stream.avail_out == 0);
+        return status;
+    };
+
+    uint64_t position = 0;
+    for (size_t block = 0; block < 10; block++) {
+        auto data = std::string();
+        for (size_t i = 0; i < 10000; i++) {
+            auto line = fmt::format("line {} of the file\n", block * 10000 + i);
+            if (i % 1000 == 0) {
+                positions.push_back(position);
+            }
+            position += line.size();
+            data += line;
+        }
+        // LZMA_FULL_FLUSH finishes the current block
+        compress(data, LZMA_FULL_FLUSH);
+    }
+
+    while (compress("", LZMA_FINISH) != LZMA_STREAM_END) {}
+    lzma_end(&stream);
+
+    return positions;
+}
+
+TEST_CASE("Read a multi-block xz file") {
+    auto filename = NamedTempPath(".xz");
+    auto positions = write_multi_block_file(filename);
+
+    auto file = TextFile(filename, File::READ, File::LZMA);
+    size_t lines = 0;
+    while (!file.eof()) {
+        auto line = file.readline();
+        if (!file.eof()) {
+            CHECK(line == fmt::format("line {} of the file", lines));
+        }
+        lines++;
+    }
+    CHECK(lines == 100001);
+
+    // seek backward
+    for (size_t i=positions.size(); i>0; i--) {
+        file.seekpos(positions[i - 1]);
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 1000));
+    }
+
+    // seek forward
+    for (size_t i=0; i<positions.size(); i += 3) {
+        file.seekpos(positions[i]);
+        CHECK(file.readline() == fmt::format("line {} of the file", i * 1000));
+        CHECK(file.readline() == fmt::format("line {} of the file", i * 1000 + 1));
+    }
+}
+
 TEST_CASE("Write an xz file") {
     auto filename = NamedTempPath(".xz");
 
@@ -87,6 +165,34 @@ TEST_CASE("Write an xz file") {
     CHECK(content == expected);
 }
 
+TEST_CASE("Write a large xz file") {
+    auto filename = NamedTempPath(".xz");
+
+    // write enough data to get multiple blocks in the file
+    {
+        auto file = TextFile(filename, File::WRITE, File::LZMA);
+        for (size_t i=0; i<400000; i++) {
+            file.print("line {} of the file\n", i);
+        }
+    }
+
+    auto file = TextFile(filename, File::READ, File::LZMA);
+    size_t lines = 0;
+    while (!file.eof()) {
+        auto line = file.readline();
+        if (lines % 1000 == 0 && lines < 400000) {
+            CHECK(line == fmt::format("line {} of the file", lines));
+        }
+        lines++;
+    }
+    CHECK(lines == 400001);
+
+    // the file can also be read with a standard stream decoder
+    auto content = read_binary_file(filename);
+    auto decompressed = decompress_xz(reinterpret_cast<const char*>(content.data()), content.size());
+    CHECK(decompressed.size() == file.tellpos());
+}
+
 TEST_CASE("In-memory decompression") {
     auto content = std::vector<uint8_t> {
         0xfd, 0x37, 0x7a, 0x58, 0x5a, 0x00, 0x00, 0x04, 0xe6, 0xd6, 0xb4, 0x46,
@@ -100,6 +206,18 @@ TEST_CASE("In-memory decompression") {
     auto decompressed = decompress_xz(reinterpret_cast<const char*>(content.data()), content.size());
     CHECK(std::string(decompressed.data(), decompressed.size()) == "Test\n5467\n");
 
+    {
+        auto memory = std::make_shared<MemoryBuffer>(reinterpret_cast<const char*>(content.data()), content.size());
+        auto file = TextFile(std::move(memory), File::READ, File::LZMA);
+        CHECK(file.readline() == "Test");
+        CHECK(file.readline() == "5467");
+        CHECK(file.readline() == "");
+        CHECK(file.eof());
+
+        file.seekpos(5);
+        CHECK(file.readline() == "5467");
+    }
+
     content[23] = 0x00;
     CHECK_THROWS_WITH(
         decompress_xz(reinterpret_cast<const char*>(content.data()), content.size()),
@@ -0,0 +1,157 @@
+// Chemfiles, a modern library for chemistry file reading and writing
+// Copyright (C) Guillaume Fraux and contributors -- BSD license
+
+#include <fstream>
+
+#include <zstd.h>
+
+#include "catch.hpp"
+#include "helpers.hpp"
+#include "chemfiles/files/ZstdFile.hpp"
+#include "chemfiles/Error.hpp"
+using namespace chemfiles;
+
+static void check_lines(TextFile& file, size_t n_lines) {
+    size_t lines = 0;
+    while (!file.eof()) {
+        auto line = file.readline();
+        if (lines < n_lines) {
+            CHECK(line == fmt::format("line {} of the file", lines));
+        }
+        lines++;
+    }
+    CHECK(lines == n_lines + 1);
+}
+
+TEST_CASE("Write and read a zstd file") {
+    auto filename = NamedTempPath(".zst");
+
+    // write enough data to get multiple frames in the file
+    auto positions = std::vector<uint64_t>();
+    {
+        auto file = TextFile(filename, File::WRITE, File::ZSTD);
+        for (size_t i=0; i<400000; i++) {
+            if (i % 1000 == 0) {
+                positions.push_back(file.tellpos());
+            }
+            file.print("line {} of the file\n", i);
+        }
+    }
+
+    auto file = TextFile(filename, File::READ, File::ZSTD);
+    check_lines(file, 400000);
+
+    // seek backward
+    for (size_t i=positions.size(); i>0; i--) {
+        file.seekpos(positions[i - 1]);
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 1000));
+    }
+
+    // seek forward
+    for (size_t i=0; i<positions.size(); i += 13) {
+        file.seekpos(positions[i]);
+        CHECK(file.readline() == fmt::format("line {} of the file", i * 1000));
+        CHECK(file.readline() == fmt::format("line {} of the file", i * 1000 + 1));
+    }
+
+    // the file can also be read with a standard stream decoder
+    auto content = read_binary_file(filename);
+    auto decompressed = decompress_zstd(reinterpret_cast<const char*>(content.data()), content.size());
+    file.seekpos(0);
+    while (!file.eof()) {
+        file.readline();
+    }
+    CHECK(decompressed.size() == file.tellpos());
+}
+
+TEST_CASE("Read a zstd file without seek table") {
+    auto filename = NamedTempPath(".zst");
+
+    auto positions = std::vector<uint64_t>();
+    auto data = std::string();
+    for (size_t i=0; i<10000; i++) {
+        if (i % 1000 == 0) {
+            positions.push_back(data.size());
+        }
+        data += fmt::format("line {} of the file\n", i);
+    }
+
+    {
+        auto compressed = std::vector<char>(ZSTD_compressBound(data.size()));
+        auto size = ZSTD_compress(compressed.data(), compressed.size(), data.data(), data.size(), 3);
+        REQUIRE(!ZSTD_isError(size));
+
+        auto output = std::ofstream(filename, std::ios::binary);
+        output.write(compressed.data(), static_cast<std::streamsize>(size));
+    }
+
+    auto file = TextFile(filename, File::READ, File::ZSTD);
+    check_lines(file, 10000);
+
+    for (size_t i=positions.size(); i>0; i--) {
+        file.seekpos(positions[i - 1]);
+        CHECK(file.readline() == fmt::format("line {} of the file", (i - 1) * 1000));
+    }
+
+    auto content = read_binary_file(filename);
+    content.resize(content.size() / 2);
+    {
+        auto output = std::ofstream(filename, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    }
+
+    CHECK_THROWS_WITH(
+        ZstdFile(filename, File::READ).read(std::vector<char>(data.size()).data(), data.size()),
+        "zstd: compressed file is truncated"
+    );
+}
+
+TEST_CASE("Zstd file errors") {
+    CHECK_THROWS_WITH(
+        ZstdFile("not existing", File::READ),
+        "could not open the file at 'not existing'"
+    );
+
+    auto filename = NamedTempPath(".zst");
+    {
+        auto file = TextFile(filename, File::WRITE, File::ZSTD);
+        file.print("Test\n");
+    }
+
+    CHECK_THROWS_WITH(
+        ZstdFile(filename, File::APPEND),
+        "appending (open mode 'a') is not supported with zstd files"
+    );
+}
+
+TEST_CASE("In-memory zstd decompression") {
+    auto filename = NamedTempPath(".zst");
+    {
+        auto file = TextFile(filename, File::WRITE, File::ZSTD);
+        file.print("Test\n");
+        file.print("{}\n", 5467);
+        CHECK(file.tellpos() == 10);
+    }
+    auto content = read_binary_file(filename);
+
+    auto decompressed = decompress_zstd(reinterpret_cast<const char*>(content.data()), content.size());
+    CHECK(std::string(decompressed.data(), decompressed.size()) == "Test\n5467\n");
+
+    {
+        auto memory = std::make_shared<MemoryBuffer>(reinterpret_cast<const char*>(content.data()), content.size());
+        auto file = TextFile(std::move(memory), File::READ, File::ZSTD);
+        CHECK(file.readline() == "Test");
+        CHECK(file.readline() == "5467");
+        CHECK(file.readline() == "");
+        CHECK(file.eof());
+
+        file.seekpos(5);
+        CHECK(file.readline() == "5467");
+    }
+
+    content[0] = 0x00;
+    CHECK_THROWS_WITH(
+        decompress_zstd(reinterpret_cast<const char*>(content.data()), content.size()),
+        "zstd: Unknown frame descriptor"
+    );
+}
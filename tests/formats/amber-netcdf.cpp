@@ -169,3 +169,65 @@ TEST_CASE("Write files in NetCDF format") {
         check_frame(file.read());
     }
 }
+
+TEST_CASE("Read a batch of frames in NetCDF format") {
+    auto tmpfile = NamedTempPath(".nc");
+    {
+        auto file = Trajectory(tmpfile, 'w');
+        for (size_t step = 0; step < 10; step++) {
+            auto value = static_cast<double>(step);
+            auto frame = Frame(UnitCell({10 + value, 10, 10}, {90, 90, 90}));
+            frame.set("time", value);
+            frame.add_velocities();
+            for (size_t i = 0; i < 4; i++) {
+                frame.add_atom(Atom("X"), {value, static_cast<double>(i), 0}, {0, 0, -value});
+            }
+            file.write(frame);
+        }
+    }
+
+    auto file = Trajectory(tmpfile);
+    auto indices = std::vector<size_t>{8, 0, 2, 4, 6, 3, 3, 9};
+    auto read = std::vector<size_t>();
+    file.read_batch(indices, [&](Frame frame) {
+        auto value = static_cast<double>(frame.index());
+        read.push_back(frame.index());
+
+        CHECK(approx_eq(frame.get("time")->as_double(), value));
+        CHECK(approx_eq(frame.cell().lengths(), {10 + value, 10, 10}, 1e-6));
+        CHECK(approx_eq(frame.positions()[2], {value, 2, 0}, 1e-6));
+        CHECK(approx_eq((*frame.velocities())[3], {0, 0, -value}, 1e-6));
+    });
+
+    std::sort(read.begin(), read.end());
+    std::sort(indices.begin(), indices.end());
+    CHECK(read == indices);
+}
+
+TEST_CASE("Read and write NetCDF files in memory") {
+    auto writer = Trajectory::memory_writer("Amber NetCDF");
+    for (size_t step = 0; step < 6; step++) {
+        auto value = static_cast<double>(step);
+        auto frame = Frame(UnitCell({10 + value, 10, 10}, {90, 90, 90}));
+        frame.set("time", value);
+        for (size_t i = 0; i < 4; i++) {
+            frame.add_atom(Atom("X"), {value, static_cast<double>(i), 0});
+        }
+        writer.write(frame);
+    }
+    // the number of records in the header is updated when closing the file
+    writer.close();
+
+    auto buffer = *writer.memory_buffer();
+    auto reader = Trajectory::memory_reader(buffer.data(), buffer.size(), "Amber NetCDF");
+    CHECK(reader.size() == 6);
+
+    auto frame = reader.read_at(4);
+    CHECK(frame.size() == 4);
+    CHECK(approx_eq(frame.get("time")->as_double(), 4));
+    CHECK(approx_eq(frame.cell().lengths(), {14, 10, 10}, 1e-6));
+    CHECK(approx_eq(frame.positions()[3], {4, 3, 0}, 1e-6));
+
+    frame = reader.read_at(1);
+    CHECK(approx_eq(frame.positions()[2], {1, 2, 0}, 1e-6));
+}
@@ -96,6 +96,9 @@ TEST_CASE("Write compressed files in XYZ format") {
 
     auto xz_path = NamedTempPath(".xyz.xz");
     check_write_file(xz_path, File::LZMA);
+
+    auto zst_path = NamedTempPath(".xyz.zst");
+    check_write_file(zst_path, File::ZSTD);
 }
 
 static void check_append_file(const std::string& path, File::Compression compression) {
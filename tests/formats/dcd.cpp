@@ -548,3 +548,66 @@ TEST_CASE("DCD timestep round-trip") {
         CHECK_FALSE(frame.get("simulation_step"));
     }
 }
+
+TEST_CASE("Read a batch of frames in DCD format") {
+    auto tmpfile = NamedTempPath(".dcd");
+    {
+        auto file = Trajectory(tmpfile, 'w');
+        for (size_t step = 0; step < 20; step++) {
+            auto frame = Frame();
+            for (size_t i = 0; i < 10; i++) {
+                frame.add_atom(Atom("A"), Vector3D(static_cast<double>(step), static_cast<double>(i), 0.5));
+            }
+            file.write(frame);
+        }
+    }
+
+    auto file = Trajectory(tmpfile);
+    auto indices = std::vector<size_t>{19, 0, 7, 1};
+    auto read = std::vector<size_t>();
+    file.read_batch(indices, [&](Frame frame) {
+        read.push_back(frame.index());
+        auto positions = frame.positions();
+        CHECK(positions.size() == 10);
+        CHECK(positions[3] == Vector3D(static_cast<double>(frame.index()), 3.0, 0.5));
+    });
+
+    // reading continues after the last frame given to the callback
+    file.read_batch({10}, [](Frame) {});
+    auto next = file.read();
+    CHECK(next.index() == 11);
+    CHECK(next.positions()[3] == Vector3D(11.0, 3.0, 0.5));
+
+    std::sort(read.begin(), read.end());
+    std::sort(indices.begin(), indices.end());
+    CHECK(read == indices);
+}
+
+TEST_CASE("Read and write DCD files in memory") {
+    auto writer = Trajectory::memory_writer("DCD");
+    for (size_t step = 0; step < 12; step++) {
+        auto frame = Frame(UnitCell({15, 16, 17}));
+        for (size_t i = 0; i < 6; i++) {
+            frame.add_atom(Atom("A"), Vector3D(static_cast<double>(step), static_cast<double>(i), 0.5));
+        }
+        writer.write(frame);
+    }
+
+    auto buffer = *writer.memory_buffer();
+    auto reader = Trajectory::memory_reader(buffer.data(), buffer.size(), "DCD");
+    CHECK(reader.size() == 12);
+
+    auto frame = reader.read_at(11);
+    CHECK(frame.size() == 6);
+    CHECK(frame.positions()[5] == Vector3D(11.0, 5.0, 0.5));
+    CHECK(approx_eq(frame.cell().lengths(), {15, 16, 17}, 1e-5));
+
+    frame = reader.read_at(2);
+    CHECK(frame.positions()[1] == Vector3D(2.0, 1.0, 0.5));
+
+    // the data is not a valid DCD file
+    CHECK_THROWS_AS(
+        Trajectory::memory_reader(buffer.data() + 8, buffer.size() - 8, "DCD"),
+        FormatError
+    );
+}
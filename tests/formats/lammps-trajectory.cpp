@@ -1,6 +1,7 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 #include <string>
+#include <fstream>
 
 #include "catch.hpp"
 
@@ -239,11 +240,11 @@ TEST_CASE("Read files in LAMMPS Atom format") {
 
         // ITEM: BOX BOUNDS issues
         CHECK_THROWS_WITH(
-            Trajectory("data/lammps/bad/box-not-item.lammpstrj"),
+            Trajectory("data/lammps/bad/box-not-item.lammpstrj").size(),
             "expected 'ITEM: BOX BOUNDS' after the number of atoms in LAMMPS trajectory, got 'DUMMY'"
         );
         CHECK_THROWS_WITH(
-            Trajectory("data/lammps/bad/box-item-name.lammpstrj"),
+            Trajectory("data/lammps/bad/box-item-name.lammpstrj").size(),
             "expected 'ITEM: BOX BOUNDS' after the number of atoms in LAMMPS trajectory, got 'ITEM: DUMMY'"
         );
 
@@ -281,12 +282,12 @@ TEST_CASE("Read files in LAMMPS Atom format") {
 
         // ITEM: ATOMS issues
         CHECK_THROWS_WITH(
-            Trajectory("data/lammps/bad/atom-no-item.lammpstrj"),
+            Trajectory("data/lammps/bad/atom-no-item.lammpstrj").size(),
             "could not read atom header for LAMMPS trajectory in this line: 'DUMMY'"
         );
 
         CHECK_THROWS_WITH(
-            Trajectory("data/lammps/bad/atom-item-name.lammpstrj"),
+            Trajectory("data/lammps/bad/atom-item-name.lammpstrj").size(),
             "could not read atom header for LAMMPS trajectory in this line: 'ITEM: DUMMY'"
         );
 
@@ -303,12 +304,50 @@ TEST_CASE("Read files in LAMMPS Atom format") {
         );
 
         CHECK_THROWS_WITH(
-            Trajectory("data/lammps/bad/items-after-atoms.lammpstrj"),
+            Trajectory("data/lammps/bad/items-after-atoms.lammpstrj").size(),
             "could not find 'ITEM: NUMBER OF ATOMS' in LAMMPS trajectory"
         );
     }
 }
 
+TEST_CASE("Scan large LAMMPS files in parallel") {
+    auto content = std::string();
+    size_t n_frames = 0;
+    while (content.size() < 20 * 1024 * 1024) {
+        auto n_atoms = n_frames % 5 + 1;
+        if (n_frames % 2 == 0) {
+            content += "ITEM: TIME\n0.5\n";
+        }
+        content += "ITEM: TIMESTEP\n" + std::to_string(n_frames) + "\n";
+        content += "ITEM: NUMBER OF ATOMS\n" + std::to_string(n_atoms) + "\n";
+        content += "ITEM: BOX BOUNDS pp pp pp\n0 10\n0 10\n0 10\nITEM: ATOMS id type x y z\n";
+        for (size_t i = 0; i < n_atoms; i++) {
+            content += std::to_string(i + 1) + " 1 0 0 " + std::to_string(n_frames) + "\n";
+        }
+        n_frames++;
+    }
+
+    auto path = NamedTempPath(".lammpstrj");
+    std::ofstream(path.path(), std::ios::binary) << content;
+
+    auto file = Trajectory(path, 'r', "LAMMPS");
+    CHECK(file.size() == n_frames);
+    for (auto step: {size_t(0), n_frames / 3, n_frames - 1}) {
+        auto frame = file.read_at(step);
+        CHECK(frame.size() == step % 5 + 1);
+        CHECK(frame.get("simulation_step")->as_double() == static_cast<double>(step));
+    }
+
+    // errors in the last frame are the same as when scanning sequentially
+    std::ofstream(path.path(), std::ios::binary | std::ios::app) <<
+        "ITEM: TIMESTEP\n0\nITEM: NUMBER OF ATOMS\n3\n"
+        "ITEM: BOX BOUNDS pp pp pp\n0 10\n0 10\n0 10\nITEM: ATOMS id type x y z\n1 1 0 0 0\n";
+    CHECK_THROWS_WITH(
+        Trajectory(path, 'r', "LAMMPS").size(),
+        "this file does not contain enough lines in ATOMS section for LAMMPS trajectory"
+    );
+}
+
 TEST_CASE("Write files in LAMMPS Atom format") {
     SECTION("Single frame") {
         auto tmpfile = NamedTempPath(".lammpstrj");
@@ -1,6 +1,7 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 #include <cstdlib>
+#include <fstream>
 
 #include "catch.hpp"
 #include "helpers.hpp"
@@ -434,6 +435,34 @@ TEST_CASE("Problematic PDB files") {
     }
 }
 
+TEST_CASE("Scan large PDB files in parallel") {
+    auto content = std::string();
+    size_t n_frames = 0;
+    while (content.size() < 20 * 1024 * 1024) {
+        auto n_atoms = n_frames % 5 + 1;
+        auto z = std::to_string(n_frames % 1000) + ".000";
+        z = std::string(8 - z.size(), ' ') + z;
+        content += "MODEL\n";
+        for (size_t i = 0; i < n_atoms; i++) {
+            content += "HETATM    " + std::to_string(i + 1) + " C    RES X   1       0.000   0.000" + z + "  1.00  0.00           C\n";
+        }
+        // ENDMDL directly followed by END only ends a single frame
+        content += (n_frames % 4 == 0) ? "ENDMDL\nEND\n" : "ENDMDL\n";
+        n_frames++;
+    }
+
+    auto path = NamedTempPath(".pdb");
+    std::ofstream(path.path(), std::ios::binary) << content;
+
+    auto file = Trajectory(path);
+    CHECK(file.size() == n_frames);
+    for (auto step: {size_t(0), n_frames / 3, n_frames - 1}) {
+        auto frame = file.read_at(step);
+        CHECK(frame.size() == step % 5 + 1);
+        CHECK(frame.positions()[0][2] == static_cast<double>(step % 1000));
+    }
+}
+
 TEST_CASE("Write files in PDB format") {
     auto tmpfile = NamedTempPath(".pdb");
     const auto* EXPECTED_CONTENT =
@@ -96,12 +96,12 @@ TEST_CASE("Errors in SDF format") {
     CHECK_THROWS_WITH(file.read(), "atom line is too small for SDF: '    3.7320   -0.0600'");
 
     CHECK_THROWS_WITH(
-        Trajectory("data/sdf/bad/count-line-not-numbers.sdf"),
+        Trajectory("data/sdf/bad/count-line-not-numbers.sdf").size(),
         "could not parse counts line in SDF file: ' 21aaa           '"
     );
 
     CHECK_THROWS_WITH(
-        Trajectory("data/sdf/bad/count-line-too-short.sdf"),
+        Trajectory("data/sdf/bad/count-line-too-short.sdf").size(),
         "counts line must have at least 10 characters in SFD file, it has 6: '  0  0'"
     );
 }
@@ -462,3 +462,29 @@ TEST_CASE("Check Errors") {
         file.write(frame),
         "TRR format does not support varying numbers of atoms: expected 1, but got 2");
 }
+
+TEST_CASE("Read and write TRR files in memory") {
+    auto writer = Trajectory::memory_writer("TRR");
+    for (size_t step = 0; step < 5; step++) {
+        auto frame = Frame(UnitCell({10, 11, 12}));
+        frame.add_velocities();
+        for (size_t i = 0; i < 8; i++) {
+            auto value = static_cast<double>(step);
+            frame.add_atom(Atom("A"), {value, static_cast<double>(i), 0}, {0, 0, -value});
+        }
+        writer.write(frame);
+    }
+
+    auto buffer = *writer.memory_buffer();
+    auto reader = Trajectory::memory_reader(buffer.data(), buffer.size(), "TRR");
+    CHECK(reader.size() == 5);
+
+    auto frame = reader.read_at(3);
+    CHECK(frame.size() == 8);
+    CHECK(approx_eq(frame.positions()[6], {3, 6, 0}, 1e-4));
+    CHECK(approx_eq((*frame.velocities())[6], {0, 0, -3}, 1e-4));
+    CHECK(approx_eq(frame.cell().lengths(), {10, 11, 12}, 1e-4));
+
+    frame = reader.read_at(0);
+    CHECK(approx_eq(frame.positions()[2], {0, 2, 0}, 1e-4));
+}
@@ -525,3 +525,78 @@ TEST_CASE("Large Numbers") {
         CHECK(approx_eq(cell.lengths(), {16777220, 16777220, 16777220}, 1e-4));
     }
 }
+
+TEST_CASE("Read a batch of frames in XTC format") {
+    auto tmpfile = NamedTempPath(".xtc");
+    {
+        auto file = Trajectory(tmpfile, 'w');
+        for (size_t step = 0; step < 50; step++) {
+            auto frame = Frame();
+            for (size_t i = 0; i < 20; i++) {
+                frame.add_atom(Atom("A"), Vector3D(static_cast<double>(step), static_cast<double>(i), 1.5));
+            }
+            file.write(frame);
+        }
+    }
+
+    auto file = Trajectory(tmpfile);
+    auto indices = std::vector<size_t>{42, 3, 17, 0, 49, 25};
+    auto read = std::vector<size_t>();
+    file.read_batch(indices, [&](Frame frame) {
+        read.push_back(frame.index());
+        auto positions = frame.positions();
+        CHECK(positions.size() == 20);
+        CHECK(approx_eq(positions[7], Vector3D(static_cast<double>(frame.index()), 7.0, 1.5), 1e-3));
+    });
+
+    // reading continues after the last frame given to the callback
+    file.read_batch({10}, [](Frame) {});
+    auto next = file.read();
+    CHECK(next.index() == 11);
+    CHECK(approx_eq(next.positions()[7], Vector3D(11.0, 7.0, 1.5), 1e-3));
+
+    std::sort(read.begin(), read.end());
+    std::sort(indices.begin(), indices.end());
+    CHECK(read == indices);
+
+    CHECK_THROWS_WITH(
+        file.read_batch({3, 50}, [](Frame) {}),
+        "can not read file '" + tmpfile.path() + "' at index 50: there are 50 frames in this file"
+    );
+}
+
+TEST_CASE("Read and write XTC files in memory") {
+    auto writer = Trajectory::memory_writer("XTC");
+    auto tmpfile = NamedTempPath(".xtc");
+    auto file = Trajectory(tmpfile, 'w');
+    for (size_t step = 0; step < 10; step++) {
+        auto frame = Frame(UnitCell({20, 20, 20}));
+        for (size_t i = 0; i < 15; i++) {
+            frame.add_atom(Atom("A"), Vector3D(static_cast<double>(step), static_cast<double>(i), 1.5));
+        }
+        writer.write(frame);
+        file.write(frame);
+    }
+    file.close();
+
+    auto buffer = *writer.memory_buffer();
+    auto expected = read_binary_file(tmpfile);
+    REQUIRE(buffer.size() == expected.size());
+    CHECK(std::equal(buffer.begin(), buffer.end(), reinterpret_cast<const char*>(expected.data())));
+
+    auto reader = Trajectory::memory_reader(buffer.data(), buffer.size(), "XTC");
+    CHECK(reader.size() == 10);
+    auto frame = reader.read_at(7);
+    CHECK(frame.size() == 15);
+    CHECK(approx_eq(frame.positions()[4], Vector3D(7.0, 4.0, 1.5), 1e-3));
+    CHECK(approx_eq(frame.cell().lengths(), {20, 20, 20}, 1e-4));
+
+    auto read = std::vector<size_t>();
+    reader.read_batch({9, 2, 5}, [&](Frame batch) {
+        read.push_back(batch.index());
+        auto index = static_cast<double>(batch.index());
+        CHECK(approx_eq(batch.positions()[11], Vector3D(index, 11.0, 1.5), 1e-3));
+    });
+    std::sort(read.begin(), read.end());
+    CHECK(read == std::vector<size_t>{2, 5, 9});
+}
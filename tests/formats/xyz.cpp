@@ -1,5 +1,6 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -160,9 +161,40 @@ static void check_bad_properties_still_read_frame(const Frame& frame) {
     CHECK(frame.positions()[0] == Vector3D(1, 4, 2.3));
 }
 
+TEST_CASE("Scan large XYZ files in parallel") {
+    // large enough to be scanned by multiple threads, using comment lines
+    // which look like the number of atoms
+    auto content = std::string();
+    size_t n_frames = 0;
+    while (content.size() < 20 * 1024 * 1024) {
+        auto n_atoms = n_frames % 7 + 1;
+        content += std::to_string(n_atoms) + "\n" + std::to_string(n_frames % 3) + "\n";
+        for (size_t i = 0; i < n_atoms; i++) {
+            content += "C 0 0 " + std::to_string(n_frames) + "\n";
+        }
+        n_frames++;
+    }
+
+    auto path = NamedTempPath(".xyz");
+    std::ofstream(path.path(), std::ios::binary) << content;
+
+    auto file = Trajectory(path);
+    CHECK(file.size() == n_frames);
+    for (auto step: {size_t(0), n_frames / 3, n_frames - 1}) {
+        auto frame = file.read_at(step);
+        CHECK(frame.size() == step % 7 + 1);
+        CHECK(frame.positions()[0][2] == static_cast<double>(step));
+    }
+
+    // errors in the last frame are the same as when scanning sequentially
+    std::ofstream(path.path(), std::ios::binary | std::ios::app) << "3\ncomment\nC 0 0 0\n";
+    auto message = "XYZ format: not enough lines at step " + std::to_string(n_frames) + " (expected 5, got 4)";
+    CHECK_THROWS_WITH(Trajectory(path).size(), message);
+}
+
 TEST_CASE("Errors in XYZ format") {
     SECTION("bad files") {
-        CHECK_THROWS_WITH(Trajectory("data/xyz/bad/helium.xyz"),
+        CHECK_THROWS_WITH(Trajectory("data/xyz/bad/helium.xyz").size(),
             "XYZ format: not enough lines at step 0 (expected 10, got 7)"
         );
 
@@ -22,6 +22,7 @@ EXPECTED_SIZES = {
     "tng.tar.gz": 207,
     "xdrfile.tar.gz": 26,
     "zlib.tar.gz": 370,
+    "zstd.tar.gz": 444,
 }
 
 
@@ -1,7 +1,11 @@
 // Chemfiles, a modern library for chemistry file reading and writing
 // Copyright (C) Guillaume Fraux and contributors -- BSD license
 
+#include <atomic>
 #include <thread>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
 
 #include <catch.hpp>
 
@@ -190,6 +194,7 @@ TEST_CASE("Guessing format") {
     CHECK(guess_format("not-a-file.xyz.gz") == "XYZ / GZ");
     CHECK(guess_format("not-a-file.xyz.bz2") == "XYZ / BZ2");
     CHECK(guess_format("not-a-file.xyz.xz") == "XYZ / XZ");
+    CHECK(guess_format("not-a-file.xyz.zst") == "XYZ / ZST");
 
     CHECK_THROWS_WITH(
         guess_format("not-a-file.unknown"),
@@ -267,6 +272,537 @@ TEST_CASE("reading a files from multiple threads") {
 
 #endif
 
+TEST_CASE("Find frames on demand in text files") {
+    auto tmpfile = NamedTempPath(".xyz");
+    {
+        std::ofstream file(tmpfile);
+        file << "1\nframe 0\nA 0 0 0\n";
+        file << "1\nframe 1\nA 1 1 1\n";
+        // the last frame is truncated
+        file << "3\nframe 2\nA 2 2 2\n";
+    }
+
+    // opening the file and reading the first frames does not need to look at
+    // the end of the file
+    auto file = Trajectory(tmpfile);
+    CHECK_FALSE(file.done());
+    CHECK(file.read().positions()[0] == Vector3D(0, 0, 0));
+    CHECK(file.read_at(1).positions()[0] == Vector3D(1, 1, 1));
+    CHECK(file.read_at(0).positions()[0] == Vector3D(0, 0, 0));
+
+    // the whole file is scanned when needed
+    CHECK_THROWS_WITH(file.size(), "XYZ format: not enough lines at step 2 (expected 5, got 4)");
+    CHECK_THROWS_WITH(file.read_at(2), "XYZ format: not enough lines at step 2 (expected 5, got 4)");
+
+    {
+        std::ofstream output(tmpfile, std::ios::app);
+        output << "A 2 2 2\nA 2 2 2\n";
+    }
+    file = Trajectory(tmpfile);
+    CHECK(file.read_at(2).size() == 3);
+    CHECK(file.done());
+    CHECK(file.size() == 3);
+    CHECK_THROWS_WITH(
+        file.read_at(3),
+        "can not read file '" + tmpfile.path() + "' at index 3: there are 3 frames in this file"
+    );
+}
+
+TEST_CASE("Read compressed text files in order") {
+    for (auto extension: {".xyz.gz", ".xyz.bz2", ".xyz.xz", ".xyz.zst"}) {
+        // frames smaller and larger than the TextFile buffer
+        for (auto n_atoms: {20, 500}) {
+            CAPTURE(extension);
+            CAPTURE(n_atoms);
+            auto tmpfile = NamedTempPath(extension);
+            {
+                auto file = Trajectory(tmpfile, 'w');
+                for (size_t step = 0; step < 30; step++) {
+                    auto frame = Frame();
+                    for (int i = 0; i < n_atoms; i++) {
+                        frame.add_atom(Atom("C"), {static_cast<double>(step), static_cast<double>(i), 1.5});
+                    }
+                    file.write(frame);
+                }
+            }
+
+            auto file = Trajectory(tmpfile);
+            size_t step = 0;
+            while (!file.done()) {
+                auto frame = file.read();
+                CHECK(frame.size() == static_cast<size_t>(n_atoms));
+                CHECK(frame.positions()[0][0] == Approx(static_cast<double>(step)));
+                step++;
+            }
+            CHECK(step == 30);
+            CHECK(file.size() == 30);
+        }
+    }
+}
+
+/// Get the frame at `step` in the trajectories written by
+/// `write_test_trajectory`: three copies of `atom` at `(step, i, 1.0)`, in a
+/// cell whose last length depends on the step.
+static Frame test_frame(size_t step, const Atom& atom = Atom("C")) {
+    auto frame = Frame(UnitCell({10, 11, 12.0 + static_cast<double>(step)}));
+    for (size_t i = 0; i < 3; i++) {
+        auto position = Vector3D(static_cast<double>(step), static_cast<double>(i), 1.0);
+        frame.add_atom(atom, position);
+    }
+    return frame;
+}
+
+/// Write `n_steps` frames created by `test_frame` to the file at `path`
+static void write_test_trajectory(const std::string& path, size_t n_steps, const Atom& atom = Atom("C")) {
+    auto file = Trajectory(path, 'w');
+    for (size_t step = 0; step < n_steps; step++) {
+        file.write(test_frame(step, atom));
+    }
+}
+
+static void check_same_frame(const Frame& actual, const Frame& expected) {
+    CHECK(actual.index() == expected.index());
+    CHECK(actual.properties() == expected.properties());
+    CHECK(actual.cell() == expected.cell());
+    CHECK(actual.topology().bonds() == expected.topology().bonds());
+    CHECK(actual.topology().residues().size() == expected.topology().residues().size());
+    CHECK(static_cast<bool>(actual.velocities()) == static_cast<bool>(expected.velocities()));
+
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); i++) {
+        CHECK(actual[i] == expected[i]);
+        CHECK(actual.positions()[i] == expected.positions()[i]);
+    }
+}
+
+TEST_CASE("Read frames in place") {
+    SECTION("Formats") {
+        for (auto extension: {".xyz", ".pdb", ".lammpstrj", ".xtc", ".trr", ".dcd", ".gro"}) {
+            auto tmpfile = NamedTempPath(extension);
+            write_test_trajectory(tmpfile, 4);
+
+            auto file = Trajectory(tmpfile);
+            auto frame = Frame();
+            for (size_t step = 0; step < 4; step++) {
+                file.read(frame);
+                check_same_frame(frame, Trajectory(tmpfile).read_at(step));
+            }
+
+            file.read_at(1, frame);
+            check_same_frame(frame, Trajectory(tmpfile).read_at(1));
+        }
+    }
+
+    SECTION("Data from the previous step is removed") {
+        auto tmpfile = NamedTempPath(".xyz");
+        {
+            std::ofstream file(tmpfile);
+            file << "2\nProperties=species:S:1:pos:R:3:velo:R:3 name=first\n";
+            file << "A 0 0 0 1 1 1\nB 0 0 0 1 1 1\n";
+            file << "3\nsecond\n";
+            file << "C 1 1 1\nC 1 1 1\nC 1 1 1\n";
+            file << "3\nthird\n";
+            file << "D 2 2 2\nD 2 2 2\nD 2 2 2\n";
+        }
+
+        auto file = Trajectory(tmpfile);
+        auto frame = Frame();
+        file.read(frame);
+        CHECK(frame.size() == 2);
+        CHECK(frame.velocities());
+        CHECK(frame.get("name")->as_string() == "first");
+
+        file.read(frame);
+        check_same_frame(frame, Trajectory(tmpfile).read_at(1));
+        CHECK_FALSE(frame.velocities());
+        CHECK_FALSE(frame.get("name"));
+
+        frame.guess_bonds();
+        file.read(frame);
+        check_same_frame(frame, Trajectory(tmpfile).read_at(2));
+    }
+}
+
+TEST_CASE("Read positions of multiple frames") {
+    SECTION("Formats") {
+        for (auto extension: {".xyz", ".pdb", ".lammpstrj", ".xtc", ".trr", ".dcd", ".nc"}) {
+            auto tmpfile = NamedTempPath(extension);
+            // use a numeric atom type for LAMMPS
+            write_test_trajectory(tmpfile, 10, Atom("C", "1"));
+
+            CAPTURE(extension);
+            auto file = Trajectory(tmpfile);
+            // read frames 1, 4 and 7
+            auto positions = std::vector<double>(3 * 3 * 3);
+            file.read_positions(1, 8, 3, positions);
+
+            auto positions_f32 = std::vector<float>(3 * 3 * 3);
+            file.read_positions(1, 8, 3, positions_f32);
+
+            for (size_t k = 0; k < 3; k++) {
+                auto frame = Trajectory(tmpfile).read_at(1 + 3 * k);
+                auto expected = frame.positions();
+                for (size_t i = 0; i < 3; i++) {
+                    for (size_t j = 0; j < 3; j++) {
+                        auto value = positions[3 * (3 * k + i) + j];
+                        CHECK(value == expected[i][j]);
+                        CHECK(positions_f32[3 * (3 * k + i) + j] == static_cast<float>(value));
+                    }
+                }
+            }
+
+            // reading continues after the last frame
+            CHECK(file.read().positions()[0][0] == Approx(8.0));
+
+            // no frames to read
+            file.read_positions(5, 5, 1, span<double>());
+        }
+    }
+
+    SECTION("Errors") {
+        auto tmpfile = NamedTempPath(".xyz");
+        {
+            std::ofstream file(tmpfile);
+            file << "1\nframe 0\nA 0 0 0\n";
+            file << "1\nframe 1\nA 1 1 1\n";
+            file << "2\nframe 2\nA 2 2 2\nA 2 2 2\n";
+        }
+
+        auto file = Trajectory(tmpfile);
+        auto positions = std::vector<double>(6);
+        CHECK_THROWS_WITH(
+            file.read_positions(0, 2, 0, positions),
+            "can not read positions with a stride of 0"
+        );
+        CHECK_THROWS_WITH(
+            file.read_positions(2, 0, 1, positions),
+            "can not read positions from 2 to 0: start is after stop"
+        );
+        CHECK_THROWS_WITH(
+            file.read_positions(0, 2, 1, span<double>(positions.data(), 5)),
+            "can not read 2 frames into a positions array with 5 values: the size should be 3 x 2 x the number of atoms"
+        );
+        CHECK_THROWS_WITH(
+            file.read_positions(2, 4, 1, positions),
+            "can not read file '" + tmpfile.path() + "' at index 3: there are 3 frames in this file"
+        );
+        CHECK_THROWS_WITH(
+            file.read_positions(1, 3, 1, positions),
+            "can not read positions in XYZ format: expected 1 atoms, got 2"
+        );
+
+        file.read_positions(0, 2, 1, positions);
+        CHECK(positions == std::vector<double>{0, 0, 0, 1, 1, 1});
+    }
+}
+
+TEST_CASE("Read frames with multiple threads") {
+    SECTION("Formats") {
+        for (auto extension: {".xyz", ".pdb", ".xtc", ".trr", ".dcd", ".nc"}) {
+            CAPTURE(extension);
+            auto tmpfile = NamedTempPath(extension);
+            write_test_trajectory(tmpfile, 50);
+
+            auto file = Trajectory(tmpfile);
+            CHECK(file.read().positions()[0][0] == 0.0);
+
+            auto first_positions = std::vector<double>(50, -1.0);
+            auto sizes = std::vector<size_t>(50, 0);
+            auto indices = std::vector<size_t>(50, 0);
+            file.parallel_for_each(5, 45, [&](size_t index, Frame& frame) {
+                // each index is only used by one thread
+                first_positions[index] = frame.positions()[0][0];
+                sizes[index] = frame.size();
+                indices[index] = frame.index();
+            }, 4);
+
+            for (size_t i = 0; i < 50; i++) {
+                if (i < 5 || i >= 45) {
+                    CHECK(first_positions[i] == -1.0);
+                } else {
+                    CHECK(first_positions[i] == Approx(static_cast<double>(i)));
+                    CHECK(sizes[i] == 3);
+                    CHECK(indices[i] == i);
+                }
+            }
+
+            // the next frame read by the trajectory did not change
+            CHECK(file.read().positions()[0][0] == Approx(1.0));
+        }
+    }
+
+    SECTION("Memory reader") {
+        auto content = std::string();
+        for (size_t step = 0; step < 20; step++) {
+            content += "1\nframe\nC 0 0 " + std::to_string(step) + "\n";
+        }
+
+        auto file = Trajectory::memory_reader(content.data(), content.size(), "XYZ");
+        auto positions = std::vector<double>(20, -1.0);
+        file.parallel_for_each(0, 20, [&](size_t index, Frame& frame) {
+            positions[index] = frame.positions()[0][2];
+        }, 3);
+
+        for (size_t i = 0; i < 20; i++) {
+            CHECK(positions[i] == static_cast<double>(i));
+        }
+    }
+
+    SECTION("Errors") {
+        auto tmpfile = NamedTempPath(".xyz");
+        {
+            std::ofstream file(tmpfile);
+            for (size_t step = 0; step < 20; step++) {
+                file << "1\nframe\nC 0 0 " << step << "\n";
+            }
+            file << "1\nframe\nC 0 0\n";
+        }
+
+        auto file = Trajectory(tmpfile);
+        CHECK_THROWS_WITH(
+            file.parallel_for_each(3, 1, [](size_t, Frame&) {}),
+            "can not read frames from 3 to 1: start is after stop"
+        );
+        CHECK_THROWS_WITH(
+            file.parallel_for_each(0, 30, [](size_t, Frame&) {}),
+            "can not read file '" + tmpfile.path() + "' at index 29: there are 21 frames in this file"
+        );
+
+        // errors while reading a frame stop the iteration
+        CHECK_THROWS_WITH(
+            file.parallel_for_each(0, 21, [](size_t, Frame&) {}, 4),
+            "error while reading 'C 0 0': expected 4 values, found 3"
+        );
+
+        // errors in the callback are given back to the caller
+        auto count = std::atomic<size_t>(0);
+        CHECK_THROWS_WITH(
+            file.parallel_for_each(0, 20, [&](size_t index, Frame&) {
+                count++;
+                if (index == 3) {
+                    throw std::runtime_error("error in callback");
+                }
+            }, 2),
+            "error in callback"
+        );
+        CHECK(count <= 20);
+
+        auto content = std::string("1\nframe\nC 0 0 0\n");
+        auto stream = Trajectory::stream_reader([&](char* data, size_t count) {
+            count = std::min(count, content.size());
+            std::copy(content.data(), content.data() + count, data);
+            content.erase(0, count);
+            return count;
+        }, "XYZ");
+        CHECK_THROWS_WITH(
+            stream.parallel_for_each(0, 1, [](size_t, Frame&) {}),
+            "can not read frames from '<stream>' with multiple threads"
+        );
+    }
+}
+
+TEST_CASE("Read frames in advance") {
+    SECTION("Formats") {
+        for (auto extension: {".xyz", ".xyz.gz", ".pdb", ".xtc", ".trr", ".dcd", ".nc"}) {
+            CAPTURE(extension);
+            auto tmpfile = NamedTempPath(extension);
+            write_test_trajectory(tmpfile, 20);
+
+            // reading a step and then continuing with the next ones
+            auto file = Trajectory(tmpfile);
+            CHECK(file.read_at(2).positions()[0][0] == Approx(2.0));
+            CHECK(file.read().positions()[0][0] == Approx(3.0));
+
+            file.set_prefetch(3);
+            auto frame = Frame();
+            for (size_t step = 4; step < 10; step++) {
+                file.read(frame);
+                CHECK(frame.index() == step);
+                CHECK(frame.size() == 3);
+                CHECK(frame.positions()[0][0] == Approx(static_cast<double>(step)));
+            }
+
+            // reading out of order restarts the reads in advance
+            CHECK(file.read_at(15).positions()[0][0] == Approx(15.0));
+            file.read(frame);
+            CHECK(frame.positions()[0][0] == Approx(16.0));
+            file.read(frame);
+            CHECK(frame.positions()[0][0] == Approx(17.0));
+
+            // the trajectory continues at the right step without prefetching
+            file.set_prefetch(0);
+            CHECK(file.read().positions()[0][0] == Approx(18.0));
+
+            file.set_prefetch(2);
+            file.read(frame);
+            CHECK(frame.positions()[0][0] == Approx(19.0));
+            CHECK(file.done());
+            CHECK_THROWS_WITH(
+                file.read(),
+                "can not read file '" + tmpfile.path() + "' at index 20: there are 20 frames in this file"
+            );
+        }
+    }
+
+    SECTION("Errors") {
+        auto tmpfile = NamedTempPath(".xyz");
+        {
+            std::ofstream file(tmpfile);
+            file << "1\nframe 0\nC 0 0 0\n";
+            file << "1\nframe 1\nC 0 0 1\n";
+            file << "1\nframe 2\nC 0 0\n";
+            file << "1\nframe 3\nC 0 0 3\n";
+        }
+
+        auto file = Trajectory(tmpfile);
+        file.set_prefetch(4);
+        CHECK(file.read().positions()[0][2] == 0.0);
+        CHECK(file.read().positions()[0][2] == 1.0);
+
+        // errors are given when reading the corresponding step
+        CHECK_THROWS_WITH(file.read(), "error while reading 'C 0 0': expected 4 values, found 3");
+        CHECK_THROWS_WITH(file.read(), "error while reading 'C 0 0': expected 4 values, found 3");
+        CHECK(file.read_at(3).positions()[0][2] == 3.0);
+
+        auto writer = Trajectory(NamedTempPath(".xyz"), 'w');
+        CHECK_THROWS_WITH(
+            writer.set_prefetch(3),
+            "the file at '" + writer.path() + "' was not opened in read mode"
+        );
+
+        auto stream = Trajectory::stream_reader([](char*, size_t) -> size_t { return 0; }, "XYZ");
+        CHECK_THROWS_WITH(stream.set_prefetch(3), "can not read frames from '<stream>' in advance");
+
+        file.close();
+        CHECK_THROWS_WITH(file.set_prefetch(3), "can not use a closed trajectory");
+    }
+}
+
+TEST_CASE("Write frames asynchronously") {
+    SECTION("Formats") {
+        for (auto extension: {".xyz", ".xyz.gz", ".pdb", ".xtc", ".trr", ".dcd", ".nc"}) {
+            CAPTURE(extension);
+            auto tmpfile = NamedTempPath(extension);
+            {
+                auto file = Trajectory(tmpfile, 'w');
+                file.set_async_write(2);
+
+                auto frame = test_frame(0);
+                for (size_t step = 0; step < 20; step++) {
+                    // the frame is copied, and can be modified right away
+                    frame.positions()[0][0] = static_cast<double>(step);
+                    file.write(frame);
+                }
+
+                auto moved = frame.clone();
+                moved.positions()[0][0] = 20.0;
+                file.write(std::move(moved));
+
+                file.flush();
+                CHECK(file.size() == 21);
+
+                // go back to writing frames directly
+                file.set_async_write(0);
+                frame.positions()[0][0] = 21.0;
+                file.write(frame);
+
+                file.set_async_write(4);
+                frame.positions()[0][0] = 22.0;
+                file.write(frame);
+                file.close();
+            }
+
+            auto file = Trajectory(tmpfile);
+            REQUIRE(file.size() == 23);
+            for (size_t step = 0; step < 23; step++) {
+                auto frame = file.read();
+                CHECK(frame.size() == 3);
+                CHECK(frame.positions()[0][0] == Approx(static_cast<double>(step)));
+                CHECK(frame.positions()[2][1] == Approx(2.0));
+            }
+        }
+    }
+
+    SECTION("Custom topology and memory writer") {
+        auto file = Trajectory::memory_writer("XYZ");
+        file.set_async_write(3);
+
+        auto topology = Topology();
+        topology.add_atom(Atom("Zn"));
+        file.set_topology(topology);
+
+        auto frame = Frame();
+        frame.add_atom(Atom("C"), {1, 2, 3});
+        file.write(frame);
+
+        // the topology is used even if it changes after writing the frame
+        topology = Topology();
+        topology.add_atom(Atom("Fe"));
+        file.set_topology(topology);
+        file.write(frame);
+
+        auto buffer = file.memory_buffer();
+        REQUIRE(buffer);
+        auto content = std::string(buffer->data(), buffer->size());
+        CHECK(content.find("Zn 1 2 3") != std::string::npos);
+        CHECK(content.find("Fe 1 2 3") != std::string::npos);
+    }
+
+    SECTION("Errors") {
+        auto tmpfile = NamedTempPath(".xtc");
+        auto file = Trajectory(tmpfile, 'w');
+        file.set_async_write(2);
+
+        auto frame = Frame();
+        frame.add_atom(Atom("C"), {0, 0, 0});
+        file.write(frame);
+        frame.add_atom(Atom("C"), {0, 0, 0});
+        file.write(frame);
+
+        // errors are given when flushing
+        CHECK_THROWS_WITH(file.flush(), "XTC format does not support varying numbers of atoms: expected 1, but got 2");
+        file.flush();
+
+        // or when writing the next frames
+        auto thrown = false;
+        for (size_t i = 0; i < 1000 && !thrown; i++) {
+            try {
+                file.write(frame);
+            } catch (const FormatError& e) {
+                CHECK(std::string(e.what()) == "XTC format does not support varying numbers of atoms: expected 1, but got 2");
+                thrown = true;
+            }
+        }
+        CHECK(thrown);
+
+        // or when closing the file
+        file.write(frame);
+        CHECK_THROWS_WITH(file.close(), "XTC format does not support varying numbers of atoms: expected 1, but got 2");
+        CHECK_THROWS_WITH(file.flush(), "can not use a closed trajectory");
+
+        auto reader = Trajectory(tmpfile);
+        CHECK_THROWS_WITH(
+            reader.set_async_write(3),
+            "the file at '" + tmpfile.path() + "' was not opened in write or append mode"
+        );
+    }
+}
+
+#ifdef __linux__
+TEST_CASE("Errors while closing the file") {
+    // all writes to /dev/full fail with ENOSPC
+    auto frame = Frame();
+    for (size_t i = 0; i < 2000; i++) {
+        frame.add_atom(Atom("Zn"), {1.0, 2.0, 3.0});
+    }
+
+    auto file = Trajectory("/dev/full", 'w', "XYZ");
+    // the data is still buffered in memory
+    file.write(frame);
+    CHECK_THROWS_AS(file.close(), FileError);
+}
+#endif
+
 TEST_CASE("Errors") {
     SECTION("Unknow opening mode") {
         CHECK_THROWS_AS(Trajectory("trajectory.xyz", 'z'), FileError);